@@ -41,17 +41,21 @@ DEFINES += QT_MESSAGELOGCONTEXT
 
 HEADERS += \
     $$PWD/../utils/log/zdlogger.h \
+    $$PWD/../utils/log/zdlogsink.h \
     $$PWD/../platform.h \
     $$PWD/../utils/singlebase/singlebase.h \
     zdobscontext.h \
     zdrecordingdefine.h \
     zdrecordingversion.h \
-    zdrecordingclient.h
+    zdrecordingclient.h \
+    zdrecordingprotocol.h
 
 SOURCES += \
     $$PWD/../utils/log/zdlogger.cpp \
+    $$PWD/../utils/log/zdlogsink.cpp \
     $$PWD/../crashhandler.cpp \
     $$PWD/../platform.cpp \
     main.cpp \
     zdobscontext.cpp \
-    zdrecordingclient.cpp
+    zdrecordingclient.cpp \
+    zdrecordingprotocol.cpp
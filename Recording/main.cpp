@@ -100,6 +100,7 @@ long __stdcall CrashHandler(_EXCEPTION_POINTERS *excp)
 
     inside_handler = true;
     qCritical(LOG_CRASHED);
+    ZDLogger::getInstance()->flush();
 
     // 写 Thread Traces 文件
     QString strCurrentTime =
@@ -162,6 +163,8 @@ static BOOL WINAPI PreCrashCallback(LPVOID lpvState)
 
     inside_handler = true;
     qCritical(LOG_CRASHED);
+    // CrashRpt 会复制日志文件，先等待日志落盘
+    ZDLogger::getInstance()->flush();
 
     return TRUE;
 }
@@ -171,34 +174,33 @@ static BOOL WINAPI PreCrashCallback(LPVOID lpvState)
 static void LogHandler(QtMsgType type, const QMessageLogContext &,
                        const QString &msg)
 {
-    QString label = "UNKNOWN";
+    const char *label = "UNKNOWN";
     switch (type)
     {
     case QtInfoMsg:
-        label = QString("INFO");
+        label = "INFO";
         break;
     case QtDebugMsg:
-        label = QString("DEBUG");
+        label = "DEBUG";
         break;
     case QtWarningMsg:
-        label = QString("WARNING");
+        label = "WARNING";
         break;
     case QtCriticalMsg:
-        label = QString("ERROR");
+        label = "ERROR";
         break;
     case QtFatalMsg:
-        label = QString("FATAL");
+        label = "FATAL";
         break;
     default:
         break;
     }
 
-    QString text = QStringLiteral("[%1][%2:%3] %4")
-                   .arg(QDateTime::currentDateTime().toString("hh:mm:ss.zzz"))
-                   .arg(quintptr(QThread::currentThreadId()))
-                   .arg(label)
-                   .arg(msg);
-    ZDLogger::getInstance()->writeLog(text);
+    // 只放入日志队列，由日志线程写文件；错误立即写入，致命错误等待落盘
+    bool urgent = type == QtCriticalMsg || type == QtFatalMsg;
+    ZDLogger::getInstance()->writeLog(label, msg.toUtf8().constData(), urgent);
+    if (type == QtFatalMsg)
+        ZDLogger::getInstance()->flush();
 }
 // [Qt 日志代理]
 
@@ -341,5 +343,8 @@ int main(int argc, char *argv[])
     QCoreApplication a(argc, argv);
     ZDRecordingClient client;
     client.connectToServer();
-    return a.exec();
+    int ret = a.exec();
+
+    ZDLogger::getInstance()->flush();
+    return ret;
 }
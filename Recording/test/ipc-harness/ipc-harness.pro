@@ -0,0 +1,19 @@
+# IPC 分帧测试程序，不依赖 OBS，可在 Linux 下运行：
+#     qmake && make && ./ipc-harness
+QT += core network
+QT -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = ipc-harness
+TEMPLATE = app
+
+INCLUDEPATH += $$PWD/../..
+
+HEADERS += \
+    $$PWD/../../zdrecordingprotocol.h
+
+SOURCES += \
+    $$PWD/../../zdrecordingprotocol.cpp \
+    main.cpp
@@ -0,0 +1,328 @@
+﻿/******************************************************************************
+    Copyright (C) 2020 by Zaodao(Dalian) Education Technology Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * ZDRecordingProtocol 的测试程序：分帧/重组/合并的单元检查，以及用
+ * QLocalServer 代替主程序的收发测试，输出每秒处理的消息数。
+ */
+
+#include "zdrecordingprotocol.h"
+
+#include <QCoreApplication>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QPair>
+#include <QTimer>
+
+#include <cstdio>
+
+enum {
+    CommandEvent = 1,
+    StatusEvent  = 2,
+    OtherEvent   = 3
+};
+
+typedef QVector<QPair<int, int>> MessageList;
+
+static int failures = 0;
+
+#define CHECK(expr) check((expr), #expr, __LINE__)
+
+static void check(bool ok, const char *expr, int line)
+{
+    if (!ok) {
+        printf("  FAILED (line %d): %s\n", line, expr);
+        failures++;
+    }
+}
+
+static QByteArray makePayload(int value)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_0);
+    out << (qint32)value << QString("message %1").arg(value);
+    return payload;
+}
+
+static int payloadValue(const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_4_0);
+    qint32 value = -1;
+    QString text;
+    in >> value >> text;
+    return text == QString("message %1").arg(value) ? value : -1;
+}
+
+static QByteArray encode(int version, const MessageList &messages)
+{
+    ZDRecordingProtocol protocol;
+    protocol.setSendVersion(version);
+    for (const QPair<int, int> &msg : messages)
+        protocol.queueMessage((quint8)msg.first, makePayload(msg.second));
+    return protocol.takeFrames();
+}
+
+// 按 chunk 字节分多次送入，取出所有完整的消息
+static MessageList feed(ZDRecordingProtocol &protocol, const QByteArray &data,
+                        int chunk)
+{
+    MessageList result;
+    ZDRecordingProtocol::Message msg;
+
+    for (int i = 0; i < data.size(); i += chunk) {
+        protocol.append(data.constData() + i, qMin(chunk, data.size() - i));
+        while (protocol.readMessage(msg))
+            result.append(qMakePair((int)msg.event, payloadValue(msg.payload)));
+    }
+
+    return result;
+}
+
+static MessageList makeMessages(int count)
+{
+    MessageList messages;
+    for (int i = 0; i < count; i++)
+        messages.append(qMakePair((int)CommandEvent + i % 3, i * 7));
+    return messages;
+}
+
+// ---------------------------------------------------------------------------
+
+static void testLegacy()
+{
+    printf("legacy format\n");
+
+    // 与旧版 sendMessageToServer() 的输出一致
+    QByteArray block;
+    QDataStream legacy(&block, QIODevice::WriteOnly);
+    legacy.setVersion(QDataStream::Qt_4_0);
+    legacy << (quint16)0 << (quint8)OtherEvent << (qint32)5
+           << QString("message 5");
+    legacy.device()->seek(0);
+    legacy << (quint16)(block.size() - sizeof(quint16));
+    CHECK(encode(ZDTALK_IPC_VERSION_LEGACY,
+                 MessageList() << qMakePair((int)OtherEvent, 5)) == block);
+
+    MessageList messages = makeMessages(5);
+    QByteArray data = encode(ZDTALK_IPC_VERSION_LEGACY, messages);
+
+    for (int chunk = 1; chunk <= data.size(); chunk++) {
+        ZDRecordingProtocol protocol;
+        CHECK(feed(protocol, data, chunk) == messages);
+        CHECK(protocol.peerVersion() == ZDTALK_IPC_VERSION_LEGACY);
+    }
+}
+
+static void testFramed()
+{
+    printf("framed batches, every split\n");
+
+    MessageList messages = makeMessages(16);
+    QByteArray data = encode(ZDTALK_IPC_VERSION, messages);
+    data += encode(ZDTALK_IPC_VERSION, makeMessages(1));
+    messages += makeMessages(1);
+
+    for (int chunk = 1; chunk <= data.size(); chunk++) {
+        ZDRecordingProtocol protocol;
+        CHECK(feed(protocol, data, chunk) == messages);
+        CHECK(protocol.peerVersion() == ZDTALK_IPC_VERSION);
+        CHECK(!protocol.hasError());
+    }
+}
+
+static void testMixed()
+{
+    printf("legacy and framed mixed\n");
+
+    MessageList legacy = makeMessages(3);
+    MessageList framed = makeMessages(4);
+    QByteArray data = encode(ZDTALK_IPC_VERSION_LEGACY, legacy) +
+            encode(ZDTALK_IPC_VERSION, framed);
+
+    ZDRecordingProtocol protocol;
+    CHECK(feed(protocol, data, 5) == legacy + framed);
+    CHECK(protocol.peerVersion() == ZDTALK_IPC_VERSION);
+}
+
+static void testCoalesce()
+{
+    printf("coalesced status events\n");
+
+    ZDRecordingProtocol sender;
+    sender.setSendVersion(ZDTALK_IPC_VERSION);
+    sender.queueMessage(StatusEvent, makePayload(1), true);
+    sender.queueMessage(CommandEvent, makePayload(2));
+    sender.queueMessage(StatusEvent, makePayload(3), true);
+    sender.queueMessage(CommandEvent, makePayload(4));
+    sender.queueMessage(StatusEvent, makePayload(5), true);
+
+    MessageList expected;
+    expected << qMakePair((int)StatusEvent, 5)
+             << qMakePair((int)CommandEvent, 2)
+             << qMakePair((int)CommandEvent, 4);
+
+    ZDRecordingProtocol receiver;
+    CHECK(feed(receiver, sender.takeFrames(), 64) == expected);
+    CHECK(!sender.hasPendingMessages());
+    CHECK(sender.takeFrames().isEmpty());
+}
+
+static void testInvalid()
+{
+    printf("invalid data\n");
+
+    QByteArray data = encode(ZDTALK_IPC_VERSION, makeMessages(2));
+    data[2] = 9;  // 未知版本
+
+    ZDRecordingProtocol protocol;
+    CHECK(feed(protocol, data, data.size()).isEmpty());
+    CHECK(protocol.hasError());
+
+    protocol.reset();
+    MessageList messages = makeMessages(2);
+    CHECK(feed(protocol, encode(ZDTALK_IPC_VERSION, messages), 3) == messages);
+    CHECK(!protocol.hasError());
+}
+
+// ---------------------------------------------------------------------------
+
+// 主程序每批发送多条命令，客户端每收到一条命令回复一条可合并的状态事件，
+// 同一轮事件循环中的回复只写一次
+static void testSocket()
+{
+    const int batches = 5000;
+    const int perBatch = 8;
+    const int total = batches * perBatch;
+
+    printf("local socket, %d commands in batches of %d\n", total, perBatch);
+
+    QString name = QString("zdtalk-ipc-harness-%1")
+            .arg(QCoreApplication::applicationPid());
+    QLocalServer::removeServer(name);
+
+    QLocalServer server;
+    if (!server.listen(name)) {
+        printf("  FAILED: listen: %s\n", qPrintable(server.errorString()));
+        failures++;
+        return;
+    }
+
+    QLocalSocket client;
+    client.connectToServer(name);
+    if (!client.waitForConnected(3000) || !server.waitForNewConnection(3000)) {
+        printf("  FAILED: connect\n");
+        failures++;
+        return;
+    }
+    QLocalSocket *host = server.nextPendingConnection();
+
+    ZDRecordingProtocol clientProtocol;
+    ZDRecordingProtocol hostProtocol;
+    hostProtocol.setSendVersion(ZDTALK_IPC_VERSION);
+
+    int received = 0, ordered = 0, statusReceived = 0, lastStatus = -1;
+    int clientWrites = 0;
+    bool flushPending = false;
+    QEventLoop loop;
+
+    QObject::connect(&client, &QLocalSocket::readyRead, [&]() {
+        ZDRecordingProtocol::Message msg;
+        clientProtocol.readFrom(&client);
+        while (clientProtocol.readMessage(msg)) {
+            if (payloadValue(msg.payload) == received)
+                ordered++;
+            received++;
+            clientProtocol.queueMessage(StatusEvent, makePayload(received),
+                                        true);
+        }
+        if (clientProtocol.peerVersion() > clientProtocol.sendVersion())
+            clientProtocol.setSendVersion(clientProtocol.peerVersion());
+
+        if (!flushPending && clientProtocol.hasPendingMessages()) {
+            flushPending = true;
+            QTimer::singleShot(0, [&]() {
+                flushPending = false;
+                client.write(clientProtocol.takeFrames());
+                clientWrites++;
+            });
+        }
+    });
+
+    QObject::connect(host, &QLocalSocket::readyRead, [&]() {
+        ZDRecordingProtocol::Message msg;
+        hostProtocol.readFrom(host);
+        while (hostProtocol.readMessage(msg)) {
+            statusReceived++;
+            lastStatus = payloadValue(msg.payload);
+        }
+        if (lastStatus == total)
+            loop.quit();
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // 每帧拆成两次写入，接收端必须重组
+    for (int b = 0; b < batches; b++) {
+        for (int i = 0; i < perBatch; i++)
+            hostProtocol.queueMessage(CommandEvent,
+                                      makePayload(b * perBatch + i));
+        QByteArray frame = hostProtocol.takeFrames();
+        host->write(frame.left(frame.size() / 2));
+        host->write(frame.mid(frame.size() / 2));
+    }
+
+    QTimer::singleShot(30000, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    qint64 elapsed = qMax<qint64>(timer.elapsed(), 1);
+
+    CHECK(received == total);
+    CHECK(ordered == total);
+    CHECK(lastStatus == total);
+    CHECK(statusReceived <= received);
+
+    printf("  %d commands in %lld ms, %.0f messages/s\n", received,
+           (long long)elapsed, received * 1000.0 / elapsed);
+    printf("  %d status events sent in %d writes (coalesced from %d)\n",
+           statusReceived, clientWrites, received);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    testLegacy();
+    testFramed();
+    testMixed();
+    testCoalesce();
+    testInvalid();
+    testSocket();
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+
+    printf("all checks passed\n");
+    return 0;
+}
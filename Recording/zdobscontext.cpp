@@ -18,6 +18,7 @@
 #include "zdobscontext.h"
 #include "zdrecordingdefine.h"
 #include "platform.h"
+#include "utils/log/zdlogger.h"
 
 #ifdef _WIN32
 #define IS_WIN32 1
@@ -40,6 +41,9 @@
 // OBS
 #include <util/util.hpp>
 #include <util/platform.h>
+#include <util/metrics.h>
+#include <util/profiler.h>
+#include <media-io/media-remux.h>
 #include <libavcodec/avcodec.h>
 
 // Qt
@@ -47,6 +51,7 @@
 #include <QFileInfo>
 #include <QSize>
 #include <QDir>
+#include <QTimer>
 #include <QDebug>
 
 using namespace std;
@@ -74,7 +79,11 @@ using namespace std;
 #define ZDTALK_VIDEO_COLORSPACE                  VIDEO_CS_601
 #define ZDTALK_VIDEO_RANGE                       VIDEO_RANGE_PARTIAL
 #define ZDTALK_VIDEO_SCALE_TYPE                  OBS_SCALE_BICUBIC
+#define ZDTALK_VIDEO_STAGING_DEPTH               3 /* 回读缓冲数，多一帧余量防止卡顿 */
+#define ZDTALK_VIDEO_PARALLEL_TICK               true /* 源的准备工作（查找窗口等）在工作线程并行执行 */
 #define ZDTALK_VIDEO_BITRATE                     150
+#define ZDTALK_VIDEO_STREAM_MAX_BITRATE          800
+#define ZDTALK_VIDEO_STREAM_MIN_BITRATE          100
 #define ZDTALK_VIDEO_CAPTURE_SOURCE_ID           "window_capture"
 #define ZDTALK_VIDEO_OUTPUT_INDEX                0
 
@@ -82,6 +91,7 @@ using namespace std;
 #define ZDTALK_TRANSITION_ID                     "fade_transition"
 
 #define ZDTALK_RECORDING_OUTPUT_ID               "ffmpeg_output"
+#define ZDTALK_RECORDING_MUXER_ID                "ffmpeg_muxer"
 #define ZDTALK_STREAMING_OUTPUT_ID               "rtmp_output"
 
 /*
@@ -93,6 +103,19 @@ static const string encoders[] = {
 };
 */
 
+// 只加载用到的模块，其余（decklink、vlc-video、text 等）不加载
+static const char *allowed_modules[] = {
+    "win-capture",
+    "win-wasapi",
+    "obs-ffmpeg",
+    "obs-x264",
+    "obs-outputs",
+    "rtmp-services",
+    "obs-filters",
+    "obs-transitions",
+    nullptr
+};
+
 static const double scaled_vals[] =
 {
     1.0,
@@ -169,21 +192,29 @@ static uint32_t GetWindowsVersion()
 }
 #endif
 
+// 直接放入日志队列，不经过 qInfo()，图形、音频线程不会等待写文件
 static void LogHandler(int level, const char *format, va_list args, void *param)
 {
-    UNUSED_PARAMETER(level);
     UNUSED_PARAMETER(param);
 
-    char str[4096];
+    char str[4096] = "-- ";
 
 #ifndef _WIN32
     va_list args2;
     va_copy(args2, args);
 #endif
 
-    vsnprintf_s(str, sizeof(str), format, args);
+    vsnprintf_s(str + 3, sizeof(str) - 3, _TRUNCATE, format, args);
+
+    const char *label = "INFO";
+    if (level <= LOG_ERROR)
+        label = "ERROR";
+    else if (level <= LOG_WARNING)
+        label = "WARNING";
+    else if (level >= LOG_DEBUG)
+        label = "DEBUG";
 
-    qInfo() << "--" << str;
+    ZDLogger::getInstance()->writeLog(label, str, level <= LOG_ERROR);
 }
 
 static void AddFilterToAudioInput(const char *id)
@@ -399,8 +430,7 @@ static void RecordingStopped(void *data, calldata_t *params)
                                   Q_ARG(QString, msg));
     } else {
         ZDTalkOBSContext *handler = static_cast<ZDTalkOBSContext *>(data);
-        QMetaObject::invokeMethod(handler, "recordingStopped",
-                                  Q_ARG(QString, handler->getRecordFilePath()));
+        QMetaObject::invokeMethod(handler, "finishRecording");
     }
 }
 
@@ -493,8 +523,19 @@ ZDTalkOBSContext::ZDTalkOBSContext(QObject *parent) : QObject(parent),
     captureSource(nullptr),
     properties(nullptr),
     recordWhenStreaming(false),
-    outputType(OutputMP4)
+    outputType(OutputMP4),
+    encoderMode(EncoderShared),
+    remuxEnabled(ZDTALK_RECORDING_REMUX_DEFAULT),
+    remuxBatch(nullptr),
+    remuxLastPercent(0),
+    statsTimer(new QTimer(this)),
+    statsLastBytes(0),
+    statsLastTime(0),
+    metricsTimer(new QTimer(this))
 {
+    connect(statsTimer, &QTimer::timeout, this, &ZDTalkOBSContext::reportStats);
+    connect(metricsTimer, &QTimer::timeout, this, &ZDTalkOBSContext::reportMetrics);
+
 #ifdef _WIN32
     DisableAudioDucking(true);
 #endif
@@ -502,6 +543,9 @@ ZDTalkOBSContext::ZDTalkOBSContext(QObject *parent) : QObject(parent),
         aacTrack[i] = nullptr;
     base_get_log_handler(&DefLogHandler, nullptr);
     base_set_log_handler(LogHandler, nullptr);
+
+    profiler_start();
+    profiler_set_sample_interval(ZDTALK_PROFILER_SAMPLE_INTERVAL);
 }
 
 ZDTalkOBSContext::~ZDTalkOBSContext()
@@ -510,11 +554,16 @@ ZDTalkOBSContext::~ZDTalkOBSContext()
     DisableAudioDucking(false);
 #endif
 
+    stopRemux();
+
     if (obs_initialized())
         release();
 
     obs_shutdown();
 
+    profiler_stop();
+    profiler_free();
+
     blog(LOG_INFO, "Memory leaks: %ld.", bnum_allocs());
     base_set_log_handler(nullptr, nullptr);
 }
@@ -523,9 +572,11 @@ void ZDTalkOBSContext::release()
 {
     blog(LOG_INFO, OBS_RELEASE_BEGIN_SEPARATOR);
 
-    signalRecordingStarted.Disconnect();
-    signalRecordingStopping.Disconnect();
-    signalRecordingStopped.Disconnect();
+    statsTimer->stop();
+    metricsTimer->stop();
+    // 退出时取消转封装，分片 MP4 本身可以正常播放
+    stopRemux();
+    disconnectRecordingSignals();
     signalStreamingStarted.Disconnect();
     signalStreamingStopping.Disconnect();
     signalStreamingStopped.Disconnect();
@@ -645,8 +696,11 @@ void ZDTalkOBSContext::initialize(const QString &configPath,
         QString modulePath = appPath + "/data/obs-plugins/%module%";
         obs_add_module_path(pluginsPath.toStdString().c_str(),
                             modulePath.toStdString().c_str());
+        for (size_t i = 0; allowed_modules[i]; i++)
+            obs_add_allowed_module(allowed_modules[i]);
+        QString cachePath = configPath + "/" ZDTALK_OBS_MODULE_CACHE;
         blog(LOG_INFO, OBS_SEPARATOR);
-        obs_load_all_modules();
+        obs_load_all_modules_lazy(cachePath.toStdString().c_str());
         blog(LOG_INFO, OBS_SEPARATOR);
         obs_log_loaded_modules();
 
@@ -703,12 +757,7 @@ void ZDTalkOBSContext::initialize(const QString &configPath,
     }
 
     // 设置录制/推流信号槽
-    signalRecordingStarted.Connect(obs_output_get_signal_handler(recordOutput),
-                          "start", RecordingStarted, this);
-    signalRecordingStopping.Connect(obs_output_get_signal_handler(recordOutput),
-                           "stopping", RecordingStopping, this);
-    signalRecordingStopped.Connect(obs_output_get_signal_handler(recordOutput),
-                          "stop", RecordingStopped, this);
+    connectRecordingSignals();
     signalStreamingStarted.Connect(obs_output_get_signal_handler(streamOutput),
                           "start", StreamingStarted, this);
     signalStreamingStopping.Connect(obs_output_get_signal_handler(streamOutput),
@@ -730,18 +779,13 @@ void ZDTalkOBSContext::initialize(const QString &configPath,
         obs_set_output_source(i, nullptr);
 
     // 场景过度 - 淡出
-    size_t idx = 0;
-    const char *id;
-    while (obs_enum_transition_types(idx++, &id)) {
-        if (!obs_is_source_configurable(id)) {
-            if (strcmp(id, ZDTALK_TRANSITION_ID) == 0) {
-                const char *name = obs_source_get_display_name(id);
-                obs_source_t *tr = obs_source_create_private(id, name, NULL);
-                blog(LOG_INFO, "Transition saved.");
-                transition = tr;
-                break;
-            }
-        }
+    // 模块按需加载，未加载模块的类型不会被枚举到，所以直接按 id 查找
+    const char *name = obs_source_get_display_name(ZDTALK_TRANSITION_ID);
+    if (name) {
+        obs_source_t *tr = obs_source_create_private(ZDTALK_TRANSITION_ID,
+                                                     name, NULL);
+        blog(LOG_INFO, "Transition saved.");
+        transition = tr;
     }
     if (!transition) {
         blog(LOG_ERROR, "Transition is not found.");
@@ -794,6 +838,8 @@ void ZDTalkOBSContext::initialize(const QString &configPath,
     obs_data_t *curSetting = obs_source_get_settings(captureSource);
     obs_data_apply(setting, curSetting);
     obs_data_release(curSetting);
+    // 课堂画面大多是静止的，开启变化检测后未变化的帧直接复用上一帧
+    obs_data_set_bool(setting, "change_detection", true);
 
     // 添加窗口捕获源的剪裁过滤器
     addFilterToSource(captureSource, ZDTALK_VIDEO_CROP_FILTER_ID);
@@ -933,9 +979,15 @@ bool ZDTalkOBSContext::resetOutputs()
     }
 
     if (!recordOutput) {
-        recordOutput = obs_output_create(ZDTALK_RECORDING_OUTPUT_ID,
-                                         ZDTALK_TAG "-AdvFFmpegOutput",
-                                         nullptr, nullptr);
+        // 共享编码时使用 ffmpeg_muxer 直接封装编码后的数据，不再重复编码
+        if (encoderMode == EncoderShared)
+            recordOutput = obs_output_create(ZDTALK_RECORDING_MUXER_ID,
+                                             ZDTALK_TAG "-AdvFFmpegMuxer",
+                                             nullptr, nullptr);
+        else
+            recordOutput = obs_output_create(ZDTALK_RECORDING_OUTPUT_ID,
+                                             ZDTALK_TAG "-AdvFFmpegOutput",
+                                             nullptr, nullptr);
         if (!recordOutput) {
             blog(LOG_ERROR, "Create record output failed.");
             return false;
@@ -956,6 +1008,8 @@ bool ZDTalkOBSContext::resetOutputs()
 
         // 禁用放缩
         obs_encoder_set_scaled_size(h264Streaming, 0, 0);
+        // 画面未变化的重复帧不再编码（每秒至少编码一帧）
+        obs_encoder_set_skip_duplicate_frames(h264Streaming, true);
         obs_encoder_set_video(h264Streaming, obs_get_video());
         obs_output_set_video_encoder(streamOutput, h264Streaming);
         obs_service_apply_encoder_settings(rtmpService, streamEncSettings, nullptr);
@@ -1011,6 +1065,8 @@ int ZDTalkOBSContext::resetVideo()
     ovi.adapter         = 0; /* 显示适配器索引 */
     ovi.gpu_conversion  = true;
     ovi.scale_type      = ZDTALK_VIDEO_SCALE_TYPE;
+    ovi.staging_depth   = ZDTALK_VIDEO_STAGING_DEPTH;
+    ovi.parallel_tick   = ZDTALK_VIDEO_PARALLEL_TICK;
 
     int ret = obs_reset_video(&ovi);
 
@@ -1025,6 +1081,17 @@ int ZDTalkOBSContext::resetVideo()
         }
     }
 
+    /* 没有可用的显卡（远程桌面、虚拟机等）时使用软件渲染 */
+    if (ret != OBS_VIDEO_SUCCESS &&
+            strcmp(ovi.graphics_module, DL_SOFTWARE) != 0) {
+        blog(LOG_WARNING, "Failed to initialize obs video (%d) "
+                          "with graphics_module='%s', retrying "
+                          "with graphics_module='%s'.",
+             ret, ovi.graphics_module, DL_SOFTWARE);
+        ovi.graphics_module = DL_SOFTWARE;
+        ret = obs_reset_video(&ovi);
+    }
+
     return ret;
 }
 
@@ -1203,11 +1270,19 @@ OBSData ZDTalkOBSContext::getStreamEncSettings()
     obs_data_set_string(settings, "preset", "medium");
     obs_data_set_string(settings, "tune", "stillimage");
     obs_data_set_string(settings, "x264opts", "");
-    obs_data_set_string(settings, "rate_control", "CRF");
     obs_data_set_int(settings, "crf", 22);
-    obs_data_set_bool(settings, "vfr", false);
+    if (encoderMode == EncoderShared) {
+        // 录制共用推流编码器，保持恒定质量，不做自适应码率
+        obs_data_set_string(settings, "rate_control", "CRF");
+    } else {
+        // 以码率为上限的 CRF，推流自适应码率时可以动态调整上限
+        obs_data_set_string(settings, "rate_control", "VBR");
+        obs_data_set_int(settings, "bitrate", ZDTALK_VIDEO_STREAM_MAX_BITRATE);
+    }
     obs_data_set_string(settings, "profile", "main");
     obs_data_set_int(settings, "keyint_sec", 10);
+    // 编码器会跳过重复帧（见 resetOutputs），时间戳有间隔：按时间戳做码控，按时间插入关键帧
+    obs_data_set_bool(settings, "skip_duplicate_frames", true);
 
     OBSData dataRet(settings);
     obs_data_release(settings);
@@ -1218,9 +1293,23 @@ bool ZDTalkOBSContext::setupRecording()
 {
     obs_data_t *settings = obs_data_create();
 
+    if (encoderMode == EncoderShared) {
+        // 封装格式由文件扩展名决定
+        // MP4 按关键帧分片写入，崩溃或强制停止时已写入的分片仍可播放
+        obs_data_set_string(settings, "path", filePath);
+        obs_data_set_bool(settings, "fragmented", outputType == OutputMP4);
+
+        obs_output_set_video_encoder(recordOutput, h264Streaming);
+        obs_output_set_audio_encoder(recordOutput, aacTrack[0], 0);
+        obs_output_update(recordOutput, settings);
+
+        obs_data_release(settings);
+        return true;
+    }
+
     obs_data_set_string(settings, "url", filePath);
+    obs_data_set_bool(settings, "fragmented", outputType == OutputMP4);
     if (outputType == OutputMP4) {
-        obs_data_set_string(settings, "muxer_settings", "movflags=faststart");
         obs_data_set_string(settings, "format_name", "mp4");
         obs_data_set_string(settings, "format_mime_type", "video/mp4");
         obs_data_set_string(settings, "video_encoder", "libx264");
@@ -1234,6 +1323,7 @@ bool ZDTalkOBSContext::setupRecording()
         obs_data_set_int(settings, "video_bitrate", ZDTALK_VIDEO_BITRATE);
     }
     obs_data_set_int(settings, "gop_size", ZDTALK_VIDEO_FPS * 10);
+    obs_data_set_bool(settings, "skip_duplicate_frames", true);
     obs_data_set_int(settings, "audio_bitrate", ZDTALK_AUDIO_BITRATE);
     obs_data_set_string(settings, "audio_encoder", ZDTALK_AUDIO_ENCODER_NAME);
     obs_data_set_int(settings, "audio_encoder_id", AV_CODEC_ID_AAC);
@@ -1251,6 +1341,64 @@ bool ZDTalkOBSContext::setupRecording()
     return true;
 }
 
+void ZDTalkOBSContext::connectRecordingSignals()
+{
+    signalRecordingStarted.Connect(obs_output_get_signal_handler(recordOutput),
+                          "start", RecordingStarted, this);
+    signalRecordingStopping.Connect(obs_output_get_signal_handler(recordOutput),
+                           "stopping", RecordingStopping, this);
+    signalRecordingStopped.Connect(obs_output_get_signal_handler(recordOutput),
+                          "stop", RecordingStopped, this);
+}
+
+void ZDTalkOBSContext::disconnectRecordingSignals()
+{
+    signalRecordingStarted.Disconnect();
+    signalRecordingStopping.Disconnect();
+    signalRecordingStopped.Disconnect();
+}
+
+void ZDTalkOBSContext::setRecordingEncoderMode(int mode)
+{
+    if (mode != EncoderStandalone && mode != EncoderShared) {
+        blog(LOG_WARNING, "Invalid recording encoder mode:%d.", mode);
+        return;
+    }
+
+    if (mode == encoderMode)
+        return;
+
+    if (recordOutput && obs_output_active(recordOutput)) {
+        blog(LOG_WARNING, "Recording is active, encoder mode not changed.");
+        return;
+    }
+
+    // 推流编码器的码率控制方式随模式变化，推流中不能切换
+    if (streamOutput && obs_output_active(streamOutput)) {
+        blog(LOG_WARNING, "Streaming is active, encoder mode not changed.");
+        return;
+    }
+
+    blog(LOG_INFO, "Recording encoder mode from:%d to:%d.", encoderMode, mode);
+    encoderMode = mode;
+
+    if (h264Streaming) {
+        OBSData streamEncSettings = getStreamEncSettings();
+        obs_service_apply_encoder_settings(rtmpService, streamEncSettings, nullptr);
+        obs_encoder_update(h264Streaming, streamEncSettings);
+    }
+
+    // 输出类型不同，需要重新创建录制输出
+    if (recordOutput) {
+        disconnectRecordingSignals();
+        recordOutput = nullptr;
+        if (resetOutputs())
+            connectRecordingSignals();
+        else
+            emit errorOccurred(ErrorRecording, QStringLiteral("初始化组件失败"));
+    }
+}
+
 bool ZDTalkOBSContext::setupStreaming()
 {
     OBSData settings = obs_data_create();
@@ -1261,6 +1409,17 @@ bool ZDTalkOBSContext::setupStreaming()
     obs_data_set_bool(settings, "use_auth", false);
     obs_service_update(rtmpService, settings);
 
+    // 根据估计的带宽动态调整编码码率，录制有独立编码器时才开启，
+    // 共享编码时调整码率会同时降低录制文件的质量
+    OBSData outputSettings = obs_data_create();
+    obs_data_release(outputSettings);
+
+    obs_data_set_bool(outputSettings, "adaptive_bitrate_enabled",
+                      encoderMode != EncoderShared);
+    obs_data_set_int(outputSettings, "adaptive_min_bitrate",
+                     ZDTALK_VIDEO_STREAM_MIN_BITRATE);
+    obs_output_update(streamOutput, outputSettings);
+
     obs_output_set_reconnect_settings(streamOutput, 0, 0);
 
     return true;
@@ -1281,6 +1440,8 @@ void ZDTalkOBSContext::startRecording(const QString &output)
         blog(LOG_INFO, "Record output file path is %s.", filePath);
     }
 
+    // 同一文件还在等待转封装时取消，避免转封装结果覆盖新的录制
+    cancelRemux(output);
     setupRecording();
 
     if (!obs_output_start(recordOutput)) {
@@ -1301,6 +1462,139 @@ void ZDTalkOBSContext::stopRecording(bool force)
     }
 }
 
+void ZDTalkOBSContext::setRecordingRemux(bool enable)
+{
+    blog(LOG_INFO, "Recording remux %s.", enable ? "enabled" : "disabled");
+    remuxEnabled = enable;
+}
+
+void ZDTalkOBSContext::finishRecording()
+{
+    QString path = QString::fromUtf8(filePath);
+
+    // 转封装在后台队列中进行，录制文件已可播放，不等待转封装完成
+    if (remuxEnabled && outputType == OutputMP4)
+        queueRemux(path);
+
+    emit recordingStopped(path);
+}
+
+// 先转封装到临时文件，成功后替换录制文件，失败或取消时保留原分片 MP4
+void ZDTalkOBSContext::queueRemux(const QString &path)
+{
+    if (!remuxBatch) {
+        // 单个工作线程依次处理，避免与进行中的录制争抢 CPU
+        remuxBatch = media_remux_batch_create(1, remuxBatchProgress,
+                                              remuxBatchDone, this);
+        if (!remuxBatch) {
+            blog(LOG_ERROR, "Create remux batch failed.");
+            return;
+        }
+    }
+
+    QFileInfo info(path);
+    QString tempPath = info.path() + "/" + info.completeBaseName() +
+            ZDTALK_RECORDING_REMUX_SUFFIX "." + info.suffix();
+
+    RemuxJob job;
+    job.path = path.toStdString();
+    job.tempPath = tempPath.toStdString();
+    job.canceled = false;
+
+    // 持锁添加，保证完成回调按序号取任务时已在列表中
+    std::lock_guard<std::mutex> lock(remuxMutex);
+    remuxJobs.push_back(job);
+    size_t idx = media_remux_batch_add(remuxBatch, job.path.c_str(),
+                                       job.tempPath.c_str());
+
+    blog(LOG_INFO, "Remux '%s' queued, job:%d.", job.path.c_str(), (int)idx);
+}
+
+void ZDTalkOBSContext::cancelRemux(const QString &path)
+{
+    if (!remuxBatch)
+        return;
+
+    string in = path.toStdString();
+
+    std::lock_guard<std::mutex> lock(remuxMutex);
+    for (size_t i = 0; i < remuxJobs.size(); i++) {
+        if (remuxJobs[i].path == in && !remuxJobs[i].canceled) {
+            remuxJobs[i].canceled = true;
+            media_remux_batch_cancel(remuxBatch, i);
+        }
+    }
+}
+
+// 退出时取消转封装，分片 MP4 本身可以正常播放
+void ZDTalkOBSContext::stopRemux()
+{
+    if (!remuxBatch)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(remuxMutex);
+        for (RemuxJob &job : remuxJobs)
+            job.canceled = true;
+    }
+
+    // 等待正在执行的任务结束，完成回调需要 remuxMutex，不能持锁调用
+    media_remux_batch_destroy(remuxBatch);
+    remuxBatch = nullptr;
+    remuxJobs.clear();
+}
+
+// 在转封装线程中执行
+bool ZDTalkOBSContext::remuxBatchProgress(void *data, size_t job, float percent)
+{
+    ZDTalkOBSContext *context = static_cast<ZDTalkOBSContext *>(data);
+    UNUSED_PARAMETER(job);
+
+    // 只在整数进度变化时通知，0 不发送（IPC 中 param1 为 0 时会被省略），
+    // 100 在替换录制文件后才发送
+    int value = (int)percent;
+    if (value > 99)
+        value = 99;
+    if (value > context->remuxLastPercent && value > 0) {
+        context->remuxLastPercent = value;
+        QMetaObject::invokeMethod(context, "remuxProgress",
+                                  Qt::QueuedConnection, Q_ARG(int, value));
+    }
+
+    return true;
+}
+
+// 在转封装线程中执行
+void ZDTalkOBSContext::remuxBatchDone(void *data, size_t job, bool success)
+{
+    ZDTalkOBSContext *context = static_cast<ZDTalkOBSContext *>(data);
+    context->remuxLastPercent = 0;
+
+    // 持锁替换，新的录制开始前取消的任务不会再覆盖录制文件
+    std::lock_guard<std::mutex> lock(context->remuxMutex);
+    const RemuxJob &remuxJob = context->remuxJobs[job];
+    const char *in = remuxJob.path.c_str();
+    const char *out = remuxJob.tempPath.c_str();
+
+    if (success && !remuxJob.canceled) {
+        success = os_safe_replace(in, out, nullptr) == 0;
+        if (!success)
+            blog(LOG_ERROR, "Remux replace '%s' failed.", in);
+    } else {
+        success = false;
+    }
+
+    if (!success)
+        os_unlink(out);
+
+    blog(LOG_INFO, "Remux '%s' %s.", in,
+         success ? "finished" : (remuxJob.canceled ? "canceled" : "failed"));
+
+    if (success)
+        QMetaObject::invokeMethod(context, "remuxProgress",
+                                  Qt::QueuedConnection, Q_ARG(int, 100));
+}
+
 void ZDTalkOBSContext::startStreaming(const QString &server, const QString &key)
 {
     if (server.isEmpty() || key.isEmpty()) {
@@ -1419,6 +1713,89 @@ void ZDTalkOBSContext::scaleVideo(const QSize &size)
     */
 }
 
+void ZDTalkOBSContext::setStatsInterval(int msec)
+{
+    blog(LOG_INFO, "Stats interval: %d ms.", msec);
+
+    if (msec <= 0) {
+        statsTimer->stop();
+        return;
+    }
+
+    statsLastBytes = 0;
+    statsLastTime  = 0;
+    statsTimer->start(msec);
+}
+
+// 推流时统计推流输出，否则统计录制输出
+void ZDTalkOBSContext::reportStats()
+{
+    obs_output_t *output = obs_output_active(streamOutput) ?
+                streamOutput : recordOutput;
+    if (!output)
+        return;
+
+    uint64_t curTime = os_gettime_ns();
+    uint64_t bytes = obs_output_get_total_bytes(output);
+    int bitrate = 0;
+
+    if (statsLastTime && bytes >= statsLastBytes && curTime > statsLastTime)
+        bitrate = (int)((bytes - statsLastBytes) * 8 * 1000000ULL /
+                        (curTime - statsLastTime));
+    statsLastBytes = bytes;
+    statsLastTime  = curTime;
+
+    // ffmpeg_output 独立编码时没有 OBS 编码器，编码耗时为 0
+    obs_encoder_t *encoder = obs_output_get_video_encoder(output);
+    double encodeTime = encoder ? (double)
+            obs_encoder_get_average_encode_time_ns(encoder) / 1000000.0 : 0.0;
+
+    emit statsUpdated(obs_get_active_fps(),
+                      obs_output_get_total_frames(output),
+                      obs_output_get_frames_dropped(output),
+                      (int)obs_get_lagged_frames(),
+                      bitrate, encodeTime);
+}
+
+void ZDTalkOBSContext::setMetricsInterval(int msec)
+{
+    blog(LOG_INFO, "Metrics interval: %d ms.", msec);
+
+    if (msec <= 0) {
+        metricsTimer->stop();
+        return;
+    }
+
+    metricsTimer->start(msec);
+}
+
+// 指标均为累计值，速率由接收方比较前后两次快照计算
+void ZDTalkOBSContext::reportMetrics()
+{
+    char *json = metrics_snapshot_json();
+    emit metricsUpdated(QByteArray(json));
+    bfree(json);
+}
+
+void ZDTalkOBSContext::dumpProfilerTrace(const QString &path)
+{
+    if (!obs_initialized())
+        return;
+
+    profiler_snapshot_t *snap = profile_snapshot_create();
+
+    profiler_print(snap);
+    profiler_print_time_between_calls(snap);
+
+    if (profiler_snapshot_dump_trace_json(snap, path.toUtf8().constData()))
+        blog(LOG_INFO, "Profiler trace saved to '%s'.", path.toUtf8().constData());
+    else
+        blog(LOG_WARNING, "Could not save profiler trace to '%s'.",
+             path.toUtf8().constData());
+
+    profile_snapshot_free(snap);
+}
+
 void ZDTalkOBSContext::logStreamStats()
 {
     if (!streamOutput) return;
@@ -1452,8 +1829,28 @@ void ZDTalkOBSContext::logStreamStats()
     dropped -= firstDropped;
     num = total ? (long double)dropped / (long double)total * 100.0l : 0.0l;
 
-    blog(LOG_INFO, "Streaming stat => bitrate:%.2lf kb/s, frames:%d / %d (%.2lf%%).",
-         kbps, dropped, total, num);
+    // 因画面未变化而跳过编码的帧
+    uint32_t received = obs_encoder_get_received_frames(h264Streaming);
+    uint32_t skipped  = obs_encoder_get_skipped_frames(h264Streaming);
+    long double skippedNum = received ?
+                (long double)skipped / (long double)received * 100.0l : 0.0l;
+
+    // 估计的可用带宽及自适应调整后的编码码率
+    int bandwidth = obs_output_get_bandwidth_estimate(streamOutput);
+    obs_data_t *encSettings = obs_encoder_get_settings(h264Streaming);
+    int encBitrate = (int)obs_data_get_int(encSettings, "bitrate");
+    obs_data_release(encSettings);
+
+    blog(LOG_INFO, "Streaming stat => bitrate:%.2lf kb/s, frames:%d / %d (%.2lf%%), "
+         "duplicates skipped:%u / %u (%.2lf%%), bandwidth:%d kb/s, "
+         "encoder bitrate:%d kb/s.",
+         kbps, dropped, total, num, skipped, received, skippedNum,
+         bandwidth, encBitrate);
+    // 编码数据包缓冲复用情况，长时间运行时分配次数应基本不再增长
+    blog(LOG_INFO, "Encoder packets => in use:%ld, allocated:%ld, reused:%ld.",
+         obs_encoder_packet_num_allocs(),
+         obs_encoder_packet_num_heap_allocs(),
+         obs_encoder_packet_num_reused());
 
     lastBytesSent     = bytesSent;
     lastBytesSentTime = curTime;
@@ -24,16 +24,22 @@
 #define DL_OPENGL "libobs-opengl.dll"
 #define DL_D3D9   ""
 #define DL_D3D11  "libobs-d3d11.dll"
+#define DL_SOFTWARE "libobs-software.dll"
 
 #include "obs.h"
 #include "obs.hpp"
 
 #include <string>
+#include <vector>
+#include <mutex>
 
 #include <QObject>
 #include <QSize>
 #include <QRect>
 
+class QTimer;
+struct media_remux_batch;
+
 class ZDTalkOBSContext : public QObject
 {
     Q_OBJECT
@@ -49,6 +55,10 @@ signals:
     void initialized();
     void recordingStarted();
     void recordingStopped(const QString &);
+    void remuxProgress(int percent);
+    void statsUpdated(double fps, int totalFrames, int droppedFrames,
+                      int laggedFrames, int bitrate, double encodeTime);
+    void metricsUpdated(const QByteArray &json);
     void streamingStarted();
     void streamingStopped();
     void errorOccurred(const int, const QString &);
@@ -83,6 +93,26 @@ public slots:
 
     void logStreamStats();
 
+    /* 录制编码方式，见 ZDRecordingEncoderMode，录制中调用无效 */
+    void setRecordingEncoderMode(int mode);
+
+    /* 停止录制后是否将分片 MP4 转封装为普通 MP4，转封装在后台线程进行 */
+    void setRecordingRemux(bool enable);
+
+    /* 定时上报统计数据（帧率、丢帧、码率、编码耗时），0 为停止 */
+    void setStatsInterval(int msec);
+
+    /* 定时上报 libobs 管线指标快照（JSON），0 为停止 */
+    void setMetricsInterval(int msec);
+
+    /* 卡顿排查：导出最近的性能分析时间线（chrome://tracing 可打开），并将汇总写入日志 */
+    void dumpProfilerTrace(const QString &path);
+
+private slots:
+    void finishRecording();
+    void reportStats();
+    void reportMetrics();
+
 private:
     bool resetAudio();
     int  resetVideo();
@@ -94,8 +124,17 @@ private:
     bool setupRecording();
     bool setupStreaming();
 
+    void connectRecordingSignals();
+    void disconnectRecordingSignals();
+
     void addFilterToSource(obs_source_t *, const char *);
 
+    void queueRemux(const QString &path);
+    void cancelRemux(const QString &path);
+    void stopRemux();
+    static bool remuxBatchProgress(void *data, size_t job, float percent);
+    static void remuxBatchDone(void *data, size_t job, bool success);
+
     char *filePath;
     char *liveServer;
     char *liveKey;
@@ -136,4 +175,23 @@ private:
     int      firstDropped;
 
     int      outputType;
+    int      encoderMode;
+
+    struct RemuxJob {
+        std::string path;      // 录制文件，转封装成功后被替换
+        std::string tempPath;  // 转封装输出的临时文件
+        bool        canceled;
+    };
+
+    bool                     remuxEnabled;
+    struct media_remux_batch *remuxBatch;       // 后台转封装队列
+    std::mutex               remuxMutex;
+    std::vector<RemuxJob>    remuxJobs;         // 下标即队列中的任务序号
+    int                      remuxLastPercent;  // 只在转封装线程中访问
+
+    QTimer   *statsTimer;
+    uint64_t statsLastBytes;
+    uint64_t statsLastTime;
+
+    QTimer   *metricsTimer;
 };
@@ -58,6 +58,12 @@ ZDRecordingClient::ZDRecordingClient(QObject *parent) :
             this,        &ZDRecordingClient::onOBSRecordingStarted);
     connect(mOBSContext, &ZDTalkOBSContext::recordingStopped,
             this,        &ZDRecordingClient::onOBSRecordingStopped);
+    connect(mOBSContext, &ZDTalkOBSContext::remuxProgress,
+            this,        &ZDRecordingClient::onOBSRemuxProgress);
+    connect(mOBSContext, &ZDTalkOBSContext::statsUpdated,
+            this,        &ZDRecordingClient::onOBSStatsUpdated);
+    connect(mOBSContext, &ZDTalkOBSContext::metricsUpdated,
+            this,        &ZDRecordingClient::onOBSMetricsUpdated);
     connect(mOBSContext, &ZDTalkOBSContext::streamingStarted,
             this,        &ZDRecordingClient::onOBSStreamingStarted);
     connect(mOBSContext, &ZDTalkOBSContext::streamingStopped,
@@ -97,6 +103,16 @@ ZDRecordingClient::ZDRecordingClient(QObject *parent) :
             mOBSContext, &ZDTalkOBSContext::stopStreaming);
     connect(this,        &ZDRecordingClient::obsLogStreamStats,
             mOBSContext, &ZDTalkOBSContext::logStreamStats);
+    connect(this,        &ZDRecordingClient::obsSetRecordingRemux,
+            mOBSContext, &ZDTalkOBSContext::setRecordingRemux);
+    connect(this,        &ZDRecordingClient::obsSetStatsInterval,
+            mOBSContext, &ZDTalkOBSContext::setStatsInterval);
+    connect(this,        &ZDRecordingClient::obsSetMetricsInterval,
+            mOBSContext, &ZDTalkOBSContext::setMetricsInterval);
+    connect(this,        &ZDRecordingClient::obsDumpProfilerTrace,
+            mOBSContext, &ZDTalkOBSContext::dumpProfilerTrace);
+    connect(this,        &ZDRecordingClient::obsSetRecordingEncoderMode,
+            mOBSContext, &ZDTalkOBSContext::setRecordingEncoderMode);
 }
 
 ZDRecordingClient::~ZDRecordingClient()
@@ -141,175 +157,238 @@ void ZDRecordingClient::onSocketError(QLocalSocket::LocalSocketError)
     qWarning() << "Socket Error :" << mSocket->errorString();
 }
 
-// 接收消息处理
+// 接收消息处理，数据可能分多次到达，也可能一次包含多条消息
 void ZDRecordingClient::onSocketReadyRead()
 {
-    QByteArray readData = mSocket->readAll();
-    QDataStream in(readData);
-    in.setVersion(QDataStream::Qt_4_0);
+    mProtocol.readFrom(mSocket);
 
-    if (readData.size() < (int)sizeof(quint16)) {
-        qWarning() << TAG_IN << "Received Data Is Small. Skip.";
-        return;
+    ZDRecordingProtocol::Message msg;
+    while (mProtocol.readMessage(msg))
+        handleMessage(msg.event, msg.payload);
+
+    if (mProtocol.hasError()) {
+        qWarning() << TAG_IN << "Received Data Invalid. Skip.";
+        mProtocol.reset();
     }
 
-    do {
-        quint16 dataSize;
-        quint8 event;
-        in >> dataSize >> event;
-        // qDebug() << TAG_IN << "Received Data Size:" << dataSize;
-        qDebug() << TAG_IN << "Received Event:" << event;
-
-        switch (event) {
-        case EventInitialize:
-        {
-            QString configPath, windowTitle;
-            QSize screenSize;
-            QRect cropRegion;
-            in >> configPath >> windowTitle >> screenSize >> cropRegion;
-            qInfo() << TAG_IN << "Init:" << configPath << windowTitle
-                    << screenSize << cropRegion;
-            emit obsInit(configPath, windowTitle, screenSize, cropRegion);
-        }
-            break;
-        case EventScaleVideo:
-        {
-            QSize size;
-            in >> size;
-            qInfo() << TAG_IN << "Scale:" << size;
-            emit obsScaleVideo(size);
-        }
-            break;
-        case EventCropVideo:
-        {
-            QRect rect;
-            in >> rect;
-            qInfo() << TAG_IN << "Crop:" << rect;
-            emit obsCropVideo(rect);
-        }
-            break;
-        case EventUpdateVideoConfig:
-        {
-            bool cursor, compatibility;
-            in >> cursor >> compatibility;
-            qInfo() << TAG_IN << "Update Video Config:" << cursor << compatibility;
-            emit obsUpdateVideoConfig(cursor, compatibility);
-        }
-            break;
-        case EventResetAudioInput:
-        {
-            QString deviceId, deviceDesc;
-            in >> deviceId >> deviceDesc;
-            qInfo() << TAG_IN << "Reset Audio Input:" << deviceId << deviceDesc;
-            emit obsResetAudioInput(deviceId, deviceDesc);
-        }
-            break;
-        case EventResetAudioOutput:
-        {
-            QString deviceId, deviceDesc;
-            in >> deviceId >> deviceDesc;
-            qInfo() << TAG_IN << "Reset Audio Output:" << deviceId << deviceDesc;
-            emit obsResetAudioOutput(deviceId, deviceDesc);
-        }
-            break;
-        case EventDownmixMonoInput:
-        {
-            bool enable;
-            in >> enable;
-            qInfo() << TAG_IN << "Downmix Input:" << enable;
-            emit obsDownmixMonoInput(enable);
-        }
-            break;
-        case EventDownmixMonoOutput:
-        {
-            bool enable;
-            in >> enable;
-            qInfo() << TAG_IN << "Downmix output:" << enable;
-            emit obsDownmixMonoOutput(enable);
-        }
-            break;
-        case EventMuteAudioInput:
-        {
-            bool enable;
-            in >> enable;
-            qInfo() << TAG_IN << "Mute Input:" << enable;
-            emit obsMuteAudioInput(enable);
-        }
-            break;
-        case EventMuteAudioOutput:
-        {
-            bool enable;
-            in >> enable;
-            qInfo() << TAG_IN << "Mute Output:" << enable;
-            emit obsMuteAudioOutput(enable);
-        }
-            break;
-        case EventStartRecording:
-        {
-            QString path;
-            in >> path;
-            qInfo() << TAG_IN << "Start Recording:" << path;
-            emit obsStartRecording(path);
-        }
-            break;
-        case EventStopRecording:
-        {
-            bool force;
-            in >> force;
-            qInfo() << TAG_IN << "Stop Recording:" << force;
-            emit obsStopRecording(force);
-        }
-            break;
-        case EventStartStreaming:
-        {
-            QString s, k;
-            in >> s >> k;
-            qInfo() << TAG_IN << "Start Streaming:" << s << k;
-            emit obsStartStreaming(s, k);
-        }
-            break;
-        case EventStopStreaming:
-        {
-            bool force;
-            in >> force;
-            qInfo() << TAG_IN << "Stop Streaming:" << force;
-            emit obsStopStreaming(force);
-        }
-            break;
-        default:
-            break;
-        }
-
-        if (in.atEnd())
-            qDebug() << "Received Data Read End.";
-        else
-            qDebug() << "Still Some Data Not Read.";
-
-    } while (!in.atEnd());
+    // 主程序使用新格式后，回复也使用新格式
+    if (mProtocol.peerVersion() > mProtocol.sendVersion())
+        mProtocol.setSendVersion(mProtocol.peerVersion());
 }
 
-void ZDRecordingClient::sendMessageToServer(int event, int param1,
-                                            const QString &param2)
+void ZDRecordingClient::handleMessage(quint8 event, const QByteArray &payload)
 {
-    if (!mSocket->isWritable()) {
-        qWarning() << TAG_OUT << "Socket Is Not Writable.";
-        return;
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_4_0);
+
+    qDebug() << TAG_IN << "Received Event:" << event;
+
+    switch (event) {
+    case EventInitialize:
+    {
+        QString configPath, windowTitle;
+        QSize screenSize;
+        QRect cropRegion;
+        in >> configPath >> windowTitle >> screenSize >> cropRegion;
+        qInfo() << TAG_IN << "Init:" << configPath << windowTitle
+                << screenSize << cropRegion;
+        emit obsInit(configPath, windowTitle, screenSize, cropRegion);
+    }
+        break;
+    case EventScaleVideo:
+    {
+        QSize size;
+        in >> size;
+        qInfo() << TAG_IN << "Scale:" << size;
+        emit obsScaleVideo(size);
+    }
+        break;
+    case EventCropVideo:
+    {
+        QRect rect;
+        in >> rect;
+        qInfo() << TAG_IN << "Crop:" << rect;
+        emit obsCropVideo(rect);
+    }
+        break;
+    case EventUpdateVideoConfig:
+    {
+        bool cursor, compatibility;
+        in >> cursor >> compatibility;
+        qInfo() << TAG_IN << "Update Video Config:" << cursor << compatibility;
+        emit obsUpdateVideoConfig(cursor, compatibility);
+    }
+        break;
+    case EventResetAudioInput:
+    {
+        QString deviceId, deviceDesc;
+        in >> deviceId >> deviceDesc;
+        qInfo() << TAG_IN << "Reset Audio Input:" << deviceId << deviceDesc;
+        emit obsResetAudioInput(deviceId, deviceDesc);
+    }
+        break;
+    case EventResetAudioOutput:
+    {
+        QString deviceId, deviceDesc;
+        in >> deviceId >> deviceDesc;
+        qInfo() << TAG_IN << "Reset Audio Output:" << deviceId << deviceDesc;
+        emit obsResetAudioOutput(deviceId, deviceDesc);
+    }
+        break;
+    case EventDownmixMonoInput:
+    {
+        bool enable;
+        in >> enable;
+        qInfo() << TAG_IN << "Downmix Input:" << enable;
+        emit obsDownmixMonoInput(enable);
+    }
+        break;
+    case EventDownmixMonoOutput:
+    {
+        bool enable;
+        in >> enable;
+        qInfo() << TAG_IN << "Downmix output:" << enable;
+        emit obsDownmixMonoOutput(enable);
+    }
+        break;
+    case EventMuteAudioInput:
+    {
+        bool enable;
+        in >> enable;
+        qInfo() << TAG_IN << "Mute Input:" << enable;
+        emit obsMuteAudioInput(enable);
+    }
+        break;
+    case EventMuteAudioOutput:
+    {
+        bool enable;
+        in >> enable;
+        qInfo() << TAG_IN << "Mute Output:" << enable;
+        emit obsMuteAudioOutput(enable);
+    }
+        break;
+    case EventStartRecording:
+    {
+        QString path;
+        in >> path;
+        qInfo() << TAG_IN << "Start Recording:" << path;
+        emit obsStartRecording(path);
+    }
+        break;
+    case EventStopRecording:
+    {
+        bool force;
+        in >> force;
+        qInfo() << TAG_IN << "Stop Recording:" << force;
+        emit obsStopRecording(force);
+    }
+        break;
+    case EventStartStreaming:
+    {
+        QString s, k;
+        in >> s >> k;
+        qInfo() << TAG_IN << "Start Streaming:" << s << k;
+        emit obsStartStreaming(s, k);
+    }
+        break;
+    case EventStopStreaming:
+    {
+        bool force;
+        in >> force;
+        qInfo() << TAG_IN << "Stop Streaming:" << force;
+        emit obsStopStreaming(force);
+    }
+        break;
+    case EventSetRecordingRemux:
+    {
+        bool enable;
+        in >> enable;
+        qInfo() << TAG_IN << "Set Recording Remux:" << enable;
+        emit obsSetRecordingRemux(enable);
+    }
+        break;
+    case EventSetStatsInterval:
+    {
+        qint32 msec;
+        in >> msec;
+        qInfo() << TAG_IN << "Set Stats Interval:" << msec;
+        emit obsSetStatsInterval(msec);
+    }
+        break;
+    case EventSetMetricsInterval:
+    {
+        qint32 msec;
+        in >> msec;
+        qInfo() << TAG_IN << "Set Metrics Interval:" << msec;
+        emit obsSetMetricsInterval(msec);
+    }
+        break;
+    case EventDumpProfilerTrace:
+    {
+        QString path;
+        in >> path;
+        qInfo() << TAG_IN << "Dump Profiler Trace:" << path;
+        emit obsDumpProfilerTrace(path);
+    }
+        break;
+    case EventSetRecordingEncoderMode:
+    {
+        qint32 mode;
+        in >> mode;
+        qInfo() << TAG_IN << "Set Recording Encoder Mode:" << mode;
+        emit obsSetRecordingEncoderMode(mode);
+    }
+        break;
+    default:
+        break;
     }
 
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
+    if (!in.atEnd())
+        qDebug() << "Still Some Data Not Read.";
+}
+
+void ZDRecordingClient::sendMessageToServer(int event, int param1,
+                                            const QString &param2,
+                                            bool coalesce)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
     out.setVersion(QDataStream::Qt_4_0);
-    out << (quint16)0;
-    out << (quint8)event;
     if (param1 != ErrorNone)
         out << (quint8)param1;
     if (!param2.isEmpty())
         out << param2;
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
 
-    mSocket->write(block);
-    mSocket->flush();
+    queueMessageToServer(event, payload, coalesce);
+}
+
+// 同一次事件循环中的消息合并为一次写入，由事件循环异步发送，不再逐条 flush
+void ZDRecordingClient::queueMessageToServer(int event,
+                                             const QByteArray &payload,
+                                             bool coalesce)
+{
+    mProtocol.queueMessage((quint8)event, payload, coalesce);
+
+    if (!mFlushPending) {
+        mFlushPending = true;
+        QMetaObject::invokeMethod(this, "flushMessages", Qt::QueuedConnection);
+    }
+}
+
+void ZDRecordingClient::flushMessages()
+{
+    mFlushPending = false;
+
+    QByteArray frames = mProtocol.takeFrames();
+    if (frames.isEmpty())
+        return;
+
+    if (!mSocket->isWritable()) {
+        qWarning() << TAG_OUT << "Socket Is Not Writable.";
+        return;
+    }
+
+    mSocket->write(frames);
 }
 
 // OBS 回调
@@ -331,6 +410,38 @@ void ZDRecordingClient::onOBSRecordingStopped(const QString &path)
     sendMessageToServer(EventRecordingStopped, ErrorNone, path);
 }
 
+void ZDRecordingClient::onOBSRemuxProgress(int percent)
+{
+    qDebug() << TAG_OUT << "Remux Progress:" << percent;
+    sendMessageToServer(EventRemuxProgress, percent, QStringLiteral(""), true);
+}
+
+// 统计数据：[double 帧率][qint32 总帧数][qint32 丢帧数][qint32 渲染延迟帧数]
+//           [qint32 码率 kb/s][double 平均编码耗时 ms]
+void ZDRecordingClient::onOBSStatsUpdated(double fps, int totalFrames,
+                                          int droppedFrames, int laggedFrames,
+                                          int bitrate, double encodeTime)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_0);
+    out << fps << (qint32)totalFrames << (qint32)droppedFrames
+        << (qint32)laggedFrames << (qint32)bitrate << encodeTime;
+
+    queueMessageToServer(EventStats, payload, true);
+}
+
+// 指标快照：[QByteArray UTF-8 JSON]，格式见 obs util/metrics.h
+void ZDRecordingClient::onOBSMetricsUpdated(const QByteArray &json)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_0);
+    out << json;
+
+    queueMessageToServer(EventMetrics, payload, true);
+}
+
 void ZDRecordingClient::onOBSStreamingStarted()
 {
     qInfo() << TAG_OUT << "Streaming Started.";
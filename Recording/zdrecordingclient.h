@@ -18,6 +18,8 @@
 #ifndef ZDRECORDINGCLIENT_H
 #define ZDRECORDINGCLIENT_H
 
+#include "zdrecordingprotocol.h"
+
 #include <QObject>
 #include <QLocalSocket>
 class QThread;
@@ -51,6 +53,11 @@ signals:
     void obsStartStreaming(const QString &server, const QString &key);
     void obsStopStreaming(bool force);
     void obsLogStreamStats();
+    void obsSetRecordingRemux(bool enable);
+    void obsSetStatsInterval(int msec);
+    void obsSetMetricsInterval(int msec);
+    void obsDumpProfilerTrace(const QString &path);
+    void obsSetRecordingEncoderMode(int mode);
 
 private slots:
     // Socket
@@ -58,21 +65,33 @@ private slots:
     void onSocketDisconnected();
     void onSocketError(QLocalSocket::LocalSocketError socketError);
     void onSocketReadyRead();
+    void flushMessages();
 
 public slots:
     // Recording Callback -> Client
     void onOBSInitialized();
     void onOBSRecordingStarted();
     void onOBSRecordingStopped(const QString &);
+    void onOBSRemuxProgress(int percent);
+    void onOBSStatsUpdated(double fps, int totalFrames, int droppedFrames,
+                           int laggedFrames, int bitrate, double encodeTime);
+    void onOBSMetricsUpdated(const QByteArray &json);
     void onOBSStreamingStarted();
     void onOBSStreamingStopped();
     void onOBSErrorOccurred(const int, const QString &);
 
 private:
+    void handleMessage(quint8 event, const QByteArray &payload);
     void sendMessageToServer(int event, int param1 = 0,
-                             const QString &param2 = QStringLiteral(""));
+                             const QString &param2 = QStringLiteral(""),
+                             bool coalesce = false);
+    void queueMessageToServer(int event, const QByteArray &payload,
+                              bool coalesce);
 
 private:
+    ZDRecordingProtocol mProtocol;
+    bool             mFlushPending = false;
+
     QLocalSocket     *mSocket     = nullptr;
     QThread          *mOBSThread  = nullptr;
     ZDTalkOBSContext *mOBSContext = nullptr;
@@ -23,12 +23,28 @@
 #define ZDTALK_STREAMING_MAX_RETRY_TIMES   3
 #define ZDTALK_STREAMING_RETRY_INTERVAL    5
 
+// MP4 录制为分片 MP4，停止后默认转封装为普通 MP4
+#define ZDTALK_RECORDING_REMUX_DEFAULT     true
+#define ZDTALK_RECORDING_REMUX_SUFFIX      ".remux"
+
+// 性能分析常开，每个线程每 N 次调用采样一次，保留最近的调用用于导出时间线
+#define ZDTALK_PROFILER_SAMPLE_INTERVAL    10
+
+// 模块按需加载，缓存各模块提供的 source/output/encoder/service id
+#define ZDTALK_OBS_MODULE_CACHE            "module-cache.json"
+
 enum ZDRecordingOutputType
 {
     OutputMP4,
     OutputFLV
 };
 
+enum ZDRecordingEncoderMode
+{
+    EncoderStandalone,  // 录制使用 ffmpeg_output 独立编码
+    EncoderShared       // 录制复用推流的 H.264/AAC 编码器
+};
+
 enum ZDRecordingEvent
 {
     // Client To Server
@@ -54,6 +70,16 @@ enum ZDRecordingEvent
     EventStreamingStarted,
     EventStreamingStopped,
     EventErrorOccurred,
+
+    // 以下为追加事件，不能插入到上面，以保持已有事件的值不变
+    EventSetRecordingRemux,     // Client To Server
+    EventRemuxProgress,         // Server To Client，param1 为进度 1~100，100 表示已替换录制文件
+    EventSetStatsInterval,      // Client To Server，qint32 间隔毫秒，0 为停止
+    EventStats,                 // Server To Client，见 ZDRecordingClient::onOBSStatsUpdated
+    EventSetMetricsInterval,    // Client To Server，qint32 间隔毫秒，0 为停止
+    EventMetrics,               // Server To Client，QByteArray JSON，见 obs util/metrics.h
+    EventDumpProfilerTrace,     // Client To Server，QString 文件路径，Chrome trace JSON 格式
+    EventSetRecordingEncoderMode, // Client To Server，qint32 见 ZDRecordingEncoderMode
 };
 
 enum ZDRecordingErrorType
@@ -0,0 +1,223 @@
+﻿/******************************************************************************
+    Copyright (C) 2020 by Zaodao(Dalian) Education Technology Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "zdrecordingprotocol.h"
+
+#include <QIODevice>
+#include <QtEndian>
+#include <QDebug>
+
+#define LEGACY_HEADER_SIZE   2   // quint16 长度
+#define FRAME_HEADER_SIZE    7   // quint16 标记 + quint8 版本 + quint32 长度
+#define MESSAGE_HEADER_SIZE  4   // quint32 长度
+
+ZDRecordingProtocol::ZDRecordingProtocol() :
+    mReadPos(0),
+    mFrameEnd(0),
+    mPeerVersion(0),
+    mError(false),
+    mSendVersion(ZDTALK_IPC_VERSION_LEGACY)
+{
+}
+
+void ZDRecordingProtocol::reset()
+{
+    mReadBuffer.clear();
+    mReadPos = 0;
+    mFrameEnd = 0;
+    mError = false;
+}
+
+// 丢弃已经取出的消息，当前帧中剩余的消息随之前移
+void ZDRecordingProtocol::compact()
+{
+    if (mReadPos == 0)
+        return;
+
+    mReadBuffer.remove(0, mReadPos);
+    if (mFrameEnd > 0)
+        mFrameEnd -= mReadPos;
+    mReadPos = 0;
+}
+
+void ZDRecordingProtocol::append(const char *data, int size)
+{
+    compact();
+    mReadBuffer.append(data, size);
+}
+
+// 直接读入接收缓冲，省去 readAll() 的临时数据
+qint64 ZDRecordingProtocol::readFrom(QIODevice *device)
+{
+    qint64 available = device->bytesAvailable();
+    if (available <= 0)
+        return 0;
+
+    compact();
+
+    int offset = mReadBuffer.size();
+    mReadBuffer.resize(offset + (int)available);
+    qint64 ret = device->read(mReadBuffer.data() + offset, available);
+    mReadBuffer.resize(offset + (int)qMax<qint64>(ret, 0));
+    return ret;
+}
+
+bool ZDRecordingProtocol::fail(const char *reason)
+{
+    qWarning() << "IPC data invalid:" << reason;
+    mReadBuffer.clear();
+    mReadPos = 0;
+    mFrameEnd = 0;
+    mError = true;
+    return false;
+}
+
+bool ZDRecordingProtocol::readMessage(Message &msg)
+{
+    const uchar *data = reinterpret_cast<const uchar *>(mReadBuffer.constData());
+
+    if (mError)
+        return false;
+
+    for (;;) {
+        // 当前帧中的消息，帧已完整接收
+        if (mFrameEnd > 0) {
+            if (mReadPos < mFrameEnd) {
+                int left = mFrameEnd - mReadPos;
+                if (left < MESSAGE_HEADER_SIZE + 1)
+                    return fail("message header truncated");
+
+                quint32 size = qFromBigEndian<quint32>(data + mReadPos);
+                if (size < 1 || size > (quint32)(left - MESSAGE_HEADER_SIZE))
+                    return fail("message size out of frame");
+
+                const char *body = mReadBuffer.constData() + mReadPos +
+                        MESSAGE_HEADER_SIZE;
+                msg.event = (quint8)body[0];
+                msg.payload = QByteArray::fromRawData(body + 1, (int)size - 1);
+                mReadPos += MESSAGE_HEADER_SIZE + (int)size;
+                return true;
+            }
+            mFrameEnd = 0;
+        }
+
+        int available = mReadBuffer.size() - mReadPos;
+        if (available < LEGACY_HEADER_SIZE)
+            return false;
+
+        quint16 head = qFromBigEndian<quint16>(data + mReadPos);
+
+        if (head == ZDTALK_IPC_FRAME_MARKER) {
+            if (available < FRAME_HEADER_SIZE)
+                return false;
+
+            quint8 version = data[mReadPos + 2];
+            quint32 length = qFromBigEndian<quint32>(data + mReadPos + 3);
+            if (version != ZDTALK_IPC_VERSION)
+                return fail("unknown frame version");
+            if (length > ZDTALK_IPC_MAX_FRAME_SIZE)
+                return fail("frame too large");
+            if ((quint32)(available - FRAME_HEADER_SIZE) < length)
+                return false;
+
+            mPeerVersion = version;
+            mReadPos += FRAME_HEADER_SIZE;
+            mFrameEnd = mReadPos + (int)length;
+            continue;
+        }
+
+        // 旧格式
+        if (head < 1)
+            return fail("empty message");
+        if (available - LEGACY_HEADER_SIZE < head)
+            return false;
+
+        if (mPeerVersion == 0)
+            mPeerVersion = ZDTALK_IPC_VERSION_LEGACY;
+
+        const char *body = mReadBuffer.constData() + mReadPos +
+                LEGACY_HEADER_SIZE;
+        msg.event = (quint8)body[0];
+        msg.payload = QByteArray::fromRawData(body + 1, head - 1);
+        mReadPos += LEGACY_HEADER_SIZE + head;
+        return true;
+    }
+}
+
+void ZDRecordingProtocol::queueMessage(quint8 event, const QByteArray &payload,
+                                       bool coalesce)
+{
+    if (coalesce) {
+        for (PendingMessage &pending : mPending) {
+            if (pending.coalesce && pending.event == event) {
+                pending.payload = payload;
+                return;
+            }
+        }
+    }
+
+    PendingMessage pending = {event, coalesce, payload};
+    mPending.append(pending);
+}
+
+QByteArray ZDRecordingProtocol::takeFrames()
+{
+    QByteArray out;
+    uchar header[FRAME_HEADER_SIZE];
+
+    if (mPending.isEmpty())
+        return out;
+
+    if (mSendVersion == ZDTALK_IPC_VERSION_LEGACY) {
+        for (const PendingMessage &pending : mPending) {
+            int size = pending.payload.size() + 1;
+            if (size > 0xFFFE) {
+                qWarning() << "IPC message too large for legacy format:"
+                           << pending.event << size;
+                continue;
+            }
+
+            qToBigEndian<quint16>((quint16)size, header);
+            out.append(reinterpret_cast<const char *>(header),
+                       LEGACY_HEADER_SIZE);
+            out.append((char)pending.event);
+            out.append(pending.payload);
+        }
+    } else {
+        int length = 0;
+        for (const PendingMessage &pending : mPending)
+            length += MESSAGE_HEADER_SIZE + 1 + pending.payload.size();
+
+        out.reserve(FRAME_HEADER_SIZE + length);
+
+        qToBigEndian<quint16>(ZDTALK_IPC_FRAME_MARKER, header);
+        header[2] = ZDTALK_IPC_VERSION;
+        qToBigEndian<quint32>((quint32)length, header + 3);
+        out.append(reinterpret_cast<const char *>(header), FRAME_HEADER_SIZE);
+
+        for (const PendingMessage &pending : mPending) {
+            qToBigEndian<quint32>((quint32)pending.payload.size() + 1, header);
+            out.append(reinterpret_cast<const char *>(header),
+                       MESSAGE_HEADER_SIZE);
+            out.append((char)pending.event);
+            out.append(pending.payload);
+        }
+    }
+
+    mPending.clear();
+    return out;
+}
@@ -0,0 +1,97 @@
+﻿/******************************************************************************
+    Copyright (C) 2020 by Zaodao(Dalian) Education Technology Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZDRECORDINGPROTOCOL_H
+#define ZDRECORDINGPROTOCOL_H
+
+#include <QByteArray>
+#include <QVector>
+
+class QIODevice;
+
+/*
+ * 与主程序之间的 IPC 分帧，所有整数均为大端。
+ *
+ * 旧格式（版本 1）每条消息单独发送：
+ *     [quint16 长度][quint8 事件][参数]
+ * 新格式（版本 2）一帧可以包含多条消息：
+ *     [quint16 0xFFFF][quint8 版本][quint32 长度] 消息...
+ *     消息: [quint32 长度][quint8 事件][参数]
+ * 长度均不包含长度字段本身。参数为 QDataStream (Qt_4_0) 序列化的数据。
+ *
+ * 两种格式可以混合接收，收到新格式后回复也切换为新格式，
+ * 以兼容只支持旧格式的主程序。
+ */
+
+#define ZDTALK_IPC_VERSION_LEGACY   1
+#define ZDTALK_IPC_VERSION          2
+#define ZDTALK_IPC_FRAME_MARKER     0xFFFF
+#define ZDTALK_IPC_MAX_FRAME_SIZE   (16 * 1024 * 1024)
+
+class ZDRecordingProtocol
+{
+public:
+    struct Message {
+        quint8     event;
+        QByteArray payload;   // 引用接收缓冲区，下次读入数据前有效
+    };
+
+    ZDRecordingProtocol();
+
+    // 接收：读入数据后循环 readMessage() 取出所有完整的消息，
+    // 不完整的消息保留到下次读入
+    void append(const char *data, int size);
+    qint64 readFrom(QIODevice *device);
+    bool readMessage(Message &msg);
+
+    // 数据格式错误时接收缓冲被清空，需要调用 reset()
+    bool hasError() const { return mError; }
+    void reset();
+
+    // 对端使用的格式，未收到数据时为 0
+    int peerVersion() const { return mPeerVersion; }
+
+    // 发送：消息先进入队列，takeFrames() 时一次编码为待写入的数据。
+    // coalesce 为 true 的状态类消息，队列中已有的同一事件会被替换为最新的
+    void setSendVersion(int version) { mSendVersion = version; }
+    int sendVersion() const { return mSendVersion; }
+    void queueMessage(quint8 event, const QByteArray &payload,
+                      bool coalesce = false);
+    bool hasPendingMessages() const { return !mPending.isEmpty(); }
+    QByteArray takeFrames();
+
+private:
+    struct PendingMessage {
+        quint8     event;
+        bool       coalesce;
+        QByteArray payload;
+    };
+
+    void compact();
+    bool fail(const char *reason);
+
+    QByteArray mReadBuffer;
+    int        mReadPos;
+    int        mFrameEnd;     // 当前帧的结束位置，不在帧内时为 0
+    int        mPeerVersion;
+    bool       mError;
+
+    QVector<PendingMessage> mPending;
+    int                     mSendVersion;
+};
+
+#endif // ZDRECORDINGPROTOCOL_H
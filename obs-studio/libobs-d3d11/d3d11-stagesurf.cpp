@@ -40,4 +40,20 @@ gs_stage_surface::gs_stage_surface(gs_device_t *device, uint32_t width,
 	hr = device->device->CreateTexture2D(&td, NULL, texture.Assign());
 	if (FAILED(hr))
 		throw HRError("Failed to create staging surface", hr);
+
+	InitFence(device->device);
+}
+
+/* without a fence the surface is simply mapped blocking, as before */
+void gs_stage_surface::InitFence(ID3D11Device *dev)
+{
+	D3D11_QUERY_DESC qd = {};
+	qd.Query = D3D11_QUERY_EVENT;
+
+	HRESULT hr = dev->CreateQuery(&qd, fence.Assign());
+	if (FAILED(hr))
+		blog(LOG_WARNING, "gs_stage_surface: Failed to create fence "
+		                  "(%08lX)", hr);
+
+	fenceIssued = false;
 }
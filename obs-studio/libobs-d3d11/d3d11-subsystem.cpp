@@ -1321,6 +1321,11 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 
 		device->CopyTex(dst->texture, 0, 0, src, 0, 0, 0, 0);
 
+		if (dst->fence) {
+			device->context->End(dst->fence);
+			dst->fenceIssued = true;
+		}
+
 	} catch (const char *error) {
 		blog(LOG_ERROR, "device_copy_texture (D3D11): %s", error);
 	}
@@ -1906,6 +1911,21 @@ void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 	stagesurf->device->context->Unmap(stagesurf->texture, 0);
 }
 
+enum gs_stage_status gs_stagesurface_get_status(gs_stagesurf_t *stagesurf)
+{
+	/* the query couldn't be created, or nothing was staged yet */
+	if (!stagesurf->fence || !stagesurf->fenceIssued)
+		return GS_STAGE_UNKNOWN;
+
+	/* the copy was flushed by gs_flush at the end of the frame */
+	HRESULT hr = stagesurf->device->context->GetData(stagesurf->fence,
+			nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH);
+	if (FAILED(hr))
+		return GS_STAGE_UNKNOWN;
+
+	return hr == S_FALSE ? GS_STAGE_BUSY : GS_STAGE_READY;
+}
+
 
 void gs_zstencil_destroy(gs_zstencil_t *zstencil)
 {
@@ -423,15 +423,23 @@ struct gs_stage_surface : gs_obj {
 	ComPtr<ID3D11Texture2D> texture;
 	D3D11_TEXTURE2D_DESC td = {};
 
+	/* event query issued after each copy into the surface */
+	ComPtr<ID3D11Query>     fence;
+	bool                    fenceIssued = false;
+
 	uint32_t        width, height;
 	gs_color_format format;
 	DXGI_FORMAT     dxgiFormat;
 
+	void InitFence(ID3D11Device *dev);
+
 	inline void Rebuild(ID3D11Device *dev);
 
 	inline void Release()
 	{
 		texture.Release();
+		fence.Release();
+		fenceIssued = false;
 	}
 
 	gs_stage_surface(gs_device_t *device, uint32_t width, uint32_t height,
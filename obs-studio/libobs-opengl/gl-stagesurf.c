@@ -65,9 +65,36 @@ gs_stagesurf_t *device_stagesurface_create(gs_device_t *device, uint32_t width,
 	return surf;
 }
 
+static inline bool has_fences(void)
+{
+	return GLAD_GL_VERSION_3_2 || GLAD_GL_ARB_sync;
+}
+
+static inline void delete_fence(struct gs_stage_surface *surf)
+{
+	if (surf->fence) {
+		glDeleteSync(surf->fence);
+		surf->fence = NULL;
+	}
+}
+
+/* marks the end of the pixel pack so gs_stagesurface_get_status can tell when
+ * the transfer is done */
+static void insert_fence(struct gs_stage_surface *surf)
+{
+	if (!has_fences())
+		return;
+
+	delete_fence(surf);
+	surf->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	gl_success("glFenceSync");
+}
+
 void gs_stagesurface_destroy(gs_stagesurf_t *stagesurf)
 {
 	if (stagesurf) {
+		delete_fence(stagesurf);
+
 		if (stagesurf->pack_buffer)
 			gl_delete_buffers(1, &stagesurf->pack_buffer);
 
@@ -141,6 +168,7 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 	if (!gl_success("glReadPixels"))
 		goto failed_unbind_all;
 
+	insert_fence(dst);
 	success = true;
 
 failed_unbind_all:
@@ -172,6 +200,8 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 	if (!gl_success("glGetTexImage"))
 		goto failed;
 
+	insert_fence(dst);
+
 	gl_bind_texture(GL_TEXTURE_2D, 0);
 	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
 	return;
@@ -232,3 +262,22 @@ void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 
 	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
 }
+
+enum gs_stage_status gs_stagesurface_get_status(gs_stagesurf_t *stagesurf)
+{
+	GLenum result;
+
+	/* no sync objects, or nothing staged yet */
+	if (!stagesurf->fence)
+		return GS_STAGE_UNKNOWN;
+
+	/* the fence was flushed by gs_flush at the end of the frame, so a
+	 * zero timeout poll never waits */
+	result = glClientWaitSync(stagesurf->fence, 0, 0);
+	if (result == GL_WAIT_FAILED) {
+		gl_success("glClientWaitSync");
+		return GS_STAGE_UNKNOWN;
+	}
+
+	return result == GL_TIMEOUT_EXPIRED ? GS_STAGE_BUSY : GS_STAGE_READY;
+}
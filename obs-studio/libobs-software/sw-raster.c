@@ -0,0 +1,1041 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <math.h>
+#include "sw-subsystem.h"
+
+/* draws smaller than this many pixels aren't worth waking up the pool */
+#define MIN_THREADED_PIXELS (128 * 128)
+
+/* the format conversion effect's PRECISION_OFFSET */
+#define PRECISION_OFFSET 0.2f
+
+struct sw_edge {
+	float                x, y;
+	float                dxdy;
+	float                y_end;
+	bool                 left;
+};
+
+struct sw_triangle {
+	int                  y_start, y_end;
+	size_t               num_edges;
+	struct sw_edge       edges[3];
+
+	float                x0, y0;
+	struct vec4          uv0, duv_dx, duv_dy;
+	struct vec4          color0, dcolor_dx, dcolor_dy;
+};
+
+/* ------------------------------------------------------------------------- */
+/* sampling */
+
+static inline int wrap_coord(int coord, int size, enum gs_address_mode mode,
+		bool *border)
+{
+	int period;
+
+	if (coord >= 0 && coord < size)
+		return coord;
+
+	switch (mode) {
+	case GS_ADDRESS_WRAP:
+		coord %= size;
+		return coord < 0 ? coord + size : coord;
+
+	case GS_ADDRESS_MIRROR:
+		period = size * 2;
+		coord %= period;
+		if (coord < 0)
+			coord += period;
+		return coord < size ? coord : period - 1 - coord;
+
+	case GS_ADDRESS_MIRRORONCE:
+		if (coord < 0)
+			coord = -coord - 1;
+		return coord < size ? coord : size - 1;
+
+	case GS_ADDRESS_BORDER:
+		*border = true;
+		return 0;
+
+	case GS_ADDRESS_CLAMP:
+	default:
+		return coord < 0 ? 0 : size - 1;
+	}
+}
+
+static inline __m128 fetch(const struct sw_sampler *s, int x, int y)
+{
+	const struct gs_texture *tex = s->tex;
+	bool border = false;
+
+	x = wrap_coord(x, (int)tex->width,  s->ss->address_u, &border);
+	y = wrap_coord(y, (int)tex->height, s->ss->address_v, &border);
+	if (border)
+		return s->ss->border_color.m;
+
+	return tex->load(tex->data + (size_t)y * tex->linesize +
+			(size_t)x * tex->bytes_per_texel);
+}
+
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t)
+{
+	return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+/* keeps float to int conversions in range for wild texture coordinates */
+static inline float clamp_coord(float val)
+{
+	if (!(val > -16777216.0f))
+		return -16777216.0f;
+	if (val > 16777216.0f)
+		return 16777216.0f;
+	return val;
+}
+
+static __m128 sample(const struct sw_sampler *s, float u, float v)
+{
+	const struct gs_texture *tex = s->tex;
+	__m128 c00, c10, c01, c11, fx, fy;
+	float fu, fv;
+	int x, y;
+
+	if (!tex)
+		return _mm_setzero_ps();
+
+	if (s->ss->filter == GS_FILTER_POINT) {
+		x = (int)floorf(clamp_coord(u * s->width));
+		y = (int)floorf(clamp_coord(v * s->height));
+		return fetch(s, x, y);
+	}
+
+	fu = clamp_coord(u * s->width  - 0.5f);
+	fv = clamp_coord(v * s->height - 0.5f);
+	x  = (int)floorf(fu);
+	y  = (int)floorf(fv);
+	fx = _mm_set1_ps(fu - (float)x);
+	fy = _mm_set1_ps(fv - (float)y);
+
+	if (x >= 0 && y >= 0 &&
+	    x + 1 < (int)tex->width && y + 1 < (int)tex->height) {
+		const uint8_t *p0 = tex->data + (size_t)y * tex->linesize +
+			(size_t)x * tex->bytes_per_texel;
+		const uint8_t *p1 = p0 + tex->linesize;
+
+		c00 = tex->load(p0);
+		c10 = tex->load(p0 + tex->bytes_per_texel);
+		c01 = tex->load(p1);
+		c11 = tex->load(p1 + tex->bytes_per_texel);
+	} else {
+		c00 = fetch(s, x,     y);
+		c10 = fetch(s, x + 1, y);
+		c01 = fetch(s, x,     y + 1);
+		c11 = fetch(s, x + 1, y + 1);
+	}
+
+	return lerp4(lerp4(c00, c10, fx), lerp4(c01, c11, fx), fy);
+}
+
+/* Texture2D.Load: out of range texels read as zero */
+static inline __m128 load_texel(const struct sw_sampler *s, int x, int y)
+{
+	const struct gs_texture *tex = s->tex;
+
+	if (!tex || x < 0 || y < 0 ||
+	    x >= (int)tex->width || y >= (int)tex->height)
+		return _mm_setzero_ps();
+
+	return tex->load(tex->data + (size_t)y * tex->linesize +
+			(size_t)x * tex->bytes_per_texel);
+}
+
+/* ------------------------------------------------------------------------- */
+/* pixel programs, each one mirrors the HLSL function it's matched to */
+
+typedef __m128 (*sw_pixel_func_t)(const struct sw_draw *d, float u, float v,
+		__m128 color);
+
+static inline __m128 saturate(__m128 val)
+{
+	return _mm_min_ps(_mm_max_ps(val, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+}
+
+static inline __m128 set_alpha(__m128 val, float alpha)
+{
+	struct vec4 out;
+	out.m = val;
+	out.w = alpha;
+	return out.m;
+}
+
+static inline __m128 splat_alpha(__m128 val)
+{
+	return _mm_shuffle_ps(val, val, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static inline __m128 apply_color_matrix(const struct sw_draw *d, __m128 rgba)
+{
+	struct vec4 yuv;
+	__m128 out;
+
+	yuv.m = _mm_min_ps(_mm_max_ps(rgba, d->range_min.m), d->range_max.m);
+
+	out = _mm_mul_ps(_mm_set1_ps(yuv.x), d->color_cols[0].m);
+	out = _mm_add_ps(out, _mm_mul_ps(_mm_set1_ps(yuv.y),
+				d->color_cols[1].m));
+	out = _mm_add_ps(out, _mm_mul_ps(_mm_set1_ps(yuv.z),
+				d->color_cols[2].m));
+	out = _mm_add_ps(out, d->color_cols[3].m);
+	return saturate(out);
+}
+
+static __m128 ps_sample(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	UNUSED_PARAMETER(color);
+	return sample(&d->samplers[0], u, v);
+}
+
+static __m128 ps_sample_opaque(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	UNUSED_PARAMETER(color);
+	return set_alpha(sample(&d->samplers[0], u, v), 1.0f);
+}
+
+static __m128 ps_sample_unpremultiply(const struct sw_draw *d, float u,
+		float v, __m128 color)
+{
+	struct vec4 rgba;
+	rgba.m = sample(&d->samplers[0], u, v);
+
+	if (rgba.w > 0.0f)
+		rgba.m = set_alpha(_mm_div_ps(rgba.m, splat_alpha(rgba.m)),
+				rgba.w);
+
+	UNUSED_PARAMETER(color);
+	return saturate(rgba.m);
+}
+
+static __m128 ps_matrix(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	UNUSED_PARAMETER(color);
+	return apply_color_matrix(d, sample(&d->samplers[0], u, v));
+}
+
+static __m128 ps_solid(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	UNUSED_PARAMETER(u);
+	UNUSED_PARAMETER(v);
+	UNUSED_PARAMETER(color);
+	return d->color.m;
+}
+
+static __m128 ps_solid_colored(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	UNUSED_PARAMETER(u);
+	UNUSED_PARAMETER(v);
+	return _mm_mul_ps(color, d->color.m);
+}
+
+static inline float undistort_u(const struct sw_draw *d, float u)
+{
+	float a = d->undistort_factor;
+	float x = (u - 0.5f) * 2.0f;
+
+	x = (1.0f - a) * (x * x * x * x * x) + a * x;
+	return x * 0.5f + 0.5f;
+}
+
+static inline __m128 scale_pixel(const struct sw_draw *d, float u, float v,
+		bool undistort)
+{
+	if (undistort)
+		u = undistort_u(d, u);
+	return sample(&d->samplers[0], u, v);
+}
+
+static inline float bicubic_weight(float x)
+{
+	const float B = 0.0f;
+	const float C = 0.75f;
+	float ax = fabsf(x);
+
+	if (ax < 1.0f)
+		return (x * x * ((12.0f - 9.0f * B - 6.0f * C) * ax +
+					(-18.0f + 12.0f * B + 6.0f * C)) +
+				(6.0f - 2.0f * B)) / 6.0f;
+	else if (ax < 2.0f)
+		return (x * x * ((-B - 6.0f * C) * ax +
+					(6.0f * B + 30.0f * C)) +
+				(-12.0f * B - 48.0f * C) * ax +
+				(8.0f * B + 24.0f * C)) / 6.0f;
+	return 0.0f;
+}
+
+static inline void bicubic_taps(float x, float taps[4])
+{
+	float sum;
+
+	taps[0] = bicubic_weight(x - 2.0f);
+	taps[1] = bicubic_weight(x - 1.0f);
+	taps[2] = bicubic_weight(x);
+	taps[3] = bicubic_weight(x + 1.0f);
+
+	sum = taps[0] + taps[1] + taps[2] + taps[3];
+	for (size_t i = 0; i < 4; i++)
+		taps[i] /= sum;
+}
+
+static inline float frac(float val)
+{
+	return val - floorf(val);
+}
+
+static __m128 draw_bicubic(const struct sw_draw *d, float u, float v,
+		bool undistort)
+{
+	float step_x = d->base_dim_i[0];
+	float step_y = d->base_dim_i[1];
+	float pos_x  = u + step_x * 0.5f;
+	float pos_y  = v + step_y * 0.5f;
+	float f_x    = frac(pos_x / step_x);
+	float f_y    = frac(pos_y / step_y);
+	float start_x, start_y;
+	float row_taps[4], col_taps[4];
+	__m128 out = _mm_setzero_ps();
+
+	bicubic_taps(1.0f - f_x, row_taps);
+	bicubic_taps(1.0f - f_y, col_taps);
+
+	start_x = (-1.5f - f_x) * step_x + pos_x;
+	start_y = (-1.5f - f_y) * step_y + pos_y;
+
+	for (size_t j = 0; j < 4; j++) {
+		float y = start_y + step_y * (float)j;
+		__m128 line = _mm_setzero_ps();
+
+		for (size_t i = 0; i < 4; i++) {
+			float x = start_x + step_x * (float)i;
+			__m128 px = scale_pixel(d, x, y, undistort);
+			line = _mm_add_ps(line,
+					_mm_mul_ps(px, _mm_set1_ps(row_taps[i])));
+		}
+
+		out = _mm_add_ps(out, _mm_mul_ps(line, _mm_set1_ps(col_taps[j])));
+	}
+
+	return out;
+}
+
+static __m128 ps_bicubic(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	UNUSED_PARAMETER(color);
+	return draw_bicubic(d, u, v, d->args[0] != 0);
+}
+
+static __m128 ps_bicubic_matrix(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	UNUSED_PARAMETER(color);
+	return apply_color_matrix(d, draw_bicubic(d, u, v, false));
+}
+
+static inline float lanczos_weight(float x, float radius)
+{
+	const float pi = 3.1415926535897932384626433832795f;
+	float ax = fabsf(x);
+
+	if (x == 0.0f)
+		return 1.0f;
+	else if (ax < radius)
+		return (sinf(x * pi) / (x * pi)) *
+			(sinf(x / radius * pi) / (x / radius * pi));
+	return 0.0f;
+}
+
+/* the six taps in sample order (the effect interleaves two float3 sets) */
+static inline void lanczos_taps(float f, float scale, float taps[6])
+{
+	float x1 = (1.0f - f) / 2.0f;
+	float x2 = x1 + 0.5f;
+	float sum = 0.0f;
+
+	for (size_t i = 0; i < 3; i++) {
+		taps[i * 2]     = lanczos_weight(
+				(x1 * 2.0f + (float)i * 2.0f - 3.0f) * scale,
+				3.0f);
+		taps[i * 2 + 1] = lanczos_weight(
+				(x2 * 2.0f + (float)i * 2.0f - 3.0f) * scale,
+				3.0f);
+	}
+
+	for (size_t i = 0; i < 6; i++)
+		sum += taps[i];
+	for (size_t i = 0; i < 6; i++)
+		taps[i] /= sum;
+}
+
+static __m128 draw_lanczos(const struct sw_draw *d, float u, float v,
+		bool undistort)
+{
+	float step_x = d->base_dim_i[0];
+	float step_y = d->base_dim_i[1];
+	float pos_x  = u + step_x * 0.5f;
+	float pos_y  = v + step_y * 0.5f;
+	float f_x    = frac(pos_x / step_x);
+	float f_y    = frac(pos_y / step_y);
+	float start_x, start_y;
+	float row_taps[6], col_taps[6];
+	__m128 out = _mm_setzero_ps();
+
+	lanczos_taps(f_x, d->scale[0], row_taps);
+	lanczos_taps(f_y, d->scale[1], col_taps);
+
+	start_x = (-2.5f - f_x) * step_x + pos_x;
+	start_y = (-2.5f - f_y) * step_y + pos_y;
+
+	for (size_t j = 0; j < 6; j++) {
+		float y = start_y + step_y * (float)j;
+		__m128 line = _mm_setzero_ps();
+
+		for (size_t i = 0; i < 6; i++) {
+			float x = start_x + step_x * (float)i;
+			__m128 px = scale_pixel(d, x, y, undistort);
+			line = _mm_add_ps(line,
+					_mm_mul_ps(px, _mm_set1_ps(row_taps[i])));
+		}
+
+		out = _mm_add_ps(out, _mm_mul_ps(line, _mm_set1_ps(col_taps[j])));
+	}
+
+	return out;
+}
+
+static __m128 ps_lanczos(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	UNUSED_PARAMETER(color);
+	return draw_lanczos(d, u, v, d->args[0] != 0);
+}
+
+static __m128 ps_lanczos_matrix(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	UNUSED_PARAMETER(color);
+	return apply_color_matrix(d, draw_lanczos(d, u, v, false));
+}
+
+static __m128 draw_lowres(const struct sw_draw *d, float u, float v)
+{
+	float step_x = d->base_dim_i[0];
+	float step_y = d->base_dim_i[1];
+	__m128 out = _mm_setzero_ps();
+
+	for (int j = -1; j <= 1; j++) {
+		for (int i = -1; i <= 1; i++) {
+			__m128 px = sample(&d->samplers[0],
+					u + step_x * (float)i,
+					v + step_y * (float)j);
+			out = _mm_add_ps(out, px);
+		}
+	}
+
+	return _mm_div_ps(out, _mm_set1_ps(9.0f));
+}
+
+static __m128 ps_lowres(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	UNUSED_PARAMETER(color);
+	return draw_lowres(d, u, v);
+}
+
+static __m128 ps_lowres_matrix(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	UNUSED_PARAMETER(color);
+	return apply_color_matrix(d, draw_lowres(d, u, v));
+}
+
+static inline __m128 convert_pmalpha(__m128 color)
+{
+	struct vec4 c;
+	c.m = color;
+
+	if (c.w >= 0.001f)
+		return set_alpha(_mm_div_ps(c.m, splat_alpha(c.m)), c.w);
+	return _mm_setzero_ps();
+}
+
+static __m128 ps_fade(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	__m128 a = convert_pmalpha(sample(&d->samplers[0], u, v));
+	__m128 b = convert_pmalpha(sample(&d->samplers[1], u, v));
+
+	UNUSED_PARAMETER(color);
+	return lerp4(a, b, _mm_set1_ps(d->fade_val));
+}
+
+static __m128 ps_packed422_reverse(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	float odd = floorf(fmodf(d->width * u + PRECISION_OFFSET, 2.0f));
+	float x = floorf(d->width_d2 * u + PRECISION_OFFSET) * d->width_d2_i;
+	struct vec4 texel;
+
+	x += d->input_width_i_d2;
+	texel.m = sample(&d->samplers[0], x, v);
+
+	UNUSED_PARAMETER(color);
+	return _mm_setr_ps(
+			texel.ptr[odd > 0.5f ? d->args[3] : d->args[2]],
+			texel.ptr[d->args[0]],
+			texel.ptr[d->args[1]],
+			1.0f);
+}
+
+static inline float offset_color(const struct sw_draw *d, int offset)
+{
+	struct vec4 texel;
+	int width = d->int_input_width > 0 ? d->int_input_width : 1;
+
+	texel.m = load_texel(&d->samplers[0], offset % width, offset / width);
+	return texel.x;
+}
+
+static __m128 ps_planar420_reverse(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	int x = (int)(u * d->width  + PRECISION_OFFSET);
+	int y = (int)(v * d->height + PRECISION_OFFSET);
+
+	int lum_offset    = y * d->int_width + x;
+	int chroma_offset = (y / 2) * (d->int_width / 2) + x / 2;
+
+	UNUSED_PARAMETER(color);
+	return _mm_setr_ps(
+			offset_color(d, lum_offset),
+			offset_color(d, d->int_u_plane_offset + chroma_offset),
+			offset_color(d, d->int_v_plane_offset + chroma_offset),
+			1.0f);
+}
+
+static __m128 ps_nv12_reverse(const struct sw_draw *d, float u, float v,
+		__m128 color)
+{
+	int x = (int)(u * d->width  + PRECISION_OFFSET);
+	int y = (int)(v * d->height + PRECISION_OFFSET);
+
+	int lum_offset    = y * d->int_width + x;
+	int chroma_offset = (y / 2) * (d->int_width / 2) + x / 2;
+	int chroma        = d->int_u_plane_offset + chroma_offset * 2;
+
+	UNUSED_PARAMETER(color);
+	return _mm_setr_ps(
+			offset_color(d, lum_offset),
+			offset_color(d, chroma),
+			offset_color(d, chroma + 1),
+			1.0f);
+}
+
+static sw_pixel_func_t get_pixel_func(enum sw_program program)
+{
+	switch (program) {
+	case SW_PROGRAM_SAMPLE_OPAQUE:        return ps_sample_opaque;
+	case SW_PROGRAM_SAMPLE_UNPREMULTIPLY: return ps_sample_unpremultiply;
+	case SW_PROGRAM_MATRIX:               return ps_matrix;
+	case SW_PROGRAM_SOLID:                return ps_solid;
+	case SW_PROGRAM_SOLID_COLORED:        return ps_solid_colored;
+	case SW_PROGRAM_BICUBIC:              return ps_bicubic;
+	case SW_PROGRAM_BICUBIC_MATRIX:       return ps_bicubic_matrix;
+	case SW_PROGRAM_LANCZOS:              return ps_lanczos;
+	case SW_PROGRAM_LANCZOS_MATRIX:       return ps_lanczos_matrix;
+	case SW_PROGRAM_LOWRES:               return ps_lowres;
+	case SW_PROGRAM_LOWRES_MATRIX:        return ps_lowres_matrix;
+	case SW_PROGRAM_FADE:                 return ps_fade;
+	case SW_PROGRAM_PACKED422_REVERSE:    return ps_packed422_reverse;
+	case SW_PROGRAM_PLANAR420_REVERSE:    return ps_planar420_reverse;
+	case SW_PROGRAM_NV12_REVERSE:         return ps_nv12_reverse;
+	case SW_PROGRAM_SAMPLE:
+	case SW_PROGRAM_VERTEX:
+	case SW_PROGRAM_VERTEX_CROP:
+	case SW_PROGRAM_UNKNOWN:;
+	}
+
+	return ps_sample;
+}
+
+/* ------------------------------------------------------------------------- */
+/* blending */
+
+static inline __m128 blend_factor(enum gs_blend_type type, __m128 src,
+		__m128 dst)
+{
+	__m128 one = _mm_set1_ps(1.0f);
+
+	switch (type) {
+	case GS_BLEND_ZERO:        return _mm_setzero_ps();
+	case GS_BLEND_ONE:         return one;
+	case GS_BLEND_SRCCOLOR:    return src;
+	case GS_BLEND_INVSRCCOLOR: return _mm_sub_ps(one, src);
+	case GS_BLEND_SRCALPHA:    return splat_alpha(src);
+	case GS_BLEND_INVSRCALPHA: return _mm_sub_ps(one, splat_alpha(src));
+	case GS_BLEND_DSTCOLOR:    return dst;
+	case GS_BLEND_INVDSTCOLOR: return _mm_sub_ps(one, dst);
+	case GS_BLEND_DSTALPHA:    return splat_alpha(dst);
+	case GS_BLEND_INVDSTALPHA: return _mm_sub_ps(one, splat_alpha(dst));
+	case GS_BLEND_SRCALPHASAT:
+		return set_alpha(_mm_min_ps(splat_alpha(src),
+				_mm_sub_ps(one, splat_alpha(dst))), 1.0f);
+	}
+
+	return one;
+}
+
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 blend(const struct sw_draw *d, __m128 src, __m128 dst)
+{
+	const __m128 alpha_mask = _mm_castsi128_ps(
+			_mm_setr_epi32(0, 0, 0, -1));
+	__m128 fs = blend_factor(d->src_c, src, dst);
+	__m128 fd = blend_factor(d->dest_c, src, dst);
+
+	if (d->src_a != d->src_c)
+		fs = select4(alpha_mask, blend_factor(d->src_a, src, dst), fs);
+	if (d->dest_a != d->dest_c)
+		fd = select4(alpha_mask, blend_factor(d->dest_a, src, dst), fd);
+
+	return _mm_add_ps(_mm_mul_ps(src, fs), _mm_mul_ps(dst, fd));
+}
+
+/* ------------------------------------------------------------------------- */
+/* rasterization */
+
+static void draw_span(const struct sw_draw *d, sw_pixel_func_t shade,
+		const struct sw_triangle *tri, int y, int x_start, int x_end)
+{
+	gs_texture_t *target = d->target;
+	uint8_t *out = target->data + (size_t)y * target->linesize +
+		(size_t)x_start * target->bytes_per_texel;
+	float fx = (float)x_start + 0.5f - tri->x0;
+	float fy = (float)y       + 0.5f - tri->y0;
+	struct vec4 uv, color;
+
+	uv.m = _mm_add_ps(tri->uv0.m, _mm_add_ps(
+			_mm_mul_ps(tri->duv_dx.m, _mm_set1_ps(fx)),
+			_mm_mul_ps(tri->duv_dy.m, _mm_set1_ps(fy))));
+	color.m = _mm_add_ps(tri->color0.m, _mm_add_ps(
+			_mm_mul_ps(tri->dcolor_dx.m, _mm_set1_ps(fx)),
+			_mm_mul_ps(tri->dcolor_dy.m, _mm_set1_ps(fy))));
+
+	for (int x = x_start; x < x_end; x++) {
+		__m128 src = shade(d, uv.x, uv.y, color.m);
+
+		if (d->blend || !d->write_all) {
+			__m128 dst = target->load(out);
+
+			if (d->blend)
+				src = blend(d, src, dst);
+			if (!d->write_all)
+				src = select4(d->write_mask, src, dst);
+		}
+
+		target->store(out, src);
+
+		out += target->bytes_per_texel;
+		uv.m    = _mm_add_ps(uv.m, tri->duv_dx.m);
+		color.m = _mm_add_ps(color.m, tri->dcolor_dx.m);
+	}
+}
+
+static inline int row_bound(float x, int min_x, int max_x)
+{
+	x = ceilf(x - 0.5f);
+
+	if (!(x > (float)min_x))
+		return min_x;
+	if (x > (float)max_x)
+		return max_x;
+	return (int)x;
+}
+
+static void draw_triangle_rows(const struct sw_draw *d, sw_pixel_func_t shade,
+		const struct sw_triangle *tri, int start_y, int end_y)
+{
+	if (start_y < tri->y_start)
+		start_y = tri->y_start;
+	if (end_y > tri->y_end)
+		end_y = tri->y_end;
+
+	for (int y = start_y; y < end_y; y++) {
+		float py = (float)y + 0.5f;
+		int x_start = d->clip_x0;
+		int x_end   = d->clip_x1;
+
+		for (size_t i = 0; i < tri->num_edges; i++) {
+			const struct sw_edge *edge = tri->edges + i;
+			float x;
+
+			if (py < edge->y || py > edge->y_end)
+				continue;
+
+			/* left edges include pixel centers lying exactly on
+			 * them and right edges don't, so triangles sharing an
+			 * edge never both draw a pixel */
+			x = edge->x + (py - edge->y) * edge->dxdy;
+			if (edge->left) {
+				int bound = row_bound(x, d->clip_x0, d->clip_x1);
+				if (bound > x_start)
+					x_start = bound;
+			} else {
+				int bound = row_bound(x, d->clip_x0, d->clip_x1);
+				if (bound < x_end)
+					x_end = bound;
+			}
+		}
+
+		if (x_start < x_end)
+			draw_span(d, shade, tri, y, x_start, x_end);
+	}
+}
+
+static void draw_slice(void *param, uint32_t start_y, uint32_t end_y)
+{
+	const struct sw_draw *d = param;
+	sw_pixel_func_t shade = get_pixel_func(d->ps_program);
+	int y0 = d->min_y + (int)start_y;
+	int y1 = d->min_y + (int)end_y;
+
+	/* triangles are drawn in submission order for each row, which keeps
+	 * blending order the same as on the GPU */
+	for (size_t i = 0; i < d->tris.num; i++)
+		draw_triangle_rows(d, shade, d->tris.array + i, y0, y1);
+}
+
+static inline void calc_gradients(struct vec4 *d_dx, struct vec4 *d_dy,
+		const struct vec4 *a0, const struct vec4 *a1,
+		const struct vec4 *a2, float dx1, float dy1, float dx2,
+		float dy2, float inv_area)
+{
+	struct vec4 da1, da2;
+
+	vec4_sub(&da1, a1, a0);
+	vec4_sub(&da2, a2, a0);
+
+	d_dx->m = _mm_mul_ps(_mm_sub_ps(
+			_mm_mul_ps(da1.m, _mm_set1_ps(dy2)),
+			_mm_mul_ps(da2.m, _mm_set1_ps(dy1))),
+			_mm_set1_ps(inv_area));
+	d_dy->m = _mm_mul_ps(_mm_sub_ps(
+			_mm_mul_ps(da2.m, _mm_set1_ps(dx1)),
+			_mm_mul_ps(da1.m, _mm_set1_ps(dx2))),
+			_mm_set1_ps(inv_area));
+}
+
+static void add_edge(struct sw_triangle *tri, const struct vec4 *a,
+		const struct vec4 *b, const struct vec4 *opposite)
+{
+	const struct vec4 *p, *q;
+	struct sw_edge *edge;
+	float side;
+
+	/* horizontal edges are handled by the row range */
+	if (a->y == b->y)
+		return;
+
+	/* always walk the edge downwards, so that both triangles sharing it
+	 * compute exactly the same crossing points */
+	p = a->y < b->y ? a : b;
+	q = a->y < b->y ? b : a;
+
+	side = (q->x - p->x) * (opposite->y - p->y) -
+	       (q->y - p->y) * (opposite->x - p->x);
+
+	edge = tri->edges + tri->num_edges++;
+	edge->x     = p->x;
+	edge->y     = p->y;
+	edge->y_end = q->y;
+	edge->dxdy  = (q->x - p->x) / (q->y - p->y);
+	edge->left  = side < 0.0f;
+}
+
+void sw_draw_add_triangle(struct sw_draw *draw,
+		const struct sw_vertex *v0, const struct sw_vertex *v1,
+		const struct sw_vertex *v2)
+{
+	const struct vec4 *p0 = &v0->pos, *p1 = &v1->pos, *p2 = &v2->pos;
+	struct sw_triangle tri;
+	float dx1 = p1->x - p0->x, dy1 = p1->y - p0->y;
+	float dx2 = p2->x - p0->x, dy2 = p2->y - p0->y;
+	float area = dx1 * dy2 - dx2 * dy1;
+	float min_x, max_x, min_y, max_y;
+
+	if (!(fabsf(area) > 1e-8f))
+		return;
+
+	min_x = fminf(p0->x, fminf(p1->x, p2->x));
+	max_x = fmaxf(p0->x, fmaxf(p1->x, p2->x));
+	min_y = fminf(p0->y, fminf(p1->y, p2->y));
+	max_y = fmaxf(p0->y, fmaxf(p1->y, p2->y));
+
+	if (max_x <= (float)draw->clip_x0 || min_x >= (float)draw->clip_x1)
+		return;
+
+	tri.y_start = row_bound(min_y, draw->clip_y0, draw->clip_y1);
+	tri.y_end   = row_bound(max_y, draw->clip_y0, draw->clip_y1);
+	if (tri.y_start >= tri.y_end)
+		return;
+
+	tri.num_edges = 0;
+	add_edge(&tri, p0, p1, p2);
+	add_edge(&tri, p1, p2, p0);
+	add_edge(&tri, p2, p0, p1);
+
+	tri.x0 = p0->x;
+	tri.y0 = p0->y;
+	tri.uv0    = v0->uv;
+	tri.color0 = v0->color;
+	calc_gradients(&tri.duv_dx, &tri.duv_dy, &v0->uv, &v1->uv, &v2->uv,
+			dx1, dy1, dx2, dy2, 1.0f / area);
+	calc_gradients(&tri.dcolor_dx, &tri.dcolor_dy,
+			&v0->color, &v1->color, &v2->color,
+			dx1, dy1, dx2, dy2, 1.0f / area);
+
+	if (!draw->tris.num || tri.y_start < draw->min_y)
+		draw->min_y = tri.y_start;
+	if (!draw->tris.num || tri.y_end > draw->max_y)
+		draw->max_y = tri.y_end;
+
+	da_push_back(draw->tris, &tri);
+}
+
+/* ------------------------------------------------------------------------- */
+/* draw state */
+
+static inline struct gs_shader_param *get_param(gs_shader_t *shader,
+		const char *name)
+{
+	return shader ? gs_shader_get_param_by_name(shader, name) : NULL;
+}
+
+static void get_floats(gs_shader_t *shader, const char *name, float *out,
+		size_t count)
+{
+	struct gs_shader_param *param = get_param(shader, name);
+	if (param && param->cur_value.num >= count * sizeof(float))
+		memcpy(out, param->cur_value.array, count * sizeof(float));
+}
+
+static inline float get_float(gs_shader_t *shader, const char *name,
+		float def)
+{
+	get_floats(shader, name, &def, 1);
+	return def;
+}
+
+static inline int get_int(gs_shader_t *shader, const char *name)
+{
+	struct gs_shader_param *param = get_param(shader, name);
+	int val = 0;
+
+	if (param && param->cur_value.num >= sizeof(int))
+		memcpy(&val, param->cur_value.array, sizeof(int));
+	return val;
+}
+
+static void setup_samplers(gs_device_t *device, struct sw_draw *draw)
+{
+	gs_shader_t *ps = device->cur_pixel_shader;
+	size_t count = 0;
+
+	memset(draw->samplers, 0, sizeof(draw->samplers));
+
+	for (size_t i = 0; i < ps->params.num && count < 2; i++) {
+		struct gs_shader_param *param = ps->params.array + i;
+		struct sw_sampler *s = draw->samplers + count;
+		size_t id = param->sampler_id;
+
+		if (param->type != GS_SHADER_PARAM_TEXTURE)
+			continue;
+
+		if (param->next_sampler) {
+			if (id < GS_MAX_TEXTURES)
+				device->cur_samplers[id] = param->next_sampler;
+			s->ss = param->next_sampler;
+			param->next_sampler = NULL;
+		} else if (id < GS_MAX_TEXTURES && device->cur_samplers[id]) {
+			s->ss = device->cur_samplers[id];
+		} else {
+			s->ss = &device->default_sampler;
+		}
+
+		s->tex = param->texture;
+		if (s->tex) {
+			s->width  = (float)s->tex->width;
+			s->height = (float)s->tex->height;
+		}
+
+		count++;
+	}
+}
+
+static void setup_color_matrix(gs_shader_t *ps, struct sw_draw *draw)
+{
+	struct matrix4 mat, cols;
+
+	matrix4_identity(&mat);
+	get_floats(ps, "color_matrix", (float*)&mat, 16);
+
+	/* mul(float4, color_matrix) with the matrix uploaded the way libobs
+	 * does it dots each row of the matrix with the vector */
+	matrix4_transpose(&cols, &mat);
+	draw->color_cols[0] = cols.x;
+	draw->color_cols[1] = cols.y;
+	draw->color_cols[2] = cols.z;
+	draw->color_cols[3] = cols.t;
+
+	vec4_set(&draw->range_min, 0.0f, 0.0f, 0.0f, -INFINITY);
+	vec4_set(&draw->range_max, 1.0f, 1.0f, 1.0f, INFINITY);
+	get_floats(ps, "color_range_min", draw->range_min.ptr, 3);
+	get_floats(ps, "color_range_max", draw->range_max.ptr, 3);
+}
+
+/* the lanczos vertex shader's per-draw "scale" output */
+static void setup_lanczos_scale(gs_device_t *device, struct sw_draw *draw)
+{
+	struct vec4 v;
+
+	vec4_set(&v, 1.0f / draw->base_dim_i[0], 1.0f / draw->base_dim_i[1],
+			1.0f, 1.0f);
+	vec4_transform(&v, &v, &device->cur_viewproj);
+
+	draw->scale[0] = fminf(0.25f + fabsf(0.75f / v.x), 1.0f);
+	draw->scale[1] = fminf(0.25f + fabsf(0.75f / v.y), 1.0f);
+}
+
+static void setup_clip(gs_device_t *device, struct sw_draw *draw)
+{
+	struct gs_rect *vp = &device->cur_viewport;
+
+	draw->clip_x0 = vp->x > 0 ? vp->x : 0;
+	draw->clip_y0 = vp->y > 0 ? vp->y : 0;
+	draw->clip_x1 = vp->x + vp->cx;
+	draw->clip_y1 = vp->y + vp->cy;
+
+	if (device->scissor_enabled) {
+		struct gs_rect *sc = &device->cur_scissor;
+		if (sc->x > draw->clip_x0)
+			draw->clip_x0 = sc->x;
+		if (sc->y > draw->clip_y0)
+			draw->clip_y0 = sc->y;
+		if (sc->x + sc->cx < draw->clip_x1)
+			draw->clip_x1 = sc->x + sc->cx;
+		if (sc->y + sc->cy < draw->clip_y1)
+			draw->clip_y1 = sc->y + sc->cy;
+	}
+
+	if (draw->clip_x1 > (int)draw->target->width)
+		draw->clip_x1 = (int)draw->target->width;
+	if (draw->clip_y1 > (int)draw->target->height)
+		draw->clip_y1 = (int)draw->target->height;
+}
+
+void sw_draw_setup(gs_device_t *device, struct sw_draw *draw)
+{
+	gs_shader_t *vs = device->cur_vertex_shader;
+	gs_shader_t *ps = device->cur_pixel_shader;
+	bool *cw = device->color_write;
+
+	draw->tris.num   = 0;
+	draw->min_y      = 0;
+	draw->max_y      = 0;
+	draw->target     = sw_get_target(device);
+	draw->vs_program = vs->program;
+	draw->ps_program = ps->program;
+	memcpy(draw->args, ps->args, sizeof(draw->args));
+
+	setup_clip(device, draw);
+
+	draw->blend  = device->blend_enabled;
+	draw->src_c  = device->blend_src_c;
+	draw->dest_c = device->blend_dest_c;
+	draw->src_a  = device->blend_src_a;
+	draw->dest_a = device->blend_dest_a;
+
+	draw->write_all  = cw[0] && cw[1] && cw[2] && cw[3];
+	draw->write_mask = _mm_castsi128_ps(_mm_setr_epi32(
+				cw[0] ? -1 : 0, cw[1] ? -1 : 0,
+				cw[2] ? -1 : 0, cw[3] ? -1 : 0));
+
+	setup_samplers(device, draw);
+	setup_color_matrix(ps, draw);
+
+	vec4_set(&draw->color, 1.0f, 1.0f, 1.0f, 1.0f);
+	get_floats(ps, "color", draw->color.ptr, 4);
+
+	draw->base_dim_i[0] = 1.0f;
+	draw->base_dim_i[1] = 1.0f;
+	get_floats(ps, "base_dimension_i", draw->base_dim_i, 2);
+
+	draw->undistort_factor = get_float(ps, "undistort_factor", 1.0f);
+	draw->fade_val         = get_float(ps, "fade_val", 0.0f);
+
+	draw->width            = get_float(ps, "width", 0.0f);
+	draw->height           = get_float(ps, "height", 0.0f);
+	draw->width_d2         = get_float(ps, "width_d2", 0.0f);
+	draw->width_d2_i       = get_float(ps, "width_d2_i", 0.0f);
+	draw->input_width_i_d2 = get_float(ps, "input_width_i_d2", 0.0f);
+
+	draw->int_width          = get_int(ps, "int_width");
+	draw->int_input_width    = get_int(ps, "int_input_width");
+	draw->int_u_plane_offset = get_int(ps, "int_u_plane_offset");
+	draw->int_v_plane_offset = get_int(ps, "int_v_plane_offset");
+
+	if (draw->ps_program == SW_PROGRAM_LANCZOS ||
+	    draw->ps_program == SW_PROGRAM_LANCZOS_MATRIX)
+		setup_lanczos_scale(device, draw);
+}
+
+void sw_draw_run(gs_device_t *device, struct sw_draw *draw)
+{
+	video_slice_pool_t *pool = device->pool;
+	uint32_t rows, pixels;
+
+	if (!draw->tris.num)
+		return;
+
+	rows   = (uint32_t)(draw->max_y - draw->min_y);
+	pixels = rows * (uint32_t)(draw->clip_x1 - draw->clip_x0);
+	if (pixels < MIN_THREADED_PIXELS)
+		pool = NULL;
+
+	video_slice_pool_run(pool, draw_slice, draw, rows, 1);
+}
+
+void sw_draw_free(struct sw_draw *draw)
+{
+	da_free(draw->tris);
+}
@@ -0,0 +1,436 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <assert.h>
+#include <ctype.h>
+
+#include <util/dstr.h>
+#include <graphics/shader-parser.h>
+#include <graphics/vec2.h>
+#include <graphics/matrix3.h>
+#include "sw-subsystem.h"
+
+struct program_info {
+	const char      *func;
+	const char      *file; /* NULL matches any effect */
+	enum sw_program program;
+};
+
+static const struct program_info pixel_programs[] = {
+	{"PSDrawBare",                NULL, SW_PROGRAM_SAMPLE},
+	{"PSCrop",                    NULL, SW_PROGRAM_SAMPLE},
+	{"PSDrawMatrix",              NULL, SW_PROGRAM_MATRIX},
+	{"PSDraw",  "premultiplied_alpha",  SW_PROGRAM_SAMPLE_UNPREMULTIPLY},
+	{"PSDraw",                "opaque", SW_PROGRAM_SAMPLE_OPAQUE},
+	{"PSSolid",                   NULL, SW_PROGRAM_SOLID},
+	{"PSSolidColored",            NULL, SW_PROGRAM_SOLID_COLORED},
+	{"PSDrawBicubicRGBA",         NULL, SW_PROGRAM_BICUBIC},
+	{"PSDrawBicubicMatrix",       NULL, SW_PROGRAM_BICUBIC_MATRIX},
+	{"PSDrawLanczosRGBA",         NULL, SW_PROGRAM_LANCZOS},
+	{"PSDrawLanczosMatrix",       NULL, SW_PROGRAM_LANCZOS_MATRIX},
+	{"PSDrawLowresBilinearRGBA",  NULL, SW_PROGRAM_LOWRES},
+	{"PSDrawLowresBilinearMatrix",NULL, SW_PROGRAM_LOWRES_MATRIX},
+	{"PSFade",                    NULL, SW_PROGRAM_FADE},
+	{"PSPacked422_Reverse",       NULL, SW_PROGRAM_PACKED422_REVERSE},
+	{"PSPlanar420_Reverse",       NULL, SW_PROGRAM_PLANAR420_REVERSE},
+	{"PSNV12_Reverse",            NULL, SW_PROGRAM_NV12_REVERSE},
+};
+
+/* reads the trailing constant arguments of the call in main(), such as the
+ * component positions of PSPacked422_Reverse or the undistort flag of the
+ * scale effects.  the first argument is always the vertex data */
+static void parse_args(const char *call, int args[SW_MAX_PROGRAM_ARGS])
+{
+	const char *pos = strchr(call, ',');
+	size_t idx = 0;
+
+	while (pos && idx < SW_MAX_PROGRAM_ARGS) {
+		pos++;
+		while (isspace((unsigned char)*pos))
+			pos++;
+
+		if (astrcmp_n(pos, "true", 4) == 0)
+			args[idx] = 1;
+		else if (astrcmp_n(pos, "false", 5) == 0)
+			args[idx] = 0;
+		else
+			args[idx] = atoi(pos);
+
+		if (args[idx] < 0 || args[idx] > 3)
+			args[idx] = 0;
+
+		idx++;
+		pos = strchr(pos, ',');
+	}
+}
+
+enum sw_program sw_find_program(enum gs_shader_type type,
+		const char *shader_str, const char *file,
+		int args[SW_MAX_PROGRAM_ARGS])
+{
+	const char *call = strstr(shader_str, " main(");
+	struct dstr func = {0};
+	enum sw_program program = SW_PROGRAM_UNKNOWN;
+
+	memset(args, 0, sizeof(int) * SW_MAX_PROGRAM_ARGS);
+
+	if (call)
+		call = strstr(call, "return ");
+	if (!call)
+		return type == GS_SHADER_VERTEX ?
+			SW_PROGRAM_VERTEX : SW_PROGRAM_UNKNOWN;
+
+	call += 7;
+	dstr_ncopy(&func, call, strcspn(call, "( \t\r\n"));
+	parse_args(call, args);
+
+	if (type == GS_SHADER_VERTEX) {
+		program = dstr_cmp(&func, "VSCrop") == 0 ?
+			SW_PROGRAM_VERTEX_CROP : SW_PROGRAM_VERTEX;
+
+	} else {
+		for (size_t i = 0; i < sizeof(pixel_programs) /
+				sizeof(pixel_programs[0]); i++) {
+			const struct program_info *info = pixel_programs + i;
+
+			if (dstr_cmp(&func, info->func) != 0)
+				continue;
+			if (info->file && (!file || !strstr(file, info->file)))
+				continue;
+
+			program = info->program;
+			break;
+		}
+	}
+
+	if (program == SW_PROGRAM_UNKNOWN)
+		blog(LOG_WARNING, "Software renderer: %s is not supported "
+		                  "(%s), it will be drawn as a plain texture",
+		                  func.array ? func.array : "(null)",
+		                  file ? file : "(unknown)");
+
+	dstr_free(&func);
+	return program;
+}
+
+static inline void shader_param_free(struct gs_shader_param *param)
+{
+	bfree(param->name);
+	da_free(param->cur_value);
+	da_free(param->def_value);
+}
+
+/* finds the sampler state a texture is sampled with, by looking for
+ * "<texture>.Sample(<sampler>" in the shader */
+static size_t find_sampler_id(struct shader_parser *parser,
+		const char *shader_str, const char *tex_name)
+{
+	struct dstr search = {0};
+	const char *pos;
+	size_t id = (size_t)-1;
+
+	dstr_printf(&search, "%s.Sample(", tex_name);
+	pos = strstr(shader_str, search.array);
+	if (pos) {
+		pos += search.len;
+		while (isspace((unsigned char)*pos))
+			pos++;
+
+		for (size_t i = 0; i < parser->samplers.num; i++) {
+			const char *name = parser->samplers.array[i].name;
+			size_t len = strlen(name);
+
+			if (strncmp(pos, name, len) == 0 &&
+			    !isalnum((unsigned char)pos[len]) &&
+			    pos[len] != '_') {
+				id = i;
+				break;
+			}
+		}
+	}
+
+	dstr_free(&search);
+	return id;
+}
+
+static void sw_add_param(struct gs_shader *shader, struct shader_var *var,
+		struct shader_parser *parser, const char *shader_str,
+		int *texture_id)
+{
+	struct gs_shader_param param = {0};
+
+	param.array_count = var->array_count;
+	param.name        = bstrdup(var->name);
+	param.shader      = shader;
+	param.type        = get_shader_param_type(var->type);
+
+	if (param.type == GS_SHADER_PARAM_TEXTURE) {
+		param.sampler_id = find_sampler_id(parser, shader_str,
+				var->name);
+		param.texture_id = (*texture_id)++;
+	}
+
+	da_move(param.def_value, var->default_val);
+	da_copy(param.cur_value, param.def_value);
+
+	da_push_back(shader->params, &param);
+}
+
+static void sw_add_params(struct gs_shader *shader,
+		struct shader_parser *parser, const char *shader_str)
+{
+	int tex_id = 0;
+
+	for (size_t i = 0; i < parser->params.num; i++)
+		sw_add_param(shader, parser->params.array + i, parser,
+				shader_str, &tex_id);
+
+	shader->viewproj = gs_shader_get_param_by_name(shader, "ViewProj");
+	shader->world    = gs_shader_get_param_by_name(shader, "World");
+}
+
+static void sw_add_samplers(struct gs_shader *shader,
+		struct shader_parser *parser)
+{
+	for (size_t i = 0; i < parser->samplers.num; i++) {
+		struct shader_sampler *sampler = parser->samplers.array + i;
+		gs_samplerstate_t *new_sampler;
+		struct gs_sampler_info info;
+
+		shader_sampler_convert(sampler, &info);
+		new_sampler = device_samplerstate_create(shader->device, &info);
+
+		da_push_back(shader->samplers, &new_sampler);
+	}
+}
+
+static struct gs_shader *shader_create(gs_device_t *device,
+		enum gs_shader_type type, const char *shader_str,
+		const char *file, char **error_string)
+{
+	struct gs_shader *shader = bzalloc(sizeof(struct gs_shader));
+	struct shader_parser parser;
+
+	shader->device = device;
+	shader->type   = type;
+
+	shader_parser_init(&parser);
+
+	if (!shader_parse(&parser, shader_str, file)) {
+		char *errors = shader_parser_geterrors(&parser);
+		if (errors) {
+			blog(LOG_DEBUG, "Parse errors for %s:\n%s", file,
+					errors);
+			if (error_string)
+				*error_string = errors;
+			else
+				bfree(errors);
+		}
+
+		gs_shader_destroy(shader);
+		shader = NULL;
+
+	} else {
+		shader->program = sw_find_program(type, shader_str, file,
+				shader->args);
+		sw_add_params(shader, &parser, shader_str);
+		sw_add_samplers(shader, &parser);
+	}
+
+	shader_parser_free(&parser);
+	return shader;
+}
+
+gs_shader_t *device_vertexshader_create(gs_device_t *device,
+		const char *shader, const char *file,
+		char **error_string)
+{
+	struct gs_shader *ptr;
+	ptr = shader_create(device, GS_SHADER_VERTEX, shader, file,
+			error_string);
+	if (!ptr)
+		blog(LOG_ERROR, "device_vertexshader_create (software) failed");
+	return ptr;
+}
+
+gs_shader_t *device_pixelshader_create(gs_device_t *device,
+		const char *shader, const char *file,
+		char **error_string)
+{
+	struct gs_shader *ptr;
+	ptr = shader_create(device, GS_SHADER_PIXEL, shader, file,
+			error_string);
+	if (!ptr)
+		blog(LOG_ERROR, "device_pixelshader_create (software) failed");
+	return ptr;
+}
+
+void gs_shader_destroy(gs_shader_t *shader)
+{
+	size_t i;
+
+	if (!shader)
+		return;
+
+	if (shader->device->cur_vertex_shader == shader)
+		shader->device->cur_vertex_shader = NULL;
+	if (shader->device->cur_pixel_shader == shader)
+		device_load_pixelshader(shader->device, NULL);
+
+	for (i = 0; i < shader->samplers.num; i++)
+		gs_samplerstate_destroy(shader->samplers.array[i]);
+
+	for (i = 0; i < shader->params.num; i++)
+		shader_param_free(shader->params.array+i);
+
+	da_free(shader->samplers);
+	da_free(shader->params);
+	bfree(shader);
+}
+
+int gs_shader_get_num_params(const gs_shader_t *shader)
+{
+	return (int)shader->params.num;
+}
+
+gs_sparam_t *gs_shader_get_param_by_idx(gs_shader_t *shader, uint32_t param)
+{
+	assert(param < shader->params.num);
+	return shader->params.array+param;
+}
+
+gs_sparam_t *gs_shader_get_param_by_name(gs_shader_t *shader, const char *name)
+{
+	size_t i;
+	for (i = 0; i < shader->params.num; i++) {
+		struct gs_shader_param *param = shader->params.array+i;
+
+		if (strcmp(param->name, name) == 0)
+			return param;
+	}
+
+	return NULL;
+}
+
+gs_sparam_t *gs_shader_get_viewproj_matrix(const gs_shader_t *shader)
+{
+	return shader->viewproj;
+}
+
+gs_sparam_t *gs_shader_get_world_matrix(const gs_shader_t *shader)
+{
+	return shader->world;
+}
+
+void gs_shader_get_param_info(const gs_sparam_t *param,
+		struct gs_shader_param_info *info)
+{
+	info->type = param->type;
+	info->name = param->name;
+}
+
+void gs_shader_set_bool(gs_sparam_t *param, bool val)
+{
+	int int_val = val;
+	da_copy_array(param->cur_value, &int_val, sizeof(int_val));
+}
+
+void gs_shader_set_float(gs_sparam_t *param, float val)
+{
+	da_copy_array(param->cur_value, &val, sizeof(val));
+}
+
+void gs_shader_set_int(gs_sparam_t *param, int val)
+{
+	da_copy_array(param->cur_value, &val, sizeof(val));
+}
+
+void gs_shader_set_matrix3(gs_sparam_t *param, const struct matrix3 *val)
+{
+	struct matrix4 mat;
+	matrix4_from_matrix3(&mat, val);
+
+	da_copy_array(param->cur_value, &mat, sizeof(mat));
+}
+
+void gs_shader_set_matrix4(gs_sparam_t *param, const struct matrix4 *val)
+{
+	da_copy_array(param->cur_value, val, sizeof(*val));
+}
+
+void gs_shader_set_vec2(gs_sparam_t *param, const struct vec2 *val)
+{
+	da_copy_array(param->cur_value, val->ptr, sizeof(*val));
+}
+
+void gs_shader_set_vec3(gs_sparam_t *param, const struct vec3 *val)
+{
+	da_copy_array(param->cur_value, val->ptr, sizeof(*val));
+}
+
+void gs_shader_set_vec4(gs_sparam_t *param, const struct vec4 *val)
+{
+	da_copy_array(param->cur_value, val->ptr, sizeof(*val));
+}
+
+void gs_shader_set_texture(gs_sparam_t *param, gs_texture_t *val)
+{
+	param->texture = val;
+}
+
+void gs_shader_set_val(gs_sparam_t *param, const void *val, size_t size)
+{
+	int count = param->array_count;
+	size_t expected_size = 0;
+	if (!count)
+		count = 1;
+
+	switch ((uint32_t)param->type) {
+	case GS_SHADER_PARAM_FLOAT:     expected_size = sizeof(float); break;
+	case GS_SHADER_PARAM_BOOL:
+	case GS_SHADER_PARAM_INT:       expected_size = sizeof(int); break;
+	case GS_SHADER_PARAM_VEC2:      expected_size = sizeof(float)*2; break;
+	case GS_SHADER_PARAM_VEC3:      expected_size = sizeof(float)*3; break;
+	case GS_SHADER_PARAM_VEC4:      expected_size = sizeof(float)*4; break;
+	case GS_SHADER_PARAM_MATRIX4X4: expected_size = sizeof(float)*4*4;break;
+	case GS_SHADER_PARAM_TEXTURE:   expected_size = sizeof(void*); break;
+	default:                        expected_size = 0;
+	}
+
+	expected_size *= count;
+	if (!expected_size)
+		return;
+
+	if (expected_size != size) {
+		blog(LOG_ERROR, "gs_shader_set_val (software): Size of shader "
+		                "param does not match the size of the input");
+		return;
+	}
+
+	if (param->type == GS_SHADER_PARAM_TEXTURE)
+		gs_shader_set_texture(param, *(gs_texture_t**)val);
+	else
+		da_copy_array(param->cur_value, val, size);
+}
+
+void gs_shader_set_default(gs_sparam_t *param)
+{
+	gs_shader_set_val(param, param->def_value.array, param->def_value.num);
+}
+
+void gs_shader_set_next_sampler(gs_sparam_t *param, gs_samplerstate_t *sampler)
+{
+	param->next_sampler = sampler;
+}
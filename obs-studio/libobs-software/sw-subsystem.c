@@ -0,0 +1,804 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/platform.h>
+#include "sw-subsystem.h"
+
+const char *device_get_name(void)
+{
+	return "Software";
+}
+
+int device_get_type(void)
+{
+	return GS_DEVICE_SOFTWARE;
+}
+
+const char *device_preprocessor_name(void)
+{
+	return "_SOFTWARE";
+}
+
+int device_create(gs_device_t **p_device, uint32_t adapter)
+{
+	struct gs_device *device = bzalloc(sizeof(struct gs_device));
+
+	blog(LOG_INFO, "---------------------------------");
+	blog(LOG_INFO, "Initializing software renderer...");
+
+	device->pool = video_slice_pool_create(0);
+
+	device->default_sampler.device    = device;
+	device->default_sampler.ref       = 1;
+	device->default_sampler.filter    = GS_FILTER_LINEAR;
+	device->default_sampler.address_u = GS_ADDRESS_CLAMP;
+	device->default_sampler.address_v = GS_ADDRESS_CLAMP;
+
+	device->cur_cull_mode = GS_NEITHER;
+	device->blend_enabled = true;
+	device->blend_src_c   = GS_BLEND_SRCALPHA;
+	device->blend_dest_c  = GS_BLEND_INVSRCALPHA;
+	device->blend_src_a   = GS_BLEND_SRCALPHA;
+	device->blend_dest_a  = GS_BLEND_INVSRCALPHA;
+	for (size_t i = 0; i < 4; i++)
+		device->color_write[i] = true;
+
+	matrix4_identity(&device->cur_proj);
+	matrix4_identity(&device->cur_view);
+	matrix4_identity(&device->cur_viewproj);
+
+	blog(LOG_INFO, "Software renderer: drawing on %d thread(s)",
+			(int)video_slice_pool_num_threads(device->pool));
+
+	UNUSED_PARAMETER(adapter);
+
+	*p_device = device;
+	return GS_SUCCESS;
+}
+
+void device_destroy(gs_device_t *device)
+{
+	if (device) {
+		sw_draw_free(&device->draw);
+		video_slice_pool_destroy(device->pool);
+		da_free(device->verts);
+		da_free(device->proj_stack);
+		bfree(device);
+	}
+}
+
+void device_enter_context(gs_device_t *device)
+{
+	UNUSED_PARAMETER(device);
+}
+
+void device_leave_context(gs_device_t *device)
+{
+	UNUSED_PARAMETER(device);
+}
+
+/* ------------------------------------------------------------------------- */
+/* swap chains are plain BGRA textures, there is no window to present to */
+
+static bool swapchain_init_target(struct gs_swap_chain *swap)
+{
+	gs_texture_destroy(swap->target);
+	swap->target = sw_texture_create(swap->device, swap->info.cx,
+			swap->info.cy, GS_BGRA, GS_RENDER_TARGET);
+	return swap->target != NULL;
+}
+
+gs_swapchain_t *device_swapchain_create(gs_device_t *device,
+		const struct gs_init_data *info)
+{
+	struct gs_swap_chain *swap = bzalloc(sizeof(struct gs_swap_chain));
+
+	swap->device = device;
+	swap->info   = *info;
+
+	if (!swapchain_init_target(swap)) {
+		blog(LOG_ERROR, "device_swapchain_create (software) failed");
+		gs_swapchain_destroy(swap);
+		return NULL;
+	}
+
+	return swap;
+}
+
+void device_resize(gs_device_t *device, uint32_t cx, uint32_t cy)
+{
+	struct gs_swap_chain *swap = device->cur_swap;
+
+	if (!swap) {
+		blog(LOG_WARNING, "device_resize (software): No active swap");
+		return;
+	}
+
+	swap->info.cx = cx;
+	swap->info.cy = cy;
+
+	if (!swapchain_init_target(swap))
+		blog(LOG_ERROR, "device_resize (software) failed");
+}
+
+void device_get_size(const gs_device_t *device, uint32_t *cx, uint32_t *cy)
+{
+	if (device->cur_swap) {
+		*cx = device->cur_swap->info.cx;
+		*cy = device->cur_swap->info.cy;
+	} else {
+		blog(LOG_WARNING, "device_get_size (software): No active swap");
+		*cx = 0;
+		*cy = 0;
+	}
+}
+
+uint32_t device_get_width(const gs_device_t *device)
+{
+	if (device->cur_swap) {
+		return device->cur_swap->info.cx;
+	} else {
+		blog(LOG_WARNING, "device_get_width (software): No active swap");
+		return 0;
+	}
+}
+
+uint32_t device_get_height(const gs_device_t *device)
+{
+	if (device->cur_swap) {
+		return device->cur_swap->info.cy;
+	} else {
+		blog(LOG_WARNING, "device_get_height (software): No active "
+		                  "swap");
+		return 0;
+	}
+}
+
+void gs_swapchain_destroy(gs_swapchain_t *swapchain)
+{
+	if (!swapchain)
+		return;
+
+	if (swapchain->device->cur_swap == swapchain)
+		device_load_swapchain(swapchain->device, NULL);
+
+	gs_texture_destroy(swapchain->target);
+	bfree(swapchain);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* only the magnification filter matters without mipmaps */
+static inline enum gs_sample_filter convert_filter(enum gs_sample_filter filter)
+{
+	switch (filter) {
+	case GS_FILTER_POINT:
+	case GS_FILTER_MIN_MAG_POINT_MIP_LINEAR:
+	case GS_FILTER_MIN_LINEAR_MAG_MIP_POINT:
+	case GS_FILTER_MIN_LINEAR_MAG_POINT_MIP_LINEAR:
+		return GS_FILTER_POINT;
+	default:
+		return GS_FILTER_LINEAR;
+	}
+}
+
+gs_samplerstate_t *device_samplerstate_create(gs_device_t *device,
+		const struct gs_sampler_info *info)
+{
+	struct gs_sampler_state *sampler;
+
+	sampler = bzalloc(sizeof(struct gs_sampler_state));
+	sampler->device    = device;
+	sampler->ref       = 1;
+	sampler->filter    = convert_filter(info->filter);
+	sampler->address_u = info->address_u;
+	sampler->address_v = info->address_v;
+	vec4_from_rgba(&sampler->border_color, info->border_color);
+
+	return sampler;
+}
+
+void gs_samplerstate_destroy(gs_samplerstate_t *samplerstate)
+{
+	if (!samplerstate)
+		return;
+
+	if (samplerstate->device)
+		for (int i = 0; i < GS_MAX_TEXTURES; i++)
+			if (samplerstate->device->cur_samplers[i] ==
+					samplerstate)
+				samplerstate->device->cur_samplers[i] = NULL;
+
+	samplerstate_release(samplerstate);
+}
+
+enum gs_texture_type device_get_texture_type(const gs_texture_t *texture)
+{
+	return texture->type;
+}
+
+void device_load_texture(gs_device_t *device, gs_texture_t *tex, int unit)
+{
+	struct gs_shader *shader = device->cur_pixel_shader;
+
+	/* need a pixel shader to properly bind textures */
+	if (!shader) {
+		blog(LOG_ERROR, "device_load_texture (software) failed");
+		return;
+	}
+
+	device->cur_textures[unit] = tex;
+
+	for (size_t i = 0; i < shader->params.num; i++) {
+		struct gs_shader_param *param = shader->params.array + i;
+		if (param->type == GS_SHADER_PARAM_TEXTURE &&
+		    param->texture_id == unit) {
+			param->texture = tex;
+			break;
+		}
+	}
+}
+
+void device_load_samplerstate(gs_device_t *device, gs_samplerstate_t *ss,
+		int unit)
+{
+	/* need a pixel shader to properly bind samplers */
+	if (!device->cur_pixel_shader)
+		ss = NULL;
+
+	device->cur_samplers[unit] = ss;
+}
+
+void device_load_vertexshader(gs_device_t *device, gs_shader_t *vertshader)
+{
+	if (vertshader && vertshader->type != GS_SHADER_VERTEX) {
+		blog(LOG_ERROR, "Specified shader is not a vertex shader");
+		blog(LOG_ERROR, "device_load_vertexshader (software) failed");
+		return;
+	}
+
+	device->cur_vertex_shader = vertshader;
+}
+
+void device_load_pixelshader(gs_device_t *device, gs_shader_t *pixelshader)
+{
+	size_t i = 0;
+
+	if (pixelshader && pixelshader->type != GS_SHADER_PIXEL) {
+		blog(LOG_ERROR, "Specified shader is not a pixel shader");
+		blog(LOG_ERROR, "device_load_pixelshader (software) failed");
+		return;
+	}
+
+	device->cur_pixel_shader = pixelshader;
+
+	for (i = 0; i < GS_MAX_TEXTURES; i++)
+		device->cur_textures[i] = NULL;
+
+	i = 0;
+	if (pixelshader)
+		for (; i < pixelshader->samplers.num && i < GS_MAX_TEXTURES;
+				i++)
+			device->cur_samplers[i] =
+				pixelshader->samplers.array[i];
+	for (; i < GS_MAX_TEXTURES; i++)
+		device->cur_samplers[i] = NULL;
+}
+
+void device_load_default_samplerstate(gs_device_t *device, bool b_3d, int unit)
+{
+	/* TODO */
+	UNUSED_PARAMETER(device);
+	UNUSED_PARAMETER(b_3d);
+	UNUSED_PARAMETER(unit);
+}
+
+gs_shader_t *device_get_vertex_shader(const gs_device_t *device)
+{
+	return device->cur_vertex_shader;
+}
+
+gs_shader_t *device_get_pixel_shader(const gs_device_t *device)
+{
+	return device->cur_pixel_shader;
+}
+
+gs_texture_t *device_get_render_target(const gs_device_t *device)
+{
+	return device->cur_render_target;
+}
+
+gs_zstencil_t *device_get_zstencil_target(const gs_device_t *device)
+{
+	return device->cur_zstencil_buffer;
+}
+
+void device_set_render_target(gs_device_t *device, gs_texture_t *tex,
+		gs_zstencil_t *zstencil)
+{
+	if (tex && (tex->type != GS_TEXTURE_2D || !tex->is_render_target)) {
+		blog(LOG_ERROR, "Texture is not a 2D render target");
+		blog(LOG_ERROR, "device_set_render_target (software) failed");
+		return;
+	}
+
+	device->cur_render_target   = tex;
+	device->cur_zstencil_buffer = zstencil;
+}
+
+void device_set_cube_render_target(gs_device_t *device, gs_texture_t *cubetex,
+		int side, gs_zstencil_t *zstencil)
+{
+	blog(LOG_ERROR, "device_set_cube_render_target (software): Cube "
+	                "textures are not supported");
+
+	UNUSED_PARAMETER(device);
+	UNUSED_PARAMETER(cubetex);
+	UNUSED_PARAMETER(side);
+	UNUSED_PARAMETER(zstencil);
+}
+
+void device_copy_texture_region(gs_device_t *device,
+		gs_texture_t *dst, uint32_t dst_x, uint32_t dst_y,
+		gs_texture_t *src, uint32_t src_x, uint32_t src_y,
+		uint32_t src_w, uint32_t src_h)
+{
+	size_t row_size;
+
+	if (!src || !dst) {
+		blog(LOG_ERROR, "Source or destination texture is NULL");
+		goto fail;
+	}
+
+	if (src->type != GS_TEXTURE_2D || dst->type != GS_TEXTURE_2D) {
+		blog(LOG_ERROR, "Source and destination textures must be "
+		                "2D textures");
+		goto fail;
+	}
+
+	if (src->format != dst->format) {
+		blog(LOG_ERROR, "Source and destination formats do not match");
+		goto fail;
+	}
+
+	if (!src_w)
+		src_w = src->width - src_x;
+	if (!src_h)
+		src_h = src->height - src_y;
+
+	if (src_x + src_w > src->width  || src_y + src_h > src->height ||
+	    dst_x + src_w > dst->width  || dst_y + src_h > dst->height) {
+		blog(LOG_ERROR, "Copy region is out of bounds");
+		goto fail;
+	}
+
+	row_size = (size_t)src_w * src->bytes_per_texel;
+	for (uint32_t y = 0; y < src_h; y++)
+		memmove(dst->data + (size_t)(dst_y + y) * dst->linesize +
+				(size_t)dst_x * dst->bytes_per_texel,
+				src->data + (size_t)(src_y + y) * src->linesize +
+				(size_t)src_x * src->bytes_per_texel,
+				row_size);
+
+	UNUSED_PARAMETER(device);
+	return;
+
+fail:
+	blog(LOG_ERROR, "device_copy_texture_region (software) failed");
+}
+
+void device_copy_texture(gs_device_t *device, gs_texture_t *dst,
+		gs_texture_t *src)
+{
+	device_copy_texture_region(device, dst, 0, 0, src, 0, 0, 0, 0);
+}
+
+void device_begin_scene(gs_device_t *device)
+{
+	for (size_t i = 0; i < GS_MAX_TEXTURES; i++)
+		device->cur_textures[i] = NULL;
+}
+
+void device_end_scene(gs_device_t *device)
+{
+	/* does nothing */
+	UNUSED_PARAMETER(device);
+}
+
+/* ------------------------------------------------------------------------- */
+/* vertex processing */
+
+static inline bool can_render(const gs_device_t *device)
+{
+	if (!device->cur_vertex_shader) {
+		blog(LOG_ERROR, "No vertex shader specified");
+		return false;
+	}
+
+	if (!device->cur_pixel_shader) {
+		blog(LOG_ERROR, "No pixel shader specified");
+		return false;
+	}
+
+	if (!device->cur_vertex_buffer) {
+		blog(LOG_ERROR, "No vertex buffer specified");
+		return false;
+	}
+
+	if (!sw_get_target(device)) {
+		blog(LOG_ERROR, "No active swap chain or render target");
+		return false;
+	}
+
+	return true;
+}
+
+static void get_vs_vec2(gs_shader_t *vs, const char *name, float *out,
+		float def)
+{
+	struct gs_shader_param *param = gs_shader_get_param_by_name(vs, name);
+
+	out[0] = out[1] = def;
+	if (param && param->cur_value.num >= sizeof(float) * 2)
+		memcpy(out, param->cur_value.array, sizeof(float) * 2);
+}
+
+/* runs the vertex program on every vertex of the buffer and maps the result
+ * to viewport pixels, the same as the GPU's viewport transform (y down) */
+static void transform_vertices(gs_device_t *device)
+{
+	struct gs_vb_data *data = device->cur_vertex_buffer->data;
+	struct gs_tvertarray *tv = data->num_tex ? data->tvarray : NULL;
+	struct gs_rect *vp = &device->cur_viewport;
+	float mul_val[2] = {1.0f, 1.0f};
+	float add_val[2] = {0.0f, 0.0f};
+
+	gs_matrix_get(&device->cur_view);
+	matrix4_mul(&device->cur_viewproj, &device->cur_view,
+			&device->cur_proj);
+
+	if (device->cur_vertex_shader->program == SW_PROGRAM_VERTEX_CROP) {
+		get_vs_vec2(device->cur_vertex_shader, "mul_val", mul_val, 1.0f);
+		get_vs_vec2(device->cur_vertex_shader, "add_val", add_val, 0.0f);
+	}
+
+	da_resize(device->verts, data->num);
+
+	for (size_t i = 0; i < data->num; i++) {
+		struct sw_vertex *v = device->verts.array + i;
+		const struct vec3 *p = data->points + i;
+		float w_i;
+
+		vec4_set(&v->pos, p->x, p->y, p->z, 1.0f);
+		vec4_transform(&v->pos, &v->pos, &device->cur_viewproj);
+
+		w_i = v->pos.w != 0.0f ? 1.0f / v->pos.w : 1.0f;
+		v->pos.x = ( v->pos.x * w_i + 1.0f) * 0.5f * (float)vp->cx +
+			(float)vp->x;
+		v->pos.y = (-v->pos.y * w_i + 1.0f) * 0.5f * (float)vp->cy +
+			(float)vp->y;
+		v->pos.z *= w_i;
+
+		vec4_zero(&v->uv);
+		if (tv && tv->array) {
+			const float *uv = (const float*)tv->array +
+				i * tv->width;
+			v->uv.x = uv[0] * mul_val[0] + add_val[0];
+			if (tv->width > 1)
+				v->uv.y = uv[1] * mul_val[1] + add_val[1];
+		}
+
+		if (data->colors)
+			v->color.m = sw_unpack_unorm8(data->colors[i]);
+		else
+			vec4_set(&v->color, 1.0f, 1.0f, 1.0f, 1.0f);
+	}
+}
+
+static inline uint32_t get_index(const struct gs_index_buffer *ib,
+		uint32_t idx)
+{
+	if (!ib)
+		return idx;
+	if (ib->type == GS_UNSIGNED_LONG)
+		return ((const uint32_t*)ib->data)[idx];
+	return ((const uint16_t*)ib->data)[idx];
+}
+
+void device_draw(gs_device_t *device, enum gs_draw_mode draw_mode,
+		uint32_t start_vert, uint32_t num_verts)
+{
+	struct gs_index_buffer *ib = device->cur_index_buffer;
+	gs_effect_t *effect = gs_get_effect();
+	const struct sw_vertex *verts;
+	size_t max_verts;
+	uint32_t end;
+
+	if (!can_render(device))
+		goto fail;
+
+	/* lines and points are only used by editor overlays */
+	if (draw_mode != GS_TRIS && draw_mode != GS_TRISTRIP)
+		return;
+
+	if (effect)
+		gs_effect_update_params(effect);
+
+	transform_vertices(device);
+	verts     = device->verts.array;
+	max_verts = ib ? ib->num : device->verts.num;
+
+	if (num_verts == 0)
+		num_verts = (uint32_t)max_verts;
+	end = start_vert + num_verts;
+	if (end > max_verts || end < start_vert) {
+		blog(LOG_ERROR, "Draw range is out of bounds");
+		goto fail;
+	}
+
+	sw_draw_setup(device, &device->draw);
+
+	for (uint32_t i = start_vert; i + 2 < end;
+			i += draw_mode == GS_TRIS ? 3 : 1) {
+		uint32_t i0 = get_index(ib, i);
+		uint32_t i1 = get_index(ib, i + 1);
+		uint32_t i2 = get_index(ib, i + 2);
+
+		if (i0 >= device->verts.num || i1 >= device->verts.num ||
+		    i2 >= device->verts.num)
+			continue;
+
+		sw_draw_add_triangle(&device->draw,
+				verts + i0, verts + i1, verts + i2);
+	}
+
+	sw_draw_run(device, &device->draw);
+	return;
+
+fail:
+	blog(LOG_ERROR, "device_draw (software) failed");
+}
+
+/* ------------------------------------------------------------------------- */
+
+void device_load_swapchain(gs_device_t *device, gs_swapchain_t *swapchain)
+{
+	device->cur_swap = swapchain;
+	device_set_render_target(device, swapchain ? swapchain->target : NULL,
+			NULL);
+}
+
+void device_clear(gs_device_t *device, uint32_t clear_flags,
+		const struct vec4 *color, float depth, uint8_t stencil)
+{
+	gs_texture_t *target = sw_get_target(device);
+	size_t row_size;
+
+	if ((clear_flags & GS_CLEAR_COLOR) == 0 || !target)
+		return;
+
+	/* fill the first row, then copy it to the others */
+	row_size = (size_t)target->width * target->bytes_per_texel;
+	for (uint32_t x = 0; x < target->width; x++)
+		target->store(target->data + x * target->bytes_per_texel,
+				color->m);
+	for (uint32_t y = 1; y < target->height; y++)
+		memcpy(target->data + (size_t)y * target->linesize,
+				target->data, row_size);
+
+	UNUSED_PARAMETER(depth);
+	UNUSED_PARAMETER(stencil);
+}
+
+void device_present(gs_device_t *device)
+{
+	/* does nothing */
+	UNUSED_PARAMETER(device);
+}
+
+void device_flush(gs_device_t *device)
+{
+	/* draws are finished when device_draw returns */
+	UNUSED_PARAMETER(device);
+}
+
+void device_set_cull_mode(gs_device_t *device, enum gs_cull_mode mode)
+{
+	device->cur_cull_mode = mode;
+}
+
+enum gs_cull_mode device_get_cull_mode(const gs_device_t *device)
+{
+	return device->cur_cull_mode;
+}
+
+void device_enable_blending(gs_device_t *device, bool enable)
+{
+	device->blend_enabled = enable;
+}
+
+void device_enable_depth_test(gs_device_t *device, bool enable)
+{
+	UNUSED_PARAMETER(device);
+	UNUSED_PARAMETER(enable);
+}
+
+void device_enable_stencil_test(gs_device_t *device, bool enable)
+{
+	UNUSED_PARAMETER(device);
+	UNUSED_PARAMETER(enable);
+}
+
+void device_enable_stencil_write(gs_device_t *device, bool enable)
+{
+	UNUSED_PARAMETER(device);
+	UNUSED_PARAMETER(enable);
+}
+
+void device_enable_color(gs_device_t *device, bool red, bool green,
+		bool blue, bool alpha)
+{
+	device->color_write[0] = red;
+	device->color_write[1] = green;
+	device->color_write[2] = blue;
+	device->color_write[3] = alpha;
+}
+
+void device_blend_function(gs_device_t *device, enum gs_blend_type src,
+		enum gs_blend_type dest)
+{
+	device_blend_function_separate(device, src, dest, src, dest);
+}
+
+void device_blend_function_separate(gs_device_t *device,
+		enum gs_blend_type src_c, enum gs_blend_type dest_c,
+		enum gs_blend_type src_a, enum gs_blend_type dest_a)
+{
+	device->blend_src_c  = src_c;
+	device->blend_dest_c = dest_c;
+	device->blend_src_a  = src_a;
+	device->blend_dest_a = dest_a;
+}
+
+void device_depth_function(gs_device_t *device, enum gs_depth_test test)
+{
+	UNUSED_PARAMETER(device);
+	UNUSED_PARAMETER(test);
+}
+
+void device_stencil_function(gs_device_t *device, enum gs_stencil_side side,
+		enum gs_depth_test test)
+{
+	UNUSED_PARAMETER(device);
+	UNUSED_PARAMETER(side);
+	UNUSED_PARAMETER(test);
+}
+
+void device_stencil_op(gs_device_t *device, enum gs_stencil_side side,
+		enum gs_stencil_op_type fail, enum gs_stencil_op_type zfail,
+		enum gs_stencil_op_type zpass)
+{
+	UNUSED_PARAMETER(device);
+	UNUSED_PARAMETER(side);
+	UNUSED_PARAMETER(fail);
+	UNUSED_PARAMETER(zfail);
+	UNUSED_PARAMETER(zpass);
+}
+
+void device_set_viewport(gs_device_t *device, int x, int y, int width,
+		int height)
+{
+	device->cur_viewport.x  = x;
+	device->cur_viewport.y  = y;
+	device->cur_viewport.cx = width;
+	device->cur_viewport.cy = height;
+}
+
+void device_get_viewport(const gs_device_t *device, struct gs_rect *rect)
+{
+	*rect = device->cur_viewport;
+}
+
+void device_set_scissor_rect(gs_device_t *device, const struct gs_rect *rect)
+{
+	device->scissor_enabled = rect != NULL;
+	if (rect)
+		device->cur_scissor = *rect;
+}
+
+/* same as Direct3D: z maps to 0..1 and there is no flip for render
+ * targets, rows are stored top-down either way */
+void device_ortho(gs_device_t *device, float left, float right,
+		float top, float bottom, float near, float far)
+{
+	struct matrix4 *dst = &device->cur_proj;
+
+	float rml = right-left;
+	float bmt = bottom-top;
+	float fmn = far-near;
+
+	vec4_zero(&dst->x);
+	vec4_zero(&dst->y);
+	vec4_zero(&dst->z);
+	vec4_zero(&dst->t);
+
+	dst->x.x =         2.0f /  rml;
+	dst->t.x = (left+right) / -rml;
+
+	dst->y.y =         2.0f / -bmt;
+	dst->t.y = (bottom+top) /  bmt;
+
+	dst->z.z =         1.0f /  fmn;
+	dst->t.z =         near / -fmn;
+
+	dst->t.w = 1.0f;
+}
+
+void device_frustum(gs_device_t *device, float left, float right,
+		float top, float bottom, float near, float far)
+{
+	struct matrix4 *dst = &device->cur_proj;
+
+	float rml    = right-left;
+	float bmt    = bottom-top;
+	float fmn    = far-near;
+	float nearx2 = 2.0f*near;
+
+	vec4_zero(&dst->x);
+	vec4_zero(&dst->y);
+	vec4_zero(&dst->z);
+	vec4_zero(&dst->t);
+
+	dst->x.x =       nearx2 /  rml;
+	dst->z.x = (left+right) / -rml;
+
+	dst->y.y =       nearx2 / -bmt;
+	dst->z.y = (bottom+top) /  bmt;
+
+	dst->z.z =          far /  fmn;
+	dst->t.z =   (near*far) / -fmn;
+
+	dst->z.w = 1.0f;
+}
+
+void device_projection_push(gs_device_t *device)
+{
+	da_push_back(device->proj_stack, &device->cur_proj);
+}
+
+void device_projection_pop(gs_device_t *device)
+{
+	struct matrix4 *end;
+	if (!device->proj_stack.num)
+		return;
+
+	end = da_end(device->proj_stack);
+	device->cur_proj = *end;
+	da_pop_back(device->proj_stack);
+}
+
+#ifdef _WIN32
+/* there are no GDI or shared GPU textures to hand out, capture sources fall
+ * back to their copying paths */
+EXPORT bool device_gdi_texture_available(void)
+{
+	return false;
+}
+
+EXPORT bool device_shared_texture_available(void)
+{
+	return false;
+}
+#endif
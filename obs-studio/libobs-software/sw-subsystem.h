@@ -0,0 +1,313 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <emmintrin.h>
+
+#include <util/darray.h>
+#include <util/threading.h>
+#include <graphics/graphics.h>
+#include <graphics/device-exports.h>
+#include <graphics/matrix4.h>
+#include <graphics/vec4.h>
+#include <media-io/video-slice-pool.h>
+
+/*
+ * CPU graphics subsystem.  Textures live in system memory in their native
+ * format, triangles are rasterized row by row on the video slice pool, and
+ * texture sampling, blending and format packing use SSE2.
+ *
+ * There is no shader compiler: each shader is matched by the function its
+ * main() calls to one of the built-in pixel programs below, which implement
+ * the effects libobs and the ZDTalk scene pipeline use (default, opaque,
+ * solid, the scale effects, crop, fade and the async frame conversions).
+ * Anything else is drawn as a plain sample of its first texture.
+ */
+
+enum sw_program {
+	SW_PROGRAM_SAMPLE,
+	SW_PROGRAM_SAMPLE_OPAQUE,
+	SW_PROGRAM_SAMPLE_UNPREMULTIPLY,
+	SW_PROGRAM_MATRIX,
+	SW_PROGRAM_SOLID,
+	SW_PROGRAM_SOLID_COLORED,
+	SW_PROGRAM_BICUBIC,
+	SW_PROGRAM_BICUBIC_MATRIX,
+	SW_PROGRAM_LANCZOS,
+	SW_PROGRAM_LANCZOS_MATRIX,
+	SW_PROGRAM_LOWRES,
+	SW_PROGRAM_LOWRES_MATRIX,
+	SW_PROGRAM_FADE,
+	SW_PROGRAM_PACKED422_REVERSE,
+	SW_PROGRAM_PLANAR420_REVERSE,
+	SW_PROGRAM_NV12_REVERSE,
+
+	/* vertex programs */
+	SW_PROGRAM_VERTEX,
+	SW_PROGRAM_VERTEX_CROP,
+
+	SW_PROGRAM_UNKNOWN
+};
+
+#define SW_MAX_PROGRAM_ARGS 4
+
+/* ------------------------------------------------------------------------- */
+/* texel formats */
+
+typedef __m128 (*sw_load_texel_t)(const uint8_t *texel);
+typedef void (*sw_store_texel_t)(uint8_t *texel, __m128 color);
+
+static inline __m128 sw_unpack_unorm8(uint32_t val)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i i = _mm_cvtsi32_si128((int)val);
+
+	i = _mm_unpacklo_epi8(i, zero);
+	i = _mm_unpacklo_epi16(i, zero);
+	return _mm_mul_ps(_mm_cvtepi32_ps(i), _mm_set1_ps(1.0f / 255.0f));
+}
+
+static inline uint32_t sw_pack_unorm8(__m128 color)
+{
+	__m128i i;
+
+	color = _mm_min_ps(_mm_max_ps(color, _mm_setzero_ps()),
+			_mm_set1_ps(1.0f));
+	i = _mm_cvtps_epi32(_mm_mul_ps(color, _mm_set1_ps(255.0f)));
+	i = _mm_packs_epi32(i, i);
+	i = _mm_packus_epi16(i, i);
+	return (uint32_t)_mm_cvtsi128_si32(i);
+}
+
+#define SW_SWAP_RB(v) _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 1, 2))
+
+extern bool sw_get_format_funcs(enum gs_color_format format,
+		sw_load_texel_t *load, sw_store_texel_t *store);
+
+/* ------------------------------------------------------------------------- */
+
+struct gs_sampler_state {
+	gs_device_t          *device;
+	volatile long        ref;
+
+	enum gs_sample_filter filter;
+	enum gs_address_mode address_u;
+	enum gs_address_mode address_v;
+	struct vec4          border_color;
+};
+
+static inline void samplerstate_addref(gs_samplerstate_t *ss)
+{
+	os_atomic_inc_long(&ss->ref);
+}
+
+static inline void samplerstate_release(gs_samplerstate_t *ss)
+{
+	if (os_atomic_dec_long(&ss->ref) == 0)
+		bfree(ss);
+}
+
+struct gs_shader_param {
+	enum gs_shader_param_type type;
+
+	char                 *name;
+	gs_shader_t          *shader;
+	gs_samplerstate_t    *next_sampler;
+	int                  texture_id;
+	size_t               sampler_id;
+	int                  array_count;
+
+	struct gs_texture    *texture;
+
+	DARRAY(uint8_t)      cur_value;
+	DARRAY(uint8_t)      def_value;
+};
+
+struct gs_shader {
+	gs_device_t          *device;
+	enum gs_shader_type  type;
+
+	enum sw_program      program;
+	int                  args[SW_MAX_PROGRAM_ARGS];
+
+	struct gs_shader_param  *viewproj;
+	struct gs_shader_param  *world;
+
+	DARRAY(struct gs_shader_param) params;
+	DARRAY(gs_samplerstate_t*)      samplers;
+};
+
+extern enum sw_program sw_find_program(enum gs_shader_type type,
+		const char *shader_str, const char *file,
+		int args[SW_MAX_PROGRAM_ARGS]);
+
+struct gs_vertex_buffer {
+	gs_device_t          *device;
+	bool                 dynamic;
+	struct gs_vb_data    *data;
+};
+
+struct gs_index_buffer {
+	gs_device_t          *device;
+	enum gs_index_type   type;
+	void                 *data;
+	size_t               num;
+	size_t               width;
+	bool                 dynamic;
+};
+
+struct gs_texture {
+	gs_device_t          *device;
+	enum gs_texture_type type;
+	enum gs_color_format format;
+	uint32_t             width;
+	uint32_t             height;
+	uint32_t             linesize;
+	uint32_t             bytes_per_texel;
+	uint8_t              *data;
+	bool                 is_dynamic;
+	bool                 is_render_target;
+
+	sw_load_texel_t      load;
+	sw_store_texel_t     store;
+};
+
+struct gs_stage_surface {
+	gs_device_t          *device;
+	enum gs_color_format format;
+	uint32_t             width;
+	uint32_t             height;
+	uint32_t             linesize;
+	uint8_t              *data;
+};
+
+struct gs_zstencil_buffer {
+	gs_device_t             *device;
+	enum gs_zstencil_format format;
+	uint32_t                width;
+	uint32_t                height;
+};
+
+struct gs_swap_chain {
+	gs_device_t          *device;
+	struct gs_init_data  info;
+	gs_texture_t         *target;
+};
+
+extern gs_texture_t *sw_texture_create(gs_device_t *device, uint32_t width,
+		uint32_t height, enum gs_color_format color_format,
+		uint32_t flags);
+
+/* ------------------------------------------------------------------------- */
+/* rasterizer */
+
+/* a vertex after the vertex program, in screen space */
+struct sw_vertex {
+	struct vec4          pos;
+	struct vec4          uv;
+	struct vec4          color;
+};
+
+struct sw_sampler {
+	const struct gs_texture       *tex;
+	const struct gs_sampler_state *ss;
+	float                         width, height;
+};
+
+struct sw_draw {
+	gs_texture_t         *target;
+	int                  clip_x0, clip_y0, clip_x1, clip_y1;
+
+	enum sw_program      vs_program;
+	enum sw_program      ps_program;
+	int                  args[SW_MAX_PROGRAM_ARGS];
+
+	bool                 blend;
+	enum gs_blend_type   src_c, dest_c, src_a, dest_a;
+	__m128               write_mask;
+	bool                 write_all;
+
+	/* pixel program constants */
+	struct sw_sampler    samplers[2];
+	struct vec4          color_cols[4];
+	struct vec4          range_min;
+	struct vec4          range_max;
+	struct vec4          color;
+	float                base_dim_i[2];
+	float                scale[2];
+	float                undistort_factor;
+	float                fade_val;
+	float                width, height, width_d2, width_d2_i;
+	float                input_width_i_d2;
+	int                  int_width, int_input_width;
+	int                  int_u_plane_offset, int_v_plane_offset;
+
+	/* screen space triangles */
+	DARRAY(struct sw_triangle) tris;
+	int                  min_y, max_y;
+};
+
+extern void sw_draw_setup(gs_device_t *device, struct sw_draw *draw);
+extern void sw_draw_add_triangle(struct sw_draw *draw,
+		const struct sw_vertex *v0, const struct sw_vertex *v1,
+		const struct sw_vertex *v2);
+extern void sw_draw_run(gs_device_t *device, struct sw_draw *draw);
+extern void sw_draw_free(struct sw_draw *draw);
+
+struct gs_device {
+	gs_texture_t         *cur_render_target;
+	gs_zstencil_t        *cur_zstencil_buffer;
+	gs_texture_t         *cur_textures[GS_MAX_TEXTURES];
+	gs_samplerstate_t    *cur_samplers[GS_MAX_TEXTURES];
+	gs_vertbuffer_t      *cur_vertex_buffer;
+	gs_indexbuffer_t     *cur_index_buffer;
+	gs_shader_t          *cur_vertex_shader;
+	gs_shader_t          *cur_pixel_shader;
+	gs_swapchain_t       *cur_swap;
+
+	enum gs_cull_mode    cur_cull_mode;
+	struct gs_rect       cur_viewport;
+	struct gs_rect       cur_scissor;
+	bool                 scissor_enabled;
+
+	bool                 blend_enabled;
+	enum gs_blend_type   blend_src_c;
+	enum gs_blend_type   blend_dest_c;
+	enum gs_blend_type   blend_src_a;
+	enum gs_blend_type   blend_dest_a;
+	bool                 color_write[4];
+
+	struct matrix4       cur_proj;
+	struct matrix4       cur_view;
+	struct matrix4       cur_viewproj;
+
+	DARRAY(struct matrix4) proj_stack;
+
+	/* rows of a draw are split across this pool */
+	video_slice_pool_t   *pool;
+	struct gs_sampler_state default_sampler;
+
+	/* reused between draws */
+	struct sw_draw       draw;
+	DARRAY(struct sw_vertex) verts;
+};
+
+static inline gs_texture_t *sw_get_target(const gs_device_t *device)
+{
+	if (device->cur_render_target)
+		return device->cur_render_target;
+	return device->cur_swap ? device->cur_swap->target : NULL;
+}
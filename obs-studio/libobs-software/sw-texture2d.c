@@ -0,0 +1,361 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "sw-subsystem.h"
+
+#define LINE_ALIGN 16
+
+/* ------------------------------------------------------------------------- */
+/* texel formats, single channel formats read as (r, 0, 0, 1) and alpha only
+ * formats as (0, 0, 0, a), the same as Direct3D */
+
+static __m128 load_a8(const uint8_t *texel)
+{
+	return _mm_setr_ps(0.0f, 0.0f, 0.0f, (float)*texel / 255.0f);
+}
+
+static void store_a8(uint8_t *texel, __m128 color)
+{
+	*texel = (uint8_t)(sw_pack_unorm8(color) >> 24);
+}
+
+static __m128 load_r8(const uint8_t *texel)
+{
+	return _mm_setr_ps((float)*texel / 255.0f, 0.0f, 0.0f, 1.0f);
+}
+
+static void store_r8(uint8_t *texel, __m128 color)
+{
+	*texel = (uint8_t)sw_pack_unorm8(color);
+}
+
+static __m128 load_r16(const uint8_t *texel)
+{
+	uint16_t val;
+	memcpy(&val, texel, sizeof(val));
+	return _mm_setr_ps((float)val / 65535.0f, 0.0f, 0.0f, 1.0f);
+}
+
+static void store_r16(uint8_t *texel, __m128 color)
+{
+	float r = _mm_cvtss_f32(color);
+	uint16_t val;
+
+	r = r < 0.0f ? 0.0f : (r > 1.0f ? 1.0f : r);
+	val = (uint16_t)(r * 65535.0f + 0.5f);
+	memcpy(texel, &val, sizeof(val));
+}
+
+static __m128 load_rgba(const uint8_t *texel)
+{
+	uint32_t val;
+	memcpy(&val, texel, sizeof(val));
+	return sw_unpack_unorm8(val);
+}
+
+static void store_rgba(uint8_t *texel, __m128 color)
+{
+	uint32_t val = sw_pack_unorm8(color);
+	memcpy(texel, &val, sizeof(val));
+}
+
+static __m128 load_bgra(const uint8_t *texel)
+{
+	__m128 color = load_rgba(texel);
+	return SW_SWAP_RB(color);
+}
+
+static void store_bgra(uint8_t *texel, __m128 color)
+{
+	store_rgba(texel, SW_SWAP_RB(color));
+}
+
+static __m128 load_bgrx(const uint8_t *texel)
+{
+	uint32_t val;
+	__m128 color;
+
+	memcpy(&val, texel, sizeof(val));
+	color = sw_unpack_unorm8(val | 0xFF000000);
+	return SW_SWAP_RB(color);
+}
+
+static void store_bgrx(uint8_t *texel, __m128 color)
+{
+	uint32_t val = sw_pack_unorm8(SW_SWAP_RB(color)) | 0xFF000000;
+	memcpy(texel, &val, sizeof(val));
+}
+
+static __m128 load_r32f(const uint8_t *texel)
+{
+	float val;
+	memcpy(&val, texel, sizeof(val));
+	return _mm_setr_ps(val, 0.0f, 0.0f, 1.0f);
+}
+
+static void store_r32f(uint8_t *texel, __m128 color)
+{
+	float val = _mm_cvtss_f32(color);
+	memcpy(texel, &val, sizeof(val));
+}
+
+static __m128 load_rgba32f(const uint8_t *texel)
+{
+	return _mm_loadu_ps((const float*)texel);
+}
+
+static void store_rgba32f(uint8_t *texel, __m128 color)
+{
+	_mm_storeu_ps((float*)texel, color);
+}
+
+bool sw_get_format_funcs(enum gs_color_format format,
+		sw_load_texel_t *load, sw_store_texel_t *store)
+{
+	switch (format) {
+	case GS_A8:      *load = load_a8;      *store = store_a8;      break;
+	case GS_R8:      *load = load_r8;      *store = store_r8;      break;
+	case GS_R16:     *load = load_r16;     *store = store_r16;     break;
+	case GS_RGBA:    *load = load_rgba;    *store = store_rgba;    break;
+	case GS_BGRA:    *load = load_bgra;    *store = store_bgra;    break;
+	case GS_BGRX:    *load = load_bgrx;    *store = store_bgrx;    break;
+	case GS_R32F:    *load = load_r32f;    *store = store_r32f;    break;
+	case GS_RGBA32F: *load = load_rgba32f; *store = store_rgba32f; break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+gs_texture_t *sw_texture_create(gs_device_t *device, uint32_t width,
+		uint32_t height, enum gs_color_format color_format,
+		uint32_t flags)
+{
+	struct gs_texture *tex;
+
+	if (!width || !height) {
+		blog(LOG_ERROR, "Invalid texture size %ux%u", width, height);
+		return NULL;
+	}
+
+	tex = bzalloc(sizeof(struct gs_texture));
+	if (!sw_get_format_funcs(color_format, &tex->load, &tex->store)) {
+		blog(LOG_ERROR, "Texture format %d is not supported by the "
+		                "software renderer", (int)color_format);
+		bfree(tex);
+		return NULL;
+	}
+
+	tex->device           = device;
+	tex->type             = GS_TEXTURE_2D;
+	tex->format           = color_format;
+	tex->width            = width;
+	tex->height           = height;
+	tex->bytes_per_texel  = gs_get_format_bpp(color_format) / 8;
+	tex->linesize         = (width * tex->bytes_per_texel + LINE_ALIGN - 1) &
+		~(LINE_ALIGN - 1);
+	tex->is_dynamic       = (flags & GS_DYNAMIC) != 0;
+	tex->is_render_target = (flags & GS_RENDER_TARGET) != 0;
+	tex->data             = bzalloc((size_t)tex->linesize * height);
+
+	return tex;
+}
+
+gs_texture_t *device_texture_create(gs_device_t *device, uint32_t width,
+		uint32_t height, enum gs_color_format color_format,
+		uint32_t levels, const uint8_t **data, uint32_t flags)
+{
+	struct gs_texture *tex;
+
+	/* only the top level is kept, the software renderer samples
+	 * without mipmaps */
+	tex = sw_texture_create(device, width, height, color_format, flags);
+	if (!tex) {
+		blog(LOG_ERROR, "device_texture_create (software) failed");
+		return NULL;
+	}
+
+	if (data && *data) {
+		uint32_t row_size = width * tex->bytes_per_texel;
+
+		for (uint32_t y = 0; y < height; y++)
+			memcpy(tex->data + (size_t)y * tex->linesize,
+					*data + (size_t)y * row_size, row_size);
+	}
+
+	UNUSED_PARAMETER(levels);
+	return tex;
+}
+
+static inline bool is_texture_2d(const gs_texture_t *tex, const char *func)
+{
+	bool is_tex2d = tex->type == GS_TEXTURE_2D;
+	if (!is_tex2d)
+		blog(LOG_ERROR, "%s (software): Texture is not a 2D texture",
+				func);
+	return is_tex2d;
+}
+
+void gs_texture_destroy(gs_texture_t *tex)
+{
+	if (!tex)
+		return;
+
+	for (size_t i = 0; i < GS_MAX_TEXTURES; i++)
+		if (tex->device->cur_textures[i] == tex)
+			tex->device->cur_textures[i] = NULL;
+	if (tex->device->cur_render_target == tex)
+		tex->device->cur_render_target = NULL;
+
+	bfree(tex->data);
+	bfree(tex);
+}
+
+uint32_t gs_texture_get_width(const gs_texture_t *tex)
+{
+	if (!is_texture_2d(tex, "gs_texture_get_width"))
+		return 0;
+	return tex->width;
+}
+
+uint32_t gs_texture_get_height(const gs_texture_t *tex)
+{
+	if (!is_texture_2d(tex, "gs_texture_get_height"))
+		return 0;
+	return tex->height;
+}
+
+enum gs_color_format gs_texture_get_color_format(const gs_texture_t *tex)
+{
+	return tex->format;
+}
+
+bool gs_texture_map(gs_texture_t *tex, uint8_t **ptr, uint32_t *linesize)
+{
+	if (!is_texture_2d(tex, "gs_texture_map"))
+		return false;
+
+	if (!tex->is_dynamic) {
+		blog(LOG_ERROR, "gs_texture_map (software): Texture is not "
+		                "dynamic");
+		return false;
+	}
+
+	*ptr      = tex->data;
+	*linesize = tex->linesize;
+	return true;
+}
+
+void gs_texture_unmap(gs_texture_t *tex)
+{
+	UNUSED_PARAMETER(tex);
+}
+
+bool gs_texture_is_rect(const gs_texture_t *tex)
+{
+	UNUSED_PARAMETER(tex);
+	return false;
+}
+
+void *gs_texture_get_obj(gs_texture_t *tex)
+{
+	return tex->data;
+}
+
+/* ------------------------------------------------------------------------- */
+/* cube and volume textures aren't used by the scene pipeline */
+
+gs_texture_t *device_cubetexture_create(gs_device_t *device, uint32_t size,
+		enum gs_color_format color_format, uint32_t levels,
+		const uint8_t **data, uint32_t flags)
+{
+	blog(LOG_ERROR, "device_cubetexture_create (software): Cube textures "
+	                "are not supported");
+
+	UNUSED_PARAMETER(device);
+	UNUSED_PARAMETER(size);
+	UNUSED_PARAMETER(color_format);
+	UNUSED_PARAMETER(levels);
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(flags);
+	return NULL;
+}
+
+void gs_cubetexture_destroy(gs_texture_t *cubetex)
+{
+	UNUSED_PARAMETER(cubetex);
+}
+
+uint32_t gs_cubetexture_get_size(const gs_texture_t *cubetex)
+{
+	UNUSED_PARAMETER(cubetex);
+	return 0;
+}
+
+enum gs_color_format gs_cubetexture_get_color_format(
+		const gs_texture_t *cubetex)
+{
+	UNUSED_PARAMETER(cubetex);
+	return GS_UNKNOWN;
+}
+
+gs_texture_t *device_voltexture_create(gs_device_t *device, uint32_t width,
+		uint32_t height, uint32_t depth,
+		enum gs_color_format color_format, uint32_t levels,
+		const uint8_t **data, uint32_t flags)
+{
+	/* TODO */
+	UNUSED_PARAMETER(device);
+	UNUSED_PARAMETER(width);
+	UNUSED_PARAMETER(height);
+	UNUSED_PARAMETER(depth);
+	UNUSED_PARAMETER(color_format);
+	UNUSED_PARAMETER(levels);
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(flags);
+	return NULL;
+}
+
+void gs_voltexture_destroy(gs_texture_t *voltex)
+{
+	UNUSED_PARAMETER(voltex);
+}
+
+uint32_t gs_voltexture_get_width(const gs_texture_t *voltex)
+{
+	UNUSED_PARAMETER(voltex);
+	return 0;
+}
+
+uint32_t gs_voltexture_get_height(const gs_texture_t *voltex)
+{
+	UNUSED_PARAMETER(voltex);
+	return 0;
+}
+
+uint32_t gs_voltexture_get_depth(const gs_texture_t *voltex)
+{
+	UNUSED_PARAMETER(voltex);
+	return 0;
+}
+
+enum gs_color_format gs_voltexture_get_color_format(const gs_texture_t *voltex)
+{
+	UNUSED_PARAMETER(voltex);
+	return GS_UNKNOWN;
+}
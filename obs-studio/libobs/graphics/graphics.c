@@ -2390,6 +2390,20 @@ void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 	graphics->exports.gs_stagesurface_unmap(stagesurf);
 }
 
+enum gs_stage_status gs_stagesurface_get_status(gs_stagesurf_t *stagesurf)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid_p("gs_stagesurface_get_status", stagesurf))
+		return GS_STAGE_UNKNOWN;
+
+	/* without fences, mapping is the only way to find out */
+	if (!graphics->exports.gs_stagesurface_get_status)
+		return GS_STAGE_UNKNOWN;
+
+	return graphics->exports.gs_stagesurface_get_status(stagesurf);
+}
+
 void gs_zstencil_destroy(gs_zstencil_t *zstencil)
 {
 	if (!gs_valid("gs_zstencil_destroy"))
@@ -168,6 +168,12 @@ enum gs_texture_type {
 	GS_TEXTURE_CUBE
 };
 
+enum gs_stage_status {
+	GS_STAGE_UNKNOWN,
+	GS_STAGE_BUSY,
+	GS_STAGE_READY
+};
+
 struct gs_monitor_info {
 	int rotation_degrees;
 	long x;
@@ -451,6 +457,7 @@ struct gs_init_data {
 
 #define GS_DEVICE_OPENGL      1
 #define GS_DEVICE_DIRECT3D_11 2
+#define GS_DEVICE_SOFTWARE    3
 
 EXPORT const char *gs_get_device_name(void);
 EXPORT int gs_get_device_type(void);
@@ -710,6 +717,15 @@ EXPORT bool     gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
 		uint32_t *linesize);
 EXPORT void     gs_stagesurface_unmap(gs_stagesurf_t *stagesurf);
 
+/**
+ * Returns whether the last gs_stage_texture into the surface has finished
+ * on the GPU (GS_STAGE_READY, mapping it will not block) or not
+ * (GS_STAGE_BUSY).  Modules or drivers that can't tell return
+ * GS_STAGE_UNKNOWN.
+ */
+EXPORT enum gs_stage_status gs_stagesurface_get_status(
+		gs_stagesurf_t *stagesurf);
+
 EXPORT void     gs_zstencil_destroy(gs_zstencil_t *zstencil);
 
 EXPORT void     gs_samplerstate_destroy(gs_samplerstate_t *samplerstate);
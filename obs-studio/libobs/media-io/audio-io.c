@@ -17,12 +17,14 @@
 
 #include <math.h>
 #include <inttypes.h>
+#include <xmmintrin.h>
 
 #include "../util/threading.h"
 #include "../util/darray.h"
 #include "../util/circlebuf.h"
 #include "../util/platform.h"
 #include "../util/profiler.h"
+#include "../util/metrics.h"
 
 #include "audio-io.h"
 #include "audio-resampler.h"
@@ -66,6 +68,9 @@ struct audio_output {
 	void                       *input_param;
 	pthread_mutex_t            input_mutex;
 	struct audio_mix           mixes[MAX_AUDIO_MIXES];
+
+	/* time taken by each tick of the audio thread */
+	metrics_histogram_t        *tick_metric;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -164,26 +169,36 @@ static inline void do_audio_output(struct audio_output *audio,
 	pthread_mutex_unlock(&audio->input_mutex);
 }
 
-static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
+static inline void clamp_audio_output(struct audio_output *audio,
+		uint32_t active_mixes, size_t bytes)
 {
 	size_t float_size = bytes / sizeof(float);
+	__m128 min_val = _mm_set1_ps(-1.0f);
+	__m128 max_val = _mm_set1_ps(1.0f);
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
 		/* do not process mixing if a specific mix is inactive */
-		if (!mix->inputs.num)
+		if ((active_mixes & (1 << mix_idx)) == 0)
 			continue;
 
 		for (size_t plane = 0; plane < audio->planes; plane++) {
 			float *mix_data = mix->buffer[plane];
-			float *mix_end = &mix_data[float_size];
+			size_t i = 0;
+
+			for (; i + 4 <= float_size; i += 4) {
+				__m128 val = _mm_loadu_ps(mix_data + i);
+				val = _mm_min_ps(_mm_max_ps(val, min_val),
+						max_val);
+				_mm_storeu_ps(mix_data + i, val);
+			}
 
-			while (mix_data < mix_end) {
-				float val = *mix_data;
+			for (; i < float_size; i++) {
+				float val = mix_data[i];
 				val = (val >  1.0f) ?  1.0f : val;
 				val = (val < -1.0f) ? -1.0f : val;
-				*(mix_data++) = val;
+				mix_data[i] = val;
 			}
 		}
 	}
@@ -213,12 +228,17 @@ static void input_and_output(struct audio_output *audio,
 	}
 	pthread_mutex_unlock(&audio->input_mutex);
 
-	/* clear mix buffers */
+	/* clear mix buffers.  mixes without outputs are left alone: they are
+	 * not rendered into, clamped or output this tick, and an output that
+	 * connects in the meantime gets its first data next tick */
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
+		if ((active_mixes & (1 << mix_idx)) == 0)
+			continue;
+
 		memset(mix->buffer[0], 0, AUDIO_OUTPUT_FRAMES *
-				MAX_AUDIO_CHANNELS * sizeof(float));
+				audio->planes * sizeof(float));
 
 		for (size_t i = 0; i < audio->planes; i++)
 			data[mix_idx].data[i] = mix->buffer[i];
@@ -231,11 +251,13 @@ static void input_and_output(struct audio_output *audio,
 		return;
 
 	/* clamps audio data to -1.0..1.0 */
-	clamp_audio_output(audio, bytes);
+	clamp_audio_output(audio, active_mixes, bytes);
 
 	/* output */
-	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
-		do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		if ((active_mixes & (1 << i)) != 0)
+			do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+	}
 }
 
 static void *audio_thread(void *param)
@@ -265,12 +287,17 @@ static void *audio_thread(void *param)
 
 		cur_time = os_gettime_ns();
 		while (audio_time <= cur_time) {
+			uint64_t tick_start = os_gettime_ns();
+
 			samples += AUDIO_OUTPUT_FRAMES;
 			audio_time = start_time +
 				audio_frames_to_ns(rate, samples);
 
 			input_and_output(audio, audio_time, prev_time);
 			prev_time = audio_time;
+
+			metrics_histogram_record(audio->tick_metric,
+					os_gettime_ns() - tick_start);
 		}
 
 		profile_end(audio_thread_name);
@@ -415,6 +442,7 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 	out->input_param= info->input_param;
 	out->block_size = (planar ? 1 : out->channels) *
 	                  get_audio_bytes_per_channel(info->format);
+	out->tick_metric = metrics_histogram_get("audio.tick");
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		goto fail;
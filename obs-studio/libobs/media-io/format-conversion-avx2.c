@@ -0,0 +1,261 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/* AVX2 conversion kernels, 32 pixels per iteration.  This file must be
+ * compiled with AVX2 enabled, and is only called if the CPU and the OS
+ * support it.
+ *
+ * Byte shuffles and packs on 256-bit registers work within each 128-bit
+ * lane, so the results are put back in order with a dword permute. */
+
+#include "format-conversion-simd.h"
+#include <immintrin.h>
+
+#define X (-128) /* pshufb: zero the byte */
+
+/* picks channel c (byte c of each uyvx pixel) of four pixels into bytes o to
+ * o + 3 of each lane */
+#define CHAN_SHUF(c, o) _mm256_setr_epi8(                                     \
+		o==0?c:X, o==0?c+4:X, o==0?c+8:X, o==0?c+12:X,                \
+		o==4?c:X, o==4?c+4:X, o==4?c+8:X, o==4?c+12:X,                \
+		o==8?c:X, o==8?c+4:X, o==8?c+8:X, o==8?c+12:X,                \
+		o==12?c:X, o==12?c+4:X, o==12?c+8:X, o==12?c+12:X,            \
+		o==0?c:X, o==0?c+4:X, o==0?c+8:X, o==0?c+12:X,                \
+		o==4?c:X, o==4?c+4:X, o==4?c+8:X, o==4?c+12:X,                \
+		o==8?c:X, o==8?c+4:X, o==8?c+8:X, o==8?c+12:X,                \
+		o==12?c:X, o==12?c+4:X, o==12?c+8:X, o==12?c+12:X)
+
+/* dword order of four interleaved 128-bit lane results */
+#define LANE_ORDER _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)
+
+/* picks channel c of 32 pixels; c == 1 is the lum plane */
+static FORCE_INLINE __m256i pack_channel(const __m256i px[4], const int c)
+{
+	__m256i a = _mm256_shuffle_epi8(px[0], CHAN_SHUF(c, 0));
+	__m256i b = _mm256_shuffle_epi8(px[1], CHAN_SHUF(c, 4));
+	__m256i d = _mm256_shuffle_epi8(px[2], CHAN_SHUF(c, 8));
+	__m256i e = _mm256_shuffle_epi8(px[3], CHAN_SHUF(c, 12));
+
+	return _mm256_permutevar8x32_epi32(
+			_mm256_or_si256(_mm256_or_si256(a, b),
+			                _mm256_or_si256(d, e)),
+			LANE_ORDER);
+}
+
+/* sums the chroma of the 2x2 blocks of sixteen pixel pairs, returning the
+ * averages as interleaved u/v bytes (nv12 order) */
+static FORCE_INLINE __m256i pack_chroma(const __m256i line1[4],
+		const __m256i line2[4])
+{
+	__m256i uv_mask = _mm256_set1_epi32(0x00FF00FF);
+	__m256i sum[4];
+	__m256i ab, cd;
+
+	for (int i = 0; i < 4; i++)
+		sum[i] = _mm256_add_epi16(
+				_mm256_and_si256(line1[i], uv_mask),
+				_mm256_and_si256(line2[i], uv_mask));
+
+#define add_pairs(p0, p1)                                                     \
+	_mm256_add_epi16(                                                     \
+		_mm256_castps_si256(_mm256_shuffle_ps(                        \
+				_mm256_castsi256_ps(p0),                      \
+				_mm256_castsi256_ps(p1),                      \
+				_MM_SHUFFLE(2,0,2,0))),                       \
+		_mm256_castps_si256(_mm256_shuffle_ps(                        \
+				_mm256_castsi256_ps(p0),                      \
+				_mm256_castsi256_ps(p1),                      \
+				_MM_SHUFFLE(3,1,3,1))))
+
+	ab = _mm256_srli_epi16(add_pairs(sum[0], sum[1]), 2);
+	cd = _mm256_srli_epi16(add_pairs(sum[2], sum[3]), 2);
+
+#undef add_pairs
+
+	return _mm256_permutevar8x32_epi32(_mm256_packus_epi16(ab, cd),
+			LANE_ORDER);
+}
+
+static FORCE_INLINE void load_pixels(const uint8_t *img, __m256i px[4])
+{
+	px[0] = _mm256_loadu_si256((const __m256i*)img);
+	px[1] = _mm256_loadu_si256((const __m256i*)(img + 32));
+	px[2] = _mm256_loadu_si256((const __m256i*)(img + 64));
+	px[3] = _mm256_loadu_si256((const __m256i*)(img + 96));
+}
+
+void compress_uyvx_to_i420_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width     = conversion_min_uint32(in_linesize,
+			out_linesize[0]);
+	uint32_t width_vec = width & ~31;
+	__m256i  uv_split  = _mm256_setr_epi8(
+			0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+			0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *line1 = input + y * in_linesize;
+		const uint8_t *line2 = line1 + in_linesize;
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *u    = output[1] + (y>>1) * out_linesize[1];
+		uint8_t *v    = output[2] + (y>>1) * out_linesize[2];
+		uint32_t x;
+
+		for (x = 0; x < width_vec; x += 32) {
+			__m256i px1[4], px2[4], uv;
+
+			load_pixels(line1 + x*4, px1);
+			load_pixels(line2 + x*4, px2);
+
+			_mm256_storeu_si256((__m256i*)(lum0 + x),
+					pack_channel(px1, 1));
+			_mm256_storeu_si256((__m256i*)(lum1 + x),
+					pack_channel(px2, 1));
+
+			/* u in the low qword of each lane, v in the high */
+			uv = _mm256_shuffle_epi8(pack_chroma(px1, px2),
+					uv_split);
+			uv = _mm256_permute4x64_epi64(uv,
+					_MM_SHUFFLE(3, 1, 2, 0));
+
+			_mm_storeu_si128((__m128i*)(u + x/2),
+					_mm256_castsi256_si128(uv));
+			_mm_storeu_si128((__m128i*)(v + x/2),
+					_mm256_extracti128_si256(uv, 1));
+		}
+
+		compress_uyvx_420_pixels(line1 + x*4, line2 + x*4, width - x,
+				lum0 + x, lum1 + x, u + x/2, v + x/2, 1);
+	}
+}
+
+void compress_uyvx_to_nv12_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width     = conversion_min_uint32(in_linesize,
+			out_linesize[0]);
+	uint32_t width_vec = width & ~31;
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *line1 = input + y * in_linesize;
+		const uint8_t *line2 = line1 + in_linesize;
+		uint8_t *lum0   = output[0] + y * out_linesize[0];
+		uint8_t *lum1   = lum0 + out_linesize[0];
+		uint8_t *chroma = output[1] + (y>>1) * out_linesize[1];
+		uint32_t x;
+
+		for (x = 0; x < width_vec; x += 32) {
+			__m256i px1[4], px2[4];
+
+			load_pixels(line1 + x*4, px1);
+			load_pixels(line2 + x*4, px2);
+
+			_mm256_storeu_si256((__m256i*)(lum0 + x),
+					pack_channel(px1, 1));
+			_mm256_storeu_si256((__m256i*)(lum1 + x),
+					pack_channel(px2, 1));
+			_mm256_storeu_si256((__m256i*)(chroma + x),
+					pack_chroma(px1, px2));
+		}
+
+		compress_uyvx_420_pixels(line1 + x*4, line2 + x*4, width - x,
+				lum0 + x, lum1 + x,
+				chroma + x, chroma + x + 1, 2);
+	}
+}
+
+void convert_uyvx_to_i444_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width     = conversion_min_uint32(in_linesize,
+			out_linesize[0]);
+	uint32_t width_vec = width & ~31;
+
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint8_t *line = input + y * in_linesize;
+		uint8_t *lum = output[0] + y * out_linesize[0];
+		uint8_t *u   = output[1] + y * out_linesize[0];
+		uint8_t *v   = output[2] + y * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x < width_vec; x += 32) {
+			__m256i px[4];
+
+			load_pixels(line + x*4, px);
+
+			_mm256_storeu_si256((__m256i*)(lum + x),
+					pack_channel(px, 1));
+			_mm256_storeu_si256((__m256i*)(u + x),
+					pack_channel(px, 0));
+			_mm256_storeu_si256((__m256i*)(v + x),
+					pack_channel(px, 2));
+		}
+
+		convert_uyvx_444_pixels(line + x*4, width - x,
+				lum + x, u + x, v + x);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+void decompress_422_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	uint32_t width_d2  = conversion_min_uint32(in_linesize/2,
+			out_linesize/4)/2;
+	uint32_t width_vec = width_d2 & ~7;
+
+	__m256i shuf_lo = leading_lum ?
+		_mm256_setr_epi8(
+			0, 1, 2, 3, 2, 1, 2, 3, 4, 5, 6, 7, 6, 5, 6, 7,
+			0, 1, 2, 3, 2, 1, 2, 3, 4, 5, 6, 7, 6, 5, 6, 7) :
+		_mm256_setr_epi8(
+			0, 1, 2, 3, 0, 3, 2, 3, 4, 5, 6, 7, 4, 7, 6, 7,
+			0, 1, 2, 3, 0, 3, 2, 3, 4, 5, 6, 7, 4, 7, 6, 7);
+	__m256i shuf_hi = _mm256_add_epi8(shuf_lo, _mm256_set1_epi8(8));
+
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint32_t *input32 =
+			(const uint32_t*)(input + y * in_linesize);
+		uint32_t *output32 = (uint32_t*)(output + y * out_linesize);
+		uint32_t x;
+
+		for (x = 0; x < width_vec; x += 8) {
+			__m256i dw = _mm256_loadu_si256(
+					(const __m256i*)(input32 + x));
+			__m256i lo = _mm256_shuffle_epi8(dw, shuf_lo);
+			__m256i hi = _mm256_shuffle_epi8(dw, shuf_hi);
+
+			_mm256_storeu_si256((__m256i*)(output32 + x*2),
+					_mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256((__m256i*)(output32 + x*2 + 8),
+					_mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+
+		decompress_422_pixels(input32 + x, width_d2 - x,
+				output32 + x*2, leading_lum);
+	}
+}
@@ -0,0 +1,165 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+/*
+ * Internal: per instruction set conversion kernels.  The SSE4.1 and AVX2
+ * kernels live in their own files so that only those files are compiled with
+ * -msse4.1/-mavx2, and are only ever called after a CPUID check.  All kernels
+ * must produce exactly the same output as the reference ones.
+ */
+
+#include "../util/c99defs.h"
+
+void compress_uyvx_to_i420_sse41(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+void compress_uyvx_to_nv12_sse41(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+void convert_uyvx_to_i444_sse41(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+void decompress_nv12_sse41(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize);
+void decompress_420_sse41(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize);
+void decompress_422_sse41(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum);
+
+/* the 4:2:0 -> packed 4:4:4 conversions write four times as much as they
+ * read and are limited by stores, so there are no AVX2 versions of them; the
+ * wider registers measured slower than the SSE4.1 ones */
+void compress_uyvx_to_i420_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+void compress_uyvx_to_nv12_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+void convert_uyvx_to_i444_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+void decompress_422_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum);
+
+static inline uint32_t conversion_min_uint32(uint32_t a, uint32_t b)
+{
+	return a < b ? a : b;
+}
+
+/* ------------------------------------------------------------------------- */
+/* scalar versions of the per-pixel operations, used for the last pixels of a
+ * line that don't fill a whole vector */
+
+static inline void compress_uyvx_420_pixels(
+		const uint8_t *line1, const uint8_t *line2, uint32_t count,
+		uint8_t *lum0, uint8_t *lum1,
+		uint8_t *u, uint8_t *v, uint32_t chroma_step)
+{
+	for (uint32_t x = 0; x < count; x += 2) {
+		const uint8_t *p1 = line1 + x * 4;
+		const uint8_t *p2 = line2 + x * 4;
+
+		lum0[x]     = p1[1];
+		lum0[x + 1] = p1[5];
+		lum1[x]     = p2[1];
+		lum1[x + 1] = p2[5];
+
+		*u = (uint8_t)((p1[0] + p1[4] + p2[0] + p2[4]) >> 2);
+		*v = (uint8_t)((p1[2] + p1[6] + p2[2] + p2[6]) >> 2);
+		u += chroma_step;
+		v += chroma_step;
+	}
+}
+
+static inline void convert_uyvx_444_pixels(const uint8_t *line,
+		uint32_t count, uint8_t *lum, uint8_t *u, uint8_t *v)
+{
+	for (uint32_t x = 0; x < count; x++) {
+		lum[x] = line[x * 4 + 1];
+		u[x]   = line[x * 4];
+		v[x]   = line[x * 4 + 2];
+	}
+}
+
+static inline void decompress_420_pixels(
+		const uint8_t *lum0, const uint8_t *lum1,
+		const uint8_t *chroma0, const uint8_t *chroma1,
+		uint32_t count_d2, uint32_t *output0, uint32_t *output1)
+{
+	for (uint32_t x = 0; x < count_d2; x++) {
+		uint32_t out = ((uint32_t)chroma0[x] << 8) |
+			((uint32_t)chroma1[x] << 16);
+
+		*(output0++) = *(lum0++) | out;
+		*(output0++) = *(lum0++) | out;
+
+		*(output1++) = *(lum1++) | out;
+		*(output1++) = *(lum1++) | out;
+	}
+}
+
+static inline void decompress_nv12_pixels(
+		const uint8_t *lum0, const uint8_t *lum1,
+		const uint8_t *chroma, uint32_t count_d2,
+		uint32_t *output0, uint32_t *output1)
+{
+	for (uint32_t x = 0; x < count_d2; x++) {
+		uint32_t out = ((uint32_t)chroma[x * 2] << 8) |
+			((uint32_t)chroma[x * 2 + 1] << 16);
+
+		*(output0++) = *(lum0++) | out;
+		*(output0++) = *(lum0++) | out;
+
+		*(output1++) = *(lum1++) | out;
+		*(output1++) = *(lum1++) | out;
+	}
+}
+
+static inline void decompress_422_pixels(const uint32_t *input32,
+		uint32_t count_d2, uint32_t *output32, bool leading_lum)
+{
+	for (uint32_t x = 0; x < count_d2; x++) {
+		uint32_t dw = input32[x];
+
+		output32[0] = dw;
+		if (leading_lum) {
+			dw &= 0xFFFFFF00;
+			dw |= (uint8_t)(dw>>16);
+		} else {
+			dw &= 0xFFFF00FF;
+			dw |= (dw>>16) & 0xFF00;
+		}
+		output32[1] = dw;
+		output32 += 2;
+	}
+}
@@ -0,0 +1,324 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/* SSE4.1 conversion kernels, 16 pixels per iteration.  This file must be
+ * compiled with SSE4.1 enabled, and is only called if the CPU supports it. */
+
+#include "format-conversion-simd.h"
+#include <smmintrin.h>
+
+#define X (-128) /* pshufb: zero the byte */
+
+/* picks Y (byte 1 of each uyvx pixel) of four pixels into bytes 0-3 */
+#define LUM_SHUF(o) _mm_setr_epi8(                                            \
+		o==0?1:X, o==0?5:X, o==0?9:X, o==0?13:X,                      \
+		o==4?1:X, o==4?5:X, o==4?9:X, o==4?13:X,                      \
+		o==8?1:X, o==8?5:X, o==8?9:X, o==8?13:X,                      \
+		o==12?1:X, o==12?5:X, o==12?9:X, o==12?13:X)
+
+#define CHAN_SHUF(c) _mm_setr_epi8(                                           \
+		c, c+4, c+8, c+12, X, X, X, X, X, X, X, X, X, X, X, X)
+
+static FORCE_INLINE __m128i pack_channel(const __m128i px[4], __m128i shuf)
+{
+	__m128i a = _mm_shuffle_epi8(px[0], shuf);
+	__m128i b = _mm_slli_si128(_mm_shuffle_epi8(px[1], shuf), 4);
+	__m128i c = _mm_slli_si128(_mm_shuffle_epi8(px[2], shuf), 8);
+	__m128i d = _mm_slli_si128(_mm_shuffle_epi8(px[3], shuf), 12);
+	return _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+}
+
+static FORCE_INLINE __m128i pack_lum(const __m128i px[4])
+{
+	__m128i a = _mm_shuffle_epi8(px[0], LUM_SHUF(0));
+	__m128i b = _mm_shuffle_epi8(px[1], LUM_SHUF(4));
+	__m128i c = _mm_shuffle_epi8(px[2], LUM_SHUF(8));
+	__m128i d = _mm_shuffle_epi8(px[3], LUM_SHUF(12));
+	return _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+}
+
+/* sums the chroma of the 2x2 blocks of eight pixel pairs, returning the
+ * averages as interleaved u/v bytes (nv12 order) */
+static FORCE_INLINE __m128i pack_chroma(const __m128i line1[4],
+		const __m128i line2[4])
+{
+	__m128i uv_mask = _mm_set1_epi32(0x00FF00FF);
+	__m128i sum[4];
+	__m128i ab, cd;
+
+	for (int i = 0; i < 4; i++)
+		sum[i] = _mm_add_epi16(
+				_mm_and_si128(line1[i], uv_mask),
+				_mm_and_si128(line2[i], uv_mask));
+
+#define add_pairs(p0, p1)                                                     \
+	_mm_add_epi16(                                                        \
+		_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(p0),         \
+				_mm_castsi128_ps(p1), _MM_SHUFFLE(2,0,2,0))), \
+		_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(p0),         \
+				_mm_castsi128_ps(p1), _MM_SHUFFLE(3,1,3,1))))
+
+	ab = _mm_srli_epi16(add_pairs(sum[0], sum[1]), 2);
+	cd = _mm_srli_epi16(add_pairs(sum[2], sum[3]), 2);
+
+#undef add_pairs
+
+	return _mm_packus_epi16(ab, cd);
+}
+
+static FORCE_INLINE void load_pixels(const uint8_t *img, __m128i px[4])
+{
+	px[0] = _mm_loadu_si128((const __m128i*)img);
+	px[1] = _mm_loadu_si128((const __m128i*)(img + 16));
+	px[2] = _mm_loadu_si128((const __m128i*)(img + 32));
+	px[3] = _mm_loadu_si128((const __m128i*)(img + 48));
+}
+
+void compress_uyvx_to_i420_sse41(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width     = conversion_min_uint32(in_linesize,
+			out_linesize[0]);
+	uint32_t width_vec = width & ~15;
+	__m128i  uv_split  = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,
+	                                   1, 3, 5, 7, 9, 11, 13, 15);
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *line1 = input + y * in_linesize;
+		const uint8_t *line2 = line1 + in_linesize;
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *u    = output[1] + (y>>1) * out_linesize[1];
+		uint8_t *v    = output[2] + (y>>1) * out_linesize[2];
+		uint32_t x;
+
+		for (x = 0; x < width_vec; x += 16) {
+			__m128i px1[4], px2[4], uv;
+
+			load_pixels(line1 + x*4, px1);
+			load_pixels(line2 + x*4, px2);
+
+			_mm_storeu_si128((__m128i*)(lum0 + x), pack_lum(px1));
+			_mm_storeu_si128((__m128i*)(lum1 + x), pack_lum(px2));
+
+			uv = _mm_shuffle_epi8(pack_chroma(px1, px2), uv_split);
+			_mm_storel_epi64((__m128i*)(u + x/2), uv);
+			_mm_storel_epi64((__m128i*)(v + x/2),
+					_mm_srli_si128(uv, 8));
+		}
+
+		compress_uyvx_420_pixels(line1 + x*4, line2 + x*4, width - x,
+				lum0 + x, lum1 + x, u + x/2, v + x/2, 1);
+	}
+}
+
+void compress_uyvx_to_nv12_sse41(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width     = conversion_min_uint32(in_linesize,
+			out_linesize[0]);
+	uint32_t width_vec = width & ~15;
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *line1 = input + y * in_linesize;
+		const uint8_t *line2 = line1 + in_linesize;
+		uint8_t *lum0   = output[0] + y * out_linesize[0];
+		uint8_t *lum1   = lum0 + out_linesize[0];
+		uint8_t *chroma = output[1] + (y>>1) * out_linesize[1];
+		uint32_t x;
+
+		for (x = 0; x < width_vec; x += 16) {
+			__m128i px1[4], px2[4];
+
+			load_pixels(line1 + x*4, px1);
+			load_pixels(line2 + x*4, px2);
+
+			_mm_storeu_si128((__m128i*)(lum0 + x), pack_lum(px1));
+			_mm_storeu_si128((__m128i*)(lum1 + x), pack_lum(px2));
+			_mm_storeu_si128((__m128i*)(chroma + x),
+					pack_chroma(px1, px2));
+		}
+
+		compress_uyvx_420_pixels(line1 + x*4, line2 + x*4, width - x,
+				lum0 + x, lum1 + x,
+				chroma + x, chroma + x + 1, 2);
+	}
+}
+
+void convert_uyvx_to_i444_sse41(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width     = conversion_min_uint32(in_linesize,
+			out_linesize[0]);
+	uint32_t width_vec = width & ~15;
+	__m128i  u_shuf    = CHAN_SHUF(0);
+	__m128i  v_shuf    = CHAN_SHUF(2);
+
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint8_t *line = input + y * in_linesize;
+		uint8_t *lum = output[0] + y * out_linesize[0];
+		uint8_t *u   = output[1] + y * out_linesize[0];
+		uint8_t *v   = output[2] + y * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x < width_vec; x += 16) {
+			__m128i px[4];
+
+			load_pixels(line + x*4, px);
+
+			_mm_storeu_si128((__m128i*)(lum + x), pack_lum(px));
+			_mm_storeu_si128((__m128i*)(u + x),
+					pack_channel(px, u_shuf));
+			_mm_storeu_si128((__m128i*)(v + x),
+					pack_channel(px, v_shuf));
+		}
+
+		convert_uyvx_444_pixels(line + x*4, width - x,
+				lum + x, u + x, v + x);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* builds four output pixels (lum in byte 0, u/v in bytes 1 and 2) from a
+ * register holding eight lum values followed by their four u/v pairs */
+#define DECOMPRESS_SHUF(p) _mm_setr_epi8(                                     \
+		p,   8+p, 9+p, X, p+1, 8+p, 9+p, X,                           \
+		p+2, 10+p, 11+p, X, p+3, 10+p, 11+p, X)
+
+static FORCE_INLINE void decompress_line(uint32_t *out, const uint8_t *lum,
+		__m128i uv)
+{
+	__m128i lum16 = _mm_loadu_si128((const __m128i*)lum);
+	__m128i src0  = _mm_unpacklo_epi64(lum16, uv);
+	__m128i src1  = _mm_unpackhi_epi64(lum16, uv);
+	__m128i shuf0 = DECOMPRESS_SHUF(0);
+	__m128i shuf1 = DECOMPRESS_SHUF(4);
+
+	_mm_storeu_si128((__m128i*)out,        _mm_shuffle_epi8(src0, shuf0));
+	_mm_storeu_si128((__m128i*)(out + 4),  _mm_shuffle_epi8(src0, shuf1));
+	_mm_storeu_si128((__m128i*)(out + 8),  _mm_shuffle_epi8(src1, shuf0));
+	_mm_storeu_si128((__m128i*)(out + 12), _mm_shuffle_epi8(src1, shuf1));
+}
+
+void decompress_420_sse41(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	uint32_t width_d2  = conversion_min_uint32(in_linesize[0],
+			out_linesize)/2;
+	uint32_t width_vec = width_d2 & ~7;
+
+	for (uint32_t y = start_y/2; y < end_y/2; y++) {
+		const uint8_t *chroma0 = input[1] + y * in_linesize[1];
+		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
+		const uint8_t *lum0    = input[0] + y * 2 * in_linesize[0];
+		const uint8_t *lum1    = lum0 + in_linesize[0];
+		uint32_t *output0 = (uint32_t*)(output + y * 2 * out_linesize);
+		uint32_t *output1 = (uint32_t*)((uint8_t*)output0 +
+				out_linesize);
+		uint32_t x;
+
+		for (x = 0; x < width_vec; x += 8) {
+			__m128i uv = _mm_unpacklo_epi8(
+				_mm_loadl_epi64((const __m128i*)(chroma0 + x)),
+				_mm_loadl_epi64((const __m128i*)(chroma1 + x)));
+
+			decompress_line(output0 + x*2, lum0 + x*2, uv);
+			decompress_line(output1 + x*2, lum1 + x*2, uv);
+		}
+
+		decompress_420_pixels(lum0 + x*2, lum1 + x*2,
+				chroma0 + x, chroma1 + x, width_d2 - x,
+				output0 + x*2, output1 + x*2);
+	}
+}
+
+void decompress_nv12_sse41(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	uint32_t width_d2  = conversion_min_uint32(in_linesize[0],
+			out_linesize)/2;
+	uint32_t width_vec = width_d2 & ~7;
+
+	for (uint32_t y = start_y/2; y < end_y/2; y++) {
+		const uint8_t *chroma = input[1] + y * in_linesize[1];
+		const uint8_t *lum0   = input[0] + y * 2 * in_linesize[0];
+		const uint8_t *lum1   = lum0 + in_linesize[0];
+		uint32_t *output0 = (uint32_t*)(output + y * 2 * out_linesize);
+		uint32_t *output1 = (uint32_t*)((uint8_t*)output0 +
+				out_linesize);
+		uint32_t x;
+
+		for (x = 0; x < width_vec; x += 8) {
+			__m128i uv = _mm_loadu_si128(
+					(const __m128i*)(chroma + x*2));
+
+			decompress_line(output0 + x*2, lum0 + x*2, uv);
+			decompress_line(output1 + x*2, lum1 + x*2, uv);
+		}
+
+		decompress_nv12_pixels(lum0 + x*2, lum1 + x*2,
+				chroma + x*2, width_d2 - x,
+				output0 + x*2, output1 + x*2);
+	}
+}
+
+void decompress_422_sse41(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	uint32_t width_d2  = conversion_min_uint32(in_linesize/2,
+			out_linesize/4)/2;
+	uint32_t width_vec = width_d2 & ~3;
+
+	/* each input dword holds two pixels; the second output pixel takes
+	 * the second lum value of the pair */
+	__m128i shuf_lo = leading_lum ?
+		_mm_setr_epi8(0, 1, 2, 3, 2, 1, 2, 3, 4, 5, 6, 7, 6, 5, 6, 7) :
+		_mm_setr_epi8(0, 1, 2, 3, 0, 3, 2, 3, 4, 5, 6, 7, 4, 7, 6, 7);
+	__m128i shuf_hi = _mm_add_epi8(shuf_lo, _mm_set1_epi8(8));
+
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint32_t *input32 =
+			(const uint32_t*)(input + y * in_linesize);
+		uint32_t *output32 = (uint32_t*)(output + y * out_linesize);
+		uint32_t x;
+
+		for (x = 0; x < width_vec; x += 4) {
+			__m128i dw = _mm_loadu_si128(
+					(const __m128i*)(input32 + x));
+
+			_mm_storeu_si128((__m128i*)(output32 + x*2),
+					_mm_shuffle_epi8(dw, shuf_lo));
+			_mm_storeu_si128((__m128i*)(output32 + x*2 + 4),
+					_mm_shuffle_epi8(dw, shuf_hi));
+		}
+
+		decompress_422_pixels(input32 + x, width_d2 - x,
+				output32 + x*2, leading_lum);
+	}
+}
@@ -16,9 +16,18 @@
 ******************************************************************************/
 
 #include "format-conversion.h"
+#include "format-conversion-simd.h"
+#include "../util/threading.h"
+#include "../util/base.h"
 #include <xmmintrin.h>
 #include <emmintrin.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
 /* ...surprisingly, if I don't use a macro to force inlining, it causes the
  * CPU usage to boost by a tremendous amount in debug builds. */
 
@@ -89,7 +98,7 @@ static FORCE_INLINE uint32_t min_uint32(uint32_t a, uint32_t b)
 	return a < b ? a : b;
 }
 
-void compress_uyvx_to_i420(
+static void compress_uyvx_to_i420_sse2(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
@@ -127,7 +136,7 @@ void compress_uyvx_to_i420(
 	}
 }
 
-void compress_uyvx_to_nv12(
+static void compress_uyvx_to_nv12_sse2(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
@@ -163,7 +172,7 @@ void compress_uyvx_to_nv12(
 	}
 }
 
-void convert_uyvx_to_i444(
+static void convert_uyvx_to_i444_sse2(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
@@ -202,7 +211,7 @@ void convert_uyvx_to_i444(
 	}
 }
 
-void decompress_420(
+static void decompress_420_c(
 		const uint8_t *const input[], const uint32_t in_linesize[],
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output, uint32_t out_linesize)
@@ -221,8 +230,8 @@ void decompress_420(
 
 		lum0 = input[0] + y * 2 * in_linesize[0];
 		lum1 = lum0 + in_linesize[0];
-		output0 = (uint32_t*)(output + y * 2 * in_linesize[0]);
-		output1 = (uint32_t*)((uint8_t*)output0 + in_linesize[0]);
+		output0 = (uint32_t*)(output + y * 2 * out_linesize);
+		output1 = (uint32_t*)((uint8_t*)output0 + out_linesize);
 
 		for (x = 0; x < width_d2; x++) {
 			uint32_t out;
@@ -237,7 +246,7 @@ void decompress_420(
 	}
 }
 
-void decompress_nv12(
+static void decompress_nv12_c(
 		const uint8_t *const input[], const uint32_t in_linesize[],
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output, uint32_t out_linesize)
@@ -271,13 +280,13 @@ void decompress_nv12(
 	}
 }
 
-void decompress_422(
+static void decompress_422_c(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output, uint32_t out_linesize,
 		bool leading_lum)
 {
-	uint32_t width_d2 = min_uint32(in_linesize, out_linesize)/2;
+	uint32_t width_d2 = min_uint32(in_linesize/2, out_linesize/4)/2;
 	uint32_t y;
 
 	register const uint32_t *input32;
@@ -322,3 +331,213 @@ void decompress_422(
 		}
 	}
 }
+
+/* ------------------------------------------------------------------------- */
+
+struct conversion_funcs {
+	void (*compress_uyvx_to_i420)(
+			const uint8_t *input, uint32_t in_linesize,
+			uint32_t start_y, uint32_t end_y,
+			uint8_t *output[], const uint32_t out_linesize[]);
+	void (*compress_uyvx_to_nv12)(
+			const uint8_t *input, uint32_t in_linesize,
+			uint32_t start_y, uint32_t end_y,
+			uint8_t *output[], const uint32_t out_linesize[]);
+	void (*convert_uyvx_to_i444)(
+			const uint8_t *input, uint32_t in_linesize,
+			uint32_t start_y, uint32_t end_y,
+			uint8_t *output[], const uint32_t out_linesize[]);
+	void (*decompress_nv12)(
+			const uint8_t *const input[], const uint32_t in_linesize[],
+			uint32_t start_y, uint32_t end_y,
+			uint8_t *output, uint32_t out_linesize);
+	void (*decompress_420)(
+			const uint8_t *const input[], const uint32_t in_linesize[],
+			uint32_t start_y, uint32_t end_y,
+			uint8_t *output, uint32_t out_linesize);
+	void (*decompress_422)(
+			const uint8_t *input, uint32_t in_linesize,
+			uint32_t start_y, uint32_t end_y,
+			uint8_t *output, uint32_t out_linesize,
+			bool leading_lum);
+};
+
+static const struct conversion_funcs simd_funcs[] = {
+	[FORMAT_CONVERSION_REFERENCE] = {
+		compress_uyvx_to_i420_sse2,
+		compress_uyvx_to_nv12_sse2,
+		convert_uyvx_to_i444_sse2,
+		decompress_nv12_c,
+		decompress_420_c,
+		decompress_422_c
+	},
+	[FORMAT_CONVERSION_SSE41] = {
+		compress_uyvx_to_i420_sse41,
+		compress_uyvx_to_nv12_sse41,
+		convert_uyvx_to_i444_sse41,
+		decompress_nv12_sse41,
+		decompress_420_sse41,
+		decompress_422_sse41
+	},
+	[FORMAT_CONVERSION_AVX2] = {
+		compress_uyvx_to_i420_avx2,
+		compress_uyvx_to_nv12_avx2,
+		convert_uyvx_to_i444_avx2,
+		decompress_nv12_sse41,
+		decompress_420_sse41,
+		decompress_422_avx2
+	},
+};
+
+static pthread_once_t simd_init_once = PTHREAD_ONCE_INIT;
+static enum format_conversion_simd simd_max = FORMAT_CONVERSION_REFERENCE;
+static const struct conversion_funcs *funcs = &simd_funcs[0];
+
+static const char *simd_names[] = {
+	[FORMAT_CONVERSION_REFERENCE] = "SSE2",
+	[FORMAT_CONVERSION_SSE41]     = "SSE4.1",
+	[FORMAT_CONVERSION_AVX2]      = "AVX2",
+};
+
+static void get_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/* the OS has to save the ymm registers for AVX to be usable */
+static bool os_saves_ymm(void)
+{
+	uint32_t xcr0;
+#ifdef _MSC_VER
+	xcr0 = (uint32_t)_xgetbv(0);
+#else
+	uint32_t edx;
+	__asm__ volatile ("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0));
+#endif
+	return (xcr0 & 0x6) == 0x6;
+}
+
+static enum format_conversion_simd detect_simd(void)
+{
+	uint32_t regs[4];
+	uint32_t max_leaf;
+	bool ssse3, sse41, osxsave, avx;
+
+	get_cpuid(0, 0, regs);
+	max_leaf = regs[0];
+	if (max_leaf < 1)
+		return FORMAT_CONVERSION_REFERENCE;
+
+	get_cpuid(1, 0, regs);
+	ssse3   = (regs[2] & (1 << 9))  != 0;
+	sse41   = (regs[2] & (1 << 19)) != 0;
+	osxsave = (regs[2] & (1 << 27)) != 0;
+	avx     = (regs[2] & (1 << 28)) != 0;
+
+	if (!ssse3 || !sse41)
+		return FORMAT_CONVERSION_REFERENCE;
+
+	if (max_leaf >= 7 && osxsave && avx && os_saves_ymm()) {
+		get_cpuid(7, 0, regs);
+		if (regs[1] & (1 << 5))
+			return FORMAT_CONVERSION_AVX2;
+	}
+
+	return FORMAT_CONVERSION_SSE41;
+}
+
+static void init_simd(void)
+{
+	simd_max = detect_simd();
+	funcs = &simd_funcs[simd_max];
+
+	blog(LOG_INFO, "Format conversion: using %s kernels",
+			simd_names[simd_max]);
+}
+
+static inline const struct conversion_funcs *get_funcs(void)
+{
+	pthread_once(&simd_init_once, init_simd);
+	return funcs;
+}
+
+enum format_conversion_simd format_conversion_get_simd(void)
+{
+	return (enum format_conversion_simd)(get_funcs() - simd_funcs);
+}
+
+enum format_conversion_simd format_conversion_get_max_simd(void)
+{
+	get_funcs();
+	return simd_max;
+}
+
+bool format_conversion_set_simd(enum format_conversion_simd level)
+{
+	get_funcs();
+
+	if (level < FORMAT_CONVERSION_REFERENCE || level > simd_max)
+		return false;
+
+	funcs = &simd_funcs[level];
+	return true;
+}
+
+void compress_uyvx_to_i420(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	get_funcs()->compress_uyvx_to_i420(input, in_linesize,
+			start_y, end_y, output, out_linesize);
+}
+
+void compress_uyvx_to_nv12(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	get_funcs()->compress_uyvx_to_nv12(input, in_linesize,
+			start_y, end_y, output, out_linesize);
+}
+
+void convert_uyvx_to_i444(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	get_funcs()->convert_uyvx_to_i444(input, in_linesize,
+			start_y, end_y, output, out_linesize);
+}
+
+void decompress_nv12(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	get_funcs()->decompress_nv12(input, in_linesize,
+			start_y, end_y, output, out_linesize);
+}
+
+void decompress_420(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	get_funcs()->decompress_420(input, in_linesize,
+			start_y, end_y, output, out_linesize);
+}
+
+void decompress_422(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	get_funcs()->decompress_422(input, in_linesize,
+			start_y, end_y, output, out_linesize, leading_lum);
+}
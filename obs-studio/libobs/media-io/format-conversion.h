@@ -27,6 +27,29 @@ extern "C" {
  * Functions for converting to and from packed 444 YUV
  */
 
+/*
+ * The conversions below are dispatched at runtime to the fastest set of
+ * kernels the CPU supports.  All sets produce identical output.
+ */
+
+enum format_conversion_simd {
+	FORMAT_CONVERSION_REFERENCE,
+	FORMAT_CONVERSION_SSE41,
+	FORMAT_CONVERSION_AVX2,
+};
+
+/** Returns the set of kernels currently in use */
+EXPORT enum format_conversion_simd format_conversion_get_simd(void);
+
+/** Returns the fastest set of kernels supported by the CPU */
+EXPORT enum format_conversion_simd format_conversion_get_max_simd(void);
+
+/**
+ * Forces a set of kernels (for testing/benchmarking).  Returns false if the
+ * CPU doesn't support it.
+ */
+EXPORT bool format_conversion_set_simd(enum format_conversion_simd level);
+
 EXPORT void compress_uyvx_to_i420(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
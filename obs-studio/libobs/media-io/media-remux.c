@@ -19,18 +19,110 @@
 
 #include "../util/base.h"
 #include "../util/bmem.h"
+#include "../util/darray.h"
 #include "../util/platform.h"
+#include "../util/threading.h"
 
 #include <libavformat/avformat.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+
+/* files are read and written through our own seekable AVIOContexts with
+ * large buffers, so that the disk sees long sequential requests even when
+ * several files are remuxed at once */
+#define READ_AHEAD_SIZE   (1024 * 1024)
+#define WRITE_BUFFER_SIZE (1024 * 1024)
 
 struct media_remux_job {
 	int64_t in_size;
 	AVFormatContext *ifmt_ctx, *ofmt_ctx;
+	AVIOContext *in_pb, *out_pb;
+	FILE *in_file, *out_file;
 };
 
+static int io_read(void *opaque, uint8_t *buf, int size)
+{
+	size_t ret = fread(buf, 1, size, opaque);
+	if (ret == 0)
+		return ferror((FILE*)opaque) ? AVERROR(EIO) : AVERROR_EOF;
+	return (int)ret;
+}
+
+static int io_write(void *opaque, uint8_t *buf, int size)
+{
+	FILE *file = opaque;
+	return fwrite(buf, 1, size, file) == (size_t)size ? size : AVERROR(EIO);
+}
+
+static int64_t io_seek(void *opaque, int64_t offset, int whence)
+{
+	FILE *file = opaque;
+	int64_t size;
+
+	whence &= ~AVSEEK_FORCE;
+
+	if (whence == AVSEEK_SIZE) {
+		int64_t pos = os_ftelli64(file);
+
+		os_fseeki64(file, 0, SEEK_END);
+		size = os_ftelli64(file);
+		os_fseeki64(file, pos, SEEK_SET);
+		return size;
+	}
+
+	if (os_fseeki64(file, offset, whence) != 0)
+		return AVERROR(EIO);
+
+	return os_ftelli64(file);
+}
+
+static AVIOContext *open_file(FILE **file, const char *filename, bool write)
+{
+	int size = write ? WRITE_BUFFER_SIZE : READ_AHEAD_SIZE;
+	AVIOContext *pb;
+	uint8_t *buf;
+
+	*file = os_fopen(filename, write ? "wb+" : "rb");
+	if (!*file)
+		return NULL;
+
+	/* avio does the buffering */
+	setvbuf(*file, NULL, _IONBF, 0);
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+	if (!write)
+		posix_fadvise(fileno(*file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	buf = av_malloc(size);
+	pb = avio_alloc_context(buf, size, write, *file,
+			write ? NULL : io_read,
+			write ? io_write : NULL, io_seek);
+	if (!pb)
+		av_free(buf);
+
+	return pb;
+}
+
+static void close_file(AVIOContext **pb, FILE **file)
+{
+	if (*pb) {
+		if ((*pb)->write_flag)
+			avio_flush(*pb);
+		av_freep(&(*pb)->buffer);
+		av_freep(pb);
+	}
+
+	if (*file) {
+		fclose(*file);
+		*file = NULL;
+	}
+}
+
 static inline void init_size(media_remux_job_t job, const char *in_filename)
 {
 #ifdef _MSC_VER
@@ -45,7 +137,20 @@ static inline void init_size(media_remux_job_t job, const char *in_filename)
 
 static inline bool init_input(media_remux_job_t job, const char *in_filename)
 {
-	int ret = avformat_open_input(&job->ifmt_ctx, in_filename, NULL, NULL);
+	int ret;
+
+	job->in_pb = open_file(&job->in_file, in_filename, false);
+	if (!job->in_pb) {
+		blog(LOG_ERROR, "media_remux: Could not open input file '%s'",
+				in_filename);
+		return false;
+	}
+
+	job->ifmt_ctx = avformat_alloc_context();
+	job->ifmt_ctx->pb = job->in_pb;
+	job->ifmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+	ret = avformat_open_input(&job->ifmt_ctx, in_filename, NULL, NULL);
 	if (ret < 0) {
 		blog(LOG_ERROR, "media_remux: Could not open input file '%s'",
 				in_filename);
@@ -103,13 +208,14 @@ static inline bool init_output(media_remux_job_t job, const char *out_filename)
 #endif
 
 	if (!(job->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-		ret = avio_open(&job->ofmt_ctx->pb, out_filename,
-				AVIO_FLAG_WRITE);
-		if (ret < 0) {
+		job->out_pb = open_file(&job->out_file, out_filename, true);
+		if (!job->out_pb) {
 			blog(LOG_ERROR, "media_remux: Failed to open output"
 					" file '%s'", out_filename);
 			return false;
 		}
+
+		job->ofmt_ctx->pb = job->out_pb;
 	}
 
 	return true;
@@ -178,9 +284,14 @@ static inline int process_packets(media_remux_job_t job,
 		}
 
 		if (callback != NULL && throttle++ > 10) {
-			float progress = pkt.pos / (float)job->in_size * 100.f;
-			if (!callback(data, progress))
+			int64_t pos = pkt.pos >= 0 ? pkt.pos :
+				avio_tell(job->ifmt_ctx->pb);
+			float progress = pos / (float)job->in_size * 100.f;
+			if (!callback(data, progress)) {
+				av_free_packet(&pkt);
+				ret = AVERROR_EXIT;
 				break;
+			}
 			throttle = 0;
 		}
 
@@ -229,7 +340,7 @@ bool media_remux_job_process(media_remux_job_t job,
 		success = false;
 	}
 
-	if (callback != NULL)
+	if (callback != NULL && success)
 		callback(data, 100.f);
 
 	return success;
@@ -241,11 +352,225 @@ void media_remux_job_destroy(media_remux_job_t job)
 		return;
 
 	avformat_close_input(&job->ifmt_ctx);
+	close_file(&job->in_pb, &job->in_file);
 
-	if (job->ofmt_ctx && !(job->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-		avio_close(job->ofmt_ctx->pb);
+	if (job->ofmt_ctx)
+		job->ofmt_ctx->pb = NULL;
+	close_file(&job->out_pb, &job->out_file);
 
 	avformat_free_context(job->ofmt_ctx);
 
 	bfree(job);
 }
+
+/* ------------------------------------------------------------------------- */
+
+struct remux_batch_job {
+	char *in_filename;
+	char *out_filename;
+	volatile bool canceled;
+};
+
+struct media_remux_batch {
+	media_remux_batch_progress_callback *progress;
+	media_remux_batch_done_callback *done;
+	void *data;
+
+	DARRAY(pthread_t) workers;
+	os_sem_t *job_sem;
+	os_event_t *finished_event;
+	volatile bool stop;
+
+	pthread_mutex_t mutex;
+	DARRAY(struct remux_batch_job*) jobs;
+	size_t next_job;
+	size_t num_finished;
+};
+
+struct remux_batch_progress {
+	media_remux_batch_t batch;
+	struct remux_batch_job *job;
+	size_t idx;
+};
+
+static bool batch_job_progress(void *data, float percent)
+{
+	struct remux_batch_progress *info = data;
+	media_remux_batch_t batch = info->batch;
+
+	if (os_atomic_load_bool(&batch->stop) ||
+	    os_atomic_load_bool(&info->job->canceled))
+		return false;
+
+	return batch->progress ?
+		batch->progress(batch->data, info->idx, percent) : true;
+}
+
+static bool batch_job_run(media_remux_batch_t batch,
+		struct remux_batch_job *job, size_t idx)
+{
+	struct remux_batch_progress info = {batch, job, idx};
+	media_remux_job_t remux;
+	bool success;
+
+	if (os_atomic_load_bool(&batch->stop) ||
+	    os_atomic_load_bool(&job->canceled))
+		return false;
+
+	success = media_remux_job_create(&remux, job->in_filename,
+			job->out_filename) &&
+		media_remux_job_process(remux, batch_job_progress, &info);
+	media_remux_job_destroy(remux);
+
+	if (!success)
+		blog(LOG_WARNING, "media_remux: Failed to remux '%s' to '%s'",
+				job->in_filename, job->out_filename);
+	return success;
+}
+
+static void *batch_worker_thread(void *data)
+{
+	media_remux_batch_t batch = data;
+
+	os_set_thread_name("media-remux: worker thread");
+
+	while (os_sem_wait(batch->job_sem) == 0) {
+		struct remux_batch_job *job;
+		size_t idx;
+		bool success;
+
+		if (os_atomic_load_bool(&batch->stop))
+			break;
+
+		pthread_mutex_lock(&batch->mutex);
+		idx = batch->next_job++;
+		job = batch->jobs.array[idx];
+		pthread_mutex_unlock(&batch->mutex);
+
+		success = batch_job_run(batch, job, idx);
+
+		if (batch->done)
+			batch->done(batch->data, idx, success);
+
+		pthread_mutex_lock(&batch->mutex);
+		batch->num_finished++;
+		pthread_mutex_unlock(&batch->mutex);
+
+		os_event_signal(batch->finished_event);
+	}
+
+	return NULL;
+}
+
+media_remux_batch_t media_remux_batch_create(size_t num_workers,
+		media_remux_batch_progress_callback progress,
+		media_remux_batch_done_callback done, void *data)
+{
+	struct media_remux_batch *batch = bzalloc(sizeof(*batch));
+
+	batch->progress = progress;
+	batch->done     = done;
+	batch->data     = data;
+
+	if (!num_workers) {
+		int cores = os_get_physical_cores();
+		num_workers = cores > 0 ? (size_t)cores : 1;
+	}
+
+	/* registering is not thread safe, so it is done before any of the
+	 * workers create their jobs */
+	av_register_all();
+
+	pthread_mutex_init_value(&batch->mutex);
+	if (pthread_mutex_init(&batch->mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&batch->job_sem, 0) != 0)
+		goto fail;
+	if (os_event_init(&batch->finished_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	for (size_t i = 0; i < num_workers; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, batch_worker_thread,
+					batch) != 0)
+			goto fail;
+		da_push_back(batch->workers, &thread);
+	}
+
+	blog(LOG_INFO, "media_remux: Created batch with %d workers",
+			(int)num_workers);
+	return batch;
+
+fail:
+	media_remux_batch_destroy(batch);
+	return NULL;
+}
+
+size_t media_remux_batch_add(media_remux_batch_t batch,
+		const char *in_filename, const char *out_filename)
+{
+	struct remux_batch_job *job = bzalloc(sizeof(*job));
+	size_t idx;
+
+	job->in_filename  = bstrdup(in_filename);
+	job->out_filename = bstrdup(out_filename);
+
+	pthread_mutex_lock(&batch->mutex);
+	idx = batch->jobs.num;
+	da_push_back(batch->jobs, &job);
+	pthread_mutex_unlock(&batch->mutex);
+
+	os_sem_post(batch->job_sem);
+	return idx;
+}
+
+void media_remux_batch_cancel(media_remux_batch_t batch, size_t idx)
+{
+	pthread_mutex_lock(&batch->mutex);
+	if (idx < batch->jobs.num)
+		os_atomic_set_bool(&batch->jobs.array[idx]->canceled, true);
+	pthread_mutex_unlock(&batch->mutex);
+}
+
+void media_remux_batch_wait(media_remux_batch_t batch)
+{
+	for (;;) {
+		bool finished;
+
+		pthread_mutex_lock(&batch->mutex);
+		finished = batch->num_finished == batch->jobs.num;
+		pthread_mutex_unlock(&batch->mutex);
+
+		if (finished)
+			break;
+
+		os_event_wait(batch->finished_event);
+	}
+}
+
+void media_remux_batch_destroy(media_remux_batch_t batch)
+{
+	if (!batch)
+		return;
+
+	os_atomic_set_bool(&batch->stop, true);
+
+	for (size_t i = 0; i < batch->workers.num; i++)
+		os_sem_post(batch->job_sem);
+	for (size_t i = 0; i < batch->workers.num; i++)
+		pthread_join(batch->workers.array[i], NULL);
+
+	for (size_t i = 0; i < batch->jobs.num; i++) {
+		struct remux_batch_job *job = batch->jobs.array[i];
+		bfree(job->in_filename);
+		bfree(job->out_filename);
+		bfree(job);
+	}
+
+	da_free(batch->jobs);
+	da_free(batch->workers);
+	os_event_destroy(batch->finished_event);
+	os_sem_destroy(batch->job_sem);
+	pthread_mutex_destroy(&batch->mutex);
+	bfree(batch);
+}
@@ -34,6 +34,35 @@ EXPORT bool media_remux_job_process(media_remux_job_t job,
 		media_remux_progress_callback callback, void *data);
 EXPORT void media_remux_job_destroy(media_remux_job_t job);
 
+/*
+ * Remuxes a batch of files on a pool of worker threads.  Jobs start as soon
+ * as they are added.  The callbacks are called from the worker threads, the
+ * progress callback can return false to cancel its job.
+ */
+struct media_remux_batch;
+typedef struct media_remux_batch *media_remux_batch_t;
+
+typedef bool (media_remux_batch_progress_callback)(void *data, size_t job,
+		float percent);
+typedef void (media_remux_batch_done_callback)(void *data, size_t job,
+		bool success);
+
+/* num_workers of 0 uses one worker per physical core */
+EXPORT media_remux_batch_t media_remux_batch_create(size_t num_workers,
+		media_remux_batch_progress_callback progress,
+		media_remux_batch_done_callback done, void *data);
+
+/* returns the index of the job that is passed to the callbacks */
+EXPORT size_t media_remux_batch_add(media_remux_batch_t batch,
+		const char *in_filename, const char *out_filename);
+EXPORT void media_remux_batch_cancel(media_remux_batch_t batch, size_t job);
+
+/* waits until every job added so far has finished or been canceled */
+EXPORT void media_remux_batch_wait(media_remux_batch_t batch);
+
+/* cancels any unfinished jobs */
+EXPORT void media_remux_batch_destroy(media_remux_batch_t batch);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,6 +20,7 @@
 #include "../util/bmem.h"
 #include "../util/platform.h"
 #include "../util/profiler.h"
+#include "../util/metrics.h"
 #include "../util/threading.h"
 #include "../util/darray.h"
 
@@ -33,134 +34,322 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 #define MAX_CONVERT_BUFFERS 3
 #define MAX_CACHE_SIZE 16
 
+/* count and skipped are added to by the graphics thread while the video
+ * thread is sending the frame, the rest of the frame info is only touched by
+ * the thread that owns the slot */
 struct cached_frame_info {
 	struct video_data frame;
-	int skipped;
-	int count;
+	volatile long skipped;
+	volatile long count;
 };
 
-struct video_input {
+/* scaled frames, shared by all inputs that ask for the same conversion so
+ * that each output frame is only scaled once per conversion */
+struct scaled_frame_cache {
 	struct video_scale_info   conversion;
 	video_scaler_t            *scaler;
 	struct video_frame        frame[MAX_CONVERT_BUFFERS];
 	int                       cur_frame;
+	bool                      frame_scaled;
+	uint64_t                  last_tick;
+	long                      refs;
+};
+
+struct video_input {
+	struct video_scale_info   conversion;
+	struct scaled_frame_cache *cache;
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
 };
 
-static inline void video_input_free(struct video_input *input)
-{
-	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
-}
-
 struct video_output {
 	struct video_output_info   info;
 
 	pthread_t                  thread;
-	pthread_mutex_t            data_mutex;
 	bool                       stop;
+	volatile bool              profile_locks;
 
 	os_sem_t                   *update_semaphore;
 	uint64_t                   frame_time;
 	uint32_t                   skipped_frames;
 	uint32_t                   total_frames;
+	metrics_counter_t          *skipped_metric;
 
 	bool                       initialized;
 
 	pthread_mutex_t            input_mutex;
 	DARRAY(struct video_input) inputs;
-
-	size_t                     available_frames;
-	size_t                     first_added;
-	size_t                     last_added;
+	DARRAY(struct scaled_frame_cache*) scale_caches;
+	uint64_t                   tick;
+	uint32_t                   scaled_frames;
+	uint32_t                   shared_scaled_frames;
+
+	/* single producer, single consumer (video thread) ring: write_idx is
+	 * only used by the producer, read_idx only by the consumer, and
+	 * queued_frames is the only shared index.  lock/unlock_frame and
+	 * repeat_frame both produce, so they are serialized by
+	 * producer_mutex */
+	pthread_mutex_t            producer_mutex;
+	volatile long              queued_frames;
+	size_t                     write_idx;
+	size_t                     read_idx;
 	struct cached_frame_info   cache[MAX_CACHE_SIZE];
 };
 
 /* ------------------------------------------------------------------------- */
 
-static inline bool scale_video_output(struct video_input *input,
-		struct video_data *data)
+static inline bool conversion_equal(const struct video_scale_info *a,
+		const struct video_scale_info *b)
 {
-	bool success = true;
+	return a->format     == b->format &&
+	       a->width      == b->width &&
+	       a->height     == b->height &&
+	       a->range      == b->range &&
+	       a->colorspace == b->colorspace;
+}
 
-	if (input->scaler) {
-		struct video_frame *frame;
+static void scaled_frame_cache_release(struct video_output *video,
+		struct scaled_frame_cache *cache)
+{
+	if (!cache || --cache->refs > 0)
+		return;
 
-		if (++input->cur_frame == MAX_CONVERT_BUFFERS)
-			input->cur_frame = 0;
+	da_erase_item(video->scale_caches, &cache);
 
-		frame = &input->frame[input->cur_frame];
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		video_frame_free(&cache->frame[i]);
+	video_scaler_destroy(cache->scaler);
+	bfree(cache);
+}
 
-		success = video_scaler_scale(input->scaler,
-				frame->data, frame->linesize,
-				(const uint8_t * const*)data->data,
-				data->linesize);
+static struct scaled_frame_cache *scaled_frame_cache_get(
+		struct video_output *video,
+		const struct video_scale_info *conversion)
+{
+	struct scaled_frame_cache *cache;
+	struct video_scale_info from = {
+		.format = video->info.format,
+		.width  = video->info.width,
+		.height = video->info.height,
+	};
+	int ret;
+
+	for (size_t i = 0; i < video->scale_caches.num; i++) {
+		cache = video->scale_caches.array[i];
+
+		if (conversion_equal(&cache->conversion, conversion)) {
+			cache->refs++;
+			return cache;
+		}
+	}
 
-		if (success) {
-			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-				data->data[i]     = frame->data[i];
-				data->linesize[i] = frame->linesize[i];
-			}
-		} else {
-			blog(LOG_WARNING, "video-io: Could not scale frame!");
+	cache = bzalloc(sizeof(struct scaled_frame_cache));
+	cache->conversion = *conversion;
+	cache->last_tick  = video->tick;
+	cache->refs       = 1;
+
+	ret = video_scaler_create(&cache->scaler, conversion, &from,
+			VIDEO_SCALE_FAST_BILINEAR);
+	if (ret != VIDEO_SCALER_SUCCESS) {
+		if (ret == VIDEO_SCALER_BAD_CONVERSION)
+			blog(LOG_ERROR, "video_input_init: Bad "
+			                "scale conversion type");
+		else
+			blog(LOG_ERROR, "video_input_init: Failed to "
+			                "create scaler");
+
+		bfree(cache);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		video_frame_init(&cache->frame[i], conversion->format,
+				conversion->width, conversion->height);
+
+	da_push_back(video->scale_caches, &cache);
+	return cache;
+}
+
+static inline void video_input_free(struct video_output *video,
+		struct video_input *input)
+{
+	scaled_frame_cache_release(video, input->cache);
+}
+
+static inline bool scale_video_output(struct video_output *video,
+		struct video_input *input, struct video_data *data)
+{
+	struct scaled_frame_cache *cache = input->cache;
+	struct video_frame *frame;
+
+	if (!cache)
+		return true;
+
+	/* only the first input that needs this conversion on a given tick
+	 * scales the frame, the others reuse the result */
+	if (cache->last_tick != video->tick) {
+		cache->last_tick = video->tick;
+
+		/* the last scaled image is still the same, don't scale again */
+		if (!data->duplicate || !cache->frame_scaled) {
+			/* the input callbacks use the frame before they return,
+			 * so the buffers are simply used in turn */
+			if (++cache->cur_frame == MAX_CONVERT_BUFFERS)
+				cache->cur_frame = 0;
+
+			frame = &cache->frame[cache->cur_frame];
+
+			cache->frame_scaled = video_scaler_scale(cache->scaler,
+					frame->data, frame->linesize,
+					(const uint8_t * const*)data->data,
+					data->linesize);
+			if (!cache->frame_scaled)
+				blog(LOG_WARNING, "video-io: Could not scale "
+				                  "frame!");
+
+			video->scaled_frames++;
 		}
+
+	} else if (cache->frame_scaled) {
+		video->shared_scaled_frames++;
 	}
 
-	return success;
+	if (!cache->frame_scaled)
+		return false;
+
+	frame = &cache->frame[cache->cur_frame];
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		data->data[i]     = frame->data[i];
+		data->linesize[i] = frame->linesize[i];
+	}
+
+	return true;
 }
 
-static inline bool video_output_cur_frame(struct video_output *video)
+static inline void atomic_add(volatile long *val, long add)
 {
-	struct cached_frame_info *frame_info;
-	bool complete;
-	bool skipped;
+	long old;
+	do {
+		old = os_atomic_load_long(val);
+	} while (!os_atomic_compare_swap_long(val, old, old + add));
+}
 
-	/* -------------------------------- */
+/* adds to the send count of a queued frame, unless the video thread already
+ * finished sending it */
+static inline bool add_frame_count(struct cached_frame_info *cfi, long add)
+{
+	long old;
+	do {
+		old = os_atomic_load_long(&cfi->count);
+		if (old == 0)
+			return false;
+	} while (!os_atomic_compare_swap_long(&cfi->count, old, old + add));
+
+	return true;
+}
 
-	pthread_mutex_lock(&video->data_mutex);
+/* the video thread is only a few instructions away from handing the slot
+ * back when the hand-off has to wait, so spin briefly before yielding, and
+ * sleep if it got preempted in between */
+#define HANDOFF_SPINS 64
 
-	frame_info = &video->cache[video->first_added];
+static inline void handoff_backoff(int *spins)
+{
+	if (++(*spins) <= HANDOFF_SPINS)
+		return;
 
-	pthread_mutex_unlock(&video->data_mutex);
+	os_sleep_ms(*spins <= HANDOFF_SPINS * 2 ? 0 : 1);
+}
 
-	/* -------------------------------- */
+static inline size_t prev_cache_idx(const struct video_output *video,
+		size_t idx)
+{
+	return idx == 0 ? video->info.cache_size - 1 : idx - 1;
+}
 
+/* lock wait profiling, to check for contention between the graphics thread,
+ * the video thread and the threads that (dis)connect outputs */
+static const char *input_lock_cur_frame_name =
+	"video_output_cur_frame: input_mutex wait";
+static const char *input_lock_connect_name =
+	"video_output_connect: input_mutex wait";
+static const char *input_lock_disconnect_name =
+	"video_output_disconnect: input_mutex wait";
+static const char *lock_frame_name = "video_output_lock_frame";
+static const char *unlock_frame_name = "video_output_unlock_frame";
+static const char *repeat_frame_name = "video_output_repeat_frame";
+
+static inline void lock_inputs(struct video_output *video, const char *name)
+{
+	if (!video->profile_locks) {
+		pthread_mutex_lock(&video->input_mutex);
+		return;
+	}
+
+	profile_start(name);
 	pthread_mutex_lock(&video->input_mutex);
+	profile_end(name);
+}
+
+static inline void profile_handoff_start(struct video_output *video,
+		const char *name)
+{
+	if (video->profile_locks)
+		profile_start(name);
+}
+
+static inline void profile_handoff_end(struct video_output *video,
+		const char *name)
+{
+	if (video->profile_locks)
+		profile_end(name);
+}
+
+static inline bool video_output_cur_frame(struct video_output *video)
+{
+	struct cached_frame_info *frame_info;
+	bool complete;
+
+	frame_info = &video->cache[video->read_idx];
+
+	/* -------------------------------- */
+
+	lock_inputs(video, input_lock_cur_frame_name);
+
+	video->tick++;
 
 	for (size_t i = 0; i < video->inputs.num; i++) {
 		struct video_input *input = video->inputs.array+i;
 		struct video_data frame = frame_info->frame;
 
-		if (scale_video_output(input, &frame))
+		if (scale_video_output(video, input, &frame)) {
 			input->callback(input->param, &frame);
+		}
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
 
 	/* -------------------------------- */
 
-	pthread_mutex_lock(&video->data_mutex);
-
+	/* any further sends of this cached frame repeat the same image */
 	frame_info->frame.timestamp += video->frame_time;
-	complete = --frame_info->count == 0;
-	skipped = frame_info->skipped > 0;
+	frame_info->frame.duplicate = true;
+	complete = os_atomic_dec_long(&frame_info->count) == 0;
 
 	if (complete) {
-		if (++video->first_added == video->info.cache_size)
-			video->first_added = 0;
+		if (++video->read_idx == video->info.cache_size)
+			video->read_idx = 0;
 
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
-	} else if (skipped) {
-		--frame_info->skipped;
+		/* hands the slot back to the graphics thread */
+		os_atomic_dec_long(&video->queued_frames);
+
+	} else if (os_atomic_load_long(&frame_info->skipped) > 0) {
+		os_atomic_dec_long(&frame_info->skipped);
 		++video->skipped_frames;
+		metrics_counter_inc(video->skipped_metric);
 	}
 
-	pthread_mutex_unlock(&video->data_mutex);
-
 	/* -------------------------------- */
 
 	return complete;
@@ -215,7 +404,9 @@ static inline void init_cache(struct video_output *video)
 				video->info.width, video->info.height);
 	}
 
-	video->available_frames = video->info.cache_size;
+	video->queued_frames = 0;
+	video->write_idx = 0;
+	video->read_idx = 0;
 }
 
 int video_output_open(video_t **video, struct video_output_info *info)
@@ -234,15 +425,16 @@ int video_output_open(video_t **video, struct video_output_info *info)
 	out->frame_time = (uint64_t)(1000000000.0 * (double)info->fps_den /
 		(double)info->fps_num);
 	out->initialized = false;
+	out->skipped_metric = metrics_counter_get("video.skipped_frames");
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		goto fail;
 	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
 		goto fail;
-	if (pthread_mutex_init(&out->data_mutex, &attr) != 0)
-		goto fail;
 	if (pthread_mutex_init(&out->input_mutex, &attr) != 0)
 		goto fail;
+	if (pthread_mutex_init(&out->producer_mutex, NULL) != 0)
+		goto fail;
 	if (os_sem_init(&out->update_semaphore, 0) != 0)
 		goto fail;
 	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
@@ -267,15 +459,16 @@ void video_output_close(video_t *video)
 	video_output_stop(video);
 
 	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+		video_input_free(video, &video->inputs.array[i]);
 	da_free(video->inputs);
+	da_free(video->scale_caches);
 
 	for (size_t i = 0; i < video->info.cache_size; i++)
 		video_frame_free((struct video_frame*)&video->cache[i]);
 
 	os_sem_destroy(video->update_semaphore);
-	pthread_mutex_destroy(&video->data_mutex);
 	pthread_mutex_destroy(&video->input_mutex);
+	pthread_mutex_destroy(&video->producer_mutex);
 	bfree(video);
 }
 
@@ -298,31 +491,10 @@ static inline bool video_input_init(struct video_input *input,
 	if (input->conversion.width  != video->info.width ||
 	    input->conversion.height != video->info.height ||
 	    input->conversion.format != video->info.format) {
-		struct video_scale_info from = {
-			.format = video->info.format,
-			.width  = video->info.width,
-			.height = video->info.height,
-		};
-
-		int ret = video_scaler_create(&input->scaler,
-				&input->conversion, &from,
-				VIDEO_SCALE_FAST_BILINEAR);
-		if (ret != VIDEO_SCALER_SUCCESS) {
-			if (ret == VIDEO_SCALER_BAD_CONVERSION)
-				blog(LOG_ERROR, "video_input_init: Bad "
-				                "scale conversion type");
-			else
-				blog(LOG_ERROR, "video_input_init: Failed to "
-				                "create scaler");
-
+		input->cache = scaled_frame_cache_get(video,
+				&input->conversion);
+		if (!input->cache)
 			return false;
-		}
-
-		for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-			video_frame_init(&input->frame[i],
-					input->conversion.format,
-					input->conversion.width,
-					input->conversion.height);
 	}
 
 	return true;
@@ -338,11 +510,13 @@ bool video_output_connect(video_t *video,
 	if (!video || !callback)
 		return false;
 
-	pthread_mutex_lock(&video->input_mutex);
+	lock_inputs(video, input_lock_connect_name);
 
 	if (video->inputs.num == 0) {
 		video->skipped_frames = 0;
 		video->total_frames = 0;
+		video->scaled_frames = 0;
+		video->shared_scaled_frames = 0;
 	}
 
 	if (video_get_input_idx(video, callback, param) == DARRAY_INVALID) {
@@ -382,11 +556,11 @@ void video_output_disconnect(video_t *video,
 	if (!video || !callback)
 		return;
 
-	pthread_mutex_lock(&video->input_mutex);
+	lock_inputs(video, input_lock_disconnect_name);
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array+idx);
+		video_input_free(video, video->inputs.array+idx);
 		da_erase(video->inputs, idx);
 	}
 
@@ -402,6 +576,13 @@ void video_output_disconnect(video_t *video,
 					video->skipped_frames,
 					video->total_frames,
 					percentage_skipped);
+
+		if (video->shared_scaled_frames)
+			blog(LOG_INFO, "Video stopped, scaled frames: "
+					"%"PRIu32", reused by other "
+					"outputs: %"PRIu32,
+					video->scaled_frames,
+					video->shared_scaled_frames);
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
@@ -423,47 +604,124 @@ bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 {
 	struct cached_frame_info *cfi;
 	bool locked;
+	int spins = 0;
 
 	if (!video) return false;
 
-	pthread_mutex_lock(&video->data_mutex);
+	profile_handoff_start(video, lock_frame_name);
 
-	if (video->available_frames == 0) {
-		video->cache[video->last_added].count += count;
-		video->cache[video->last_added].skipped += count;
-		locked = false;
+	/* held until video_output_unlock_frame when the frame is locked */
+	pthread_mutex_lock(&video->producer_mutex);
 
-	} else {
-		if (video->available_frames != video->info.cache_size) {
-			if (++video->last_added == video->info.cache_size)
-				video->last_added = 0;
-		}
+	for (;;) {
+		long queued = os_atomic_load_long(&video->queued_frames);
+
+		if (queued == (long)video->info.cache_size) {
+			cfi = &video->cache[prev_cache_idx(video,
+					video->write_idx)];
+
+			/* if the video thread just finished the last frame,
+			 * a slot is about to become free */
+			if (!add_frame_count(cfi, count)) {
+				handoff_backoff(&spins);
+				continue;
+			}
 
-		cfi = &video->cache[video->last_added];
-		cfi->frame.timestamp = timestamp;
-		cfi->count = count;
-		cfi->skipped = 0;
+			atomic_add(&cfi->skipped, count);
+			locked = false;
 
-		memcpy(frame, &cfi->frame, sizeof(*frame));
+		} else {
+			cfi = &video->cache[video->write_idx];
+			cfi->frame.timestamp = timestamp;
+			cfi->frame.duplicate = false;
+			cfi->count = count;
+			cfi->skipped = 0;
+
+			memcpy(frame, &cfi->frame, sizeof(*frame));
+
+			locked = true;
+		}
 
-		locked = true;
+		break;
 	}
 
-	pthread_mutex_unlock(&video->data_mutex);
+	if (!locked)
+		pthread_mutex_unlock(&video->producer_mutex);
+
+	profile_handoff_end(video, lock_frame_name);
 
 	return locked;
 }
 
+static inline void queue_frame(struct video_output *video)
+{
+	if (++video->write_idx == video->info.cache_size)
+		video->write_idx = 0;
+
+	os_atomic_inc_long(&video->queued_frames);
+	os_sem_post(video->update_semaphore);
+}
+
 void video_output_unlock_frame(video_t *video)
 {
 	if (!video) return;
 
-	pthread_mutex_lock(&video->data_mutex);
+	profile_handoff_start(video, unlock_frame_name);
+	queue_frame(video);
+	pthread_mutex_unlock(&video->producer_mutex);
+	profile_handoff_end(video, unlock_frame_name);
+}
 
-	video->available_frames--;
-	os_sem_post(video->update_semaphore);
+bool video_output_repeat_frame(video_t *video, int count, uint64_t timestamp)
+{
+	struct cached_frame_info *cfi;
+	struct cached_frame_info *prev;
+	int spins = 0;
+
+	if (!video) return false;
+
+	profile_handoff_start(video, repeat_frame_name);
+	pthread_mutex_lock(&video->producer_mutex);
+
+	prev = &video->cache[prev_cache_idx(video, video->write_idx)];
+
+	/* the last frame is still queued, just send it more times */
+	while (os_atomic_load_long(&video->queued_frames) != 0) {
+		if (add_frame_count(prev, count)) {
+			pthread_mutex_unlock(&video->producer_mutex);
+			profile_handoff_end(video, repeat_frame_name);
+			return true;
+		}
 
-	pthread_mutex_unlock(&video->data_mutex);
+		/* the last frame was just sent, wait for its slot */
+		handoff_backoff(&spins);
+	}
+
+	/* the queue is empty, so the last frame that was sent sits right
+	 * before the next free slot */
+	cfi = &video->cache[video->write_idx];
+
+	if (cfi != prev)
+		video_frame_copy((struct video_frame*)&cfi->frame,
+				(const struct video_frame*)&prev->frame,
+				video->info.format, video->info.height);
+
+	cfi->frame.timestamp = timestamp;
+	cfi->frame.duplicate = true;
+	cfi->count = count;
+	cfi->skipped = 0;
+
+	queue_frame(video);
+
+	pthread_mutex_unlock(&video->producer_mutex);
+	profile_handoff_end(video, repeat_frame_name);
+	return true;
+}
+
+void video_output_set_lock_profiling(video_t *video, bool enable)
+{
+	if (video)
+		os_atomic_set_bool(&video->profile_locks, enable);
 }
 
 uint64_t video_output_get_frame_time(const video_t *video)
@@ -526,3 +784,13 @@ uint32_t video_output_get_total_frames(const video_t *video)
 {
 	return video->total_frames;
 }
+
+uint32_t video_output_get_scaled_frames(const video_t *video)
+{
+	return video ? video->scaled_frames : 0;
+}
+
+uint32_t video_output_get_shared_scaled_frames(const video_t *video)
+{
+	return video ? video->shared_scaled_frames : 0;
+}
@@ -68,6 +68,9 @@ struct video_data {
 	uint8_t           *data[MAX_AV_PLANES];
 	uint32_t          linesize[MAX_AV_PLANES];
 	uint64_t          timestamp;
+
+	/* the image is identical to the previously sent frame */
+	bool              duplicate;
 };
 
 struct video_output_info {
@@ -168,6 +171,23 @@ EXPORT const struct video_output_info *video_output_get_info(
 EXPORT bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 		int count, uint64_t timestamp);
 EXPORT void video_output_unlock_frame(video_t *video);
+
+/**
+ * Sends the most recently output frame again instead of locking a new one.
+ * Used when the canvas did not change since the last frame, so that the
+ * caller can skip rendering and conversion.  Must only be called once at
+ * least one frame has been output.
+ */
+EXPORT bool video_output_repeat_frame(video_t *video, int count,
+		uint64_t timestamp);
+
+/**
+ * Enables profiling of the time the graphics thread, the video thread and
+ * output (dis)connects spend in the frame hand-off and waiting for locks.
+ * The waits show up as their own entries in the profiler.
+ */
+EXPORT void video_output_set_lock_profiling(video_t *video, bool enable);
+
 EXPORT uint64_t video_output_get_frame_time(const video_t *video);
 EXPORT void video_output_stop(video_t *video);
 EXPORT bool video_output_stopped(video_t *video);
@@ -179,6 +199,8 @@ EXPORT double video_output_get_frame_rate(const video_t *video);
 
 EXPORT uint32_t video_output_get_skipped_frames(const video_t *video);
 EXPORT uint32_t video_output_get_total_frames(const video_t *video);
+EXPORT uint32_t video_output_get_scaled_frames(const video_t *video);
+EXPORT uint32_t video_output_get_shared_scaled_frames(const video_t *video);
 
 
 #ifdef __cplusplus
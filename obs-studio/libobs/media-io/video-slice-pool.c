@@ -0,0 +1,180 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "../util/bmem.h"
+#include "../util/platform.h"
+#include "../util/threading.h"
+#include "video-slice-pool.h"
+
+/* a few slices per thread, so a thread that got descheduled doesn't hold up
+ * the whole frame, while keeping each slice big enough to stay sequential in
+ * memory */
+#define SLICES_PER_THREAD 2
+#define MAX_THREADS       16
+
+struct video_slice_pool {
+	pthread_t          *threads;
+	size_t             num_workers;
+	os_sem_t           *start_sem;
+	os_sem_t           *done_sem;
+	volatile bool      exit;
+
+	/* current run, written before start_sem is posted */
+	video_slice_func_t func;
+	void               *param;
+	uint32_t           height;
+	uint32_t           slice_height;
+	long               num_slices;
+	volatile long      next_slice;
+};
+
+static void run_slices(struct video_slice_pool *pool)
+{
+	for (;;) {
+		long slice = os_atomic_inc_long(&pool->next_slice) - 1;
+		uint32_t start_y, end_y;
+
+		if (slice >= pool->num_slices)
+			break;
+
+		start_y = (uint32_t)slice * pool->slice_height;
+		end_y   = start_y + pool->slice_height;
+		if (end_y > pool->height)
+			end_y = pool->height;
+
+		pool->func(pool->param, start_y, end_y);
+	}
+}
+
+static void *slice_worker(void *data)
+{
+	struct video_slice_pool *pool = data;
+
+	os_set_thread_name("video-slice-pool: worker");
+
+	for (;;) {
+		if (os_sem_wait(pool->start_sem) != 0)
+			break;
+		if (pool->exit)
+			break;
+
+		run_slices(pool);
+		os_sem_post(pool->done_sem);
+	}
+
+	return NULL;
+}
+
+static size_t default_num_threads(void)
+{
+	/* the encoders need the cores more than the conversion does */
+	int cores = os_get_physical_cores() / 2;
+	return cores < 1 ? 1 : (cores > 4 ? 4 : (size_t)cores);
+}
+
+video_slice_pool_t *video_slice_pool_create(size_t num_threads)
+{
+	struct video_slice_pool *pool = bzalloc(sizeof(*pool));
+
+	if (!num_threads)
+		num_threads = default_num_threads();
+	if (num_threads > MAX_THREADS)
+		num_threads = MAX_THREADS;
+
+	if (os_sem_init(&pool->start_sem, 0) != 0)
+		goto fail;
+	if (os_sem_init(&pool->done_sem, 0) != 0)
+		goto fail;
+
+	pool->threads = bzalloc(sizeof(pthread_t) * num_threads);
+
+	for (size_t i = 0; i + 1 < num_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, slice_worker,
+					pool) != 0) {
+			blog(LOG_WARNING, "video_slice_pool_create: failed to "
+					"create worker %d", (int)i);
+			break;
+		}
+
+		pool->num_workers++;
+	}
+
+	return pool;
+
+fail:
+	video_slice_pool_destroy(pool);
+	return NULL;
+}
+
+void video_slice_pool_destroy(video_slice_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	pool->exit = true;
+
+	for (size_t i = 0; i < pool->num_workers; i++)
+		os_sem_post(pool->start_sem);
+	for (size_t i = 0; i < pool->num_workers; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	os_sem_destroy(pool->start_sem);
+	os_sem_destroy(pool->done_sem);
+	bfree(pool->threads);
+	bfree(pool);
+}
+
+size_t video_slice_pool_num_threads(const video_slice_pool_t *pool)
+{
+	return pool ? pool->num_workers + 1 : 1;
+}
+
+void video_slice_pool_run(video_slice_pool_t *pool,
+		video_slice_func_t func, void *param,
+		uint32_t height, uint32_t row_align)
+{
+	uint32_t num_threads;
+	uint32_t slice_height;
+
+	if (!pool || !pool->num_workers) {
+		func(param, 0, height);
+		return;
+	}
+
+	if (!row_align)
+		row_align = 1;
+
+	num_threads  = (uint32_t)pool->num_workers + 1;
+	slice_height = (height + num_threads * SLICES_PER_THREAD - 1) /
+		(num_threads * SLICES_PER_THREAD);
+	slice_height = (slice_height + row_align - 1) / row_align * row_align;
+	if (!slice_height)
+		slice_height = row_align;
+
+	pool->func         = func;
+	pool->param        = param;
+	pool->height       = height;
+	pool->slice_height = slice_height;
+	pool->num_slices   = (long)((height + slice_height - 1) / slice_height);
+	pool->next_slice   = 0;
+
+	for (size_t i = 0; i < pool->num_workers; i++)
+		os_sem_post(pool->start_sem);
+
+	run_slices(pool);
+
+	for (size_t i = 0; i < pool->num_workers; i++)
+		os_sem_wait(pool->done_sem);
+}
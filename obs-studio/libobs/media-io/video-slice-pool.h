@@ -0,0 +1,58 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+
+/*
+ * Runs a per-row function (such as the format conversions) over a frame in
+ * parallel, by splitting the rows into slices that are handed out to a fixed
+ * set of worker threads.  The thread calling video_slice_pool_run works on
+ * slices too, so a pool of N threads creates N-1 workers.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct video_slice_pool;
+typedef struct video_slice_pool video_slice_pool_t;
+
+typedef void (*video_slice_func_t)(void *param, uint32_t start_y,
+		uint32_t end_y);
+
+/**
+ * Creates a pool with the given number of threads, including the calling
+ * thread.  0 picks a number based on the CPU.  Returns NULL on failure.
+ */
+EXPORT video_slice_pool_t *video_slice_pool_create(size_t num_threads);
+EXPORT void video_slice_pool_destroy(video_slice_pool_t *pool);
+
+EXPORT size_t video_slice_pool_num_threads(const video_slice_pool_t *pool);
+
+/**
+ * Calls func for slices covering rows 0 to height, and returns when all of
+ * them are done.  Slice boundaries are multiples of row_align (for example
+ * 2 for 4:2:0 output).  Only one thread may run a pool at a time.  A NULL
+ * pool runs the whole frame on the calling thread.
+ */
+EXPORT void video_slice_pool_run(video_slice_pool_t *pool,
+		video_slice_func_t func, void *param,
+		uint32_t height, uint32_t row_align);
+
+#ifdef __cplusplus
+}
+#endif
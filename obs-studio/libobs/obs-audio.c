@@ -16,6 +16,7 @@
 ******************************************************************************/
 
 #include <inttypes.h>
+#include <xmmintrin.h>
 #include "obs-internal.h"
 
 struct ts_info {
@@ -43,9 +44,35 @@ static inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
 	return (size_t)(t * (uint64_t)sample_rate / 1000000000ULL);
 }
 
+static inline void mix_float_buffer(float *mix, const float *aud,
+		size_t count)
+{
+	size_t i = 0;
+
+	/* the start point is in frames, so the buffers can be unaligned */
+	for (; i + 16 <= count; i += 16) {
+		__m128 a = _mm_add_ps(_mm_loadu_ps(mix + i),
+				_mm_loadu_ps(aud + i));
+		__m128 b = _mm_add_ps(_mm_loadu_ps(mix + i + 4),
+				_mm_loadu_ps(aud + i + 4));
+		__m128 c = _mm_add_ps(_mm_loadu_ps(mix + i + 8),
+				_mm_loadu_ps(aud + i + 8));
+		__m128 d = _mm_add_ps(_mm_loadu_ps(mix + i + 12),
+				_mm_loadu_ps(aud + i + 12));
+
+		_mm_storeu_ps(mix + i,      a);
+		_mm_storeu_ps(mix + i + 4,  b);
+		_mm_storeu_ps(mix + i + 8,  c);
+		_mm_storeu_ps(mix + i + 12, d);
+	}
+
+	for (; i < count; i++)
+		mix[i] += aud[i];
+}
+
 static inline void mix_audio(struct audio_output_data *mixes,
-		obs_source_t *source, size_t channels, size_t sample_rate,
-		struct ts_info *ts)
+		obs_source_t *source, uint32_t mixers, size_t channels,
+		size_t sample_rate, struct ts_info *ts)
 {
 	size_t total_floats = AUDIO_OUTPUT_FRAMES;
 	size_t start_point = 0;
@@ -63,18 +90,18 @@ static inline void mix_audio(struct audio_output_data *mixes,
 	}
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-		for (size_t ch = 0; ch < channels; ch++) {
-			register float *mix = mixes[mix_idx].data[ch];
-			register float *aud =
-				source->audio_output_buf[mix_idx][ch];
-			register float *end;
+		uint32_t mix_and_val = (1 << mix_idx);
 
-			mix += start_point;
-			end = aud + total_floats;
+		/* mixes without outputs have no buffers, and the source's
+		 * output for mixes it isn't assigned to is silent */
+		if ((mixers & mix_and_val) == 0 ||
+		    (source->audio_mixers & mix_and_val) == 0)
+			continue;
 
-			while (aud < end)
-				*(mix++) += *(aud++);
-		}
+		for (size_t ch = 0; ch < channels; ch++)
+			mix_float_buffer(mixes[mix_idx].data[ch] + start_point,
+					source->audio_output_buf[mix_idx][ch],
+					total_floats);
 	}
 }
 
@@ -257,6 +284,7 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 	ms = ticks * AUDIO_OUTPUT_FRAMES * 1000 / sample_rate;
 	total_ms = audio->total_buffering_ticks * AUDIO_OUTPUT_FRAMES * 1000 /
 		sample_rate;
+	metrics_gauge_set(audio->buffering_metric, (int64_t)total_ms);
 
 	blog(LOG_INFO, "adding %d milliseconds of audio buffering, total "
 			"audio buffering is now %d milliseconds",
@@ -445,8 +473,8 @@ bool audio_callback(void *param,
 			pthread_mutex_lock(&source->audio_buf_mutex);
 
 			if (source->audio_output_buf[0][0] && source->audio_ts)
-				mix_audio(mixes, source, channels, sample_rate,
-						&ts);
+				mix_audio(mixes, source, mixers, channels,
+						sample_rate, &ts);
 
 			pthread_mutex_unlock(&source->audio_buf_mutex);
 		}
@@ -15,7 +15,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
-#include "obs.h"
+#include "obs-internal.h"
 #include "obs-avc.h"
 #include "util/array-serializer.h"
 
@@ -97,11 +97,19 @@ static inline int get_drop_priority(int priority)
 	return priority;
 }
 
-static void serialize_avc_data(struct serializer *s, const uint8_t *data,
+/* every start code of at least three bytes becomes a four byte size, so the
+ * output is at most a third larger than the input */
+static inline size_t max_avc_data_size(size_t size)
+{
+	return size + size / 3 + 4;
+}
+
+static size_t write_avc_data(uint8_t *output, const uint8_t *data,
 		size_t size, bool *is_keyframe, int *priority)
 {
 	const uint8_t *nal_start, *nal_end;
 	const uint8_t *end = data+size;
+	uint8_t *out = output;
 	int type;
 
 	nal_start = obs_avc_find_startcode(data, end);
@@ -121,28 +129,30 @@ static void serialize_avc_data(struct serializer *s, const uint8_t *data,
 		}
 
 		nal_end = obs_avc_find_startcode(nal_start, end);
-		s_wb32(s, (uint32_t)(nal_end - nal_start));
-		s_write(s, nal_start, nal_end - nal_start);
+		size = nal_end - nal_start;
+
+		out[0] = (uint8_t)(size >> 24);
+		out[1] = (uint8_t)(size >> 16);
+		out[2] = (uint8_t)(size >> 8);
+		out[3] = (uint8_t)size;
+		memcpy(out + 4, nal_start, size);
+
+		out += 4 + size;
 		nal_start = nal_end;
 	}
+
+	return out - output;
 }
 
 void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 		const struct encoder_packet *src)
 {
-	struct array_output_data output;
-	struct serializer s;
-	long ref = 1;
-
-	array_output_serializer_init(&s, &output);
 	*avc_packet = *src;
 
-	serialize(&s, &ref, sizeof(ref));
-	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe,
+	avc_packet->data = obs_packet_pool_alloc(max_avc_data_size(src->size));
+	avc_packet->size = write_avc_data(avc_packet->data, src->data,
+			src->size, &avc_packet->keyframe,
 			&avc_packet->priority);
-
-	avc_packet->data          = output.bytes.array + sizeof(ref);
-	avc_packet->size          = output.bytes.num - sizeof(ref);
 	avc_packet->drop_priority = get_drop_priority(avc_packet->priority);
 }
 
@@ -25,14 +25,23 @@
 
 struct obs_encoder_info *find_encoder(const char *id)
 {
-	for (size_t i = 0; i < obs->encoder_types.num; i++) {
-		struct obs_encoder_info *info = obs->encoder_types.array+i;
+	struct obs_encoder_info *info = NULL;
+
+	pthread_mutex_lock(&obs->types_mutex);
 
-		if (strcmp(info->id, id) == 0)
-			return info;
+	for (size_t i = 0; i < obs->encoder_types.num; i++) {
+		if (strcmp(obs->encoder_types.array[i].id, id) == 0) {
+			info = obs->encoder_types.array+i;
+			break;
+		}
 	}
 
-	return NULL;
+	pthread_mutex_unlock(&obs->types_mutex);
+
+	if (!info && load_deferred_module(MODULE_PROVIDES_ENCODER, id))
+		info = find_encoder(id);
+
+	return info;
 }
 
 const char *obs_encoder_get_display_name(const char *id)
@@ -70,6 +79,18 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 	return true;
 }
 
+static metrics_histogram_t *get_encode_metric(const char *name)
+{
+	struct dstr metric_name = {0};
+	metrics_histogram_t *metric;
+
+	dstr_printf(&metric_name, "encoder.%s.encode", name);
+	metric = metrics_histogram_get(metric_name.array);
+	dstr_free(&metric_name);
+
+	return metric;
+}
+
 static struct obs_encoder *create_encoder(const char *id,
 		enum obs_encoder_type type, const char *name,
 		obs_data_t *settings, size_t mixer_idx, obs_data_t *hotkey_data)
@@ -103,6 +124,7 @@ static struct obs_encoder *create_encoder(const char *id,
 
 	encoder->control = bzalloc(sizeof(obs_weak_encoder_t));
 	encoder->control->encoder = encoder;
+	encoder->encode_metric = get_encode_metric(name);
 
 	obs_context_data_insert(&encoder->context,
 			&obs->data.encoders_mutex,
@@ -468,6 +490,11 @@ static inline void obs_encoder_start_internal(obs_encoder_t *encoder,
 
 	if (first) {
 		encoder->cur_pts = 0;
+		encoder->last_encoded_pts = 0;
+		encoder->received_frames = 0;
+		encoder->skipped_frames = 0;
+		encoder->encode_time_ns = 0;
+		encoder->encode_calls = 0;
 		add_connection(encoder);
 	}
 }
@@ -616,6 +643,42 @@ uint32_t obs_encoder_get_height(const obs_encoder_t *encoder)
 		video_output_get_height(encoder->media);
 }
 
+void obs_encoder_set_skip_duplicate_frames(obs_encoder_t *encoder, bool skip)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_set_skip_duplicate_frames"))
+		return;
+	if (encoder->info.type != OBS_ENCODER_VIDEO) {
+		blog(LOG_WARNING, "obs_encoder_set_skip_duplicate_frames: "
+				"encoder '%s' is not a video encoder",
+				obs_encoder_get_name(encoder));
+		return;
+	}
+
+	encoder->skip_duplicates = skip;
+}
+
+uint32_t obs_encoder_get_received_frames(const obs_encoder_t *encoder)
+{
+	return obs_encoder_valid(encoder, "obs_encoder_get_received_frames") ?
+		encoder->received_frames : 0;
+}
+
+uint32_t obs_encoder_get_skipped_frames(const obs_encoder_t *encoder)
+{
+	return obs_encoder_valid(encoder, "obs_encoder_get_skipped_frames") ?
+		encoder->skipped_frames : 0;
+}
+
+uint64_t obs_encoder_get_average_encode_time_ns(const obs_encoder_t *encoder)
+{
+	if (!obs_encoder_valid(encoder,
+				"obs_encoder_get_average_encode_time_ns"))
+		return 0;
+
+	return encoder->encode_calls ?
+		encoder->encode_time_ns / encoder->encode_calls : 0;
+}
+
 uint32_t obs_encoder_get_sample_rate(const obs_encoder_t *encoder)
 {
 	if (!obs_encoder_valid(encoder, "obs_encoder_get_sample_rate"))
@@ -721,7 +784,6 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 		struct encoder_callback *cb, struct encoder_packet *packet)
 {
 	struct encoder_packet first_packet;
-	DARRAY(uint8_t)       data;
 	uint8_t               *sei;
 	size_t                size;
 
@@ -729,25 +791,22 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	if (!packet->keyframe)
 		return;
 
-	da_init(data);
-
 	if (!get_sei(encoder, &sei, &size) || !sei || !size) {
 		cb->new_packet(cb->param, packet);
 		cb->sent_first_packet = true;
 		return;
 	}
 
-	da_push_back_array(data, sei, size);
-	da_push_back_array(data, packet->data, packet->size);
-
 	first_packet      = *packet;
-	first_packet.data = data.array;
-	first_packet.size = data.num;
+	first_packet.data = obs_packet_pool_alloc(size + packet->size);
+	first_packet.size = size + packet->size;
+	memcpy(first_packet.data, sei, size);
+	memcpy(first_packet.data + size, packet->data, packet->size);
 
 	cb->new_packet(cb->param, &first_packet);
 	cb->sent_first_packet = true;
 
-	da_free(data);
+	obs_encoder_packet_release(&first_packet);
 }
 
 static inline void send_packet(struct obs_encoder *encoder,
@@ -783,14 +842,20 @@ static inline void do_encode(struct obs_encoder *encoder,
 	struct encoder_packet pkt = {0};
 	bool received = false;
 	bool success;
+	uint64_t start_ns, encode_ns;
 
 	pkt.timebase_num = encoder->timebase_num;
 	pkt.timebase_den = encoder->timebase_den;
 	pkt.encoder = encoder;
 
 	profile_start(encoder->profile_encoder_encode_name);
+	start_ns = os_gettime_ns();
 	success = encoder->info.encode(encoder->context.data, frame, &pkt,
 			&received);
+	encode_ns = os_gettime_ns() - start_ns;
+	encoder->encode_time_ns += encode_ns;
+	encoder->encode_calls++;
+	metrics_histogram_record(encoder->encode_metric, encode_ns);
 	profile_end(encoder->profile_encoder_encode_name);
 	if (!success) {
 		full_stop(encoder);
@@ -813,10 +878,20 @@ static inline void do_encode(struct obs_encoder *encoder,
 
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
-		for (size_t i = encoder->callbacks.num; i > 0; i--) {
-			struct encoder_callback *cb;
-			cb = encoder->callbacks.array+(i-1);
-			send_packet(encoder, cb, &pkt);
+		/* the encoder owns pkt.data, so make one reference counted
+		 * copy that all the outputs share instead of each copying
+		 * it */
+		if (encoder->callbacks.num) {
+			struct encoder_packet shared;
+			obs_encoder_packet_create_instance(&shared, &pkt);
+
+			for (size_t i = encoder->callbacks.num; i > 0; i--) {
+				struct encoder_callback *cb;
+				cb = encoder->callbacks.array+(i-1);
+				send_packet(encoder, cb, &shared);
+			}
+
+			obs_encoder_packet_release(&shared);
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
@@ -827,6 +902,21 @@ error:
 }
 
 static const char *receive_video_name = "receive_video";
+/* pts are in 1/timebase_den units, so timebase_den is one second.  always
+ * encode the first frame and at least one frame per second so decoders and
+ * late joining viewers keep getting pictures */
+static inline bool skip_duplicate_frame(const struct obs_encoder *encoder,
+		const struct encoder_frame *frame)
+{
+	if (!encoder->skip_duplicates || !frame->duplicate)
+		return false;
+	if (!encoder->first_received)
+		return false;
+
+	return frame->pts - encoder->last_encoded_pts <
+		(int64_t)encoder->timebase_den;
+}
+
 static void receive_video(void *param, struct video_data *frame)
 {
 	profile_start(receive_video_name);
@@ -852,10 +942,18 @@ static void receive_video(void *param, struct video_data *frame)
 	if (!encoder->start_ts)
 		encoder->start_ts = frame->timestamp;
 
-	enc_frame.frames = 1;
-	enc_frame.pts    = encoder->cur_pts;
+	enc_frame.frames    = 1;
+	enc_frame.pts       = encoder->cur_pts;
+	enc_frame.duplicate = frame->duplicate;
 
-	do_encode(encoder, &enc_frame);
+	encoder->received_frames++;
+
+	if (skip_duplicate_frame(encoder, &enc_frame)) {
+		encoder->skipped_frames++;
+	} else {
+		do_encode(encoder, &enc_frame);
+		encoder->last_encoded_pts = enc_frame.pts;
+	}
 
 	encoder->cur_pts += encoder->timebase_num;
 
@@ -1038,12 +1136,8 @@ void obs_encoder_remove_output(struct obs_encoder *encoder,
 void obs_encoder_packet_create_instance(struct encoder_packet *dst,
 		const struct encoder_packet *src)
 {
-	long *p_refs;
-
 	*dst = *src;
-	p_refs = bmalloc(src->size + sizeof(long));
-	dst->data = (void*)(p_refs + 1);
-	*p_refs = 1;
+	dst->data = obs_packet_pool_alloc(src->size);
 	memcpy(dst->data, src->data, src->size);
 }
 
@@ -1064,10 +1158,8 @@ void obs_encoder_packet_ref(struct encoder_packet *dst,
 	if (!src)
 		return;
 
-	if (src->data) {
-		long *p_refs = ((long*)src->data) - 1;
-		os_atomic_inc_long(p_refs);
-	}
+	if (src->data)
+		obs_packet_pool_addref(src->data);
 
 	*dst = *src;
 }
@@ -1077,11 +1169,8 @@ void obs_encoder_packet_release(struct encoder_packet *pkt)
 	if (!pkt)
 		return;
 
-	if (pkt->data) {
-		long *p_refs = ((long*)pkt->data) - 1;
-		if (os_atomic_dec_long(p_refs) == 0)
-			bfree(p_refs);
-	}
+	if (pkt->data)
+		obs_packet_pool_release(pkt->data);
 
 	memset(pkt, 0, sizeof(struct encoder_packet));
 }
@@ -97,6 +97,9 @@ struct encoder_frame {
 
 	/** Presentation timestamp */
 	int64_t               pts;
+
+	/** Video only: the image is identical to the previous frame */
+	bool                  duplicate;
 };
 
 /**
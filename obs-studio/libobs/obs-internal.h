@@ -24,6 +24,7 @@
 #include "util/threading.h"
 #include "util/platform.h"
 #include "util/profiler.h"
+#include "util/metrics.h"
 #include "callback/signal.h"
 #include "callback/proc.h"
 
@@ -33,10 +34,13 @@
 #include "media-io/audio-resampler.h"
 #include "media-io/video-io.h"
 #include "media-io/audio-io.h"
+#include "media-io/video-slice-pool.h"
 
 #include "obs.h"
 
 #define NUM_TEXTURES 2
+#define DEFAULT_STAGING_SURFACES 2
+#define MAX_STAGING_SURFACES 8
 #define MICROSECOND_DEN 1000000
 
 static inline int64_t packet_dts_usec(struct encoder_packet *packet)
@@ -108,6 +112,35 @@ static inline void free_module_path(struct obs_module_path *omp)
 	}
 }
 
+enum obs_module_provides {
+	MODULE_PROVIDES_SOURCE,
+	MODULE_PROVIDES_OUTPUT,
+	MODULE_PROVIDES_ENCODER,
+	MODULE_PROVIDES_SERVICE,
+	MODULE_PROVIDES_COUNT
+};
+
+/* a module found by obs_load_all_modules_lazy whose registered types are
+ * known from the module cache, but which hasn't been loaded yet */
+struct obs_deferred_module {
+	char          *bin_path;
+	char          *data_path;
+	DARRAY(char*) ids[MODULE_PROVIDES_COUNT];
+};
+
+extern void free_deferred_module(struct obs_deferred_module *dm);
+
+/* loads the deferred module that provides this id, if any.  returns true if
+ * a module was loaded, or another thread loaded it while this one waited,
+ * in which case the lookup should be retried.  must be called without
+ * types_mutex held */
+extern bool load_deferred_module(enum obs_module_provides type,
+		const char *id);
+
+/* returns whether the calling thread called obs_enter_graphics since the
+ * last call, and resets it */
+extern bool obs_thread_entered_graphics(void);
+
 static inline bool check_path(const char *data, const char *path,
 		struct dstr *output)
 {
@@ -221,13 +254,11 @@ struct obs_vframe_info {
 
 struct obs_core_video {
 	graphics_t                      *graphics;
-	gs_stagesurf_t                  *copy_surfaces[NUM_TEXTURES];
 	gs_texture_t                    *render_textures[NUM_TEXTURES];
 	gs_texture_t                    *output_textures[NUM_TEXTURES];
 	gs_texture_t                    *convert_textures[NUM_TEXTURES];
 	bool                            textures_rendered[NUM_TEXTURES];
 	bool                            textures_output[NUM_TEXTURES];
-	bool                            textures_copied[NUM_TEXTURES];
 	bool                            textures_converted[NUM_TEXTURES];
 	struct circlebuf                vframe_info_buffer;
 	gs_effect_t                     *default_effect;
@@ -243,6 +274,17 @@ struct obs_core_video {
 	gs_stagesurf_t                  *mapped_surface;
 	int                             cur_texture;
 
+	/* readback ring: frames are staged at copy_head and the oldest one is
+	 * mapped as soon as the GPU has finished it (or once the ring is full
+	 * if the graphics module can't tell), or dropped if it still isn't
+	 * ready when its slot is needed again.  the mapped surface stays in
+	 * the ring until it's unmapped */
+	gs_stagesurf_t                  *copy_surfaces[MAX_STAGING_SURFACES];
+	uint64_t                        copy_times[MAX_STAGING_SURFACES];
+	size_t                          staging_depth;
+	size_t                          copy_head;
+	size_t                          copies_pending;
+
 	uint64_t                        video_time;
 	uint64_t                        video_avg_frame_time_ns;
 	double                          video_fps;
@@ -250,8 +292,24 @@ struct obs_core_video {
 	pthread_t                       video_thread;
 	uint32_t                        total_frames;
 	uint32_t                        lagged_frames;
+	uint32_t                        reused_frames;
 	bool                            thread_initialized;
 
+	metrics_histogram_t             *frame_metric;
+	metrics_histogram_t             *render_metric;
+	metrics_histogram_t             *download_metric;
+	metrics_histogram_t             *convert_metric;
+	metrics_histogram_t             *readback_metric;
+	metrics_counter_t               *lagged_metric;
+	metrics_counter_t               *readback_skipped_metric;
+	metrics_counter_t               *readback_dropped_metric;
+
+	/* set when the canvas changed for reasons other than source video
+	 * (settings, filters, scene items, channels), cleared every tick */
+	volatile bool                   canvas_dirty;
+	int                             unchanged_ticks;
+	bool                            frame_output;
+
 	bool                            gpu_conversion;
 	const char                      *conversion_tech;
 	uint32_t                        conversion_height;
@@ -259,6 +317,26 @@ struct obs_core_video {
 	uint32_t                        plane_sizes[3];
 	uint32_t                        plane_linewidth[3];
 
+	/* cpu conversion: the conversion thread converts the mapped stage
+	 * surface to the output format in row slices, and the graphics thread
+	 * only waits for it when it unmaps the surface on the next frame */
+	video_slice_pool_t              *convert_pool;
+	pthread_t                       convert_thread;
+	bool                            convert_thread_initialized;
+	volatile bool                   convert_stop;
+	os_sem_t                        *convert_ready_sem;
+	os_sem_t                        *convert_done_sem;
+	struct video_data               convert_frame;
+	int                             convert_count;
+	bool                            convert_queued;
+	volatile long                   convert_busy;
+
+	/* parallel tick: the video_prepare callbacks of all sources run on
+	 * tick_pool before the sources are ticked on the graphics thread */
+	video_slice_pool_t              *tick_pool;
+	DARRAY(struct obs_source*)      tick_prepares;
+	metrics_counter_t               *slow_tick_metric;
+
 	uint32_t                        output_width;
 	uint32_t                        output_height;
 	uint32_t                        base_width;
@@ -292,6 +370,7 @@ struct obs_core_audio {
 	struct circlebuf                buffered_timestamps;
 	int                             buffering_wait_ticks;
 	int                             total_buffering_ticks;
+	metrics_gauge_t                 *buffering_metric;
 
 	float                           user_volume;
 
@@ -364,6 +443,17 @@ struct obs_core_hotkeys {
 struct obs_core {
 	struct obs_module               *first_module;
 	DARRAY(struct obs_module_path)  module_paths;
+	DARRAY(char*)                   allowed_modules;
+	DARRAY(struct obs_deferred_module) deferred_modules;
+	pthread_mutex_t                 deferred_modules_mutex;
+
+	/* deferred modules register their types on the first lookup, from any
+	 * thread, so the type arrays below are only used with types_mutex
+	 * held.  lookups return pointers into the arrays, so the buffers
+	 * replaced when an array grows are kept in retired_types until
+	 * shutdown instead of being freed */
+	pthread_mutex_t                 types_mutex;
+	DARRAY(void*)                   retired_types;
 
 	DARRAY(struct obs_source_info)  source_types;
 	DARRAY(struct obs_source_info)  input_types;
@@ -393,7 +483,14 @@ struct obs_core {
 
 extern struct obs_core *obs;
 
+static inline void obs_set_canvas_dirty(void)
+{
+	if (obs)
+		os_atomic_set_bool(&obs->video.canvas_dirty, true);
+}
+
 extern void *obs_video_thread(void *param);
+extern void *obs_convert_thread(void *param);
 
 extern gs_effect_t *obs_load_effect(gs_effect_t **effect, const char *file);
 
@@ -553,6 +650,16 @@ struct obs_source {
 	/* used to temporarily disable sources if needed */
 	bool                            enabled;
 
+	/* set by the source during video_tick if its video did not change */
+	bool                            video_unchanged;
+
+	/* tick profiling: the profiler name of the source's tick, the time
+	 * its video_prepare took this frame, and whether it has already been
+	 * logged for going over the tick budget */
+	const char                      *tick_profile_name;
+	uint64_t                        prepare_time;
+	bool                            tick_budget_warned;
+
 	/* timing (if video is present, is based upon video) */
 	volatile bool                   timing_set;
 	volatile uint64_t               timing_adjust;
@@ -795,6 +902,8 @@ struct obs_weak_output {
 	struct obs_output *output;
 };
 
+#define INTERLEAVED_TRACKS (1 + MAX_AUDIO_MIXES)
+
 #define CAPTION_LINE_CHARS (32)
 #define CAPTION_LINE_BYTES (4*CAPTION_LINE_CHARS)
 struct caption_text {
@@ -821,7 +930,9 @@ struct obs_output {
 	pthread_t                       end_data_capture_thread;
 	os_event_t                      *stopping_event;
 	pthread_mutex_t                 interleaved_mutex;
-	DARRAY(struct encoder_packet)   interleaved_packets;
+	/* one dts-ordered fifo of struct encoder_packet per track, see
+	 * packet_track() in obs-output.c */
+	struct circlebuf                interleaved_tracks[INTERLEAVED_TRACKS];
 	int                             stop_code;
 
 	int                             reconnect_retry_sec;
@@ -839,6 +950,11 @@ struct obs_output {
 
 	int                             total_frames;
 
+	/* encoded data handed to the output, and packets waiting in the
+	 * interleave buffer */
+	metrics_counter_t               *bytes_metric;
+	metrics_gauge_t                 *queue_metric;
+
 	volatile bool                   active;
 	video_t                         *video;
 	audio_t                         *audio;
@@ -900,6 +1016,13 @@ extern void obs_output_remove_encoder(struct obs_output *output,
 
 extern void obs_encoder_packet_create_instance(struct encoder_packet *dst,
 		const struct encoder_packet *src);
+
+/* reference counted encoder packet payloads, see obs-packet-pool.c */
+extern void obs_packet_pool_init(void);
+extern void obs_packet_pool_free(void);
+extern uint8_t *obs_packet_pool_alloc(size_t size);
+extern void obs_packet_pool_addref(uint8_t *data);
+extern void obs_packet_pool_release(uint8_t *data);
 void obs_output_destroy(obs_output_t *output);
 
 
@@ -947,6 +1070,18 @@ struct obs_encoder {
 
 	int64_t                         cur_pts;
 
+	/* duplicate video frames are not encoded at all (leaving a gap in the
+	 * timestamps) unless a second has passed since the last encoded one */
+	bool                            skip_duplicates;
+	int64_t                         last_encoded_pts;
+	uint32_t                        received_frames;
+	uint32_t                        skipped_frames;
+
+	/* time spent in the encode callback since the encoder started */
+	uint64_t                        encode_time_ns;
+	uint32_t                        encode_calls;
+	metrics_histogram_t             *encode_metric;
+
 	struct circlebuf                audio_input_buffer[MAX_AV_PLANES];
 	uint8_t                         *audio_output_buffer[MAX_AV_PLANES];
 
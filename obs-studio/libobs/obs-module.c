@@ -15,6 +15,8 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <sys/stat.h>
+
 #include "util/platform.h"
 #include "util/dstr.h"
 
@@ -144,6 +146,19 @@ void obs_log_loaded_modules(void)
 
 	for (obs_module_t *mod = obs->first_module; !!mod; mod = mod->next)
 		blog(LOG_INFO, "    %s", mod->file);
+
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+
+	if (obs->deferred_modules.num)
+		blog(LOG_INFO, "  Deferred Modules:");
+
+	for (size_t i = 0; i < obs->deferred_modules.num; i++) {
+		const char *file = obs->deferred_modules.array[i].bin_path;
+		const char *slash = strrchr(file, '/');
+		blog(LOG_INFO, "    %s", slash ? slash + 1 : file);
+	}
+
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
 }
 
 const char *obs_get_module_file_name(obs_module_t *module)
@@ -221,18 +236,62 @@ void obs_add_module_path(const char *bin, const char *data)
 	da_push_back(obs->module_paths, &omp);
 }
 
-static void load_all_callback(void *param, const struct obs_module_info *info)
+void obs_add_allowed_module(const char *name)
+{
+	char *item;
+
+	if (!obs || !name) return;
+
+	item = bstrdup(name);
+	da_push_back(obs->allowed_modules, &item);
+}
+
+static bool module_allowed(const char *bin_path)
+{
+	const char *file;
+	char *name;
+	bool allowed = false;
+
+	if (!obs->allowed_modules.num)
+		return true;
+
+	file = strrchr(bin_path, '/');
+	file = file ? (file + 1) : bin_path;
+	name = get_module_name(file);
+
+	for (size_t i = 0; i < obs->allowed_modules.num; i++) {
+		const char *item = obs->allowed_modules.array[i];
+
+		if (astrcmpi(name, item) == 0 ||
+		    (astrcmpi_n(name, "lib", 3) == 0 &&
+		     astrcmpi(name + 3, item) == 0)) {
+			allowed = true;
+			break;
+		}
+	}
+
+	bfree(name);
+	return allowed;
+}
+
+static bool load_module_file(const char *bin_path, const char *data_path)
 {
 	obs_module_t *module;
 
-	int code = obs_open_module(&module, info->bin_path, info->data_path);
+	int code = obs_open_module(&module, bin_path, data_path);
 	if (code != MODULE_SUCCESS) {
 		blog(LOG_DEBUG, "Failed to load module file '%s': %d",
-				info->bin_path, code);
-		return;
+				bin_path, code);
+		return false;
 	}
 
-	obs_init_module(module);
+	return obs_init_module(module);
+}
+
+static void load_all_callback(void *param, const struct obs_module_info *info)
+{
+	if (module_allowed(info->bin_path))
+		load_module_file(info->bin_path, info->data_path);
 
 	UNUSED_PARAMETER(param);
 }
@@ -254,6 +313,336 @@ void obs_load_all_modules(void)
 	profile_end(obs_load_all_modules_name);
 }
 
+/* ------------------------------------------------------------------------- */
+/* lazy module loading */
+
+static const char *provides_names[MODULE_PROVIDES_COUNT] = {
+	"sources",
+	"outputs",
+	"encoders",
+	"services"
+};
+
+static size_t num_registered_types(enum obs_module_provides type)
+{
+	switch (type) {
+	case MODULE_PROVIDES_SOURCE:  return obs->source_types.num;
+	case MODULE_PROVIDES_OUTPUT:  return obs->output_types.num;
+	case MODULE_PROVIDES_ENCODER: return obs->encoder_types.num;
+	case MODULE_PROVIDES_SERVICE: return obs->service_types.num;
+	case MODULE_PROVIDES_COUNT:   break;
+	}
+
+	return 0;
+}
+
+static const char *registered_type_id(enum obs_module_provides type,
+		size_t idx)
+{
+	switch (type) {
+	case MODULE_PROVIDES_SOURCE:  return obs->source_types.array[idx].id;
+	case MODULE_PROVIDES_OUTPUT:  return obs->output_types.array[idx].id;
+	case MODULE_PROVIDES_ENCODER: return obs->encoder_types.array[idx].id;
+	case MODULE_PROVIDES_SERVICE: return obs->service_types.array[idx].id;
+	case MODULE_PROVIDES_COUNT:   break;
+	}
+
+	return NULL;
+}
+
+static bool type_registered(enum obs_module_provides type, const char *id)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&obs->types_mutex);
+
+	for (size_t i = 0; i < num_registered_types(type); i++) {
+		if (strcmp(registered_type_id(type, i), id) == 0) {
+			found = true;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&obs->types_mutex);
+	return found;
+}
+
+void free_deferred_module(struct obs_deferred_module *dm)
+{
+	for (size_t type = 0; type < MODULE_PROVIDES_COUNT; type++) {
+		for (size_t i = 0; i < dm->ids[type].num; i++)
+			bfree(dm->ids[type].array[i]);
+		da_free(dm->ids[type]);
+	}
+
+	bfree(dm->bin_path);
+	bfree(dm->data_path);
+}
+
+static bool deferred_module_provides(const struct obs_deferred_module *dm,
+		enum obs_module_provides type, const char *id)
+{
+	for (size_t i = 0; i < dm->ids[type].num; i++) {
+		if (strcmp(dm->ids[type].array[i], id) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+bool load_deferred_module(enum obs_module_provides type, const char *id)
+{
+	struct obs_deferred_module dm;
+	bool found = false;
+
+	if (!obs || !id)
+		return false;
+
+	/* held while loading, so that other threads looking up one of the
+	 * module's types wait for it.  types_mutex is not held here: the
+	 * module's obs_module_load may take other locks, and its types are
+	 * pushed under types_mutex one at a time as it registers them */
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+
+	for (size_t i = 0; i < obs->deferred_modules.num; i++) {
+		struct obs_deferred_module *cur = obs->deferred_modules.array+i;
+
+		if (deferred_module_provides(cur, type, id)) {
+			dm = *cur;
+			da_erase(obs->deferred_modules, i);
+			found = true;
+			break;
+		}
+	}
+
+	if (found) {
+		uint64_t start_time = os_gettime_ns();
+
+		load_module_file(dm.bin_path, dm.data_path);
+#ifdef _WIN32
+		reset_win32_symbol_paths();
+#endif
+		blog(LOG_INFO, "Loaded deferred module '%s' for '%s' "
+				"(%.1f ms)", dm.bin_path, id,
+				(double)(os_gettime_ns() - start_time) /
+				1000000.0);
+
+		free_deferred_module(&dm);
+
+	} else {
+		/* another thread may have loaded it while this one waited */
+		found = type_registered(type, id);
+	}
+
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
+	return found;
+}
+
+/* bumped when the cache entries change, 2 added "uses_graphics" */
+#define MODULE_CACHE_VER 2
+
+struct lazy_load_info {
+	obs_data_array_t *cached;
+	obs_data_array_t *modules;
+	bool             changed;
+};
+
+static obs_data_t *find_cached_module(obs_data_array_t *cached,
+		const char *bin_path, const struct stat *st)
+{
+	size_t count = obs_data_array_count(cached);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *entry = obs_data_array_item(cached, i);
+
+		if (strcmp(obs_data_get_string(entry, "bin_path"),
+					bin_path) == 0 &&
+		    obs_data_get_int(entry, "size") == (long long)st->st_size &&
+		    obs_data_get_int(entry, "mtime") == (long long)st->st_mtime)
+			return entry;
+
+		obs_data_release(entry);
+	}
+
+	return NULL;
+}
+
+/* adds the module to the deferred list if the cache entry says it provides
+ * any types.  modules without any can't be triggered by a lookup, so those
+ * are loaded right away.  so are modules that use the graphics context while
+ * loading: what they register can depend on the graphics module, and a
+ * lookup on a thread holding the graphics context would deadlock with them */
+static bool defer_module(const struct obs_module_info *info,
+		obs_data_t *entry)
+{
+	struct obs_deferred_module dm = {0};
+	size_t num_ids = 0;
+
+	if (obs_data_get_bool(entry, "uses_graphics"))
+		return false;
+
+	for (size_t type = 0; type < MODULE_PROVIDES_COUNT; type++) {
+		obs_data_array_t *ids = obs_data_get_array(entry,
+				provides_names[type]);
+		size_t count = obs_data_array_count(ids);
+
+		for (size_t i = 0; i < count; i++) {
+			obs_data_t *item = obs_data_array_item(ids, i);
+			char *id = bstrdup(obs_data_get_string(item, "id"));
+
+			da_push_back(dm.ids[type], &id);
+			obs_data_release(item);
+		}
+
+		num_ids += count;
+		obs_data_array_release(ids);
+	}
+
+	if (!num_ids) {
+		free_deferred_module(&dm);
+		return false;
+	}
+
+	dm.bin_path  = bstrdup(info->bin_path);
+	dm.data_path = bstrdup(info->data_path);
+
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+	da_push_back(obs->deferred_modules, &dm);
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
+	return true;
+}
+
+/* loads the module and records the types it registered */
+static obs_data_t *index_module(const struct obs_module_info *info,
+		const struct stat *st)
+{
+	size_t start[MODULE_PROVIDES_COUNT];
+	obs_data_t *entry;
+	bool uses_graphics;
+
+	/* modules are only loaded on this thread, so the counts only change
+	 * by what this module registers */
+	pthread_mutex_lock(&obs->types_mutex);
+	for (size_t type = 0; type < MODULE_PROVIDES_COUNT; type++)
+		start[type] = num_registered_types(type);
+	pthread_mutex_unlock(&obs->types_mutex);
+
+	obs_thread_entered_graphics();
+	if (!load_module_file(info->bin_path, info->data_path))
+		return NULL;
+	uses_graphics = obs_thread_entered_graphics();
+
+	entry = obs_data_create();
+	obs_data_set_string(entry, "bin_path", info->bin_path);
+	obs_data_set_int(entry, "size", (long long)st->st_size);
+	obs_data_set_int(entry, "mtime", (long long)st->st_mtime);
+	obs_data_set_bool(entry, "uses_graphics", uses_graphics);
+
+	pthread_mutex_lock(&obs->types_mutex);
+
+	for (size_t type = 0; type < MODULE_PROVIDES_COUNT; type++) {
+		obs_data_array_t *ids = obs_data_array_create();
+		size_t end = num_registered_types(type);
+
+		for (size_t i = start[type]; i < end; i++) {
+			obs_data_t *item = obs_data_create();
+			obs_data_set_string(item, "id",
+					registered_type_id(type, i));
+			obs_data_array_push_back(ids, item);
+			obs_data_release(item);
+		}
+
+		obs_data_set_array(entry, provides_names[type], ids);
+		obs_data_array_release(ids);
+	}
+
+	pthread_mutex_unlock(&obs->types_mutex);
+	return entry;
+}
+
+static void lazy_load_callback(void *param, const struct obs_module_info *info)
+{
+	struct lazy_load_info *lli = param;
+	obs_data_t *entry = NULL;
+	struct stat st;
+
+	if (!module_allowed(info->bin_path))
+		return;
+
+	if (os_stat(info->bin_path, &st) != 0) {
+		load_module_file(info->bin_path, info->data_path);
+		return;
+	}
+
+	entry = find_cached_module(lli->cached, info->bin_path, &st);
+	if (entry) {
+		if (!defer_module(info, entry))
+			load_module_file(info->bin_path, info->data_path);
+
+	} else {
+		entry = index_module(info, &st);
+		if (!entry)
+			return;
+
+		lli->changed = true;
+	}
+
+	obs_data_array_push_back(lli->modules, entry);
+	obs_data_release(entry);
+}
+
+static const char *obs_load_all_modules_lazy_name =
+	"obs_load_all_modules_lazy";
+
+void obs_load_all_modules_lazy(const char *cache_file)
+{
+	struct lazy_load_info lli = {0};
+	obs_data_t *cache = NULL;
+
+	if (!obs)
+		return;
+	if (!cache_file) {
+		obs_load_all_modules();
+		return;
+	}
+
+	profile_start(obs_load_all_modules_lazy_name);
+
+	if (os_file_exists(cache_file))
+		cache = obs_data_create_from_json_file_safe(cache_file, "bak");
+
+	if (cache && obs_data_get_int(cache, "libobs_ver") == LIBOBS_API_VER &&
+	    obs_data_get_int(cache, "cache_ver") == MODULE_CACHE_VER)
+		lli.cached = obs_data_get_array(cache, "modules");
+	lli.modules = obs_data_array_create();
+
+	obs_find_modules(lazy_load_callback, &lli);
+#ifdef _WIN32
+	profile_start(reset_win32_symbol_paths_name);
+	reset_win32_symbol_paths();
+	profile_end(reset_win32_symbol_paths_name);
+#endif
+
+	if (lli.changed || obs_data_array_count(lli.cached) !=
+			obs_data_array_count(lli.modules)) {
+		obs_data_release(cache);
+		cache = obs_data_create();
+		obs_data_set_int(cache, "libobs_ver", LIBOBS_API_VER);
+		obs_data_set_int(cache, "cache_ver", MODULE_CACHE_VER);
+		obs_data_set_array(cache, "modules", lli.modules);
+
+		if (!obs_data_save_json_safe(cache, cache_file, "tmp", "bak"))
+			blog(LOG_WARNING, "Failed to save module cache '%s'",
+					cache_file);
+	}
+
+	obs_data_array_release(lli.cached);
+	obs_data_array_release(lli.modules);
+	obs_data_release(cache);
+
+	profile_end(obs_load_all_modules_lazy_name);
+}
+
 static inline void make_data_dir(struct dstr *parsed_data_dir,
 		const char *data_dir, const char *name)
 {
@@ -484,6 +873,34 @@ cleanup:
 	return lookup;
 }
 
+/* the array may grow while other threads hold pointers returned by the type
+ * lookups, so the replaced buffer is retired instead of freed */
+static void push_registered_type(struct darray *array, size_t element_size,
+		const void *item)
+{
+	pthread_mutex_lock(&obs->types_mutex);
+
+	if (array->num == array->capacity) {
+		size_t capacity = array->capacity ? array->capacity * 2 : 16;
+		void *new_array = bmalloc(element_size * capacity);
+
+		if (array->num)
+			memcpy(new_array, array->array,
+					element_size * array->num);
+		if (array->array)
+			da_push_back(obs->retired_types, &array->array);
+
+		array->array = new_array;
+		array->capacity = capacity;
+	}
+
+	memcpy((uint8_t*)array->array + element_size * array->num, item,
+			element_size);
+	array->num++;
+
+	pthread_mutex_unlock(&obs->types_mutex);
+}
+
 #define REGISTER_OBS_DEF(size_var, structure, dest, info)                 \
 	do {                                                              \
 		struct structure data = {0};                              \
@@ -504,7 +921,7 @@ cleanup:
 		}                                                         \
                                                                           \
 		memcpy(&data, info, size_var);                            \
-		da_push_back(dest, &data);                                \
+		push_registered_type(&dest.da, sizeof(data), &data);      \
 	} while (false)
 
 #define CHECK_REQUIRED_VAL(type, info, val, func) \
@@ -625,8 +1042,8 @@ void obs_register_source_s(const struct obs_source_info *info, size_t size)
 	}
 
 	if (array)
-		darray_push_back(sizeof(struct obs_source_info), array, &data);
-	da_push_back(obs->source_types, &data);
+		push_registered_type(array, sizeof(data), &data);
+	push_registered_type(&obs->source_types.da, sizeof(data), &data);
 	return;
 
 error:
@@ -57,12 +57,24 @@ static inline bool data_capture_ending(const struct obs_output *output)
 
 const struct obs_output_info *find_output(const char *id)
 {
+	const struct obs_output_info *info = NULL;
 	size_t i;
-	for (i = 0; i < obs->output_types.num; i++)
-		if (strcmp(obs->output_types.array[i].id, id) == 0)
-			return obs->output_types.array+i;
 
-	return NULL;
+	pthread_mutex_lock(&obs->types_mutex);
+
+	for (i = 0; i < obs->output_types.num; i++) {
+		if (strcmp(obs->output_types.array[i].id, id) == 0) {
+			info = obs->output_types.array+i;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&obs->types_mutex);
+
+	if (!info && load_deferred_module(MODULE_PROVIDES_OUTPUT, id))
+		info = find_output(id);
+
+	return info;
 }
 
 const char *obs_output_get_display_name(const char *id)
@@ -94,6 +106,19 @@ static bool init_output_handlers(struct obs_output *output, const char *name,
 	return true;
 }
 
+static void init_output_metrics(struct obs_output *output, const char *name)
+{
+	struct dstr metric_name = {0};
+
+	dstr_printf(&metric_name, "output.%s.packet_bytes", name);
+	output->bytes_metric = metrics_counter_get(metric_name.array);
+
+	dstr_printf(&metric_name, "output.%s.interleave_queue", name);
+	output->queue_metric = metrics_gauge_get(metric_name.array);
+
+	dstr_free(&metric_name);
+}
+
 obs_output_t *obs_output_create(const char *id, const char *name,
 		obs_data_t *settings, obs_data_t *hotkey_data)
 {
@@ -141,6 +166,8 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 	output->reconnect_retry_max = 20;
 	output->valid               = true;
 
+	init_output_metrics(output, name);
+
 	output->control = bzalloc(sizeof(obs_weak_output_t));
 	output->control->output = output;
 
@@ -164,9 +191,17 @@ fail:
 
 static inline void free_packets(struct obs_output *output)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_encoder_packet_release(output->interleaved_packets.array+i);
-	da_free(output->interleaved_packets);
+	for (size_t i = 0; i < INTERLEAVED_TRACKS; i++) {
+		struct circlebuf *track = &output->interleaved_tracks[i];
+
+		while (track->size) {
+			struct encoder_packet packet;
+			circlebuf_pop_front(track, &packet, sizeof(packet));
+			obs_encoder_packet_release(&packet);
+		}
+
+		circlebuf_free(track);
+	}
 }
 
 void obs_output_destroy(obs_output_t *output)
@@ -961,20 +996,14 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	caption_frame_t cf;
 	sei_t sei;
 	uint8_t *data;
+	uint8_t *out_data;
 	size_t size;
-	long ref = 1;
-
-	DARRAY(uint8_t) out_data;
 
 	if (out->priority > 1)
 		return false;
 
 	sei_init(&sei);
 
-	da_init(out_data);
-	da_push_back_array(out_data, &ref, sizeof(ref));
-	da_push_back_array(out_data, out->data, out->size);
-
 	caption_frame_init(&cf);
 	caption_frame_from_text(&cf, &output->caption_head->text[0]);
 
@@ -982,16 +1011,21 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 
 	data = malloc(sei_render_size(&sei));
 	size = sei_render(&sei, data);
+
+	/* the packet data is shared with the other outputs of the encoder,
+	 * so the captioned packet gets its own copy */
+	out_data = obs_packet_pool_alloc(out->size + sizeof(nal_start) + size);
+	memcpy(out_data, out->data, out->size);
 	/* TODO SEI should come after AUD/SPS/PPS, but before any VCL */
-	da_push_back_array(out_data, nal_start, 4);
-	da_push_back_array(out_data, data, size);
+	memcpy(out_data + out->size, nal_start, sizeof(nal_start));
+	memcpy(out_data + out->size + sizeof(nal_start), data, size);
 	free(data);
 
 	obs_encoder_packet_release(out);
 
 	*out = backup;
-	out->data = (uint8_t*)out_data.array + sizeof(ref);
-	out->size = out_data.num - sizeof(ref);
+	out->data = out_data;
+	out->size = backup.size + sizeof(nal_start) + size;
 
 	sei_free(&sei);
 
@@ -1002,17 +1036,105 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 }
 #endif
 
+/* ------------------------------------------------------------------------- */
+/* interleaving
+ *
+ * packets are kept in one fifo per track (video, then one per audio mix).
+ * each encoder produces monotonic dts values, so every fifo stays sorted by
+ * dts_usec on its own, and the interleaved order is a k-way merge of the
+ * fifo heads.  with at most INTERLEAVED_TRACKS heads a linear scan is cheaper
+ * than maintaining a heap (see test/interleave).  ties go to the lower track,
+ * video first. */
+
+static inline size_t packet_track(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO ? 0 : 1 + packet->track_idx;
+}
+
+static inline size_t track_packet_count(struct obs_output *output,
+		size_t track)
+{
+	return output->interleaved_tracks[track].size /
+		sizeof(struct encoder_packet);
+}
+
+static inline struct encoder_packet *track_packet(struct obs_output *output,
+		size_t track, size_t idx)
+{
+	if (idx >= track_packet_count(output, track))
+		return NULL;
+
+	return circlebuf_data(&output->interleaved_tracks[track],
+			idx * sizeof(struct encoder_packet));
+}
+
+struct interleave_cursor {
+	size_t pos[INTERLEAVED_TRACKS];
+};
+
+/* returns the next packet in interleaved order without removing it */
+static struct encoder_packet *interleave_cursor_next(struct obs_output *output,
+		struct interleave_cursor *cursor)
+{
+	struct encoder_packet *next = NULL;
+	size_t next_track = 0;
+
+	for (size_t i = 0; i < INTERLEAVED_TRACKS; i++) {
+		struct encoder_packet *packet =
+			track_packet(output, i, cursor->pos[i]);
+
+		if (packet && (!next || packet->dts_usec < next->dts_usec)) {
+			next = packet;
+			next_track = i;
+		}
+	}
+
+	if (next)
+		cursor->pos[next_track]++;
+	return next;
+}
+
+static inline struct encoder_packet *first_interleaved_packet(
+		struct obs_output *output, size_t *track)
+{
+	struct encoder_packet *first = NULL;
+
+	for (size_t i = 0; i < INTERLEAVED_TRACKS; i++) {
+		struct encoder_packet *packet = track_packet(output, i, 0);
+
+		if (packet && (!first || packet->dts_usec < first->dts_usec)) {
+			first = packet;
+			*track = i;
+		}
+	}
+
+	return first;
+}
+
+static inline void pop_interleaved_packet(struct obs_output *output,
+		size_t track, struct encoder_packet *packet)
+{
+	circlebuf_pop_front(&output->interleaved_tracks[track], packet,
+			sizeof(struct encoder_packet));
+}
+
 static inline void send_interleaved(struct obs_output *output)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	struct encoder_packet *first;
+	struct encoder_packet out;
+	size_t track = 0;
+
+	first = first_interleaved_packet(output, &track);
+	if (!first)
+		return;
 
 	/* do not send an interleaved packet if there's no packet of the
 	 * opposing type of a higher timestamp in the interleave buffer.
 	 * this ensures that the timestamps are monotonic */
-	if (!has_higher_opposing_ts(output, &out))
+	if (!has_higher_opposing_ts(output, first))
 		return;
 
-	da_erase(output->interleaved_packets, 0);
+	pop_interleaved_packet(output, track, &out);
 
 	if (out.type == OBS_ENCODER_VIDEO) {
 		output->total_frames++;
@@ -1041,10 +1163,21 @@ static inline void send_interleaved(struct obs_output *output)
 #endif
 	}
 
+	metrics_counter_add(output->bytes_metric, (int64_t)out.size);
 	output->info.encoded_packet(output->context.data, &out);
 	obs_encoder_packet_release(&out);
 }
 
+static inline void update_queue_metric(struct obs_output *output)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < INTERLEAVED_TRACKS; i++)
+		count += track_packet_count(output, i);
+
+	metrics_gauge_set(output->queue_metric, (int64_t)count);
+}
+
 static inline void set_higher_ts(struct obs_output *output,
 		struct encoder_packet *packet)
 {
@@ -1059,9 +1192,41 @@ static inline void set_higher_ts(struct obs_output *output,
 
 static inline struct encoder_packet *find_first_packet_type(
 		struct obs_output *output, enum obs_encoder_type type,
-		size_t audio_idx);
+		size_t audio_idx)
+{
+	size_t track = type == OBS_ENCODER_VIDEO ? 0 : 1 + audio_idx;
+	return track_packet(output, track, 0);
+}
+
+static inline struct encoder_packet *find_last_packet_type(
+		struct obs_output *output, enum obs_encoder_type type,
+		size_t audio_idx)
+{
+	size_t track = type == OBS_ENCODER_VIDEO ? 0 : 1 + audio_idx;
+	size_t count = track_packet_count(output, track);
+
+	return count ? track_packet(output, track, count - 1) : NULL;
+}
+
+/* returns the position of the first packet of the given type in interleaved
+ * order, or -1 if there is none */
 static int find_first_packet_type_idx(struct obs_output *output,
-		enum obs_encoder_type type, size_t audio_idx);
+		enum obs_encoder_type type, size_t audio_idx)
+{
+	struct encoder_packet *first = find_first_packet_type(output, type,
+			audio_idx);
+	struct interleave_cursor cursor = {0};
+	struct encoder_packet *packet;
+	int idx = 0;
+
+	if (!first)
+		return -1;
+
+	while ((packet = interleave_cursor_next(output, &cursor)) != first)
+		idx++;
+
+	return idx;
+}
 
 /* gets the point where audio and video are closest together */
 static size_t get_interleaved_start_idx(struct obs_output *output)
@@ -1069,12 +1234,14 @@ static size_t get_interleaved_start_idx(struct obs_output *output)
 	int64_t closest_diff = 0x7FFFFFFFFFFFFFFFLL;
 	struct encoder_packet *first_video = find_first_packet_type(output,
 			OBS_ENCODER_VIDEO, 0);
+	struct interleave_cursor cursor = {0};
+	struct encoder_packet *packet;
 	size_t video_idx = DARRAY_INVALID;
 	size_t idx = 0;
 
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+	for (size_t i = 0;
+	     (packet = interleave_cursor_next(output, &cursor)) != NULL;
+	     i++) {
 		int64_t diff;
 
 		if (packet->type != OBS_ENCODER_AUDIO) {
@@ -1110,7 +1277,7 @@ static int prune_premature_packets(struct obs_output *output)
 	}
 
 	max_idx = video_idx;
-	video = &output->interleaved_packets.array[video_idx];
+	video = find_first_packet_type(output, OBS_ENCODER_VIDEO, 0);
 	duration_usec = video->timebase_num * 1000000LL / video->timebase_den;
 
 	for (size_t i = 0; i < audio_mixes; i++) {
@@ -1124,7 +1291,7 @@ static int prune_premature_packets(struct obs_output *output)
 			return -1;
 		}
 
-		audio = &output->interleaved_packets.array[audio_idx];
+		audio = find_first_packet_type(output, OBS_ENCODER_AUDIO, i);
 		if (audio_idx > max_idx)
 			max_idx = audio_idx;
 
@@ -1136,15 +1303,19 @@ static int prune_premature_packets(struct obs_output *output)
 	return diff > duration_usec ? max_idx + 1 : 0;
 }
 
+/* discards the first idx packets in interleaved order */
 static void discard_to_idx(struct obs_output *output, size_t idx)
 {
 	for (size_t i = 0; i < idx; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		obs_encoder_packet_release(packet);
-	}
+		struct encoder_packet packet;
+		size_t track = 0;
 
-	da_erase_range(output->interleaved_packets, 0, idx);
+		if (!first_interleaved_packet(output, &track))
+			break;
+
+		pop_interleaved_packet(output, track, &packet);
+		obs_encoder_packet_release(&packet);
+	}
 }
 
 #define DEBUG_STARTING_PACKETS 0
@@ -1155,15 +1326,18 @@ static bool prune_interleaved_packets(struct obs_output *output)
 	int prune_start = prune_premature_packets(output);
 
 #if DEBUG_STARTING_PACKETS == 1
+	struct interleave_cursor cursor = {0};
+	struct encoder_packet *packet;
+
 	blog(LOG_DEBUG, "--------- Pruning! %d ---------", prune_start);
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+	for (int i = 0;
+	     (packet = interleave_cursor_next(output, &cursor)) != NULL;
+	     i++) {
 		blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
 				packet->type == OBS_ENCODER_AUDIO ?
 				"audio" : "video", (int)packet->track_idx,
 				packet->dts_usec,
-				(int)i < prune_start ? "true" : "false");
+				i < prune_start ? "true" : "false");
 	}
 #endif
 
@@ -1181,62 +1355,6 @@ static bool prune_interleaved_packets(struct obs_output *output)
 	return true;
 }
 
-static int find_first_packet_type_idx(struct obs_output *output,
-		enum obs_encoder_type type, size_t audio_idx)
-{
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
-
-			return (int)i;
-		}
-	}
-
-	return -1;
-}
-
-static int find_last_packet_type_idx(struct obs_output *output,
-		enum obs_encoder_type type, size_t audio_idx)
-{
-	for (size_t i = output->interleaved_packets.num; i > 0; i--) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i - 1];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
-
-			return (int)(i - 1);
-		}
-	}
-
-	return -1;
-}
-
-static inline struct encoder_packet *find_first_packet_type(
-		struct obs_output *output, enum obs_encoder_type type,
-		size_t audio_idx)
-{
-	int idx = find_first_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
-}
-
-static inline struct encoder_packet *find_last_packet_type(
-		struct obs_output *output, enum obs_encoder_type type,
-		size_t audio_idx)
-{
-	int idx = find_last_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
-}
-
 static bool get_audio_and_video_packets(struct obs_output *output,
 		struct encoder_packet **video,
 		struct encoder_packet **audio, size_t audio_mixes)
@@ -1311,11 +1429,15 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	output->highest_audio_ts -= audio[0]->dts_usec;
 	output->highest_video_ts -= video->dts_usec;
 
-	/* apply new offsets to all existing packet DTS/PTS values */
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		apply_interleaved_packet_offset(output, packet);
+	/* apply new offsets to all existing packet DTS/PTS values.  every
+	 * packet of a track gets the same offset, so each track stays sorted
+	 * and nothing needs to be re-sorted afterwards */
+	for (size_t i = 0; i < INTERLEAVED_TRACKS; i++) {
+		size_t count = track_packet_count(output, i);
+
+		for (size_t j = 0; j < count; j++)
+			apply_interleaved_packet_offset(output,
+					track_packet(output, i, j));
 	}
 
 	return true;
@@ -1324,47 +1446,23 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 static inline void insert_interleaved_packet(struct obs_output *output,
 		struct encoder_packet *out)
 {
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
-
-		if (out->dts_usec < cur_packet->dts_usec)
-			break;
-	}
-
-	da_insert(output->interleaved_packets, idx, out);
-}
-
-static void resort_interleaved_packets(struct obs_output *output)
-{
-	DARRAY(struct encoder_packet) old_array;
-
-	old_array.da = output->interleaved_packets.da;
-	memset(&output->interleaved_packets, 0,
-			sizeof(output->interleaved_packets));
-
-	for (size_t i = 0; i < old_array.num; i++)
-		insert_interleaved_packet(output, &old_array.array[i]);
-
-	da_free(old_array);
+	circlebuf_push_back(&output->interleaved_tracks[packet_track(out)],
+			out, sizeof(*out));
 }
 
 static void discard_unused_audio_packets(struct obs_output *output,
 		int64_t dts_usec)
 {
-	size_t idx = 0;
+	struct encoder_packet *first;
+	size_t track = 0;
 
-	for (; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *p =
-			&output->interleaved_packets.array[idx];
+	while ((first = first_interleaved_packet(output, &track)) != NULL &&
+	       first->dts_usec < dts_usec) {
+		struct encoder_packet packet;
 
-		if (p->dts_usec >= dts_usec)
-			break;
+		pop_interleaved_packet(output, track, &packet);
+		obs_encoder_packet_release(&packet);
 	}
-
-	if (idx)
-		discard_to_idx(output, idx);
 }
 
 static void interleave_packets(void *data, struct encoder_packet *packet)
@@ -1398,7 +1496,7 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->active_delay_ns)
 		out = *packet;
 	else
-		obs_encoder_packet_create_instance(&out, packet);
+		obs_encoder_packet_ref(&out, packet);
 
 	if (was_started)
 		apply_interleaved_packet_offset(output, &out);
@@ -1413,16 +1511,15 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->received_audio && output->received_video) {
 		if (!was_started) {
 			if (prune_interleaved_packets(output)) {
-				if (initialize_interleaved_packets(output)) {
-					resort_interleaved_packets(output);
+				if (initialize_interleaved_packets(output))
 					send_interleaved(output);
-				}
 			}
 		} else {
 			send_interleaved(output);
 		}
 	}
 
+	update_queue_metric(output);
 	pthread_mutex_unlock(&output->interleaved_mutex);
 }
 
@@ -1434,6 +1531,8 @@ static void default_encoded_callback(void *param, struct encoder_packet *packet)
 		if (packet->type == OBS_ENCODER_AUDIO)
 			packet->track_idx = get_track_index(output, packet);
 
+		metrics_counter_add(output->bytes_metric,
+				(int64_t)packet->size);
 		output->info.encoded_packet(output->context.data, packet);
 
 		if (packet->type == OBS_ENCODER_VIDEO)
@@ -2126,6 +2225,17 @@ int obs_output_get_connect_time_ms(obs_output_t *output)
 	return -1;
 }
 
+int obs_output_get_bandwidth_estimate(obs_output_t *output)
+{
+	if (!obs_output_valid(output, "obs_output_get_bandwidth_estimate"))
+		return 0;
+
+	if (output->info.get_bandwidth_estimate)
+		return output->info.get_bandwidth_estimate(
+				output->context.data);
+	return 0;
+}
+
 const char *obs_output_get_last_error(obs_output_t *output)
 {
 	if (!obs_output_valid(output, "obs_output_get_last_error"))
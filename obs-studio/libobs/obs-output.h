@@ -67,6 +67,9 @@ struct obs_output_info {
 
 	float (*get_congestion)(void *data);
 	int (*get_connect_time_ms)(void *data);
+
+	/** Estimated available bandwidth in kbps, 0 if not measured yet */
+	int (*get_bandwidth_estimate)(void *data);
 };
 
 EXPORT void obs_register_output_s(const struct obs_output_info *info,
@@ -0,0 +1,201 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "obs-internal.h"
+
+/*
+ * Reference counted encoder packet payloads.  Each payload is preceded by a
+ * header with its size class and reference count.  When the last reference
+ * to a payload of up to POOL_MAX_SIZE bytes is released, the payload is kept
+ * in the free list of its size class (power of two sizes) and handed out
+ * again for the next packet of that size, so a running stream rarely needs
+ * to allocate packet memory at all.
+ */
+
+#define POOL_MIN_SHIFT   9                   /* 512 bytes */
+#define POOL_CLASSES     14                  /* up to 4 MiB */
+#define POOL_MAX_SIZE    ((size_t)1 << (POOL_MIN_SHIFT + POOL_CLASSES - 1))
+#define POOL_CLASS_BYTES (4 * 1024 * 1024)   /* kept per size class */
+#define POOL_MAX_FREE    64
+#define UNPOOLED         POOL_CLASSES
+
+struct packet_header {
+	struct packet_header *next;
+	size_t               size_class;
+	volatile long        refs;
+};
+
+struct size_class {
+	pthread_mutex_t      mutex;
+	struct packet_header *free;
+	size_t               num_free;
+	size_t               max_free;
+};
+
+static struct size_class classes[POOL_CLASSES];
+static pthread_once_t    pool_once    = PTHREAD_ONCE_INIT;
+static volatile bool     pool_enabled = false;
+
+static volatile long     num_packets  = 0;
+static volatile long     num_allocs   = 0;
+static volatile long     num_reused   = 0;
+
+static void init_pool(void)
+{
+	for (size_t i = 0; i < POOL_CLASSES; i++) {
+		size_t max_free = POOL_CLASS_BYTES >> (POOL_MIN_SHIFT + i);
+
+		if (max_free < 2)
+			max_free = 2;
+		else if (max_free > POOL_MAX_FREE)
+			max_free = POOL_MAX_FREE;
+
+		pthread_mutex_init(&classes[i].mutex, NULL);
+		classes[i].max_free = max_free;
+	}
+}
+
+static inline size_t get_size_class(size_t size)
+{
+	size_t size_class = 0;
+
+	if (size > POOL_MAX_SIZE)
+		return UNPOOLED;
+
+	while (size > ((size_t)1 << (POOL_MIN_SHIFT + size_class)))
+		size_class++;
+
+	return size_class;
+}
+
+static inline struct packet_header *get_header(uint8_t *data)
+{
+	return (struct packet_header*)data - 1;
+}
+
+void obs_packet_pool_init(void)
+{
+	pthread_once(&pool_once, init_pool);
+	os_atomic_set_bool(&pool_enabled, true);
+}
+
+void obs_packet_pool_free(void)
+{
+	os_atomic_set_bool(&pool_enabled, false);
+
+	blog(LOG_INFO, "Encoder packets: %ld allocated, %ld reused, "
+			"%ld still in use",
+			os_atomic_load_long(&num_allocs),
+			os_atomic_load_long(&num_reused),
+			os_atomic_load_long(&num_packets));
+
+	for (size_t i = 0; i < POOL_CLASSES; i++) {
+		struct size_class    *sc = &classes[i];
+		struct packet_header *header;
+
+		pthread_mutex_lock(&sc->mutex);
+		header = sc->free;
+		sc->free = NULL;
+		sc->num_free = 0;
+		pthread_mutex_unlock(&sc->mutex);
+
+		while (header) {
+			struct packet_header *next = header->next;
+			bfree(header);
+			header = next;
+		}
+	}
+}
+
+uint8_t *obs_packet_pool_alloc(size_t size)
+{
+	struct packet_header *header = NULL;
+	size_t size_class = get_size_class(size);
+
+	if (size_class != UNPOOLED) {
+		struct size_class *sc = &classes[size_class];
+
+		pthread_once(&pool_once, init_pool);
+
+		pthread_mutex_lock(&sc->mutex);
+		header = sc->free;
+		if (header) {
+			sc->free = header->next;
+			sc->num_free--;
+		}
+		pthread_mutex_unlock(&sc->mutex);
+
+		size = (size_t)1 << (POOL_MIN_SHIFT + size_class);
+	}
+
+	if (header) {
+		os_atomic_inc_long(&num_reused);
+	} else {
+		header = bmalloc(sizeof(*header) + size);
+		header->size_class = size_class;
+		os_atomic_inc_long(&num_allocs);
+	}
+
+	header->next = NULL;
+	header->refs = 1;
+	os_atomic_inc_long(&num_packets);
+	return (uint8_t*)(header + 1);
+}
+
+void obs_packet_pool_addref(uint8_t *data)
+{
+	os_atomic_inc_long(&get_header(data)->refs);
+}
+
+void obs_packet_pool_release(uint8_t *data)
+{
+	struct packet_header *header = get_header(data);
+
+	if (os_atomic_dec_long(&header->refs) != 0)
+		return;
+
+	os_atomic_dec_long(&num_packets);
+
+	if (header->size_class != UNPOOLED &&
+	    os_atomic_load_bool(&pool_enabled)) {
+		struct size_class *sc = &classes[header->size_class];
+
+		pthread_mutex_lock(&sc->mutex);
+		if (sc->num_free < sc->max_free) {
+			header->next = sc->free;
+			sc->free = header;
+			sc->num_free++;
+			header = NULL;
+		}
+		pthread_mutex_unlock(&sc->mutex);
+	}
+
+	bfree(header);
+}
+
+long obs_encoder_packet_num_allocs(void)
+{
+	return os_atomic_load_long(&num_packets);
+}
+
+long obs_encoder_packet_num_heap_allocs(void)
+{
+	return os_atomic_load_long(&num_allocs);
+}
+
+long obs_encoder_packet_num_reused(void)
+{
+	return os_atomic_load_long(&num_reused);
+}
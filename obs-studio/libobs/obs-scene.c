@@ -203,6 +203,8 @@ static void scene_enum_all_sources(void *data,
 
 static inline void detach_sceneitem(struct obs_scene_item *item)
 {
+	obs_set_canvas_dirty();
+
 	if (item->prev)
 		item->prev->next = item->next;
 	else
@@ -220,6 +222,8 @@ static inline void attach_sceneitem(struct obs_scene *parent,
 	item->prev   = prev;
 	item->parent = parent;
 
+	obs_set_canvas_dirty();
+
 	if (prev) {
 		item->next = prev->next;
 		if (prev->next)
@@ -326,6 +330,8 @@ static void update_item_transform(struct obs_scene_item *item)
 	if (os_atomic_load_long(&item->defer_update) > 0)
 		return;
 
+	obs_set_canvas_dirty();
+
 	width = cx;
 	height = cy;
 
@@ -1754,6 +1760,7 @@ bool obs_sceneitem_set_visible(obs_sceneitem_t *item, bool visible)
 	}
 
 	item->user_visible = visible;
+	obs_set_canvas_dirty();
 
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "scene", item->parent);
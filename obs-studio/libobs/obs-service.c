@@ -19,12 +19,24 @@
 
 const struct obs_service_info *find_service(const char *id)
 {
+	const struct obs_service_info *info = NULL;
 	size_t i;
-	for (i = 0; i < obs->service_types.num; i++)
-		if (strcmp(obs->service_types.array[i].id, id) == 0)
-			return obs->service_types.array+i;
 
-	return NULL;
+	pthread_mutex_lock(&obs->types_mutex);
+
+	for (i = 0; i < obs->service_types.num; i++) {
+		if (strcmp(obs->service_types.array[i].id, id) == 0) {
+			info = obs->service_types.array+i;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&obs->types_mutex);
+
+	if (!info && load_deferred_module(MODULE_PROVIDES_SERVICE, id))
+		info = find_service(id);
+
+	return info;
 }
 
 const char *obs_service_get_display_name(const char *id)
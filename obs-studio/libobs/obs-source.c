@@ -41,13 +41,23 @@ static inline bool deinterlacing_enabled(const struct obs_source *source)
 
 const struct obs_source_info *get_source_info(const char *id)
 {
+	const struct obs_source_info *info = NULL;
+
+	pthread_mutex_lock(&obs->types_mutex);
+
 	for (size_t i = 0; i < obs->source_types.num; i++) {
-		struct obs_source_info *info = &obs->source_types.array[i];
-		if (strcmp(info->id, id) == 0)
-			return info;
+		if (strcmp(obs->source_types.array[i].id, id) == 0) {
+			info = &obs->source_types.array[i];
+			break;
+		}
 	}
 
-	return NULL;
+	pthread_mutex_unlock(&obs->types_mutex);
+
+	if (!info && load_deferred_module(MODULE_PROVIDES_SOURCE, id))
+		info = get_source_info(id);
+
+	return info;
 }
 
 static const char *source_signals[] = {
@@ -766,6 +776,7 @@ static void obs_source_deferred_update(obs_source_t *source)
 				source->context.settings);
 
 	source->defer_update = false;
+	obs_set_canvas_dirty();
 }
 
 void obs_source_update(obs_source_t *source, obs_data_t *settings)
@@ -1012,6 +1023,8 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 	/* call show/hide if the reference changed */
 	now_showing = !!source->show_refs;
 	if (now_showing != source->showing) {
+		obs_set_canvas_dirty();
+
 		if (now_showing) {
 			show_source(source);
 		} else {
@@ -1033,6 +1046,8 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 		source->active = now_active;
 	}
 
+	source->video_unchanged = false;
+
 	if (source->context.data && source->info.video_tick)
 		source->info.video_tick(source->context.data, seconds);
 
@@ -1932,6 +1947,8 @@ void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
+	obs_set_canvas_dirty();
+
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", source);
 	calldata_set_ptr(&cd, "filter", filter);
@@ -1967,6 +1984,8 @@ static bool obs_source_filter_remove_refless(obs_source_t *source,
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
+	obs_set_canvas_dirty();
+
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", source);
 	calldata_set_ptr(&cd, "filter", filter);
@@ -2093,8 +2112,10 @@ void obs_source_filter_set_order(obs_source_t *source, obs_source_t *filter,
 	success = move_filter_dir(source, filter, movement);
 	pthread_mutex_unlock(&source->filter_mutex);
 
-	if (success)
+	if (success) {
+		obs_set_canvas_dirty();
 		obs_source_dosignal(source, NULL, "reorder_filters");
+	}
 }
 
 obs_data_t *obs_source_get_settings(const obs_source_t *source)
@@ -2793,6 +2814,11 @@ void obs_source_set_name(obs_source_t *source, const char *name)
 		signal_handler_signal(source->context.signals, "rename", &data);
 		calldata_free(&data);
 		bfree(prev_name);
+
+		/* recreated with the new name on the next tick */
+		pthread_mutex_lock(&source->context.rename_cache_mutex);
+		source->tick_profile_name = NULL;
+		pthread_mutex_unlock(&source->context.rename_cache_mutex);
 	}
 }
 
@@ -3295,6 +3321,14 @@ bool obs_source_showing(const obs_source_t *source)
 		source->show_refs != 0 : false;
 }
 
+void obs_source_set_video_unchanged(obs_source_t *source, bool unchanged)
+{
+	if (!obs_source_valid(source, "obs_source_set_video_unchanged"))
+		return;
+
+	source->video_unchanged = unchanged;
+}
+
 static inline void signal_flags_updated(obs_source_t *source)
 {
 	struct calldata data;
@@ -3504,6 +3538,7 @@ void obs_source_set_enabled(obs_source_t *source, bool enabled)
 		return;
 
 	source->enabled = enabled;
+	obs_set_canvas_dirty();
 
 	calldata_init_fixed(&data, stack, sizeof(stack));
 	calldata_set_ptr(&data, "source", source);
@@ -3757,8 +3792,8 @@ static inline void apply_audio_action(obs_source_t *source,
 	}
 }
 
-static void apply_audio_actions(obs_source_t *source, size_t channels,
-		size_t sample_rate)
+static void apply_audio_actions(obs_source_t *source, uint32_t mixers,
+		size_t channels, size_t sample_rate)
 {
 	float *vol_data = malloc(sizeof(float) * AUDIO_OUTPUT_FRAMES);
 	float cur_vol = get_source_volume(source, source->audio_ts);
@@ -3798,7 +3833,9 @@ static void apply_audio_actions(obs_source_t *source, size_t channels,
 	pthread_mutex_unlock(&source->audio_actions_mutex);
 
 	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
-		if ((source->audio_mixers & (1 << mix)) != 0)
+		uint32_t mix_and_val = (1 << mix);
+		if ((source->audio_mixers & mix_and_val) != 0 &&
+		    (mixers & mix_and_val) != 0)
 			multiply_vol_data(source, mix, channels, vol_data);
 	}
 
@@ -3825,7 +3862,8 @@ static void apply_audio_volume(obs_source_t *source, uint32_t mixers,
 				AUDIO_OUTPUT_FRAMES);
 
 		if (action.timestamp < (source->audio_ts + duration)) {
-			apply_audio_actions(source, channels, sample_rate);
+			apply_audio_actions(source, mixers, channels,
+					sample_rate);
 			return;
 		}
 	}
@@ -3874,7 +3912,11 @@ static void custom_audio_render(obs_source_t *source, uint32_t mixers,
 		return;
 
 	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
-		if ((source->audio_mixers & (1 << mix)) == 0) {
+		uint32_t mix_and_val = (1 << mix);
+
+		/* inactive mixes aren't mixed, so they needn't be cleared */
+		if ((mixers & mix_and_val) != 0 &&
+		    (source->audio_mixers & mix_and_val) == 0) {
 			memset(source->audio_output_buf[mix][0], 0,
 					sizeof(float) * AUDIO_OUTPUT_FRAMES *
 					channels);
@@ -130,6 +130,17 @@ enum obs_source_type {
  */
 #define OBS_SOURCE_DO_NOT_SELF_MONITOR (1<<9)
 
+/**
+ * Filter output only depends on its input and its settings
+ *
+ * When used on a filter, a source filtered by it still counts as unchanged
+ * when it reports unchanged video (see obs_source_set_video_unchanged), so
+ * the previous output frame can be reused.  A source with any enabled video
+ * filter without this flag (scrolling, animated masks, anything that
+ * changes over time) counts as changed every frame.
+ */
+#define OBS_SOURCE_CACHEABLE (1<<10)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent,
@@ -425,6 +436,18 @@ struct obs_source_info {
 	void (*enum_all_sources)(void *data,
 			obs_source_enum_proc_t enum_callback,
 			void *param);
+
+	/**
+	 * Called each frame before video_tick, without the graphics context.
+	 * When the video thread ticks sources in parallel, this runs on a
+	 * worker thread alongside the video_prepare of other sources, so work
+	 * that doesn't need graphics (finding a window, CPU-side capture) can
+	 * be moved here out of video_tick.
+	 *
+	 * @param  data     Source data
+	 * @param  seconds  Seconds elapsed since the last frame
+	 */
+	void (*video_prepare)(void *data, float seconds);
 };
 
 EXPORT void obs_register_source_s(const struct obs_source_info *info,
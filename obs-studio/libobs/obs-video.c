@@ -21,31 +21,233 @@
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
 
+/* number of unchanged ticks required before the previous output frame is
+ * reused, so that the last change has fully passed through the render,
+ * conversion and staging textures */
+static inline uint64_t reuse_settle_ticks(const struct obs_core_video *video)
+{
+	return NUM_TEXTURES + video->staging_depth;
+}
+
+/* a filter may change its output on its own from one frame to the next, unless
+ * it opts in with OBS_SOURCE_CACHEABLE */
+static bool filters_unchanged(struct obs_source *source)
+{
+	bool unchanged = true;
+
+	pthread_mutex_lock(&source->filter_mutex);
+
+	for (size_t i = 0; i < source->filters.num; i++) {
+		struct obs_source *filter = source->filters.array[i];
+		uint32_t flags = filter->info.output_flags;
+
+		if (filter->enabled && (flags & OBS_SOURCE_VIDEO) != 0 &&
+		    (flags & OBS_SOURCE_CACHEABLE) == 0) {
+			unchanged = false;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&source->filter_mutex);
+	return unchanged;
+}
+
+static inline bool source_video_unchanged(struct obs_source *source)
+{
+	/* filters are checked through the source they are attached to */
+	if (source->info.type == OBS_SOURCE_TYPE_FILTER)
+		return true;
+
+	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION) {
+		if (source->transitioning_video)
+			return false;
+	} else if (source->info.type == OBS_SOURCE_TYPE_INPUT &&
+	           (source->info.output_flags & OBS_SOURCE_VIDEO) != 0) {
+		if (source->showing && !source->video_unchanged)
+			return false;
+	}
+
+	return !source->showing || filters_unchanged(source);
+}
+
+static inline bool has_draw_callbacks(void)
+{
+	bool has_callbacks;
+
+	pthread_mutex_lock(&obs->data.draw_callbacks_mutex);
+	has_callbacks = obs->data.draw_callbacks.num != 0;
+	pthread_mutex_unlock(&obs->data.draw_callbacks_mutex);
+
+	return has_callbacks;
+}
+
+/* a source that takes longer than this share of the frame interval to tick
+ * holds up every source after it and the render, and is logged once */
+#define TICK_BUDGET_DIVISOR 4
+
+static inline bool source_has_prepare(const struct obs_source *source)
+{
+	return source->context.data && source->info.video_prepare;
+}
+
+/* the name can be changed by obs_source_set_name on another thread, so both
+ * it and the cached profiler name are used under the rename lock.  the
+ * returned name lives in the profiler name store */
+static const char *source_tick_name(struct obs_source *source)
+{
+	const char *tick_name;
+
+	pthread_mutex_lock(&source->context.rename_cache_mutex);
+
+	if (!source->tick_profile_name) {
+		const char *name = source->context.name;
+
+		source->tick_profile_name = profile_store_name(
+				obs_get_profiler_name_store(), "'%s' (%s)",
+				name ? name : "", source->info.id);
+	}
+
+	tick_name = source->tick_profile_name;
+
+	pthread_mutex_unlock(&source->context.rename_cache_mutex);
+	return tick_name;
+}
+
+struct prepare_sources_data {
+	struct obs_source **sources;
+	float             seconds;
+};
+
+static void prepare_sources_slice(void *param, uint32_t start,
+		uint32_t end)
+{
+	struct prepare_sources_data *data = param;
+
+	for (uint32_t i = start; i < end; i++) {
+		struct obs_source *source = data->sources[i];
+		uint64_t start_ns = os_gettime_ns();
+
+		source->info.video_prepare(source->context.data,
+				data->seconds);
+		source->prepare_time = os_gettime_ns() - start_ns;
+	}
+}
+
+/* runs the video_prepare callbacks of all sources on the tick pool.  they
+ * don't use the graphics context, so a slow one doesn't hold up the rest.
+ * the profiler is per-thread, so their times are recorded here afterwards */
+static const char *prepare_sources_name = "prepare_sources";
+static void prepare_sources(struct obs_core_video *video, float seconds)
+{
+	struct obs_source *source = obs->data.first_source;
+	struct prepare_sources_data data;
+
+	da_resize(video->tick_prepares, 0);
+
+	while (source) {
+		if (source_has_prepare(source))
+			da_push_back(video->tick_prepares, &source);
+
+		source = (struct obs_source*)source->context.next;
+	}
+
+	if (!video->tick_prepares.num)
+		return;
+
+	profile_start(prepare_sources_name);
+
+	data.sources = video->tick_prepares.array;
+	data.seconds = seconds;
+	video_slice_pool_run(video->tick_pool, prepare_sources_slice, &data,
+			(uint32_t)video->tick_prepares.num, 1);
+
+	for (size_t i = 0; i < video->tick_prepares.num; i++) {
+		source = video->tick_prepares.array[i];
+		profile_record(source_tick_name(source), source->prepare_time);
+	}
+
+	profile_end(prepare_sources_name);
+}
+
+static void tick_source(struct obs_core_video *video,
+		struct obs_source *source, float seconds, uint64_t budget)
+{
+	const char *name = source_tick_name(source);
+	uint64_t start_ns = os_gettime_ns();
+	uint64_t tick_time;
+
+	profile_start(name);
+
+	if (!video->tick_pool && source_has_prepare(source))
+		source->info.video_prepare(source->context.data, seconds);
+	obs_source_video_tick(source, seconds);
+
+	profile_end(name);
+
+	tick_time = os_gettime_ns() - start_ns + source->prepare_time;
+	source->prepare_time = 0;
+
+	if (tick_time <= budget)
+		return;
+
+	metrics_counter_add(video->slow_tick_metric, 1);
+
+	if (!source->tick_budget_warned) {
+		blog(LOG_WARNING, "Source %s took %.2f ms to tick, over the "
+		                  "%.2f ms budget", name,
+		                  (double)tick_time / 1000000.0,
+		                  (double)budget / 1000000.0);
+		source->tick_budget_warned = true;
+	}
+}
+
 static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 {
 	struct obs_core_data *data = &obs->data;
+	struct obs_core_video *video = &obs->video;
 	struct obs_source    *source;
+	uint64_t             frame_time;
 	uint64_t             delta_time;
 	float                seconds;
+	bool                 unchanged = true;
+
+	frame_time = video_output_get_frame_time(obs->video.video);
 
 	if (!last_time)
-		last_time = cur_time -
-			video_output_get_frame_time(obs->video.video);
+		last_time = cur_time - frame_time;
 
 	delta_time = cur_time - last_time;
 	seconds = (float)((double)delta_time / 1000000000.0);
 
 	pthread_mutex_lock(&data->sources_mutex);
 
+	if (video->tick_pool)
+		prepare_sources(video, seconds);
+
 	/* call the tick function of each source */
 	source = data->first_source;
 	while (source) {
-		obs_source_video_tick(source, seconds);
+		tick_source(video, source, seconds,
+				frame_time / TICK_BUDGET_DIVISOR);
+		if (!source_video_unchanged(source))
+			unchanged = false;
+
 		source = (struct obs_source*)source->context.next;
 	}
 
 	pthread_mutex_unlock(&data->sources_mutex);
 
+	/* sources ticked above may have marked the canvas dirty themselves */
+	if (os_atomic_set_bool(&video->canvas_dirty, false))
+		unchanged = false;
+	if (unchanged && has_draw_callbacks())
+		unchanged = false;
+
+	if (!unchanged)
+		video->unchanged_ticks = 0;
+	else if (video->unchanged_ticks <= reuse_settle_ticks(video))
+		video->unchanged_ticks++;
+
 	return cur_time;
 }
 
@@ -86,12 +288,47 @@ static inline void set_render_size(uint32_t width, uint32_t height)
 
 static inline void unmap_last_surface(struct obs_core_video *video)
 {
+	/* the conversion thread may still be reading the mapped surface */
+	if (video->convert_queued) {
+		os_sem_wait(video->convert_done_sem);
+		video->convert_queued = false;
+	}
+
+	/* the mapped surface is always the oldest copy in the staging ring */
 	if (video->mapped_surface) {
 		gs_stagesurface_unmap(video->mapped_surface);
 		video->mapped_surface = NULL;
+		video->copies_pending--;
 	}
 }
 
+static inline size_t oldest_copy(const struct obs_core_video *video)
+{
+	return (video->copy_head + video->staging_depth -
+			video->copies_pending) % video->staging_depth;
+}
+
+/* the staging ring is full and the oldest copy still hasn't been read back:
+ * give up on it and let the next copy cover its frame timestamp as well */
+static void drop_oldest_copy(struct obs_core_video *video)
+{
+	struct obs_vframe_info dropped;
+	struct obs_vframe_info *next;
+
+	video->copies_pending--;
+	metrics_counter_add(video->readback_dropped_metric, 1);
+
+	if (video->vframe_info_buffer.size < sizeof(dropped) * 2)
+		return;
+
+	circlebuf_pop_front(&video->vframe_info_buffer, &dropped,
+			sizeof(dropped));
+
+	next = circlebuf_data(&video->vframe_info_buffer, 0);
+	next->timestamp = dropped.timestamp;
+	next->count += dropped.count;
+}
+
 static const char *render_main_texture_name = "render_main_texture";
 static inline void render_main_texture(struct obs_core_video *video,
 		int cur_texture)
@@ -287,13 +524,12 @@ end:
 
 static const char *stage_output_texture_name = "stage_output_texture";
 static inline void stage_output_texture(struct obs_core_video *video,
-		int cur_texture, int prev_texture)
+		int prev_texture)
 {
 	profile_start(stage_output_texture_name);
 
 	gs_texture_t   *texture;
 	bool        texture_ready;
-	gs_stagesurf_t *copy = video->copy_surfaces[cur_texture];
 
 	if (video->gpu_conversion) {
 		texture = video->convert_textures[prev_texture];
@@ -308,9 +544,14 @@ static inline void stage_output_texture(struct obs_core_video *video,
 	if (!texture_ready)
 		goto end;
 
-	gs_stage_texture(copy, texture);
+	if (video->copies_pending == video->staging_depth)
+		drop_oldest_copy(video);
+
+	gs_stage_texture(video->copy_surfaces[video->copy_head], texture);
 
-	video->textures_copied[cur_texture] = true;
+	video->copy_times[video->copy_head] = os_gettime_ns();
+	video->copy_head = (video->copy_head + 1) % video->staging_depth;
+	video->copies_pending++;
 
 end:
 	profile_end(stage_output_texture_name);
@@ -329,7 +570,7 @@ static inline void render_video(struct obs_core_video *video, int cur_texture,
 	if (video->gpu_conversion)
 		render_convert_texture(video, cur_texture, prev_texture);
 
-	stage_output_texture(video, cur_texture, prev_texture);
+	stage_output_texture(video, prev_texture);
 
 	gs_set_render_target(NULL, NULL);
 	gs_enable_blending(true);
@@ -337,17 +578,44 @@ static inline void render_video(struct obs_core_video *video, int cur_texture,
 	gs_end_scene();
 }
 
+/* maps the oldest staged copy once the GPU has finished writing it, so the
+ * graphics thread never stalls on a copy that is still in flight.  when the
+ * graphics module can't tell, the copy is mapped once the ring is full, which
+ * gives the GPU staging_depth - 1 frames to finish it */
+static const char *readback_latency_name = "readback_latency";
 static inline bool download_frame(struct obs_core_video *video,
-		int prev_texture, struct video_data *frame)
+		struct video_data *frame)
 {
-	gs_stagesurf_t *surface = video->copy_surfaces[prev_texture];
+	enum gs_stage_status status;
+	gs_stagesurf_t *surface;
+	uint64_t latency;
+	size_t oldest;
+
+	if (!video->copies_pending)
+		return false;
+
+	oldest  = oldest_copy(video);
+	surface = video->copy_surfaces[oldest];
+	status  = gs_stagesurface_get_status(surface);
 
-	if (!video->textures_copied[prev_texture])
+	if (status == GS_STAGE_UNKNOWN &&
+	    video->copies_pending < video->staging_depth)
 		return false;
 
+	if (status == GS_STAGE_BUSY) {
+		/* a copy made this frame isn't expected to be ready yet */
+		if (video->copies_pending > 1)
+			metrics_counter_add(video->readback_skipped_metric, 1);
+		return false;
+	}
+
 	if (!gs_stagesurface_map(surface, &frame->data[0], &frame->linesize[0]))
 		return false;
 
+	latency = os_gettime_ns() - video->copy_times[oldest];
+	metrics_histogram_record(video->readback_metric, latency);
+	profile_record(readback_latency_name, latency);
+
 	video->mapped_surface = surface;
 	return true;
 }
@@ -434,24 +702,25 @@ static void set_gpu_converted_data(struct obs_core_video *video,
 
 static void convert_frame(
 		struct video_frame *output, const struct video_data *input,
-		const struct video_output_info *info)
+		const struct video_output_info *info,
+		uint32_t start_y, uint32_t end_y)
 {
 	if (info->format == VIDEO_FORMAT_I420) {
 		compress_uyvx_to_i420(
 				input->data[0], input->linesize[0],
-				0, info->height,
+				start_y, end_y,
 				output->data, output->linesize);
 
 	} else if (info->format == VIDEO_FORMAT_NV12) {
 		compress_uyvx_to_nv12(
 				input->data[0], input->linesize[0],
-				0, info->height,
+				start_y, end_y,
 				output->data, output->linesize);
 
 	} else if (info->format == VIDEO_FORMAT_I444) {
 		convert_uyvx_to_i444(
 				input->data[0], input->linesize[0],
-				0, info->height,
+				start_y, end_y,
 				output->data, output->linesize);
 
 	} else {
@@ -459,6 +728,18 @@ static void convert_frame(
 	}
 }
 
+struct convert_slice_data {
+	struct video_frame             *output;
+	const struct video_data        *input;
+	const struct video_output_info *info;
+};
+
+static void convert_frame_slice(void *param, uint32_t start_y, uint32_t end_y)
+{
+	struct convert_slice_data *data = param;
+	convert_frame(data->output, data->input, data->info, start_y, end_y);
+}
+
 static inline void copy_rgbx_frame(
 		struct video_frame *output, const struct video_data *input,
 		const struct video_output_info *info)
@@ -495,7 +776,14 @@ static inline void output_video_data(struct obs_core_video *video,
 					input_frame, info);
 
 		} else if (format_is_yuv(info->format)) {
-			convert_frame(&output_frame, input_frame, info);
+			struct convert_slice_data data = {
+				&output_frame, input_frame, info
+			};
+
+			/* the chroma rows of 4:2:0 cover two luma rows */
+			video_slice_pool_run(video->convert_pool,
+					convert_frame_slice, &data,
+					info->height, 2);
 		} else {
 			copy_rgbx_frame(&output_frame, input_frame, info);
 		}
@@ -522,6 +810,8 @@ static inline void video_sleep(struct obs_core_video *video,
 
 	video->total_frames += count;
 	video->lagged_frames += count - 1;
+	if (count > 1)
+		metrics_counter_add(video->lagged_metric, count - 1);
 
 	vframe_info.timestamp = cur_time;
 	vframe_info.count = count;
@@ -529,11 +819,54 @@ static inline void video_sleep(struct obs_core_video *video,
 			sizeof(vframe_info));
 }
 
+/* hands the mapped frame to the conversion thread.  the surface stays mapped
+ * until unmap_last_surface, which waits for the conversion to finish */
+static void queue_convert_frame(struct obs_core_video *video,
+		const struct video_data *frame, int count)
+{
+	video->convert_frame  = *frame;
+	video->convert_count  = count;
+	video->convert_queued = true;
+
+	os_atomic_set_long(&video->convert_busy, 1);
+	os_sem_post(video->convert_ready_sem);
+}
+
 static const char *output_frame_gs_context_name = "gs_context(video->graphics)";
 static const char *output_frame_render_video_name = "render_video";
 static const char *output_frame_download_frame_name = "download_frame";
 static const char *output_frame_gs_flush_name = "gs_flush";
 static const char *output_frame_output_video_data_name = "output_video_data";
+static const char *output_frame_reuse_frame_name = "reuse_frame";
+
+static inline bool can_reuse_frame(struct obs_core_video *video)
+{
+	/* a repeat refers to the last frame video-io has, so the frame being
+	 * converted has to reach it first */
+	if (os_atomic_load_long(&video->convert_busy) != 0)
+		return false;
+
+	return video->frame_output &&
+		video->unchanged_ticks > reuse_settle_ticks(video) &&
+		video->vframe_info_buffer.size != 0;
+}
+
+/* nothing changed since the last frame was sent: leave the textures alone and
+ * output the previous frame again for the oldest pending frame timestamp */
+static inline void reuse_frame(struct obs_core_video *video)
+{
+	struct obs_vframe_info vframe_info;
+
+	circlebuf_pop_front(&video->vframe_info_buffer, &vframe_info,
+			sizeof(vframe_info));
+
+	profile_start(output_frame_reuse_frame_name);
+	video_output_repeat_frame(video->video, vframe_info.count,
+			vframe_info.timestamp);
+	profile_end(output_frame_reuse_frame_name);
+
+	video->reused_frames += vframe_info.count;
+}
 static inline void output_frame(void)
 {
 	struct obs_core_video *video = &obs->video;
@@ -541,6 +874,12 @@ static inline void output_frame(void)
 	int prev_texture = cur_texture == 0 ? NUM_TEXTURES-1 : cur_texture-1;
 	struct video_data frame;
 	bool frame_ready;
+	uint64_t start_ns, end_ns;
+
+	if (can_reuse_frame(video)) {
+		reuse_frame(video);
+		return;
+	}
 
 	memset(&frame, 0, sizeof(struct video_data));
 
@@ -548,11 +887,17 @@ static inline void output_frame(void)
 	gs_enter_context(video->graphics);
 
 	profile_start(output_frame_render_video_name);
+	start_ns = os_gettime_ns();
 	render_video(video, cur_texture, prev_texture);
+	end_ns = os_gettime_ns();
+	metrics_histogram_record(video->render_metric, end_ns - start_ns);
 	profile_end(output_frame_render_video_name);
 
 	profile_start(output_frame_download_frame_name);
-	frame_ready = download_frame(video, prev_texture, &frame);
+	start_ns = end_ns;
+	frame_ready = download_frame(video, &frame);
+	metrics_histogram_record(video->download_metric,
+			os_gettime_ns() - start_ns);
 	profile_end(output_frame_download_frame_name);
 
 	profile_start(output_frame_gs_flush_name);
@@ -568,9 +913,19 @@ static inline void output_frame(void)
 				sizeof(vframe_info));
 
 		frame.timestamp = vframe_info.timestamp;
-		profile_start(output_frame_output_video_data_name);
-		output_video_data(video, &frame, vframe_info.count);
-		profile_end(output_frame_output_video_data_name);
+
+		if (video->convert_thread_initialized) {
+			queue_convert_frame(video, &frame, vframe_info.count);
+		} else {
+			profile_start(output_frame_output_video_data_name);
+			start_ns = os_gettime_ns();
+			output_video_data(video, &frame, vframe_info.count);
+			metrics_histogram_record(video->convert_metric,
+					os_gettime_ns() - start_ns);
+			profile_end(output_frame_output_video_data_name);
+		}
+
+		video->frame_output = true;
 	}
 
 	if (++video->cur_texture == NUM_TEXTURES)
@@ -591,6 +946,8 @@ void *obs_video_thread(void *param)
 	uint32_t fps_total_frames = 0;
 
 	obs->video.video_time = os_gettime_ns();
+	obs->video.unchanged_ticks = 0;
+	obs->video.frame_output = false;
 
 	os_set_thread_name("libobs: graphics thread");
 
@@ -618,6 +975,8 @@ void *obs_video_thread(void *param)
 		profile_end(output_frame_name);
 
 		frame_time_ns = os_gettime_ns() - frame_start;
+		metrics_histogram_record(obs->video.frame_metric,
+				frame_time_ns);
 
 		profile_end(video_thread_name);
 
@@ -644,3 +1003,35 @@ void *obs_video_thread(void *param)
 	UNUSED_PARAMETER(param);
 	return NULL;
 }
+
+static const char *convert_thread_name = "obs_convert_thread";
+void *obs_convert_thread(void *param)
+{
+	struct obs_core_video *video = param;
+
+	os_set_thread_name("libobs: conversion thread");
+
+	for (;;) {
+		uint64_t start_ns;
+
+		if (os_sem_wait(video->convert_ready_sem) != 0)
+			break;
+		if (video->convert_stop)
+			break;
+
+		profile_start(convert_thread_name);
+		start_ns = os_gettime_ns();
+		output_video_data(video, &video->convert_frame,
+				video->convert_count);
+		metrics_histogram_record(video->convert_metric,
+				os_gettime_ns() - start_ns);
+		profile_end(convert_thread_name);
+
+		profile_reenable_thread();
+
+		os_atomic_set_long(&video->convert_busy, 0);
+		os_sem_post(video->convert_done_sem);
+	}
+
+	return NULL;
+}
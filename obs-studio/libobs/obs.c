@@ -190,13 +190,15 @@ static bool obs_init_textures(struct obs_video_info *ovi)
 		video->conversion_height : ovi->output_height;
 	size_t i;
 
-	for (i = 0; i < NUM_TEXTURES; i++) {
+	for (i = 0; i < video->staging_depth; i++) {
 		video->copy_surfaces[i] = gs_stagesurface_create(
 				ovi->output_width, output_height, GS_RGBA);
 
 		if (!video->copy_surfaces[i])
 			return false;
+	}
 
+	for (i = 0; i < NUM_TEXTURES; i++) {
 		video->render_textures[i] = gs_texture_create(
 				ovi->base_width, ovi->base_height,
 				GS_RGBA, 1, NULL, GS_RENDER_TARGET);
@@ -347,6 +349,48 @@ static inline void set_video_matrix(struct obs_core_video *video,
 	memcpy(video->color_matrix, &mat, sizeof(float) * 16);
 }
 
+static bool obs_init_cpu_conversion(struct obs_core_video *video)
+{
+	video->convert_stop   = false;
+	video->convert_queued = false;
+	video->convert_busy   = 0;
+
+	if (os_sem_init(&video->convert_ready_sem, 0) != 0)
+		return false;
+	if (os_sem_init(&video->convert_done_sem, 0) != 0)
+		return false;
+
+	video->convert_pool = video_slice_pool_create(0);
+
+	if (pthread_create(&video->convert_thread, NULL, obs_convert_thread,
+				video) != 0)
+		return false;
+
+	video->convert_thread_initialized = true;
+
+	blog(LOG_INFO, "CPU video conversion threads: %d",
+			(int)video_slice_pool_num_threads(video->convert_pool));
+	return true;
+}
+
+static void obs_free_cpu_conversion(struct obs_core_video *video)
+{
+	if (video->convert_thread_initialized) {
+		video->convert_stop = true;
+		os_sem_post(video->convert_ready_sem);
+		pthread_join(video->convert_thread, NULL);
+		video->convert_thread_initialized = false;
+	}
+
+	video_slice_pool_destroy(video->convert_pool);
+	os_sem_destroy(video->convert_ready_sem);
+	os_sem_destroy(video->convert_done_sem);
+	video->convert_pool      = NULL;
+	video->convert_ready_sem = NULL;
+	video->convert_done_sem  = NULL;
+	video->convert_queued    = false;
+}
+
 static int obs_init_video(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
@@ -360,9 +404,22 @@ static int obs_init_video(struct obs_video_info *ovi)
 	video->output_height  = ovi->output_height;
 	video->gpu_conversion = ovi->gpu_conversion;
 	video->scale_type     = ovi->scale_type;
+	video->staging_depth  = ovi->staging_depth;
 
 	set_video_matrix(video, ovi);
 
+	video->frame_metric    = metrics_histogram_get("video.frame");
+	video->render_metric   = metrics_histogram_get("video.render");
+	video->download_metric = metrics_histogram_get("video.download");
+	video->convert_metric  = metrics_histogram_get("video.convert");
+	video->readback_metric = metrics_histogram_get("video.readback_latency");
+	video->lagged_metric   = metrics_counter_get("video.lagged_frames");
+	video->readback_skipped_metric =
+		metrics_counter_get("video.readback_skipped");
+	video->readback_dropped_metric =
+		metrics_counter_get("video.readback_dropped");
+	video->slow_tick_metric = metrics_counter_get("video.slow_source_ticks");
+
 	errorcode = video_output_open(&video->video, &vi);
 
 	if (errorcode != VIDEO_OUTPUT_SUCCESS) {
@@ -377,13 +434,33 @@ static int obs_init_video(struct obs_video_info *ovi)
 
 	gs_enter_context(video->graphics);
 
-	if (ovi->gpu_conversion && !obs_init_gpu_conversion(ovi))
+	/* the software renderer has no conversion shaders, so output frames
+	 * go through the CPU conversion thread instead */
+	if (video->gpu_conversion &&
+	    gs_get_device_type() == GS_DEVICE_SOFTWARE) {
+		blog(LOG_INFO, "GPU conversion is not available with the "
+		               "software renderer");
+		video->gpu_conversion = false;
+	}
+
+	if (video->gpu_conversion && !obs_init_gpu_conversion(ovi))
 		return OBS_VIDEO_FAIL;
 	if (!obs_init_textures(ovi))
 		return OBS_VIDEO_FAIL;
 
 	gs_leave_context();
 
+	if (!video->gpu_conversion && format_is_yuv(ovi->output_format) &&
+	    !obs_init_cpu_conversion(video))
+		return OBS_VIDEO_FAIL;
+
+	if (ovi->parallel_tick) {
+		video->tick_pool = video_slice_pool_create(0);
+		blog(LOG_INFO, "Source tick threads: %d",
+				(int)video_slice_pool_num_threads(
+					video->tick_pool));
+	}
+
 	errorcode = pthread_create(&video->video_thread, NULL,
 			obs_video_thread, obs);
 	if (errorcode != 0)
@@ -405,6 +482,14 @@ static void stop_video(void)
 			pthread_join(video->video_thread, &thread_retval);
 			video->thread_initialized = false;
 		}
+
+		/* after the graphics thread, which may be waiting for the
+		 * conversion before unmapping */
+		obs_free_cpu_conversion(video);
+
+		video_slice_pool_destroy(video->tick_pool);
+		video->tick_pool = NULL;
+		da_free(video->tick_prepares);
 	}
 
 }
@@ -427,13 +512,16 @@ static void obs_free_video(void)
 			video->mapped_surface = NULL;
 		}
 
-		for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		for (size_t i = 0; i < MAX_STAGING_SURFACES; i++) {
 			gs_stagesurface_destroy(video->copy_surfaces[i]);
+			video->copy_surfaces[i] = NULL;
+		}
+
+		for (size_t i = 0; i < NUM_TEXTURES; i++) {
 			gs_texture_destroy(video->render_textures[i]);
 			gs_texture_destroy(video->convert_textures[i]);
 			gs_texture_destroy(video->output_textures[i]);
 
-			video->copy_surfaces[i]    = NULL;
 			video->render_textures[i]  = NULL;
 			video->convert_textures[i] = NULL;
 			video->output_textures[i]  = NULL;
@@ -447,12 +535,12 @@ static void obs_free_video(void)
 				sizeof(video->textures_rendered));
 		memset(&video->textures_output, 0,
 				sizeof(video->textures_output));
-		memset(&video->textures_copied, 0,
-				sizeof(video->textures_copied));
 		memset(&video->textures_converted, 0,
 				sizeof(video->textures_converted));
 
-		video->cur_texture = 0;
+		video->cur_texture    = 0;
+		video->copy_head      = 0;
+		video->copies_pending = 0;
 	}
 }
 
@@ -501,6 +589,7 @@ static bool obs_init_audio(struct audio_output_info *ai)
 		return false;
 
 	audio->user_volume    = 1.0f;
+	audio->buffering_metric = metrics_gauge_get("audio.buffering_ms");
 
 	audio->monitoring_device_name = bstrdup("Default");
 	audio->monitoring_device_id = bstrdup("default");
@@ -739,6 +828,28 @@ static inline void obs_free_hotkeys(void)
 	pthread_mutex_destroy(&hotkeys->mutex);
 }
 
+static bool obs_init_deferred_modules(void)
+{
+	pthread_mutexattr_t attr;
+
+	if (pthread_mutexattr_init(&attr) != 0)
+		return false;
+	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
+		return false;
+	if (pthread_mutex_init(&obs->types_mutex, &attr) != 0)
+		return false;
+	return pthread_mutex_init(&obs->deferred_modules_mutex, &attr) == 0;
+}
+
+static void obs_free_deferred_modules(void)
+{
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+	for (size_t i = 0; i < obs->deferred_modules.num; i++)
+		free_deferred_module(obs->deferred_modules.array+i);
+	da_free(obs->deferred_modules);
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
+}
+
 extern const struct obs_source_info scene_info;
 
 extern void log_system_info(void);
@@ -749,6 +860,8 @@ static bool obs_init(const char *locale, const char *module_config_path,
 	obs = bzalloc(sizeof(struct obs_core));
 
 	pthread_mutex_init_value(&obs->audio.monitoring_mutex);
+	pthread_mutex_init_value(&obs->deferred_modules_mutex);
+	pthread_mutex_init_value(&obs->types_mutex);
 
 	obs->name_store_owned = !store;
 	obs->name_store = store ? store : profiler_name_store_create();
@@ -765,10 +878,13 @@ static bool obs_init(const char *locale, const char *module_config_path,
 		return false;
 	if (!obs_init_hotkeys())
 		return false;
+	if (!obs_init_deferred_modules())
+		return false;
 
 	if (module_config_path)
 		obs->module_config_path = bstrdup(module_config_path);
 	obs->locale = bstrdup(locale);
+	obs_packet_pool_init();
 	obs_register_source(&scene_info);
 	add_default_module_paths();
 	return true;
@@ -813,6 +929,9 @@ void obs_shutdown(void)
 	if (!obs)
 		return;
 
+	/* nothing may load a module while the types are being freed */
+	obs_free_deferred_modules();
+
 #define FREE_REGISTERED_TYPES(structure, list) \
 	do { \
 		for (size_t i = 0; i < list.num; i++) { \
@@ -836,6 +955,10 @@ void obs_shutdown(void)
 	da_free(obs->filter_types);
 	da_free(obs->transition_types);
 
+	for (size_t i = 0; i < obs->retired_types.num; i++)
+		bfree(obs->retired_types.array[i]);
+	da_free(obs->retired_types);
+
 	stop_video();
 	stop_hotkeys();
 
@@ -844,6 +967,7 @@ void obs_shutdown(void)
 	obs_free_video();
 	obs_free_hotkeys();
 	obs_free_graphics();
+	obs_packet_pool_free();
 	proc_handler_destroy(obs->procs);
 	signal_handler_destroy(obs->signals);
 	obs->procs = NULL;
@@ -861,9 +985,17 @@ void obs_shutdown(void)
 		free_module_path(obs->module_paths.array+i);
 	da_free(obs->module_paths);
 
+	for (size_t i = 0; i < obs->allowed_modules.num; i++)
+		bfree(obs->allowed_modules.array[i]);
+	da_free(obs->allowed_modules);
+	pthread_mutex_destroy(&obs->deferred_modules_mutex);
+	pthread_mutex_destroy(&obs->types_mutex);
+
 	if (obs->name_store_owned)
 		profiler_name_store_free(obs->name_store);
 
+	metrics_free();
+
 	bfree(obs->module_config_path);
 	bfree(obs->locale);
 	bfree(obs);
@@ -938,6 +1070,13 @@ int obs_reset_video(struct obs_video_info *ovi)
 	ovi->output_width  &= 0xFFFFFFFC;
 	ovi->output_height &= 0xFFFFFFFE;
 
+	if (!ovi->staging_depth)
+		ovi->staging_depth = DEFAULT_STAGING_SURFACES;
+	else if (ovi->staging_depth < 2)
+		ovi->staging_depth = 2;
+	else if (ovi->staging_depth > MAX_STAGING_SURFACES)
+		ovi->staging_depth = MAX_STAGING_SURFACES;
+
 	if (!video->graphics) {
 		int errorcode = obs_init_graphics(ovi);
 		if (errorcode != OBS_VIDEO_SUCCESS) {
@@ -971,12 +1110,16 @@ int obs_reset_video(struct obs_video_info *ovi)
 	               "\toutput resolution: %dx%d\n"
 	               "\tdownscale filter:  %s\n"
 	               "\tfps:               %d/%d\n"
-	               "\tformat:            %s",
+	               "\tformat:            %s\n"
+	               "\tstaging surfaces:  %u\n"
+	               "\tparallel tick:     %s",
 	               ovi->base_width, ovi->base_height,
 	               ovi->output_width, ovi->output_height,
 	               scale_type_name,
 	               ovi->fps_num, ovi->fps_den,
-		       get_video_format_name(ovi->output_format));
+		       get_video_format_name(ovi->output_format),
+		       ovi->staging_depth,
+		       ovi->parallel_tick ? "yes" : "no");
 
 	return obs_init_video(ovi);
 }
@@ -1037,78 +1180,76 @@ bool obs_get_audio_info(struct obs_audio_info *oai)
 	return true;
 }
 
+/* deferred modules can add types while these are enumerated */
+#define ENUM_TYPE_ID(list, idx, id)                                       \
+	do {                                                              \
+		bool found;                                               \
+		if (!obs) return false;                                   \
+                                                                          \
+		pthread_mutex_lock(&obs->types_mutex);                    \
+		found = idx < list.num;                                   \
+		if (found)                                                \
+			*id = list.array[idx].id;                         \
+		pthread_mutex_unlock(&obs->types_mutex);                  \
+		return found;                                             \
+	} while (false)
+
 bool obs_enum_source_types(size_t idx, const char **id)
 {
-	if (!obs) return false;
-
-	if (idx >= obs->source_types.num)
-		return false;
-	*id = obs->source_types.array[idx].id;
-	return true;
+	ENUM_TYPE_ID(obs->source_types, idx, id);
 }
 
 bool obs_enum_input_types(size_t idx, const char **id)
 {
-	if (!obs) return false;
-
-	if (idx >= obs->input_types.num)
-		return false;
-	*id = obs->input_types.array[idx].id;
-	return true;
+	ENUM_TYPE_ID(obs->input_types, idx, id);
 }
 
 bool obs_enum_filter_types(size_t idx, const char **id)
 {
-	if (!obs) return false;
-
-	if (idx >= obs->filter_types.num)
-		return false;
-	*id = obs->filter_types.array[idx].id;
-	return true;
+	ENUM_TYPE_ID(obs->filter_types, idx, id);
 }
 
 bool obs_enum_transition_types(size_t idx, const char **id)
 {
-	if (!obs) return false;
-
-	if (idx >= obs->transition_types.num)
-		return false;
-	*id = obs->transition_types.array[idx].id;
-	return true;
+	ENUM_TYPE_ID(obs->transition_types, idx, id);
 }
 
 bool obs_enum_output_types(size_t idx, const char **id)
 {
-	if (!obs) return false;
-
-	if (idx >= obs->output_types.num)
-		return false;
-	*id = obs->output_types.array[idx].id;
-	return true;
+	ENUM_TYPE_ID(obs->output_types, idx, id);
 }
 
 bool obs_enum_encoder_types(size_t idx, const char **id)
 {
-	if (!obs) return false;
-
-	if (idx >= obs->encoder_types.num)
-		return false;
-	*id = obs->encoder_types.array[idx].id;
-	return true;
+	ENUM_TYPE_ID(obs->encoder_types, idx, id);
 }
 
 bool obs_enum_service_types(size_t idx, const char **id)
 {
-	if (!obs) return false;
+	ENUM_TYPE_ID(obs->service_types, idx, id);
+}
 
-	if (idx >= obs->service_types.num)
-		return false;
-	*id = obs->service_types.array[idx].id;
-	return true;
+#undef ENUM_TYPE_ID
+
+/* modules that use the graphics context while loading are never deferred by
+ * obs_load_all_modules_lazy, this is how it finds them */
+#ifdef _MSC_VER
+static __declspec(thread) bool thread_entered_graphics = false;
+#else
+static __thread bool thread_entered_graphics = false;
+#endif
+
+bool obs_thread_entered_graphics(void)
+{
+	bool entered = thread_entered_graphics;
+	thread_entered_graphics = false;
+	return entered;
 }
 
 void obs_enter_graphics(void)
 {
+	thread_entered_graphics = true;
+
 	if (obs && obs->video.graphics)
 		gs_enter_context(obs->video.graphics);
 }
@@ -1223,6 +1364,8 @@ void obs_set_output_source(uint32_t channel, obs_source_t *source)
 
 	pthread_mutex_unlock(&view->channels_mutex);
 
+	obs_set_canvas_dirty();
+
 	if (source)
 		obs_source_activate(source, MAIN_VIEW);
 
@@ -1974,3 +2117,8 @@ uint32_t obs_get_lagged_frames(void)
 {
 	return obs ? obs->video.lagged_frames : 0;
 }
+
+uint32_t obs_get_reused_frames(void)
+{
+	return obs ? obs->video.reused_frames : 0;
+}
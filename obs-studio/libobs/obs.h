@@ -150,7 +150,8 @@ struct obs_transform_info {
  */
 struct obs_video_info {
 	/**
-	 * Graphics module to use (usually "libobs-opengl" or "libobs-d3d11")
+	 * Graphics module to use (usually "libobs-opengl" or "libobs-d3d11",
+	 * or "libobs-software" to render on the CPU without a GPU)
 	 */
 	const char          *graphics_module;
 
@@ -174,6 +175,23 @@ struct obs_video_info {
 	enum video_range_type range;       /**< YUV range (if YUV) */
 
 	enum obs_scale_type scale_type;    /**< How to scale if scaling */
+
+	/**
+	 * Number of staging surfaces frames are downloaded through (2 to 8,
+	 * 0 for the default of 2).  A copy is mapped once the GPU has
+	 * finished it instead of blocking the graphics thread; each surface
+	 * past 2 gives a late copy another frame before it is dropped.  If
+	 * the graphics module can't tell when a copy is finished, frames are
+	 * delayed by staging_depth - 1 frames instead.
+	 */
+	uint32_t            staging_depth;
+
+	/**
+	 * Runs the video_prepare callbacks of sources on worker threads
+	 * before they are ticked, instead of one after another on the
+	 * graphics thread.
+	 */
+	bool                parallel_tick;
 };
 
 /**
@@ -384,6 +402,33 @@ EXPORT void obs_set_app_path(const char *path);
 /** Automatically loads all modules from module paths (convenience function) */
 EXPORT void obs_load_all_modules(void);
 
+/**
+ * Restricts obs_load_all_modules and obs_load_all_modules_lazy to the modules
+ * added with this function.  If it's never called, all modules are loaded.
+ *
+ * @param  name  Module file name without the extension or "lib" prefix,
+ *               for example "obs-ffmpeg".
+ */
+EXPORT void obs_add_allowed_module(const char *name);
+
+/**
+ * Like obs_load_all_modules, but only loads modules the first time one of
+ * their sources, outputs, encoders or services is looked up, for example by
+ * obs_source_create.
+ *
+ *   The ids each module registers are kept in a JSON cache file.  A module
+ * that isn't in the cache, or whose file changed since it was indexed, is
+ * loaded right away and indexed.  Modules that register none of those types
+ * are always loaded right away.
+ *
+ * @note   Types of modules that haven't been loaded yet are not listed by
+ *         obs_enum_source_types and the other type enumeration functions.
+ *
+ * @param  cache_file  Path to the module cache file.  If NULL, this is the
+ *                     same as obs_load_all_modules.
+ */
+EXPORT void obs_load_all_modules_lazy(const char *cache_file);
+
 struct obs_module_info {
 	const char *bin_path;
 	const char *data_path;
@@ -642,6 +687,12 @@ EXPORT uint64_t obs_get_average_frame_time_ns(void);
 EXPORT uint32_t obs_get_total_frames(void);
 EXPORT uint32_t obs_get_lagged_frames(void);
 
+/**
+ * Returns the number of frames that repeated the previous output frame
+ * because nothing on the canvas changed
+ */
+EXPORT uint32_t obs_get_reused_frames(void);
+
 
 /* ------------------------------------------------------------------------- */
 /* Display context */
@@ -847,6 +898,15 @@ EXPORT bool obs_source_active(const obs_source_t *source);
  */
 EXPORT bool obs_source_showing(const obs_source_t *source);
 
+/**
+ * Reports whether the source's video changed during the current tick.  This
+ * is reset to false before each video_tick, so sources that detect their own
+ * changes should call it from video_tick.  When no showing input changed,
+ * libobs skips rendering and repeats the previous output frame.
+ */
+EXPORT void obs_source_set_video_unchanged(obs_source_t *source,
+		bool unchanged);
+
 /** Unused flag */
 #define OBS_SOURCE_FLAG_UNUSED_1               (1<<0)
 /** Specifies to force audio to mono */
@@ -1524,6 +1584,12 @@ EXPORT void obs_output_output_caption_text1(obs_output_t *output,
 EXPORT float obs_output_get_congestion(obs_output_t *output);
 EXPORT int obs_output_get_connect_time_ms(obs_output_t *output);
 
+/**
+ * Returns the bandwidth the output has estimated for its connection in kbps,
+ * or 0 if the output doesn't measure it or hasn't measured it yet
+ */
+EXPORT int obs_output_get_bandwidth_estimate(obs_output_t *output);
+
 EXPORT bool obs_output_reconnecting(const obs_output_t *output);
 
 /** Pass a string of the last output error, for UI use */
@@ -1655,6 +1721,24 @@ EXPORT uint32_t obs_encoder_get_height(const obs_encoder_t *encoder);
 /** For audio encoders, returns the sample rate of the audio */
 EXPORT uint32_t obs_encoder_get_sample_rate(const obs_encoder_t *encoder);
 
+/**
+ * For video encoders, skips encoding frames that are identical to the previous
+ * frame.  The skipped frames leave gaps in the packet timestamps (variable
+ * frame rate), and at least one frame per second is still encoded.
+ */
+EXPORT void obs_encoder_set_skip_duplicate_frames(obs_encoder_t *encoder,
+		bool skip);
+
+/** For video encoders, returns the frames received since it was started */
+EXPORT uint32_t obs_encoder_get_received_frames(const obs_encoder_t *encoder);
+
+/** For video encoders, returns the duplicate frames that were not encoded */
+EXPORT uint32_t obs_encoder_get_skipped_frames(const obs_encoder_t *encoder);
+
+/** Returns the average time an encode call has taken since it was started */
+EXPORT uint64_t obs_encoder_get_average_encode_time_ns(
+		const obs_encoder_t *encoder);
+
 /**
  * Sets the preferred video format for a video encoder.  If the encoder can use
  * the format specified, it will force a conversion to that format if the
@@ -1732,6 +1816,21 @@ EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst,
 		struct encoder_packet *src);
 EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
 
+/** Returns the number of encoder packet payloads currently in use */
+EXPORT long obs_encoder_packet_num_allocs(void);
+
+/**
+ * Returns the number of encoder packet payloads that have been allocated
+ * from the heap since startup
+ */
+EXPORT long obs_encoder_packet_num_heap_allocs(void);
+
+/**
+ * Returns the number of encoder packet payloads that have been reused from
+ * the packet pool instead of being allocated since startup
+ */
+EXPORT long obs_encoder_packet_num_reused(void);
+
 
 /* ------------------------------------------------------------------------- */
 /* Stream Services */
@@ -0,0 +1,406 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+#include "metrics.h"
+
+#include "base.h"
+#include "bmem.h"
+#include "darray.h"
+#include "dstr.h"
+#include "platform.h"
+#include "threading.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* 64 bit atomics.  32 bit windows has no 64 bit add/exchange intrinsics, so
+ * those are done with compare-exchange there */
+
+#ifdef _MSC_VER
+static inline bool atomic_cas64(volatile int64_t *ptr, int64_t old_val,
+		int64_t new_val)
+{
+	return _InterlockedCompareExchange64(ptr, new_val, old_val) == old_val;
+}
+
+static inline int64_t atomic_load64(const volatile int64_t *ptr)
+{
+	return _InterlockedCompareExchange64((volatile int64_t*)ptr, 0, 0);
+}
+
+static inline void atomic_add64(volatile int64_t *ptr, int64_t val)
+{
+#ifdef _WIN64
+	_InterlockedExchangeAdd64(ptr, val);
+#else
+	int64_t old_val;
+	do {
+		old_val = *ptr;
+	} while (!atomic_cas64(ptr, old_val, old_val + val));
+#endif
+}
+
+static inline void atomic_set64(volatile int64_t *ptr, int64_t val)
+{
+#ifdef _WIN64
+	_InterlockedExchange64(ptr, val);
+#else
+	int64_t old_val;
+	do {
+		old_val = *ptr;
+	} while (!atomic_cas64(ptr, old_val, val));
+#endif
+}
+
+#else
+static inline bool atomic_cas64(volatile int64_t *ptr, int64_t old_val,
+		int64_t new_val)
+{
+	return __atomic_compare_exchange_n(ptr, &old_val, new_val, false,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static inline int64_t atomic_load64(const volatile int64_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_add64(volatile int64_t *ptr, int64_t val)
+{
+	__atomic_fetch_add(ptr, val, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_set64(volatile int64_t *ptr, int64_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELAXED);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+struct metrics_counter {
+	volatile int64_t value;
+};
+
+struct metrics_gauge {
+	volatile int64_t value;
+};
+
+struct metrics_histogram {
+	volatile int64_t count;
+	volatile int64_t sum_ns;
+	volatile int64_t max_ns;
+	volatile int64_t buckets[METRICS_HISTOGRAM_BUCKETS];
+};
+
+struct metric {
+	char              *name;
+	enum metrics_type type;
+
+	union {
+		struct metrics_counter   counter;
+		struct metrics_gauge     gauge;
+		struct metrics_histogram histogram;
+	} data;
+};
+
+static pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(struct metric*) metrics;
+
+static const char *type_names[] = {"counter", "gauge", "histogram"};
+
+static void *get_metric(const char *name, enum metrics_type type)
+{
+	struct metric *metric = NULL;
+
+	if (!name)
+		return NULL;
+
+	pthread_mutex_lock(&metrics_mutex);
+
+	for (size_t i = 0; i < metrics.num; i++) {
+		if (strcmp(metrics.array[i]->name, name) == 0) {
+			metric = metrics.array[i];
+			break;
+		}
+	}
+
+	if (metric && metric->type != type) {
+		blog(LOG_WARNING, "metrics: '%s' is already a %s, not a %s",
+				name, type_names[metric->type],
+				type_names[type]);
+		metric = NULL;
+
+	} else if (!metric) {
+		metric = bzalloc(sizeof(*metric));
+		metric->name = bstrdup(name);
+		metric->type = type;
+		da_push_back(metrics, &metric);
+	}
+
+	pthread_mutex_unlock(&metrics_mutex);
+
+	return metric ? &metric->data : NULL;
+}
+
+metrics_counter_t *metrics_counter_get(const char *name)
+{
+	return get_metric(name, METRICS_COUNTER);
+}
+
+metrics_gauge_t *metrics_gauge_get(const char *name)
+{
+	return get_metric(name, METRICS_GAUGE);
+}
+
+metrics_histogram_t *metrics_histogram_get(const char *name)
+{
+	return get_metric(name, METRICS_HISTOGRAM);
+}
+
+void metrics_free(void)
+{
+	pthread_mutex_lock(&metrics_mutex);
+
+	for (size_t i = 0; i < metrics.num; i++) {
+		bfree(metrics.array[i]->name);
+		bfree(metrics.array[i]);
+	}
+	da_free(metrics);
+
+	pthread_mutex_unlock(&metrics_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void metrics_counter_add(metrics_counter_t *counter, int64_t val)
+{
+	if (counter)
+		atomic_add64(&counter->value, val);
+}
+
+void metrics_gauge_set(metrics_gauge_t *gauge, int64_t val)
+{
+	if (gauge)
+		atomic_set64(&gauge->value, val);
+}
+
+void metrics_gauge_add(metrics_gauge_t *gauge, int64_t val)
+{
+	if (gauge)
+		atomic_add64(&gauge->value, val);
+}
+
+static inline size_t get_bucket(uint64_t time_ns)
+{
+	uint64_t usec = time_ns / 1000;
+	size_t bucket = 0;
+
+	while (usec && bucket < METRICS_HISTOGRAM_BUCKETS - 1) {
+		usec >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+void metrics_histogram_record(metrics_histogram_t *histogram,
+		uint64_t time_ns)
+{
+	int64_t max_ns;
+
+	if (!histogram)
+		return;
+
+	atomic_add64(&histogram->count, 1);
+	atomic_add64(&histogram->sum_ns, (int64_t)time_ns);
+	atomic_add64(&histogram->buckets[get_bucket(time_ns)], 1);
+
+	max_ns = atomic_load64(&histogram->max_ns);
+	while ((int64_t)time_ns > max_ns) {
+		if (atomic_cas64(&histogram->max_ns, max_ns, (int64_t)time_ns))
+			break;
+		max_ns = atomic_load64(&histogram->max_ns);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+int64_t metrics_counter_value(const metrics_counter_t *counter)
+{
+	return counter ? atomic_load64(&counter->value) : 0;
+}
+
+int64_t metrics_gauge_value(const metrics_gauge_t *gauge)
+{
+	return gauge ? atomic_load64(&gauge->value) : 0;
+}
+
+void metrics_histogram_get_data(const metrics_histogram_t *histogram,
+		struct metrics_histogram_data *data)
+{
+	memset(data, 0, sizeof(*data));
+	if (!histogram)
+		return;
+
+	data->count  = (uint64_t)atomic_load64(&histogram->count);
+	data->sum_ns = (uint64_t)atomic_load64(&histogram->sum_ns);
+	data->max_ns = (uint64_t)atomic_load64(&histogram->max_ns);
+
+	for (size_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++)
+		data->buckets[i] =
+			(uint64_t)atomic_load64(&histogram->buckets[i]);
+}
+
+uint64_t metrics_histogram_bucket_limit_ns(size_t bucket)
+{
+	if (bucket >= METRICS_HISTOGRAM_BUCKETS - 1)
+		return UINT64_MAX;
+
+	return (1ULL << bucket) * 1000ULL;
+}
+
+uint64_t metrics_histogram_percentile_ns(
+		const struct metrics_histogram_data *data, double percentile)
+{
+	uint64_t total = 0;
+	uint64_t target;
+
+	if (!data->count)
+		return 0;
+
+	target = (uint64_t)(percentile * (double)data->count + 0.5);
+	if (target < 1)
+		target = 1;
+
+	for (size_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+		total += data->buckets[i];
+		if (total >= target) {
+			uint64_t limit = metrics_histogram_bucket_limit_ns(i);
+			return limit < data->max_ns ? limit : data->max_ns;
+		}
+	}
+
+	return data->max_ns;
+}
+
+void metrics_enum(metrics_enum_func func, void *param)
+{
+	pthread_mutex_lock(&metrics_mutex);
+
+	for (size_t i = 0; i < metrics.num; i++) {
+		struct metric *metric = metrics.array[i];
+		if (!func(param, metric->name, metric->type, &metric->data))
+			break;
+	}
+
+	pthread_mutex_unlock(&metrics_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+/* JSON snapshot */
+
+static void json_cat_name(struct dstr *json, const char *name)
+{
+	dstr_cat_ch(json, '"');
+
+	for (; *name; name++) {
+		if (*name == '"' || *name == '\\')
+			dstr_cat_ch(json, '\\');
+		if ((unsigned char)*name >= 0x20)
+			dstr_cat_ch(json, *name);
+	}
+
+	dstr_cat(json, "\":");
+}
+
+static void json_cat_histogram(struct dstr *json,
+		const metrics_histogram_t *histogram)
+{
+	struct metrics_histogram_data data;
+
+	metrics_histogram_get_data(histogram, &data);
+
+	dstr_catf(json, "{\"count\":%"PRIu64",\"sum_ns\":%"PRIu64
+			",\"max_ns\":%"PRIu64",\"p50_ns\":%"PRIu64
+			",\"p99_ns\":%"PRIu64",\"buckets\":[",
+			data.count, data.sum_ns, data.max_ns,
+			metrics_histogram_percentile_ns(&data, 0.5),
+			metrics_histogram_percentile_ns(&data, 0.99));
+
+	for (size_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+		if (i)
+			dstr_cat_ch(json, ',');
+		dstr_catf(json, "%"PRIu64, data.buckets[i]);
+	}
+
+	dstr_cat(json, "]}");
+}
+
+static void json_cat_type(struct dstr *json, enum metrics_type type)
+{
+	bool first = true;
+
+	json_cat_name(json, type == METRICS_COUNTER ? "counters" :
+			type == METRICS_GAUGE ? "gauges" : "histograms");
+	dstr_cat_ch(json, '{');
+
+	for (size_t i = 0; i < metrics.num; i++) {
+		struct metric *metric = metrics.array[i];
+		if (metric->type != type)
+			continue;
+
+		if (!first)
+			dstr_cat_ch(json, ',');
+		first = false;
+
+		json_cat_name(json, metric->name);
+
+		if (type == METRICS_COUNTER)
+			dstr_catf(json, "%"PRId64, metrics_counter_value(
+						&metric->data.counter));
+		else if (type == METRICS_GAUGE)
+			dstr_catf(json, "%"PRId64, metrics_gauge_value(
+						&metric->data.gauge));
+		else
+			json_cat_histogram(json, &metric->data.histogram);
+	}
+
+	dstr_cat_ch(json, '}');
+}
+
+char *metrics_snapshot_json(void)
+{
+	struct dstr json = {0};
+
+	dstr_reserve(&json, 4096);
+	dstr_catf(&json, "{\"time_ns\":%"PRIu64",", os_gettime_ns());
+
+	pthread_mutex_lock(&metrics_mutex);
+
+	json_cat_type(&json, METRICS_COUNTER);
+	dstr_cat_ch(&json, ',');
+	json_cat_type(&json, METRICS_GAUGE);
+	dstr_cat_ch(&json, ',');
+	json_cat_type(&json, METRICS_HISTOGRAM);
+
+	pthread_mutex_unlock(&metrics_mutex);
+
+	dstr_cat_ch(&json, '}');
+	return json.array;
+}
@@ -0,0 +1,121 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+
+/*
+ * Always-on pipeline metrics: named counters, gauges and fixed-bucket
+ * latency histograms.
+ *
+ *   Looking a metric up by name takes the registry lock, so it's meant to be
+ * done once when the owning object is created.  The returned pointer stays
+ * valid until metrics_free (called by obs_shutdown), and updating it is a
+ * handful of atomic operations without any locking, so it can be done from
+ * any thread.  All update functions accept NULL.
+ *
+ *   Values are cumulative since the metric was created; consumers that want
+ * rates compare two snapshots.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct metrics_counter   metrics_counter_t;
+typedef struct metrics_gauge     metrics_gauge_t;
+typedef struct metrics_histogram metrics_histogram_t;
+
+enum metrics_type {
+	METRICS_COUNTER,
+	METRICS_GAUGE,
+	METRICS_HISTOGRAM
+};
+
+/* bucket 0 holds samples under 1 microsecond, bucket i holds samples under
+ * 2^i microseconds, and the last bucket holds everything above that */
+#define METRICS_HISTOGRAM_BUCKETS 20
+
+struct metrics_histogram_data {
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t max_ns;
+	uint64_t buckets[METRICS_HISTOGRAM_BUCKETS];
+};
+
+/* ------------------------------------------------------------------------- */
+/* Registration */
+
+/* returns the metric with this name, creating it if needed.  returns NULL if
+ * the name is already used by a metric of another type */
+EXPORT metrics_counter_t *metrics_counter_get(const char *name);
+EXPORT metrics_gauge_t *metrics_gauge_get(const char *name);
+EXPORT metrics_histogram_t *metrics_histogram_get(const char *name);
+
+/* frees every metric; nothing may use a metric pointer afterwards */
+EXPORT void metrics_free(void);
+
+/* ------------------------------------------------------------------------- */
+/* Updates */
+
+EXPORT void metrics_counter_add(metrics_counter_t *counter, int64_t val);
+
+static inline void metrics_counter_inc(metrics_counter_t *counter)
+{
+	metrics_counter_add(counter, 1);
+}
+
+EXPORT void metrics_gauge_set(metrics_gauge_t *gauge, int64_t val);
+EXPORT void metrics_gauge_add(metrics_gauge_t *gauge, int64_t val);
+
+EXPORT void metrics_histogram_record(metrics_histogram_t *histogram,
+		uint64_t time_ns);
+
+/* ------------------------------------------------------------------------- */
+/* Queries */
+
+EXPORT int64_t metrics_counter_value(const metrics_counter_t *counter);
+EXPORT int64_t metrics_gauge_value(const metrics_gauge_t *gauge);
+EXPORT void metrics_histogram_get_data(const metrics_histogram_t *histogram,
+		struct metrics_histogram_data *data);
+
+/* upper limit of a bucket in nanoseconds, UINT64_MAX for the last one */
+EXPORT uint64_t metrics_histogram_bucket_limit_ns(size_t bucket);
+
+/* estimates a percentile (0.0 - 1.0) as the upper limit of the bucket that
+ * contains it, capped at the largest recorded sample */
+EXPORT uint64_t metrics_histogram_percentile_ns(
+		const struct metrics_histogram_data *data, double percentile);
+
+/* enumerates metrics in the order they were created.  the registry is locked
+ * while enumerating, so the callback must not create metrics */
+typedef bool (*metrics_enum_func)(void *param, const char *name,
+		enum metrics_type type, const void *metric);
+
+EXPORT void metrics_enum(metrics_enum_func func, void *param);
+
+/* returns a JSON object with the current value of every metric:
+ *
+ *   {"time_ns":..., "counters":{"name":value, ...},
+ *    "gauges":{"name":value, ...},
+ *    "histograms":{"name":{"count":..., "sum_ns":..., "max_ns":...,
+ *                          "p50_ns":..., "p99_ns":..., "buckets":[...]}}}
+ *
+ * the string must be freed with bfree */
+EXPORT char *metrics_snapshot_json(void);
+
+#ifdef __cplusplus
+}
+#endif
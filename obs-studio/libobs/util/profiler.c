@@ -12,8 +12,34 @@
 
 //#define TRACK_OVERHEAD
 
+/* finished root calls are kept per thread and merged in batches, at most
+ * THREAD_BUFFER_CALLS calls or THREAD_BUFFER_NS after the first one */
+#define THREAD_BUFFER_CALLS 32
+#define THREAD_BUFFER_NS    250000000ULL
+
+/* distinct roots a thread keeps sampling counters for */
+#define THREAD_ROOT_SLOTS   8
+
+/* recorded calls that are kept for timelines by default, about 30 seconds
+ * of a graphics thread and an audio thread at the default sampling */
+#define DEFAULT_TRACE_EVENTS 65536
+
+struct profiler_trace_event {
+	const char *name;
+	long thread_id;
+	uint64_t start_time;
+	uint64_t end_time;
+};
+
+struct profiler_thread_name {
+	long thread_id;
+	const char *name;
+};
+
 struct profiler_snapshot {
 	DARRAY(profiler_snapshot_entry_t) roots;
+	DARRAY(struct profiler_trace_event) trace;
+	DARRAY(struct profiler_thread_name) threads;
 };
 
 struct profiler_snapshot_entry {
@@ -46,6 +72,10 @@ struct profile_call {
 	uint64_t expected_time_between_calls;
 	DARRAY(profile_call) children;
 	profile_call *parent;
+
+	/* root calls only: start of the previous call of the same root on the
+	 * same thread, 0 if it wasn't timed */
+	uint64_t prev_start_time;
 };
 
 typedef struct profile_times_table_entry profile_times_table_entry;
@@ -83,7 +113,24 @@ struct profile_root_entry {
 	pthread_mutex_t *mutex;
 	const char *name;
 	profile_entry *entry;
-	profile_call *prev_call;
+};
+
+typedef struct thread_root_slot thread_root_slot;
+struct thread_root_slot {
+	const char *name;
+	uint64_t count;
+	uint64_t last_count;
+	uint64_t last_start;
+};
+
+typedef struct profile_thread_buffer profile_thread_buffer;
+struct profile_thread_buffer {
+	long thread_id;
+	bool named;
+	DARRAY(profile_call*) calls;
+	uint64_t first_end_time;
+	thread_root_slot roots[THREAD_ROOT_SLOTS];
+	size_t next_slot;
 };
 
 static inline uint64_t diff_ns_to_usec(uint64_t prev, uint64_t next)
@@ -228,18 +275,17 @@ static profile_entry *get_child(profile_entry *parent, const char *name)
 	return init_entry(da_push_back_new(parent->children), name);
 }
 
-static void merge_call(profile_entry *entry, profile_call *call,
-		profile_call *prev_call)
+static void merge_call(profile_entry *entry, profile_call *call)
 {
 	const size_t num = call->children.num;
 	for (size_t i = 0; i < num; i++) {
 		profile_call *child = &call->children.array[i];
-		merge_call(get_child(entry, child->name), child, NULL);
+		merge_call(get_child(entry, child->name), child);
 	}
 
-	if (entry->expected_time_between_calls != 0 && prev_call) {
+	if (entry->expected_time_between_calls != 0 && call->prev_start_time) {
 		migrate_old_entries(&entry->times_between_calls, true);
-		uint64_t usec = diff_ns_to_usec(prev_call->start_time,
+		uint64_t usec = diff_ns_to_usec(call->prev_start_time,
 				call->start_time);
 		add_hashmap_entry(&entry->times_between_calls, usec, 1);
 	}
@@ -260,12 +306,30 @@ static bool enabled = false;
 static pthread_mutex_t root_mutex = PTHREAD_MUTEX_INITIALIZER;
 static DARRAY(profile_root_entry) root_entries;
 
+static volatile long sample_interval = 1;
+
+/* ring of the most recent recorded calls, and the threads they came from */
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct profiler_trace_event *trace_events;
+static size_t trace_size = DEFAULT_TRACE_EVENTS;
+static size_t trace_pos;
+static size_t trace_num;
+static DARRAY(struct profiler_thread_name) thread_names;
+
+static pthread_once_t buffer_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t buffer_key;
+static volatile long next_thread_id = 0;
+
 #ifdef _MSC_VER
 static __declspec(thread) profile_call *thread_context = NULL;
 static __declspec(thread) bool thread_enabled = true;
+static __declspec(thread) unsigned thread_skip_depth = 0;
+static __declspec(thread) profile_thread_buffer *thread_buffer = NULL;
 #else
 static __thread profile_call *thread_context = NULL;
 static __thread bool thread_enabled = true;
+static __thread unsigned thread_skip_depth = 0;
+static __thread profile_thread_buffer *thread_buffer = NULL;
 #endif
 
 void profiler_start(void)
@@ -282,6 +346,27 @@ void profiler_stop(void)
 	pthread_mutex_unlock(&root_mutex);
 }
 
+void profiler_set_sample_interval(uint32_t interval)
+{
+	os_atomic_set_long(&sample_interval, interval ? (long)interval : 1);
+}
+
+uint32_t profiler_get_sample_interval(void)
+{
+	return (uint32_t)os_atomic_load_long(&sample_interval);
+}
+
+void profiler_set_trace_size(size_t num_events)
+{
+	pthread_mutex_lock(&trace_mutex);
+	bfree(trace_events);
+	trace_events = NULL;
+	trace_size   = num_events;
+	trace_pos    = 0;
+	trace_num    = 0;
+	pthread_mutex_unlock(&trace_mutex);
+}
+
 void profile_reenable_thread(void)
 {
 	if (thread_enabled)
@@ -339,42 +424,192 @@ void profile_register_root(const char *name,
 	pthread_mutex_unlock(&root_mutex);
 }
 
+/* ------------------------------------------------------------------------- */
+/* per thread buffers.  the hot path only touches thread local data; finished
+ * root calls are merged into the shared tables in batches, and copied to the
+ * trace so that recent calls can be exported as a timeline */
+
 static void free_call_context(profile_call *context);
 
-static void merge_context(profile_call *context)
+static void add_call_to_trace(profile_call *call, long thread_id)
+{
+	struct profiler_trace_event *event = &trace_events[trace_pos];
+
+	event->name       = call->name;
+	event->thread_id  = thread_id;
+	event->start_time = call->start_time;
+	event->end_time   = call->end_time;
+
+	if (++trace_pos == trace_size)
+		trace_pos = 0;
+	if (trace_num < trace_size)
+		trace_num++;
+
+	for (size_t i = 0; i < call->children.num; i++)
+		add_call_to_trace(&call->children.array[i], thread_id);
+}
+
+static void add_to_trace(profile_thread_buffer *buf)
+{
+	pthread_mutex_lock(&trace_mutex);
+
+	if (!buf->named) {
+		struct profiler_thread_name *thread =
+			da_push_back_new(thread_names);
+		thread->thread_id = buf->thread_id;
+		thread->name      = buf->calls.array[0]->name;
+		buf->named = true;
+	}
+
+	if (trace_size && !trace_events)
+		trace_events = bmalloc(sizeof(*trace_events) * trace_size);
+
+	for (size_t i = 0; trace_size && i < buf->calls.num; i++)
+		add_call_to_trace(buf->calls.array[i], buf->thread_id);
+
+	pthread_mutex_unlock(&trace_mutex);
+}
+
+static void flush_thread_buffer(profile_thread_buffer *buf)
 {
-	pthread_mutex_t *mutex = NULL;
-	profile_entry *entry = NULL;
-	profile_call *prev_call = NULL;
+	struct {
+		pthread_mutex_t *mutex;
+		profile_entry *entry;
+	} entries[THREAD_BUFFER_CALLS];
+	size_t num = buf->calls.num;
+
+	if (!num)
+		return;
 
 	if (!lock_root()) {
-		free_call_context(context);
+		for (size_t i = 0; i < num; i++)
+			free_call_context(buf->calls.array[i]);
+		da_resize(buf->calls, 0);
 		return;
 	}
 
-	profile_root_entry *r_entry = get_root_entry(context->name);
+	for (size_t i = 0; i < num; i++) {
+		profile_root_entry *r_entry =
+			get_root_entry(buf->calls.array[i]->name);
+		entries[i].mutex = r_entry->mutex;
+		entries[i].entry = r_entry->entry;
+	}
+
+	pthread_mutex_unlock(&root_mutex);
 
-	mutex     = r_entry->mutex;
-	entry     = r_entry->entry;
-	prev_call = r_entry->prev_call;
+	for (size_t i = 0; i < num; i++) {
+		pthread_mutex_lock(entries[i].mutex);
+		merge_call(entries[i].entry, buf->calls.array[i]);
+		pthread_mutex_unlock(entries[i].mutex);
+	}
 
-	r_entry->prev_call = context;
+	add_to_trace(buf);
 
-	pthread_mutex_lock(mutex);
-	pthread_mutex_unlock(&root_mutex);
+	for (size_t i = 0; i < num; i++)
+		free_call_context(buf->calls.array[i]);
+	da_resize(buf->calls, 0);
+}
+
+static void free_thread_buffer(void *data)
+{
+	profile_thread_buffer *buf = data;
+
+	flush_thread_buffer(buf);
+	da_free(buf->calls);
+	bfree(buf);
+
+	thread_buffer = NULL;
+}
+
+static void init_buffer_key(void)
+{
+	pthread_key_create(&buffer_key, free_thread_buffer);
+}
+
+static profile_thread_buffer *get_thread_buffer(void)
+{
+	if (!thread_buffer) {
+		pthread_once(&buffer_key_once, init_buffer_key);
+
+		thread_buffer = bzalloc(sizeof(profile_thread_buffer));
+		thread_buffer->thread_id = os_atomic_inc_long(&next_thread_id);
+		pthread_setspecific(buffer_key, thread_buffer);
+	}
+
+	return thread_buffer;
+}
+
+static void buffer_call(profile_call *call)
+{
+	profile_thread_buffer *buf = get_thread_buffer();
+
+	if (!buf->calls.num)
+		buf->first_end_time = call->end_time;
+	da_push_back(buf->calls, &call);
+
+	if (buf->calls.num >= THREAD_BUFFER_CALLS ||
+	    call->end_time - buf->first_end_time >= THREAD_BUFFER_NS)
+		flush_thread_buffer(buf);
+}
+
+static thread_root_slot *get_root_slot(const char *name)
+{
+	profile_thread_buffer *buf = get_thread_buffer();
+	thread_root_slot *slot;
+
+	for (size_t i = 0; i < THREAD_ROOT_SLOTS; i++) {
+		if (buf->roots[i].name == name)
+			return &buf->roots[i];
+	}
 
-	merge_call(entry, context, prev_call);
+	slot = &buf->roots[buf->next_slot];
+	buf->next_slot = (buf->next_slot + 1) % THREAD_ROOT_SLOTS;
 
-	pthread_mutex_unlock(mutex);
+	memset(slot, 0, sizeof(*slot));
+	slot->name = name;
+	return slot;
+}
+
+/* only every Nth call of a root is recorded, along with everything it
+ * calls.  the call right before a recorded one is still timestamped, so that
+ * recorded calls get a valid time between calls */
+static bool sample_root(thread_root_slot *slot)
+{
+	long interval = os_atomic_load_long(&sample_interval);
+
+	slot->count++;
+
+	if (interval <= 1 || slot->count % interval == 0)
+		return true;
 
-	free_call_context(prev_call);
+	if ((slot->count + 1) % interval == 0) {
+		slot->last_start = os_gettime_ns();
+		slot->last_count = slot->count;
+	}
+
+	return false;
 }
 
 void profile_start(const char *name)
 {
+	thread_root_slot *slot = NULL;
+
 	if (!thread_enabled)
 		return;
 
+	if (thread_skip_depth) {
+		thread_skip_depth++;
+		return;
+	}
+
+	if (!thread_context) {
+		slot = get_root_slot(name);
+		if (!sample_root(slot)) {
+			thread_skip_depth = 1;
+			return;
+		}
+	}
+
 	profile_call new_call = {
 		.name = name,
 #ifdef TRACK_OVERHEAD
@@ -395,6 +630,13 @@ void profile_start(const char *name)
 
 	thread_context = call;
 	call->start_time = os_gettime_ns();
+
+	if (slot) {
+		if (slot->last_count + 1 == slot->count)
+			call->prev_start_time = slot->last_start;
+		slot->last_start = call->start_time;
+		slot->last_count = slot->count;
+	}
 }
 
 void profile_end(const char *name)
@@ -403,6 +645,11 @@ void profile_end(const char *name)
 	if (!thread_enabled)
 		return;
 
+	if (thread_skip_depth) {
+		thread_skip_depth--;
+		return;
+	}
+
 	profile_call *call = thread_context;
 	if (!call) {
 		blog(LOG_ERROR, "Called profile end with no active profile");
@@ -440,7 +687,29 @@ void profile_end(const char *name)
 	if (call->parent)
 		return;
 
-	merge_context(call);
+	buffer_call(call);
+}
+
+void profile_record(const char *name, uint64_t duration_ns)
+{
+	uint64_t end = os_gettime_ns();
+	profile_call *parent = thread_context;
+
+	if (!thread_enabled || thread_skip_depth || !parent)
+		return;
+
+	profile_call new_call = {
+		.name = name,
+#ifdef TRACK_OVERHEAD
+		.overhead_start = end,
+		.overhead_end = end,
+#endif
+		.parent = parent,
+		.start_time = end > duration_ns ? end - duration_ns : 0,
+		.end_time = end,
+	};
+
+	da_push_back(parent->children, &new_call);
 }
 
 static int profiler_time_entry_compare(const void *first, const void *second)
@@ -821,13 +1090,30 @@ void profiler_free(void)
 		bfree(entry->mutex);
 		entry->mutex = NULL;
 
-		free_call_context(entry->prev_call);
-
 		free_profile_entry(entry->entry);
 		bfree(entry->entry);
 	}
 
 	da_free(old_root_entries);
+
+	pthread_mutex_lock(&trace_mutex);
+	bfree(trace_events);
+	trace_events = NULL;
+	trace_pos    = 0;
+	trace_num    = 0;
+	da_free(thread_names);
+	pthread_mutex_unlock(&trace_mutex);
+
+	/* buffers of other threads are freed when those threads exit */
+	if (thread_buffer) {
+		for (size_t i = 0; i < thread_buffer->calls.num; i++)
+			free_call_context(thread_buffer->calls.array[i]);
+
+		pthread_setspecific(buffer_key, NULL);
+		da_free(thread_buffer->calls);
+		bfree(thread_buffer);
+		thread_buffer = NULL;
+	}
 }
 
 
@@ -929,6 +1215,22 @@ static void sort_snapshot_entry(profiler_snapshot_entry_t *entry)
 		sort_snapshot_entry(&entry->children.array[i]);
 }
 
+static void add_trace_to_snapshot(profiler_snapshot_t *snap)
+{
+	pthread_mutex_lock(&trace_mutex);
+
+	/* oldest first */
+	size_t start = trace_num < trace_size ? 0 : trace_pos;
+
+	da_resize(snap->trace, trace_num);
+	for (size_t i = 0; i < trace_num; i++)
+		snap->trace.array[i] = trace_events[(start + i) % trace_size];
+
+	da_copy(snap->threads, thread_names);
+
+	pthread_mutex_unlock(&trace_mutex);
+}
+
 profiler_snapshot_t *profile_snapshot_create(void)
 {
 	profiler_snapshot_t *snap = bzalloc(sizeof(profiler_snapshot_t));
@@ -946,6 +1248,7 @@ profiler_snapshot_t *profile_snapshot_create(void)
 	for (size_t i = 0; i < snap->roots.num; i++)
 		sort_snapshot_entry(&snap->roots.array[i]);
 
+	add_trace_to_snapshot(snap);
 	return snap;
 }
 
@@ -968,6 +1271,8 @@ void profile_snapshot_free(profiler_snapshot_t *snap)
 		free_snapshot_entry(&snap->roots.array[i]);
 
 	da_free(snap->roots);
+	da_free(snap->trace);
+	da_free(snap->threads);
 	bfree(snap);
 }
 
@@ -1067,6 +1372,89 @@ bool profiler_snapshot_dump_csv_gz(const profiler_snapshot_t *snap,
 	return true;
 }
 
+/* chrome trace event format (chrome://tracing, perfetto): one complete
+ * event per recorded call, timestamps in microseconds */
+
+static void trace_cat_string(struct dstr *buffer, const char *str)
+{
+	dstr_cat_ch(buffer, '"');
+
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			dstr_cat_ch(buffer, '\\');
+		if ((unsigned char)*str >= 0x20)
+			dstr_cat_ch(buffer, *str);
+	}
+
+	dstr_cat_ch(buffer, '"');
+}
+
+static void profiler_snapshot_dump_trace(const profiler_snapshot_t *snap,
+		dump_csv_func func, void *data)
+{
+	struct dstr buffer = {0};
+	uint64_t base_time = ~(uint64_t)0;
+	const char *sep = "";
+
+	for (size_t i = 0; i < snap->trace.num; i++) {
+		if (snap->trace.array[i].start_time < base_time)
+			base_time = snap->trace.array[i].start_time;
+	}
+
+	dstr_init_copy(&buffer, "{\"displayTimeUnit\":\"ms\","
+			"\"traceEvents\":[");
+	func(data, &buffer);
+
+	for (size_t i = 0; i < snap->threads.num; i++) {
+		const struct profiler_thread_name *thread =
+			&snap->threads.array[i];
+
+		dstr_printf(&buffer, "%s\n{\"name\":\"thread_name\","
+				"\"ph\":\"M\",\"pid\":1,\"tid\":%ld,"
+				"\"args\":{\"name\":", sep,
+				thread->thread_id);
+		trace_cat_string(&buffer, thread->name);
+		dstr_cat(&buffer, "}}");
+		func(data, &buffer);
+		sep = ",";
+	}
+
+	for (size_t i = 0; i < snap->trace.num; i++) {
+		const struct profiler_trace_event *event =
+			&snap->trace.array[i];
+
+		dstr_printf(&buffer, "%s\n{\"name\":", sep);
+		trace_cat_string(&buffer, event->name);
+		dstr_catf(&buffer, ",\"ph\":\"X\",\"pid\":1,\"tid\":%ld,"
+				"\"ts\":%.3f,\"dur\":%.3f}",
+				event->thread_id,
+				(double)(event->start_time - base_time) /
+					1000.0,
+				(double)(event->end_time - event->start_time) /
+					1000.0);
+		func(data, &buffer);
+		sep = ",";
+	}
+
+	dstr_copy(&buffer, "\n]}\n");
+	func(data, &buffer);
+
+	dstr_free(&buffer);
+}
+
+bool profiler_snapshot_dump_trace_json(const profiler_snapshot_t *snap,
+		const char *filename)
+{
+	FILE *f = os_fopen(filename, "wb+");
+	if (!f)
+		return false;
+
+	profiler_snapshot_dump_trace(snap, dump_csv_fwrite, f);
+
+	fclose(f);
+	return true;
+}
+
 size_t profiler_snapshot_num_roots(profiler_snapshot_t *snap)
 {
 	return snap ? snap->roots.num : 0;
@@ -20,6 +20,11 @@ EXPORT void profile_register_root(const char *name,
 EXPORT void profile_start(const char *name);
 EXPORT void profile_end(const char *name);
 
+/* records a duration that was measured outside of start/end, such as a
+ * latency spanning several calls, as a call that ends now inside the active
+ * call.  ignored when no call is active */
+EXPORT void profile_record(const char *name, uint64_t duration_ns);
+
 EXPORT void profile_reenable_thread(void);
 
 /* ------------------------------------------------------------------------- */
@@ -33,6 +38,17 @@ EXPORT void profiler_print_time_between_calls(profiler_snapshot_t *snap);
 
 EXPORT void profiler_free(void);
 
+/* records only every Nth call of each root (and everything inside it) on
+ * each thread, 1 records every call.  times and counts in snapshots then
+ * cover one call in N */
+EXPORT void profiler_set_sample_interval(uint32_t interval);
+EXPORT uint32_t profiler_get_sample_interval(void);
+
+/* number of the most recent recorded calls (of roots and their children)
+ * that are kept for profiler_snapshot_dump_trace_json, 0 keeps none.
+ * changing it clears the calls kept so far */
+EXPORT void profiler_set_trace_size(size_t num_events);
+
 /* ------------------------------------------------------------------------- */
 /* Profiler name storage */
 
@@ -74,6 +90,11 @@ EXPORT bool profiler_snapshot_dump_csv(const profiler_snapshot_t *snap,
 EXPORT bool profiler_snapshot_dump_csv_gz(const profiler_snapshot_t *snap,
 		const char *filename);
 
+/* writes the recent calls kept in the snapshot as a timeline in the chrome
+ * trace event format, which chrome://tracing and perfetto can open */
+EXPORT bool profiler_snapshot_dump_trace_json(const profiler_snapshot_t *snap,
+		const char *filename);
+
 EXPORT size_t profiler_snapshot_num_roots(profiler_snapshot_t *snap);
 EXPORT void profiler_snapshot_enumerate_roots(profiler_snapshot_t *snap,
 		profiler_entry_enum_func func, void *context);
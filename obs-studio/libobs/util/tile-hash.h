@@ -0,0 +1,125 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+#include <string.h>
+
+#include "bmem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Tile hashing for 32-bit captured images.  The image is split into square
+ * tiles, each tile is hashed, and the hashes are compared against the ones
+ * from the previous capture to find out which parts of the image changed.
+ */
+
+#define TILE_HASH_SIZE 64
+
+struct tile_hash {
+	uint64_t *hashes;
+	uint32_t width;
+	uint32_t height;
+	uint32_t tiles_x;
+	uint32_t tiles_y;
+};
+
+static inline void tile_hash_free(struct tile_hash *th)
+{
+	bfree(th->hashes);
+	memset(th, 0, sizeof(struct tile_hash));
+}
+
+static inline uint64_t tile_hash_row(uint64_t hash, const uint8_t *data,
+		size_t size)
+{
+	uint64_t val;
+
+	/* FNV-1a on 64-bit words */
+	while (size >= sizeof(uint64_t)) {
+		memcpy(&val, data, sizeof(uint64_t));
+		hash = (hash ^ val) * 0x100000001B3ULL;
+		data += sizeof(uint64_t);
+		size -= sizeof(uint64_t);
+	}
+
+	while (size--)
+		hash = (hash ^ *(data++)) * 0x100000001B3ULL;
+
+	return hash;
+}
+
+/**
+ * Hashes the tiles of a 32-bit image and compares them with the previous
+ * call.  Returns the number of tiles that changed; all tiles are reported as
+ * changed on the first call or when the image size changes.
+ */
+static inline size_t tile_hash_update(struct tile_hash *th,
+		const uint8_t *data, uint32_t linesize,
+		uint32_t width, uint32_t height)
+{
+	size_t changed = 0;
+	bool reset = false;
+
+	if (!data || !width || !height)
+		return 0;
+
+	if (th->width != width || th->height != height || !th->hashes) {
+		th->width   = width;
+		th->height  = height;
+		th->tiles_x = (width  + TILE_HASH_SIZE - 1) / TILE_HASH_SIZE;
+		th->tiles_y = (height + TILE_HASH_SIZE - 1) / TILE_HASH_SIZE;
+		th->hashes  = brealloc(th->hashes,
+				th->tiles_x * th->tiles_y * sizeof(uint64_t));
+		reset = true;
+	}
+
+	for (uint32_t ty = 0; ty < th->tiles_y; ty++) {
+		uint32_t y_start = ty * TILE_HASH_SIZE;
+		uint32_t y_end   = y_start + TILE_HASH_SIZE;
+
+		if (y_end > height)
+			y_end = height;
+
+		for (uint32_t tx = 0; tx < th->tiles_x; tx++) {
+			uint32_t x_start = tx * TILE_HASH_SIZE;
+			uint32_t cx      = TILE_HASH_SIZE;
+			uint64_t *tile   = th->hashes + ty * th->tiles_x + tx;
+			uint64_t hash    = 0xCBF29CE484222325ULL;
+
+			if (x_start + cx > width)
+				cx = width - x_start;
+
+			for (uint32_t y = y_start; y < y_end; y++)
+				hash = tile_hash_row(hash,
+						data + y * linesize + x_start * 4,
+						cx * 4);
+
+			if (reset || *tile != hash) {
+				*tile = hash;
+				changed++;
+			}
+		}
+	}
+
+	return changed;
+}
+
+#ifdef __cplusplus
+}
+#endif
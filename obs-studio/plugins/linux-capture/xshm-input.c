@@ -24,6 +24,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <obs-module.h>
 #include <util/dstr.h>
+#include <util/tile-hash.h>
 #include "xcursor-xcb.h"
 #include "xhelpers.h"
 
@@ -51,6 +52,12 @@ struct xshm_data {
 	bool             show_cursor;
 	bool             use_xinerama;
 	bool             advanced;
+
+	bool             change_detection;
+	struct tile_hash tiles;
+	int16_t          cursor_x;
+	int16_t          cursor_y;
+	uint32_t         cursor_serial;
 };
 
 /**
@@ -170,6 +177,8 @@ static void xshm_capture_stop(struct xshm_data *data)
 		bfree(data->server);
 		data->server = NULL;
 	}
+
+	tile_hash_free(&data->tiles);
 }
 
 /**
@@ -229,6 +238,8 @@ static void xshm_update(void *vptr, obs_data_t *settings)
 	data->show_cursor = obs_data_get_bool(settings, "show_cursor");
 	data->advanced    = obs_data_get_bool(settings, "advanced");
 	data->server      = bstrdup(obs_data_get_string(settings, "server"));
+	data->change_detection =
+		obs_data_get_bool(settings, "change_detection");
 
 	xshm_capture_start(data);
 }
@@ -241,6 +252,7 @@ static void xshm_defaults(obs_data_t *defaults)
 	obs_data_set_default_int(defaults, "screen", 0);
 	obs_data_set_default_bool(defaults, "show_cursor", true);
 	obs_data_set_default_bool(defaults, "advanced", false);
+	obs_data_set_default_bool(defaults, "change_detection", false);
 }
 
 /**
@@ -339,6 +351,8 @@ static obs_properties_t *xshm_properties(void *vptr)
 			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
 	obs_properties_add_bool(props, "show_cursor",
 			obs_module_text("CaptureCursor"));
+	obs_properties_add_bool(props, "change_detection",
+			obs_module_text("ChangeDetection"));
 	obs_property_t *advanced = obs_properties_add_bool(props, "advanced",
 			obs_module_text("AdvancedSettings"));
 	obs_property_t *server = obs_properties_add_text(props, "server",
@@ -383,6 +397,39 @@ static void *xshm_create(obs_data_t *settings, obs_source_t *source)
 	return data;
 }
 
+/**
+ * Check if the cursor moved or changed its image since the last tick
+ */
+static bool xshm_cursor_changed(struct xshm_data *data,
+		xcb_xfixes_get_cursor_image_reply_t *cur_r)
+{
+	bool changed;
+
+	if (!data->show_cursor || !cur_r)
+		return false;
+
+	changed = cur_r->x != data->cursor_x ||
+		cur_r->y != data->cursor_y ||
+		cur_r->cursor_serial != data->cursor_serial;
+
+	data->cursor_x      = cur_r->x;
+	data->cursor_y      = cur_r->y;
+	data->cursor_serial = cur_r->cursor_serial;
+	return changed;
+}
+
+/**
+ * Check if any tile of the captured image changed since the last tick
+ */
+static bool xshm_image_changed(struct xshm_data *data)
+{
+	if (!data->change_detection)
+		return true;
+
+	return tile_hash_update(&data->tiles, (uint8_t *) data->xshm->data,
+			data->width * 4, data->width, data->height) != 0;
+}
+
 /**
  * Prepare the capture data
  */
@@ -412,14 +459,21 @@ static void xshm_video_tick(void *vptr, float seconds)
 	if (!img_r)
 		goto exit;
 
+	bool image_changed  = xshm_image_changed(data);
+	bool cursor_changed = xshm_cursor_changed(data, cur_r);
+
 	obs_enter_graphics();
 
-	gs_texture_set_image(data->texture, (void *) data->xshm->data,
-		data->width * 4, false);
+	if (image_changed)
+		gs_texture_set_image(data->texture, (void *) data->xshm->data,
+			data->width * 4, false);
 	xcb_xcursor_update(data->cursor, cur_r);
 
 	obs_leave_graphics();
 
+	obs_source_set_video_unchanged(data->source,
+			!image_changed && !cursor_changed);
+
 exit:
 	free(img_r);
 	free(cur_r);
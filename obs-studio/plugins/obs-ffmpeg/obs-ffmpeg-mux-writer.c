@@ -0,0 +1,724 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-module.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/metrics.h>
+#include <util/circlebuf.h>
+#include <util/threading.h>
+#include "ffmpeg-mux/ffmpeg-mux.h"
+#include "obs-ffmpeg-mux-writer.h"
+
+#include <libavformat/avformat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define do_log(level, format, ...) \
+	blog(level, "[ffmpeg muxer: '%s'] " format, \
+			obs_output_get_name(writer->output), ##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
+
+#define IO_BUFFER_SIZE (256 * 1024)
+
+struct mux_header {
+	uint8_t *data;
+	int     size;
+};
+
+struct mux_audio_params {
+	char    *name;
+	int     bitrate;
+	int     sample_rate;
+	int     channels;
+};
+
+struct ffmpeg_mux_writer {
+	obs_output_t            *output;
+	struct dstr             path;
+	struct dstr             muxer_settings;
+	uint64_t                create_time_ns;
+
+	/* stream parameters, the same ones that are passed to ffmpeg-mux */
+	bool                    has_video;
+	const char              *vcodec;
+	int                     vbitrate;
+	int                     width;
+	int                     height;
+	int                     fps_num;
+	int                     fps_den;
+	int                     num_tracks;
+	struct mux_audio_params audio[MAX_AUDIO_MIXES];
+
+	struct mux_header       video_header;
+	struct mux_header       audio_headers[MAX_AUDIO_MIXES];
+
+	/* only used by the writer thread once it has started */
+	AVFormatContext         *context;
+	AVStream                *video_stream;
+	AVStream                *audio_streams[MAX_AUDIO_MIXES];
+	FILE                    *file;
+	bool                    initialized;
+	uint64_t                last_flush_ns;
+	uint64_t                last_sync_ns;
+	uint64_t                flush_interval_ns;
+	uint64_t                sync_interval_ns;
+	bool                    flush_on_keyframe;
+	long                    num_written;
+
+	pthread_t               thread;
+	bool                    thread_active;
+	os_sem_t                *packet_sem;
+	os_event_t              *space_event;
+
+	pthread_mutex_t         mutex;
+	struct circlebuf        packets;
+	size_t                  queued_bytes;
+	size_t                  queued_bytes_hwm;
+	size_t                  max_queue_bytes;
+	long                    num_waits;
+
+	metrics_counter_t       *bytes_metric;
+	metrics_gauge_t         *queue_metric;
+
+	volatile bool           stop;
+	volatile bool           failed;
+	volatile long           error_code;
+};
+
+/* ------------------------------------------------------------------------- */
+/* file i/o.  the file is written through our own AVIOContext so that the
+ * writer decides when data is flushed and synced, instead of avio */
+
+static int io_write(void *opaque, uint8_t *buf, int size)
+{
+	struct ffmpeg_mux_writer *writer = opaque;
+
+	if (fwrite(buf, 1, size, writer->file) != (size_t)size)
+		return AVERROR(EIO);
+
+	metrics_counter_add(writer->bytes_metric, size);
+	return size;
+}
+
+static int64_t io_seek(void *opaque, int64_t offset, int whence)
+{
+	struct ffmpeg_mux_writer *writer = opaque;
+	FILE *file = writer->file;
+	int64_t size;
+
+	whence &= ~AVSEEK_FORCE;
+
+	if (whence == AVSEEK_SIZE) {
+		int64_t pos = os_ftelli64(file);
+
+		os_fseeki64(file, 0, SEEK_END);
+		size = os_ftelli64(file);
+		os_fseeki64(file, pos, SEEK_SET);
+		return size;
+	}
+
+	if (os_fseeki64(file, offset, whence) != 0)
+		return AVERROR(EIO);
+
+	return os_ftelli64(file);
+}
+
+static void sync_file(FILE *file)
+{
+	fflush(file);
+#ifdef _WIN32
+	_commit(_fileno(file));
+#else
+	fsync(fileno(file));
+#endif
+}
+
+static bool open_file(struct ffmpeg_mux_writer *writer)
+{
+	uint8_t *io_buf;
+
+	writer->file = os_fopen(writer->path.array, "wb+");
+	if (!writer->file) {
+		warn("Couldn't open '%s'", writer->path.array);
+		return false;
+	}
+
+	/* avio already buffers, so data it flushes goes straight to the OS;
+	 * the mp4 faststart pass reads the file back by name */
+	setvbuf(writer->file, NULL, _IONBF, 0);
+
+	io_buf = av_malloc(IO_BUFFER_SIZE);
+	writer->context->pb = avio_alloc_context(io_buf, IO_BUFFER_SIZE, 1,
+			writer, NULL, io_write, io_seek);
+	if (!writer->context->pb) {
+		av_free(io_buf);
+		return false;
+	}
+
+	return true;
+}
+
+static void close_file(struct ffmpeg_mux_writer *writer)
+{
+	AVIOContext *pb = writer->context ? writer->context->pb : NULL;
+
+	if (pb) {
+		avio_flush(pb);
+		av_freep(&pb->buffer);
+		av_free(pb);
+		writer->context->pb = NULL;
+	}
+
+	if (writer->file) {
+		sync_file(writer->file);
+		fclose(writer->file);
+		writer->file = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* libavformat setup, the same as ffmpeg-mux does it */
+
+static AVStream *new_stream(struct ffmpeg_mux_writer *writer, const char *name,
+		enum AVCodecID *id)
+{
+	const AVCodecDescriptor *desc = avcodec_descriptor_get_by_name(name);
+	AVCodec *codec;
+	AVStream *stream;
+
+	if (!desc) {
+		warn("Couldn't find encoder '%s'", name);
+		return NULL;
+	}
+
+	*id = desc->id;
+
+	codec = avcodec_find_encoder(desc->id);
+	if (!codec) {
+		warn("Couldn't create encoder '%s'", name);
+		return NULL;
+	}
+
+	stream = avformat_new_stream(writer->context, codec);
+	if (!stream) {
+		warn("Couldn't create stream for encoder '%s'", name);
+		return NULL;
+	}
+
+	stream->id = writer->context->nb_streams - 1;
+	return stream;
+}
+
+static inline void set_extradata(AVCodecContext *context,
+		const struct mux_header *header)
+{
+	if (header->size) {
+		context->extradata      = av_memdup(header->data, header->size);
+		context->extradata_size = header->size;
+	}
+}
+
+static void create_video_stream(struct ffmpeg_mux_writer *writer)
+{
+	AVCodecContext *context;
+	AVStream *stream;
+
+	stream = new_stream(writer, writer->vcodec,
+			&writer->context->oformat->video_codec);
+	if (!stream)
+		return;
+
+	context               = stream->codec;
+	context->bit_rate     = writer->vbitrate * 1000;
+	context->width        = writer->width;
+	context->height       = writer->height;
+	context->coded_width  = writer->width;
+	context->coded_height = writer->height;
+	context->time_base    =
+		(AVRational){writer->fps_den, writer->fps_num};
+	set_extradata(context, &writer->video_header);
+
+	stream->time_base = context->time_base;
+
+	if (writer->context->oformat->flags & AVFMT_GLOBALHEADER)
+		context->flags |= CODEC_FLAG_GLOBAL_HEADER;
+
+	writer->video_stream = stream;
+}
+
+static void create_audio_stream(struct ffmpeg_mux_writer *writer, int idx)
+{
+	struct mux_audio_params *audio = &writer->audio[idx];
+	AVCodecContext *context;
+	AVStream *stream;
+
+	stream = new_stream(writer, "aac",
+			&writer->context->oformat->audio_codec);
+	if (!stream)
+		return;
+
+	av_dict_set(&stream->metadata, "title", audio->name, 0);
+
+	stream->time_base = (AVRational){1, audio->sample_rate};
+
+	context                 = stream->codec;
+	context->bit_rate       = audio->bitrate * 1000;
+	context->channels       = audio->channels;
+	context->sample_rate    = audio->sample_rate;
+	context->sample_fmt     = AV_SAMPLE_FMT_S16;
+	context->time_base      = stream->time_base;
+	context->channel_layout =
+			av_get_default_channel_layout(context->channels);
+	set_extradata(context, &writer->audio_headers[idx]);
+
+	if (writer->context->oformat->flags & AVFMT_GLOBALHEADER)
+		context->flags |= CODEC_FLAG_GLOBAL_HEADER;
+
+	writer->audio_streams[idx] = stream;
+}
+
+static int write_file_header(struct ffmpeg_mux_writer *writer)
+{
+	AVDictionary *dict = NULL;
+	int ret;
+
+	if ((ret = av_dict_parse_string(&dict, writer->muxer_settings.array,
+				"=", " ", 0))) {
+		warn("Failed to parse muxer settings: %s\n%s",
+				av_err2str(ret), writer->muxer_settings.array);
+		av_dict_free(&dict);
+		dict = NULL;
+	}
+
+	ret = avformat_write_header(writer->context, &dict);
+	av_dict_free(&dict);
+
+	if (ret < 0) {
+		warn("Error opening '%s': %s", writer->path.array,
+				av_err2str(ret));
+		return ret == AVERROR(EINVAL) ? FFM_UNSUPPORTED : FFM_ERROR;
+	}
+
+	return FFM_SUCCESS;
+}
+
+static int init_context(struct ffmpeg_mux_writer *writer)
+{
+	AVOutputFormat *format;
+	int ret;
+
+	format = av_guess_format(NULL, writer->path.array, NULL);
+	if (!format) {
+		warn("Couldn't find an appropriate muxer for '%s'",
+				writer->path.array);
+		return FFM_ERROR;
+	}
+
+	ret = avformat_alloc_output_context2(&writer->context, format, NULL,
+			NULL);
+	if (ret < 0) {
+		warn("Couldn't initialize output context: %s",
+				av_err2str(ret));
+		return FFM_ERROR;
+	}
+
+	writer->context->oformat->video_codec = AV_CODEC_ID_NONE;
+	writer->context->oformat->audio_codec = AV_CODEC_ID_NONE;
+
+	if (writer->has_video)
+		create_video_stream(writer);
+	for (int i = 0; i < writer->num_tracks; i++)
+		create_audio_stream(writer, i);
+
+	if (!writer->context->nb_streams)
+		return FFM_ERROR;
+
+	if ((format->flags & AVFMT_NOFILE) == 0 && !open_file(writer))
+		return FFM_ERROR;
+
+	strncpy(writer->context->filename, writer->path.array,
+			sizeof(writer->context->filename));
+	writer->context->filename[sizeof(writer->context->filename) - 1] = 0;
+
+	ret = write_file_header(writer);
+	if (ret != FFM_SUCCESS)
+		return ret;
+
+	writer->initialized = true;
+	writer->last_flush_ns = writer->last_sync_ns = os_gettime_ns();
+
+	info("File header written %.3f ms after the output started",
+			(double)(writer->last_flush_ns -
+				writer->create_time_ns) / 1000000.0);
+	return FFM_SUCCESS;
+}
+
+static void free_context(struct ffmpeg_mux_writer *writer)
+{
+	if (writer->initialized)
+		av_write_trailer(writer->context);
+
+	close_file(writer);
+
+	if (writer->context) {
+		avformat_free_context(writer->context);
+		writer->context = NULL;
+	}
+
+	writer->initialized = false;
+}
+
+/* ------------------------------------------------------------------------- */
+/* writer thread */
+
+static inline AVStream *get_stream(struct ffmpeg_mux_writer *writer,
+		struct encoder_packet *packet)
+{
+	if (packet->type == OBS_ENCODER_VIDEO)
+		return writer->video_stream;
+
+	return packet->track_idx < (size_t)writer->num_tracks ?
+		writer->audio_streams[packet->track_idx] : NULL;
+}
+
+static inline int64_t rescale_ts(struct encoder_packet *packet, int64_t val,
+		AVStream *stream)
+{
+	return av_rescale_q_rnd(val, (AVRational){1, packet->timebase_den},
+			stream->time_base,
+			AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
+}
+
+static bool mux_packet(struct ffmpeg_mux_writer *writer,
+		struct encoder_packet *packet)
+{
+	AVStream *stream = get_stream(writer, packet);
+	AVPacket av_packet;
+
+	/* the muxer might not support video/audio, or multiple audio tracks */
+	if (!stream)
+		return true;
+
+	av_init_packet(&av_packet);
+	av_packet.data         = packet->data;
+	av_packet.size         = (int)packet->size;
+	av_packet.stream_index = stream->index;
+	av_packet.pts          = rescale_ts(packet, packet->pts, stream);
+	av_packet.dts          = rescale_ts(packet, packet->dts, stream);
+
+	if (packet->keyframe)
+		av_packet.flags = AV_PKT_FLAG_KEY;
+
+	return av_interleaved_write_frame(writer->context, &av_packet) >= 0;
+}
+
+static void apply_flush_policy(struct ffmpeg_mux_writer *writer,
+		const struct encoder_packet *packet)
+{
+	uint64_t ts = os_gettime_ns();
+	bool keyframe = packet->type == OBS_ENCODER_VIDEO && packet->keyframe;
+
+	if (!writer->file)
+		return;
+
+	/* a fragmenting muxer closes the previous fragment when it receives
+	 * a keyframe */
+	if ((writer->flush_on_keyframe && keyframe) ||
+	    (writer->flush_interval_ns &&
+	     ts - writer->last_flush_ns >= writer->flush_interval_ns)) {
+		avio_flush(writer->context->pb);
+		writer->last_flush_ns = ts;
+	}
+
+	if (writer->sync_interval_ns &&
+	    ts - writer->last_sync_ns >= writer->sync_interval_ns) {
+		avio_flush(writer->context->pb);
+		sync_file(writer->file);
+		writer->last_sync_ns = ts;
+	}
+}
+
+static void set_failed(struct ffmpeg_mux_writer *writer, int code)
+{
+	os_atomic_set_long(&writer->error_code, code);
+	os_atomic_set_bool(&writer->failed, true);
+	os_event_signal(writer->space_event);
+}
+
+static bool pop_packet(struct ffmpeg_mux_writer *writer,
+		struct encoder_packet *packet)
+{
+	bool success = false;
+
+	pthread_mutex_lock(&writer->mutex);
+	if (writer->packets.size) {
+		circlebuf_pop_front(&writer->packets, packet, sizeof(*packet));
+		writer->queued_bytes -= packet->size;
+		metrics_gauge_set(writer->queue_metric,
+				(int64_t)writer->queued_bytes);
+		success = true;
+	}
+	pthread_mutex_unlock(&writer->mutex);
+
+	return success;
+}
+
+static void *writer_thread(void *data)
+{
+	struct ffmpeg_mux_writer *writer = data;
+	struct encoder_packet packet;
+
+	os_set_thread_name("ffmpeg-mux-writer");
+
+	while (os_sem_wait(writer->packet_sem) == 0) {
+		if (!pop_packet(writer, &packet)) {
+			if (os_atomic_load_bool(&writer->stop))
+				break;
+			continue;
+		}
+
+		os_event_signal(writer->space_event);
+
+		/* after a failure the queue is only drained */
+		if (!os_atomic_load_bool(&writer->failed)) {
+			if (!writer->initialized) {
+				int ret = init_context(writer);
+				if (ret != FFM_SUCCESS)
+					set_failed(writer, ret);
+			}
+
+			if (writer->initialized) {
+				if (mux_packet(writer, &packet)) {
+					writer->num_written++;
+					apply_flush_policy(writer, &packet);
+				} else {
+					warn("Error writing packet to '%s'",
+							writer->path.array);
+					set_failed(writer, FFM_ERROR);
+				}
+			}
+		}
+
+		obs_encoder_packet_release(&packet);
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void get_stream_params(struct ffmpeg_mux_writer *writer)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(writer->output);
+	obs_data_t *settings;
+
+	if (vencoder) {
+		const struct video_output_info *voi =
+			video_output_get_info(obs_get_video());
+
+		settings = obs_encoder_get_settings(vencoder);
+		writer->vbitrate = (int)obs_data_get_int(settings, "bitrate");
+		obs_data_release(settings);
+
+		writer->has_video = true;
+		writer->vcodec    = obs_encoder_get_codec(vencoder);
+		writer->width     = (int)obs_output_get_width(writer->output);
+		writer->height    = (int)obs_output_get_height(writer->output);
+		writer->fps_num   = (int)voi->fps_num;
+		writer->fps_den   = (int)voi->fps_den;
+	}
+
+	for (int i = 0; i < MAX_AUDIO_MIXES; i++) {
+		obs_encoder_t *aencoder = obs_output_get_audio_encoder(
+				writer->output, i);
+		struct mux_audio_params *audio = &writer->audio[i];
+
+		if (!aencoder)
+			break;
+
+		settings = obs_encoder_get_settings(aencoder);
+		audio->bitrate = (int)obs_data_get_int(settings, "bitrate");
+		obs_data_release(settings);
+
+		audio->name        = bstrdup(obs_encoder_get_name(aencoder));
+		audio->sample_rate = (int)obs_encoder_get_sample_rate(aencoder);
+		audio->channels    = (int)audio_output_get_channels(
+				obs_get_audio());
+		writer->num_tracks++;
+	}
+}
+
+static void init_metrics(struct ffmpeg_mux_writer *writer)
+{
+	const char *name = obs_output_get_name(writer->output);
+	struct dstr metric_name = {0};
+
+	dstr_printf(&metric_name, "output.%s.bytes_written", name);
+	writer->bytes_metric = metrics_counter_get(metric_name.array);
+
+	dstr_printf(&metric_name, "output.%s.mux_queue_bytes", name);
+	writer->queue_metric = metrics_gauge_get(metric_name.array);
+
+	dstr_free(&metric_name);
+}
+
+struct ffmpeg_mux_writer *ffmpeg_mux_writer_create(
+		obs_output_t *output, const char *path,
+		const char *muxer_settings,
+		const struct ffmpeg_mux_writer_config *config)
+{
+	struct ffmpeg_mux_writer *writer = bzalloc(sizeof(*writer));
+
+	writer->output            = output;
+	writer->create_time_ns    = os_gettime_ns();
+	writer->max_queue_bytes   = config->max_queue_bytes;
+	writer->flush_interval_ns =
+		(uint64_t)config->flush_interval_ms * 1000000ULL;
+	writer->sync_interval_ns  =
+		(uint64_t)config->sync_interval_ms * 1000000ULL;
+	writer->flush_on_keyframe = config->flush_on_keyframe;
+
+	dstr_copy(&writer->path, path);
+	dstr_copy(&writer->muxer_settings, muxer_settings);
+	get_stream_params(writer);
+	init_metrics(writer);
+
+	pthread_mutex_init_value(&writer->mutex);
+	if (pthread_mutex_init(&writer->mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&writer->packet_sem, 0) != 0)
+		goto fail;
+	if (os_event_init(&writer->space_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	av_register_all();
+
+	if (pthread_create(&writer->thread, NULL, writer_thread, writer) != 0)
+		goto fail;
+
+	writer->thread_active = true;
+	return writer;
+
+fail:
+	warn("Failed to create the muxer thread");
+	ffmpeg_mux_writer_destroy(writer);
+	return NULL;
+}
+
+int ffmpeg_mux_writer_destroy(struct ffmpeg_mux_writer *writer)
+{
+	int ret = FFM_SUCCESS;
+
+	if (!writer)
+		return FFM_ERROR;
+
+	if (writer->thread_active) {
+		os_atomic_set_bool(&writer->stop, true);
+		os_sem_post(writer->packet_sem);
+		pthread_join(writer->thread, NULL);
+	}
+
+	if (os_atomic_load_bool(&writer->failed))
+		ret = (int)os_atomic_load_long(&writer->error_code);
+	else if (!writer->initialized)
+		ret = FFM_ERROR;
+
+	free_context(writer);
+
+	if (writer->thread_active)
+		info("Muxed %ld packets, queue peaked at %.1f MB, "
+				"waited for the queue %ld time(s)",
+				writer->num_written,
+				(double)writer->queued_bytes_hwm /
+					(1024.0 * 1024.0),
+				writer->num_waits);
+
+	bfree(writer->video_header.data);
+	for (int i = 0; i < MAX_AUDIO_MIXES; i++) {
+		bfree(writer->audio_headers[i].data);
+		bfree(writer->audio[i].name);
+	}
+
+	circlebuf_free(&writer->packets);
+	os_event_destroy(writer->space_event);
+	os_sem_destroy(writer->packet_sem);
+	pthread_mutex_destroy(&writer->mutex);
+	dstr_free(&writer->muxer_settings);
+	dstr_free(&writer->path);
+	bfree(writer);
+	return ret;
+}
+
+void ffmpeg_mux_writer_set_header(struct ffmpeg_mux_writer *writer,
+		struct encoder_packet *packet)
+{
+	struct mux_header *header;
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		header = &writer->video_header;
+	else if (packet->track_idx < MAX_AUDIO_MIXES)
+		header = &writer->audio_headers[packet->track_idx];
+	else
+		return;
+
+	bfree(header->data);
+	header->data = packet->size ? bmemdup(packet->data, packet->size) :
+		NULL;
+	header->size = (int)packet->size;
+}
+
+bool ffmpeg_mux_writer_write(struct ffmpeg_mux_writer *writer,
+		struct encoder_packet *packet)
+{
+	struct encoder_packet pkt;
+
+	for (;;) {
+		if (os_atomic_load_bool(&writer->failed))
+			return false;
+
+		pthread_mutex_lock(&writer->mutex);
+
+		/* a single packet larger than the whole queue still goes in
+		 * once the queue is empty */
+		if (!writer->queued_bytes || writer->queued_bytes +
+				packet->size <= writer->max_queue_bytes)
+			break;
+
+		writer->num_waits++;
+		pthread_mutex_unlock(&writer->mutex);
+
+		os_event_wait(writer->space_event);
+	}
+
+	obs_encoder_packet_ref(&pkt, packet);
+	circlebuf_push_back(&writer->packets, &pkt, sizeof(pkt));
+
+	writer->queued_bytes += pkt.size;
+	if (writer->queued_bytes > writer->queued_bytes_hwm)
+		writer->queued_bytes_hwm = writer->queued_bytes;
+	metrics_gauge_set(writer->queue_metric, (int64_t)writer->queued_bytes);
+
+	pthread_mutex_unlock(&writer->mutex);
+
+	os_sem_post(writer->packet_sem);
+	return true;
+}
@@ -0,0 +1,56 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs-module.h>
+
+/*
+ * In-process replacement for the ffmpeg-mux helper process.  Packets are
+ * queued by reference and muxed by libavformat on the writer's own thread;
+ * the caller only blocks when more than max_queue_bytes of packet data is
+ * waiting to be written.
+ */
+
+struct ffmpeg_mux_writer;
+
+struct ffmpeg_mux_writer_config {
+	size_t   max_queue_bytes;
+
+	/* how often buffered output is handed to the OS, and how often the
+	 * file is synced to disk (0 = only when closing) */
+	uint32_t flush_interval_ms;
+	uint32_t sync_interval_ms;
+
+	/* hand buffered output to the OS after every video keyframe, so that
+	 * each completed fragment of a fragmented file survives a crash */
+	bool     flush_on_keyframe;
+};
+
+extern struct ffmpeg_mux_writer *ffmpeg_mux_writer_create(
+		obs_output_t *output, const char *path,
+		const char *muxer_settings,
+		const struct ffmpeg_mux_writer_config *config);
+
+/* returns one of the FFM_* codes of the muxing that was done */
+extern int ffmpeg_mux_writer_destroy(struct ffmpeg_mux_writer *writer);
+
+/* the codec headers must all be set before the first packet is written */
+extern void ffmpeg_mux_writer_set_header(struct ffmpeg_mux_writer *writer,
+		struct encoder_packet *packet);
+
+/* returns false if the file could not be written */
+extern bool ffmpeg_mux_writer_write(struct ffmpeg_mux_writer *writer,
+		struct encoder_packet *packet);
@@ -25,6 +25,7 @@
 #include <util/circlebuf.h>
 #include <util/threading.h>
 #include "ffmpeg-mux/ffmpeg-mux.h"
+#include "obs-ffmpeg-mux-writer.h"
 
 #include <libavformat/avformat.h>
 
@@ -38,6 +39,7 @@
 struct ffmpeg_muxer {
 	obs_output_t      *output;
 	os_process_pipe_t *pipe;
+	struct ffmpeg_mux_writer *writer;
 	int64_t           stop_ts;
 	uint64_t          total_bytes;
 	struct dstr       path;
@@ -85,6 +87,8 @@ static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
 	stream->keyframes = 0;
 }
 
+static int stop_muxer(struct ffmpeg_muxer *stream);
+
 static void ffmpeg_mux_destroy(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -94,11 +98,20 @@ static void ffmpeg_mux_destroy(void *data)
 		pthread_join(stream->mux_thread, NULL);
 	da_free(stream->mux_packets);
 
-	os_process_pipe_destroy(stream->pipe);
+	stop_muxer(stream);
 	dstr_free(&stream->path);
 	bfree(stream);
 }
 
+static void ffmpeg_mux_defaults(obs_data_t *s)
+{
+	obs_data_set_default_bool(s, "in_process", true);
+	obs_data_set_default_int(s, "max_queue_mb", 32);
+	obs_data_set_default_int(s, "flush_interval_ms", 1000);
+	obs_data_set_default_int(s, "sync_interval_ms", 0);
+	obs_data_set_default_bool(s, "fragmented", false);
+}
+
 static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
@@ -203,12 +216,29 @@ static void log_muxer_params(struct ffmpeg_muxer *stream, const char *settings)
 	av_dict_free(&dict);
 }
 
+/* fragmented mp4/mov files are written as a series of self-contained
+ * fragments starting at each keyframe, so everything up to the last keyframe
+ * stays playable if recording is interrupted, and nothing has to be rewritten
+ * when it stops.  the movflags set here override any set by the user */
+#define FRAGMENTED_MOVFLAGS "movflags=frag_keyframe+empty_moov+default_base_moof"
+
+static void get_muxer_settings(obs_data_t *settings, struct dstr *mux)
+{
+	dstr_copy(mux, obs_data_get_string(settings, "muxer_settings"));
+
+	if (obs_data_get_bool(settings, "fragmented")) {
+		if (!dstr_is_empty(mux))
+			dstr_cat_ch(mux, ' ');
+		dstr_cat(mux, FRAGMENTED_MOVFLAGS);
+	}
+}
+
 static void add_muxer_params(struct dstr *cmd, struct ffmpeg_muxer *stream)
 {
 	obs_data_t *settings = obs_output_get_settings(stream->output);
 	struct dstr mux = {0};
 
-	dstr_copy(&mux, obs_data_get_string(settings, "muxer_settings"));
+	get_muxer_settings(settings, &mux);
 
 	log_muxer_params(stream, mux.array);
 
@@ -269,11 +299,80 @@ static inline void start_pipe(struct ffmpeg_muxer *stream, const char *path)
 	dstr_free(&cmd);
 }
 
+static inline void start_writer(struct ffmpeg_muxer *stream,
+		obs_data_t *settings, const char *path)
+{
+	struct dstr mux = {0};
+	struct ffmpeg_mux_writer_config config = {
+		.max_queue_bytes   = (size_t)obs_data_get_int(settings,
+				"max_queue_mb") * 1024 * 1024,
+		.flush_interval_ms = (uint32_t)obs_data_get_int(settings,
+				"flush_interval_ms"),
+		.sync_interval_ms  = (uint32_t)obs_data_get_int(settings,
+				"sync_interval_ms"),
+		.flush_on_keyframe = obs_data_get_bool(settings, "fragmented")
+	};
+
+	if (path != stream->path.array)
+		dstr_copy(&stream->path, path);
+
+	get_muxer_settings(settings, &mux);
+	log_muxer_params(stream, mux.array);
+	stream->writer = ffmpeg_mux_writer_create(stream->output,
+			stream->path.array, mux.array, &config);
+	dstr_free(&mux);
+}
+
+/* muxes either in-process on a writer thread, or in the ffmpeg-mux helper
+ * process fed through a pipe */
+static bool start_muxer(struct ffmpeg_muxer *stream, const char *path)
+{
+	obs_data_t *settings = obs_output_get_settings(stream->output);
+	bool in_process = obs_data_get_bool(settings, "in_process");
+	uint64_t start_ns = os_gettime_ns();
+
+	if (in_process)
+		start_writer(stream, settings, path);
+	else
+		start_pipe(stream, path);
+
+	obs_data_release(settings);
+
+	if (in_process && !stream->writer) {
+		warn("Failed to create muxer thread");
+		return false;
+	} else if (!in_process && !stream->pipe) {
+		warn("Failed to create process pipe");
+		return false;
+	}
+
+	info("Started %s muxer in %.3f ms",
+			in_process ? "in-process" : FFMPEG_MUX,
+			(double)(os_gettime_ns() - start_ns) / 1000000.0);
+	return true;
+}
+
+static int stop_muxer(struct ffmpeg_muxer *stream)
+{
+	int ret;
+
+	if (stream->writer) {
+		ret = ffmpeg_mux_writer_destroy(stream->writer);
+		stream->writer = NULL;
+	} else {
+		ret = os_process_pipe_destroy(stream->pipe);
+		stream->pipe = NULL;
+	}
+
+	return ret;
+}
+
 static bool ffmpeg_mux_start(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
 	obs_data_t *settings;
 	const char *path;
+	bool success;
 
 	if (!obs_output_can_begin_data_capture(stream->output, 0))
 		return false;
@@ -282,13 +381,11 @@ static bool ffmpeg_mux_start(void *data)
 
 	settings = obs_output_get_settings(stream->output);
 	path = obs_data_get_string(settings, "path");
-	start_pipe(stream, path);
+	success = start_muxer(stream, path);
 	obs_data_release(settings);
 
-	if (!stream->pipe) {
-		warn("Failed to create process pipe");
+	if (!success)
 		return false;
-	}
 
 	/* write headers and start capture */
 	os_atomic_set_bool(&stream->active, true);
@@ -305,8 +402,7 @@ static int deactivate(struct ffmpeg_muxer *stream)
 	int ret = -1;
 
 	if (active(stream)) {
-		ret = os_process_pipe_destroy(stream->pipe);
-		stream->pipe = NULL;
+		ret = stop_muxer(stream);
 
 		os_atomic_set_bool(&stream->active, false);
 		os_atomic_set_bool(&stream->sent_headers, false);
@@ -352,6 +448,18 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 	bool is_video = packet->type == OBS_ENCODER_VIDEO;
 	size_t ret;
 
+	if (stream->writer) {
+		if (!ffmpeg_mux_writer_write(stream->writer, packet)) {
+			warn("Failed to write packet to '%s'",
+					stream->path.array);
+			signal_failure(stream);
+			return false;
+		}
+
+		stream->total_bytes += packet->size;
+		return true;
+	}
+
 	struct ffm_packet_info info = {
 		.pts = packet->pts,
 		.dts = packet->dts,
@@ -380,6 +488,19 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 	return true;
 }
 
+/* the in-process muxer takes the codec headers before the first packet,
+ * ffmpeg-mux reads them as the first packets of the pipe */
+static bool write_header(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet)
+{
+	if (stream->writer) {
+		ffmpeg_mux_writer_set_header(stream->writer, packet);
+		return true;
+	}
+
+	return write_packet(stream, packet);
+}
+
 static bool send_audio_headers(struct ffmpeg_muxer *stream,
 		obs_encoder_t *aencoder, size_t idx)
 {
@@ -390,7 +511,7 @@ static bool send_audio_headers(struct ffmpeg_muxer *stream,
 	};
 
 	obs_encoder_get_extra_data(aencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return write_header(stream, &packet);
 }
 
 static bool send_video_headers(struct ffmpeg_muxer *stream)
@@ -403,7 +524,7 @@ static bool send_video_headers(struct ffmpeg_muxer *stream)
 	};
 
 	obs_encoder_get_extra_data(vencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return write_header(stream, &packet);
 }
 
 static bool send_headers(struct ffmpeg_muxer *stream)
@@ -481,6 +602,7 @@ struct obs_output_info ffmpeg_muxer = {
 	.stop           = ffmpeg_mux_stop,
 	.encoded_packet = ffmpeg_mux_data,
 	.get_total_bytes= ffmpeg_mux_total_bytes,
+	.get_defaults   = ffmpeg_mux_defaults,
 	.get_properties = ffmpeg_mux_properties
 };
 
@@ -654,12 +776,8 @@ static void *replay_buffer_mux_thread(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
 
-	start_pipe(stream, stream->path.array);
-
-	if (!stream->pipe) {
-		warn("Failed to create process pipe");
+	if (!start_muxer(stream, stream->path.array))
 		goto error;
-	}
 
 	if (!send_headers(stream)) {
 		warn("Could not write headers for file '%s'",
@@ -676,8 +794,7 @@ static void *replay_buffer_mux_thread(void *data)
 	info("Wrote replay buffer to '%s'", stream->path.array);
 
 error:
-	os_process_pipe_destroy(stream->pipe);
-	stream->pipe = NULL;
+	stop_muxer(stream);
 	da_free(stream->mux_packets);
 	os_atomic_set_bool(&stream->muxing, false);
 	return NULL;
@@ -804,6 +921,7 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 
 static void replay_buffer_defaults(obs_data_t *s)
 {
+	ffmpeg_mux_defaults(s);
 	obs_data_set_default_int(s, "max_time_sec", 15);
 	obs_data_set_default_int(s, "max_size_mb", 500);
 	obs_data_set_default_string(s, "format", "%CCYY-%MM-%DD %hh-%mm-%ss");
@@ -19,7 +19,6 @@
 #include <util/circlebuf.h>
 #include <util/threading.h>
 #include <util/dstr.h>
-#include <util/darray.h>
 #include <util/platform.h>
 
 #include <libavutil/opt.h>
@@ -31,6 +30,13 @@
 #include "closest-pixel-format.h"
 #include "obs-ffmpeg-compat.h"
 
+#define DEFAULT_VIDEO_QUEUE_DEPTH 4
+#define MAX_VIDEO_QUEUE_DEPTH     16
+
+/* must be a power of two */
+#define PACKET_QUEUE_SIZE         8192
+#define MAX_WRITE_BATCH           64
+
 struct ffmpeg_cfg {
 	const char         *url;
 	const char         *format_name;
@@ -52,6 +58,23 @@ struct ffmpeg_cfg {
 	int                scale_height;
 	int                width;
 	int                height;
+	int                video_queue_depth;
+	bool               skip_duplicates;
+	bool               fragmented;
+};
+
+/* single producer/single consumer packet ring, head is only advanced by the
+ * producer and tail only by the write thread */
+struct packet_queue {
+	AVPacket           *packets;
+	volatile long      head;
+	volatile long      tail;
+};
+
+struct video_queue_frame {
+	AVFrame            *frame;
+	AVPicture          picture;
+	uint64_t           queued_ts;
 };
 
 struct ffmpeg_data {
@@ -63,10 +86,15 @@ struct ffmpeg_data {
 	struct SwsContext  *swscale;
 
 	int64_t            total_frames;
+	int64_t            last_encoded_frame;
+	int64_t            last_keyframe;
 	AVPicture          dst_picture;
 	AVFrame            *vframe;
 	int                frame_size;
 
+	struct video_queue_frame vqueue[MAX_VIDEO_QUEUE_DEPTH];
+	int                vqueue_depth;
+
 	uint64_t           start_timestamp;
 
 	int64_t            total_samples;
@@ -99,12 +127,42 @@ struct ffmpeg_output {
 	volatile bool      stopping;
 
 	bool               write_thread_active;
-	pthread_mutex_t    write_mutex;
 	pthread_t          write_thread;
 	os_sem_t           *write_sem;
 	os_event_t         *stop_event;
 
-	DARRAY(AVPacket)   packets;
+	struct packet_queue video_packets;
+	struct packet_queue audio_packets;
+	volatile long      packets_hwm;
+	volatile long      packets_dropped;
+
+	/* once a queue overflows, audio and video are both dropped until the
+	 * next video keyframe, so no written frame refers to a dropped one */
+	volatile bool      drop_until_keyframe;
+
+	/* pipelined video encode, vqueue_head is only touched by the video
+	 * callback and vqueue_tail only by the encode thread */
+	bool               encode_thread_active;
+	pthread_t          encode_thread;
+	os_sem_t           *encode_sem;
+	volatile bool      encode_stop;
+	volatile long      vqueue_count;
+	int                vqueue_head;
+	int                vqueue_tail;
+
+	/* the counters are read by get_encode_stats from any thread.  the
+	 * latency totals are only touched by the encoding thread, which
+	 * publishes the average and maximum (in microseconds) from them */
+	volatile long      vqueue_full;
+	volatile long      skipped_frames;
+	volatile long      encoded_frames;
+	volatile long      encode_latency_avg_us;
+	volatile long      encode_latency_max_us;
+	uint64_t           encode_latency_total;
+	uint64_t           encode_latency_max;
+
+	/* set when writing failed, nothing more is written after that */
+	bool               write_failed;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -207,6 +265,36 @@ static bool open_video_codec(struct ffmpeg_data *data)
 	}
 
 	*((AVPicture*)data->vframe) = data->dst_picture;
+
+	data->vqueue_depth = data->config.video_queue_depth;
+	for (int i = 0; i < data->vqueue_depth; i++) {
+		struct video_queue_frame *qf = &data->vqueue[i];
+
+		qf->frame = av_frame_alloc();
+		if (!qf->frame) {
+			blog(LOG_WARNING, "Failed to allocate queued video "
+			                  "frame");
+			return false;
+		}
+
+		qf->frame->format = context->pix_fmt;
+		qf->frame->width  = context->width;
+		qf->frame->height = context->height;
+		qf->frame->colorspace = data->config.color_space;
+		qf->frame->color_range = data->config.color_range;
+
+		ret = avpicture_alloc(&qf->picture, context->pix_fmt,
+				context->width, context->height);
+		if (ret < 0) {
+			blog(LOG_WARNING, "Failed to allocate queued picture: "
+			                  "%s", av_err2str(ret));
+			av_frame_free(&qf->frame);
+			return false;
+		}
+
+		*((AVPicture*)qf->frame) = qf->picture;
+	}
+
 	return true;
 }
 
@@ -397,6 +485,13 @@ static inline bool open_output_file(struct ffmpeg_data *data)
 		return false;
 	}
 
+	/* write mp4/mov as a series of fragments starting at each keyframe, so
+	 * the file stays playable up to the last keyframe if recording is
+	 * interrupted and nothing has to be rewritten when it stops */
+	if (data->config.fragmented)
+		av_dict_set(&dict, "movflags",
+				"frag_keyframe+empty_moov+default_base_moof", 0);
+
 	if (av_dict_count(dict) > 0) {
 		struct dstr str = {0};
 
@@ -426,6 +521,15 @@ static void close_video(struct ffmpeg_data *data)
 	avcodec_close(data->video->codec);
 	avpicture_free(&data->dst_picture);
 
+	for (int i = 0; i < data->vqueue_depth; i++) {
+		struct video_queue_frame *qf = &data->vqueue[i];
+		if (!qf->frame)
+			continue;
+
+		avpicture_free(&qf->picture);
+		av_frame_free(&qf->frame);
+	}
+
 	// This format for some reason derefs video frame
 	// too many times
 	if (data->vcodec->id == AV_CODEC_ID_A64_MULTI ||
@@ -587,27 +691,120 @@ static void ffmpeg_log_callback(void *param, int level, const char *format,
 	UNUSED_PARAMETER(param);
 }
 
+static void get_encode_stats_proc(void *param, calldata_t *cd)
+{
+	struct ffmpeg_output *output = param;
+
+	calldata_set_int(cd, "queue_full",
+			os_atomic_load_long(&output->vqueue_full));
+	calldata_set_int(cd, "encoded_frames",
+			os_atomic_load_long(&output->encoded_frames));
+	calldata_set_int(cd, "skipped_frames",
+			os_atomic_load_long(&output->skipped_frames));
+	calldata_set_int(cd, "latency_avg_ns", (long long)os_atomic_load_long(
+				&output->encode_latency_avg_us) * 1000);
+	calldata_set_int(cd, "latency_max_ns", (long long)os_atomic_load_long(
+				&output->encode_latency_max_us) * 1000);
+}
+
+static inline long packet_queue_size(struct packet_queue *pq)
+{
+	return (long)((unsigned long)os_atomic_load_long(&pq->head) -
+			(unsigned long)os_atomic_load_long(&pq->tail));
+}
+
+static inline long packets_backlog(struct ffmpeg_output *output)
+{
+	return packet_queue_size(&output->video_packets) +
+		packet_queue_size(&output->audio_packets);
+}
+
+static bool packet_queue_push(struct packet_queue *pq, AVPacket *packet)
+{
+	long head = pq->head;
+
+	if (packet_queue_size(pq) >= PACKET_QUEUE_SIZE)
+		return false;
+
+	pq->packets[head & (PACKET_QUEUE_SIZE - 1)] = *packet;
+	os_atomic_set_long(&pq->head, head + 1);
+	return true;
+}
+
+static inline AVPacket *packet_queue_peek(struct packet_queue *pq)
+{
+	if (!packet_queue_size(pq))
+		return NULL;
+
+	return &pq->packets[pq->tail & (PACKET_QUEUE_SIZE - 1)];
+}
+
+static inline void packet_queue_pop(struct packet_queue *pq)
+{
+	os_atomic_set_long(&pq->tail, pq->tail + 1);
+}
+
+/* only safe once both producers have stopped */
+static void packet_queue_clear(struct packet_queue *pq)
+{
+	AVPacket *packet;
+
+	while ((packet = packet_queue_peek(pq)) != NULL) {
+		av_free_packet(packet);
+		packet_queue_pop(pq);
+	}
+
+	os_atomic_set_long(&pq->head, 0);
+	os_atomic_set_long(&pq->tail, 0);
+}
+
+static void get_write_stats_proc(void *param, calldata_t *cd)
+{
+	struct ffmpeg_output *output = param;
+
+	calldata_set_int(cd, "backlog", packets_backlog(output));
+	calldata_set_int(cd, "backlog_hwm",
+			os_atomic_load_long(&output->packets_hwm));
+	calldata_set_int(cd, "dropped",
+			os_atomic_load_long(&output->packets_dropped));
+}
+
 static void *ffmpeg_output_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct ffmpeg_output *data = bzalloc(sizeof(struct ffmpeg_output));
-	pthread_mutex_init_value(&data->write_mutex);
 	data->output = output;
 
-	if (pthread_mutex_init(&data->write_mutex, NULL) != 0)
-		goto fail;
+	data->video_packets.packets =
+		bzalloc(PACKET_QUEUE_SIZE * sizeof(AVPacket));
+	data->audio_packets.packets =
+		bzalloc(PACKET_QUEUE_SIZE * sizeof(AVPacket));
+
 	if (os_event_init(&data->stop_event, OS_EVENT_TYPE_AUTO) != 0)
 		goto fail;
 	if (os_sem_init(&data->write_sem, 0) != 0)
 		goto fail;
+	if (os_sem_init(&data->encode_sem, 0) != 0)
+		goto fail;
 
 	av_log_set_callback(ffmpeg_log_callback);
 
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+	proc_handler_add(ph, "void get_encode_stats(out int queue_full, "
+			"out int encoded_frames, out int skipped_frames, "
+			"out int latency_avg_ns, out int latency_max_ns)",
+			get_encode_stats_proc, data);
+	proc_handler_add(ph, "void get_write_stats(out int backlog, "
+			"out int backlog_hwm, out int dropped)",
+			get_write_stats_proc, data);
+
 	UNUSED_PARAMETER(settings);
 	return data;
 
 fail:
-	pthread_mutex_destroy(&data->write_mutex);
 	os_event_destroy(data->stop_event);
+	os_sem_destroy(data->write_sem);
+	bfree(data->video_packets.packets);
+	bfree(data->audio_packets.packets);
 	bfree(data);
 	return NULL;
 }
@@ -625,9 +822,11 @@ static void ffmpeg_output_destroy(void *data)
 
 		ffmpeg_output_full_stop(output);
 
-		pthread_mutex_destroy(&output->write_mutex);
 		os_sem_destroy(output->write_sem);
+		os_sem_destroy(output->encode_sem);
 		os_event_destroy(output->stop_event);
+		bfree(output->video_packets.packets);
+		bfree(output->audio_packets.packets);
 		bfree(data);
 	}
 }
@@ -658,76 +857,270 @@ static inline void copy_data(AVPicture *pic, const struct video_data *frame,
 	}
 }
 
-static void receive_video(void *param, struct video_data *frame)
+static inline void drop_packet(struct ffmpeg_output *output,
+		AVPacket *packet)
 {
-	struct ffmpeg_output *output = param;
-	struct ffmpeg_data   *data   = &output->ff_data;
+	if (os_atomic_inc_long(&output->packets_dropped) == 1)
+		blog(LOG_WARNING, "push_packet: write queue is full, "
+		                  "dropping packets until the next keyframe");
+	av_free_packet(packet);
+}
 
-	// codec doesn't support video or none configured
-	if (!data->video)
+static void push_packet(struct ffmpeg_output *output,
+		struct packet_queue *pq, AVPacket *packet)
+{
+	bool has_video = output->ff_data.video != NULL;
+	bool keyframe  = pq == &output->video_packets &&
+		(packet->flags & AV_PKT_FLAG_KEY) != 0;
+	long backlog, hwm;
+
+	if (os_atomic_load_bool(&output->drop_until_keyframe) && !keyframe) {
+		drop_packet(output, packet);
+		return;
+	}
+
+	if (!packet_queue_push(pq, packet)) {
+		/* without video there are no references to break */
+		if (has_video)
+			os_atomic_set_bool(&output->drop_until_keyframe, true);
+		drop_packet(output, packet);
 		return;
+	}
 
+	if (keyframe)
+		os_atomic_set_bool(&output->drop_until_keyframe, false);
+
+	backlog = packets_backlog(output);
+	hwm = os_atomic_load_long(&output->packets_hwm);
+	while (backlog > hwm) {
+		if (os_atomic_compare_swap_long(&output->packets_hwm,
+					hwm, backlog))
+			break;
+		hwm = os_atomic_load_long(&output->packets_hwm);
+	}
+
+	os_sem_post(output->write_sem);
+}
+
+static inline void convert_video_frame(struct ffmpeg_data *data,
+		AVPicture *pic, struct video_data *frame)
+{
 	AVCodecContext *context = data->video->codec;
+
+	if (!!data->swscale)
+		sws_scale(data->swscale, (const uint8_t *const *)frame->data,
+				(const int*)frame->linesize,
+				0, data->config.height, pic->data,
+				pic->linesize);
+	else
+		copy_data(pic, frame, context->height, context->pix_fmt);
+}
+
+static void encode_video(struct ffmpeg_output *output, AVFrame *vframe,
+		uint64_t queued_ts)
+{
+	struct ffmpeg_data *data    = &output->ff_data;
+	AVCodecContext     *context = data->video->codec;
 	AVPacket packet = {0};
-	int ret = 0, got_packet;
+	uint64_t latency;
+	long frames;
+	int ret, got_packet;
 
 	av_init_packet(&packet);
 
+	ret = avcodec_encode_video2(context, &packet, vframe, &got_packet);
+	if (ret < 0) {
+		blog(LOG_WARNING, "encode_video: Error encoding "
+		                  "video: %s", av_err2str(ret));
+		return;
+	}
+
+	latency = os_gettime_ns() - queued_ts;
+	output->encode_latency_total += latency;
+	if (latency > output->encode_latency_max)
+		output->encode_latency_max = latency;
+
+	frames = os_atomic_inc_long(&output->encoded_frames);
+	os_atomic_set_long(&output->encode_latency_avg_us,
+			(long)(output->encode_latency_total /
+				(uint64_t)frames / 1000));
+	os_atomic_set_long(&output->encode_latency_max_us,
+			(long)(output->encode_latency_max / 1000));
+
+	if (got_packet && packet.size) {
+		packet.pts = rescale_ts(packet.pts, context,
+				data->video->time_base);
+		packet.dts = rescale_ts(packet.dts, context,
+				data->video->time_base);
+		packet.duration = (int)av_rescale_q(packet.duration,
+				context->time_base,
+				data->video->time_base);
+
+		push_packet(output, &output->video_packets, &packet);
+	}
+}
+
+static void *encode_thread(void *param)
+{
+	struct ffmpeg_output *output = param;
+	struct ffmpeg_data   *data   = &output->ff_data;
+
+	os_set_thread_name("ffmpeg-output: encode_thread");
+
+	while (os_sem_wait(output->encode_sem) == 0) {
+		/* a wakeup may encode frames posted for later wakeups, those
+		 * (and stale wakeups from a previous session) then find the
+		 * queue empty, which is harmless */
+		while (os_atomic_load_long(&output->vqueue_count)) {
+			struct video_queue_frame *qf =
+				&data->vqueue[output->vqueue_tail];
+			encode_video(output, qf->frame, qf->queued_ts);
+
+			output->vqueue_tail = (output->vqueue_tail + 1) %
+				data->vqueue_depth;
+			os_atomic_dec_long(&output->vqueue_count);
+		}
+
+		/* checked after the queue is drained, so frames that were
+		 * already queued still make it into the recording */
+		if (os_atomic_load_bool(&output->encode_stop))
+			break;
+	}
+
+	return NULL;
+}
+
+static bool start_encode_thread(struct ffmpeg_output *output)
+{
+	output->vqueue_head = 0;
+	output->vqueue_tail = 0;
+	os_atomic_set_long(&output->vqueue_count, 0);
+	os_atomic_set_bool(&output->encode_stop, false);
+
+	if (!output->ff_data.vqueue_depth)
+		return true;
+
+	if (pthread_create(&output->encode_thread, NULL, encode_thread,
+				output) != 0)
+		return false;
+
+	output->encode_thread_active = true;
+	return true;
+}
+
+static void stop_encode_thread(struct ffmpeg_output *output)
+{
+	if (!output->encode_thread_active)
+		return;
+
+	os_atomic_set_bool(&output->encode_stop, true);
+	os_sem_post(output->encode_sem);
+	pthread_join(output->encode_thread, NULL);
+	output->encode_thread_active = false;
+}
+
+/* duplicate frames are dropped entirely (leaving a gap in the pts) as long
+ * as a frame was encoded within the last second */
+static inline bool skip_duplicate_frame(struct ffmpeg_data *data,
+		struct video_data *frame)
+{
+	AVRational tb = data->video->codec->time_base;
+	int64_t frames_per_sec;
+
+	if (!data->config.skip_duplicates || !frame->duplicate)
+		return false;
+	if (!data->total_frames)
+		return false;
+
+	frames_per_sec = tb.num ? (tb.den + tb.num - 1) / tb.num : 1;
+	return data->total_frames - data->last_encoded_frame < frames_per_sec;
+}
+
+/* with skipped frames the encoder's gop is counted in encoded frames, so force
+ * keyframes based on the frame timestamps instead.  packets are being dropped
+ * until the next keyframe after an overflow, so ask for one right away */
+static inline void set_picture_type(struct ffmpeg_output *output,
+		AVFrame *vframe)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+
+	vframe->pict_type = AV_PICTURE_TYPE_NONE;
+
+	if (os_atomic_load_bool(&output->drop_until_keyframe)) {
+		vframe->pict_type = AV_PICTURE_TYPE_I;
+		data->last_keyframe = data->total_frames;
+		return;
+	}
+
+	if (!data->config.skip_duplicates || data->config.gop_size <= 0)
+		return;
+
+	if (!data->total_frames ||
+	    data->total_frames - data->last_keyframe >= data->config.gop_size) {
+		vframe->pict_type = AV_PICTURE_TYPE_I;
+		data->last_keyframe = data->total_frames;
+	}
+}
+
+static void receive_video(void *param, struct video_data *frame)
+{
+	struct ffmpeg_output *output = param;
+	struct ffmpeg_data   *data   = &output->ff_data;
+
+	// codec doesn't support video or none configured
+	if (!data->video)
+		return;
+
 	if (!output->video_start_ts)
 		output->video_start_ts = frame->timestamp;
 	if (!data->start_timestamp)
 		data->start_timestamp = frame->timestamp;
 
-	if (!!data->swscale)
-		sws_scale(data->swscale, (const uint8_t *const *)frame->data,
-				(const int*)frame->linesize,
-				0, data->config.height, data->dst_picture.data,
-				data->dst_picture.linesize);
-	else
-		copy_data(&data->dst_picture, frame, context->height, context->pix_fmt);
-
 	if (data->output->flags & AVFMT_RAWPICTURE) {
+		AVPacket packet = {0};
+		av_init_packet(&packet);
+
+		convert_video_frame(data, &data->dst_picture, frame);
+
 		packet.flags        |= AV_PKT_FLAG_KEY;
 		packet.stream_index  = data->video->index;
 		packet.data          = data->dst_picture.data[0];
 		packet.size          = sizeof(AVPicture);
 
-		pthread_mutex_lock(&output->write_mutex);
-		da_push_back(output->packets, &packet);
-		pthread_mutex_unlock(&output->write_mutex);
-		os_sem_post(output->write_sem);
+		push_packet(output, &output->video_packets, &packet);
 
-	} else {
-		data->vframe->pts = data->total_frames;
-		ret = avcodec_encode_video2(context, &packet, data->vframe,
-				&got_packet);
-		if (ret < 0) {
-			blog(LOG_WARNING, "receive_video: Error encoding "
-			                  "video: %s", av_err2str(ret));
+	} else if (skip_duplicate_frame(data, frame)) {
+		os_atomic_inc_long(&output->skipped_frames);
+
+	} else if (output->encode_thread_active) {
+		struct video_queue_frame *qf;
+
+		/* never block the video thread on the encoder, drop instead */
+		if (os_atomic_load_long(&output->vqueue_count) >=
+				data->vqueue_depth) {
+			os_atomic_inc_long(&output->vqueue_full);
+			data->total_frames++;
 			return;
 		}
 
-		if (!ret && got_packet && packet.size) {
-			packet.pts = rescale_ts(packet.pts, context,
-					data->video->time_base);
-			packet.dts = rescale_ts(packet.dts, context,
-					data->video->time_base);
-			packet.duration = (int)av_rescale_q(packet.duration,
-					context->time_base,
-					data->video->time_base);
-
-			pthread_mutex_lock(&output->write_mutex);
-			da_push_back(output->packets, &packet);
-			pthread_mutex_unlock(&output->write_mutex);
-			os_sem_post(output->write_sem);
-		} else {
-			ret = 0;
-		}
-	}
+		qf = &data->vqueue[output->vqueue_head];
+		convert_video_frame(data, &qf->picture, frame);
+		set_picture_type(output, qf->frame);
+		qf->frame->pts = data->total_frames;
+		qf->queued_ts = os_gettime_ns();
+		data->last_encoded_frame = data->total_frames;
 
-	if (ret != 0) {
-		blog(LOG_WARNING, "receive_video: Error writing video: %s",
-				av_err2str(ret));
+		output->vqueue_head = (output->vqueue_head + 1) %
+			data->vqueue_depth;
+		os_atomic_inc_long(&output->vqueue_count);
+		os_sem_post(output->encode_sem);
+
+	} else {
+		convert_video_frame(data, &data->dst_picture, frame);
+		set_picture_type(output, data->vframe);
+		data->vframe->pts = data->total_frames;
+		data->last_encoded_frame = data->total_frames;
+		encode_video(output, data->vframe, os_gettime_ns());
 	}
 
 	data->total_frames++;
@@ -775,10 +1168,7 @@ static void encode_audio(struct ffmpeg_output *output,
 			data->audio->time_base);
 	packet.stream_index = data->audio->index;
 
-	pthread_mutex_lock(&output->write_mutex);
-	da_push_back(output->packets, &packet);
-	pthread_mutex_unlock(&output->write_mutex);
-	os_sem_post(output->write_sem);
+	push_packet(output, &output->audio_packets, &packet);
 }
 
 static bool prepare_audio(struct ffmpeg_data *data,
@@ -865,44 +1255,64 @@ static uint64_t get_packet_sys_dts(struct ffmpeg_output *output,
 			time_base, (AVRational){1, 1000000000});
 }
 
-static int process_packet(struct ffmpeg_output *output)
+/* returns the queue whose head packet is earliest in system time, so that
+ * stopping at stop_ts cuts audio and video at the same point */
+static struct packet_queue *next_packet_queue(struct ffmpeg_output *output)
 {
-	AVPacket packet;
-	bool new_packet = false;
-	int ret;
+	AVPacket *video = packet_queue_peek(&output->video_packets);
+	AVPacket *audio = packet_queue_peek(&output->audio_packets);
 
-	pthread_mutex_lock(&output->write_mutex);
-	if (output->packets.num) {
-		packet = output->packets.array[0];
-		da_erase(output->packets, 0);
-		new_packet = true;
-	}
-	pthread_mutex_unlock(&output->write_mutex);
+	if (!video)
+		return audio ? &output->audio_packets : NULL;
+	if (!audio)
+		return &output->video_packets;
 
-	if (!new_packet)
-		return 0;
+	return get_packet_sys_dts(output, video) <=
+		get_packet_sys_dts(output, audio) ?
+		&output->video_packets : &output->audio_packets;
+}
 
-	/*blog(LOG_DEBUG, "size = %d, flags = %lX, stream = %d, "
-			"packets queued: %lu",
-			packet.size, packet.flags,
-			packet.stream_index, output->packets.num);*/
+static int process_packets(struct ffmpeg_output *output)
+{
+	struct packet_queue *pq;
+	int count = 0;
+	int ret;
 
-	if (stopping(output)) {
-		uint64_t sys_ts = get_packet_sys_dts(output, &packet);
-		if (sys_ts >= output->stop_ts) {
-			ffmpeg_output_full_stop(output);
-			return 0;
+	while (count++ < MAX_WRITE_BATCH &&
+	       (pq = next_packet_queue(output)) != NULL) {
+		AVPacket packet = *packet_queue_peek(pq);
+		bool keyframe;
+
+		packet_queue_pop(pq);
+
+		if (stopping(output)) {
+			uint64_t sys_ts = get_packet_sys_dts(output, &packet);
+			if (sys_ts >= output->stop_ts) {
+				av_free_packet(&packet);
+				ffmpeg_output_full_stop(output);
+				return 0;
+			}
 		}
-	}
 
-	output->total_bytes += packet.size;
+		output->total_bytes += packet.size;
+		keyframe = (packet.flags & AV_PKT_FLAG_KEY) != 0 &&
+			output->ff_data.video &&
+			output->ff_data.video->index == packet.stream_index;
 
-	ret = av_interleaved_write_frame(output->ff_data.output, &packet);
-	if (ret < 0) {
-		av_free_packet(&packet);
-		blog(LOG_WARNING, "receive_audio: Error writing packet: %s",
-				av_err2str(ret));
-		return ret;
+		ret = av_interleaved_write_frame(output->ff_data.output,
+				&packet);
+		if (ret < 0) {
+			av_free_packet(&packet);
+			blog(LOG_WARNING, "process_packets: Error writing "
+			                  "packet: %s", av_err2str(ret));
+			return ret;
+		}
+
+		/* a keyframe closes the previous fragment, get it to the OS
+		 * rather than leaving it in the avio buffer */
+		if (keyframe && output->ff_data.config.fragmented &&
+		    output->ff_data.output->pb)
+			avio_flush(output->ff_data.output->pb);
 	}
 
 	return 0;
@@ -917,12 +1327,15 @@ static void *write_thread(void *data)
 		if (os_event_try(output->stop_event) == 0)
 			break;
 
-		int ret = process_packet(output);
+		/* a wakeup may drain packets posted for later wakeups, those
+		 * then find the queues empty, which is harmless */
+		int ret = process_packets(output);
 		if (ret != 0) {
 			int code = OBS_OUTPUT_ERROR;
 
 			pthread_detach(output->write_thread);
 			output->write_thread_active = false;
+			output->write_failed = true;
 
 			if (ret == -ENOSPC)
 				code = OBS_OUTPUT_NO_SPACE;
@@ -958,6 +1371,8 @@ static bool try_connect(struct ffmpeg_output *output)
 	settings = obs_output_get_settings(output->output);
 
 	obs_data_set_default_int(settings, "gop_size", 120);
+	obs_data_set_default_int(settings, "video_queue_depth",
+			DEFAULT_VIDEO_QUEUE_DEPTH);
 
 	config.url = obs_data_get_string(settings, "url");
 	config.format_name = get_string_or_null(settings, "format_name");
@@ -979,6 +1394,11 @@ static bool try_connect(struct ffmpeg_output *output)
 	config.scale_height = (int)obs_data_get_int(settings, "scale_height");
 	config.width  = (int)obs_output_get_width(output->output);
 	config.height = (int)obs_output_get_height(output->output);
+	config.video_queue_depth = (int)obs_data_get_int(settings,
+			"video_queue_depth");
+	config.skip_duplicates = obs_data_get_bool(settings,
+			"skip_duplicate_frames");
+	config.fragmented = obs_data_get_bool(settings, "fragmented");
 	config.format = obs_to_ffmpeg_video_format(
 			video_output_get_format(video));
 
@@ -1001,6 +1421,10 @@ static bool try_connect(struct ffmpeg_output *output)
 		config.scale_width = config.width;
 	if (!config.scale_height)
 		config.scale_height = config.height;
+	if (config.video_queue_depth < 0)
+		config.video_queue_depth = 0;
+	else if (config.video_queue_depth > MAX_VIDEO_QUEUE_DEPTH)
+		config.video_queue_depth = MAX_VIDEO_QUEUE_DEPTH;
 
 	success = ffmpeg_data_init(&output->ff_data, &config);
 	obs_data_release(settings);
@@ -1017,6 +1441,25 @@ static bool try_connect(struct ffmpeg_output *output)
 	if (!obs_output_can_begin_data_capture(output->output, 0))
 		return false;
 
+	os_atomic_set_long(&output->vqueue_full, 0);
+	os_atomic_set_long(&output->packets_hwm, 0);
+	os_atomic_set_long(&output->packets_dropped, 0);
+	os_atomic_set_bool(&output->drop_until_keyframe, false);
+	os_atomic_set_long(&output->skipped_frames, 0);
+	os_atomic_set_long(&output->encoded_frames, 0);
+	os_atomic_set_long(&output->encode_latency_avg_us, 0);
+	os_atomic_set_long(&output->encode_latency_max_us, 0);
+	output->encode_latency_total = 0;
+	output->encode_latency_max = 0;
+	output->write_failed = false;
+
+	if (!start_encode_thread(output)) {
+		blog(LOG_WARNING, "ffmpeg_output_start: failed to create encode "
+		                  "thread.");
+		ffmpeg_output_full_stop(output);
+		return false;
+	}
+
 	ret = pthread_create(&output->write_thread, NULL, write_thread, output);
 	if (ret != 0) {
 		blog(LOG_WARNING, "ffmpeg_output_start: failed to create write "
@@ -1085,8 +1528,61 @@ static void ffmpeg_output_stop(void *data, uint64_t ts)
 	}
 }
 
+/* writes what is left in the queues once the encode and write threads have
+ * stopped (the frames drained from the video queue and anything the write
+ * thread hadn't got to), up to stop_ts when stopping at a timestamp */
+static void write_remaining_packets(struct ffmpeg_output *output)
+{
+	struct packet_queue *pq;
+	int ret;
+
+	if (output->write_failed || !output->ff_data.initialized)
+		return;
+
+	while ((pq = next_packet_queue(output)) != NULL) {
+		AVPacket packet = *packet_queue_peek(pq);
+
+		packet_queue_pop(pq);
+
+		if (stopping(output) &&
+		    get_packet_sys_dts(output, &packet) >= output->stop_ts) {
+			av_free_packet(&packet);
+			continue;
+		}
+
+		output->total_bytes += packet.size;
+
+		ret = av_interleaved_write_frame(output->ff_data.output,
+				&packet);
+		if (ret < 0) {
+			av_free_packet(&packet);
+			blog(LOG_WARNING, "write_remaining_packets: Error "
+			                  "writing packet: %s", av_err2str(ret));
+			break;
+		}
+	}
+}
+
 static void ffmpeg_deactivate(struct ffmpeg_output *output)
 {
+	long encoded_frames;
+
+	stop_encode_thread(output);
+
+	encoded_frames = os_atomic_load_long(&output->encoded_frames);
+	if (encoded_frames) {
+		blog(LOG_INFO, "ffmpeg_output: encoded %ld frames, skipped "
+		               "%ld duplicates, queue full %ld times, "
+		               "encode latency avg %.2f ms, max %.2f ms",
+				encoded_frames,
+				os_atomic_load_long(&output->skipped_frames),
+				os_atomic_load_long(&output->vqueue_full),
+				(double)(output->encode_latency_total /
+					(uint64_t)encoded_frames) /
+					1000000.0,
+				(double)output->encode_latency_max / 1000000.0);
+	}
+
 	if (output->write_thread_active) {
 		os_event_signal(output->stop_event);
 		os_sem_post(output->write_sem);
@@ -1094,13 +1590,16 @@ static void ffmpeg_deactivate(struct ffmpeg_output *output)
 		output->write_thread_active = false;
 	}
 
-	pthread_mutex_lock(&output->write_mutex);
+	write_remaining_packets(output);
 
-	for (size_t i = 0; i < output->packets.num; i++)
-		av_free_packet(output->packets.array+i);
-	da_free(output->packets);
+	if (os_atomic_load_long(&output->packets_hwm))
+		blog(LOG_INFO, "ffmpeg_output: write backlog high-water mark "
+		               "%ld packets, %ld dropped",
+				os_atomic_load_long(&output->packets_hwm),
+				os_atomic_load_long(&output->packets_dropped));
 
-	pthread_mutex_unlock(&output->write_mutex);
+	packet_queue_clear(&output->video_packets);
+	packet_queue_clear(&output->audio_packets);
 
 	ffmpeg_data_free(&output->ff_data);
 }
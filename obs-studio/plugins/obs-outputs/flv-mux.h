@@ -32,3 +32,12 @@ extern bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 		bool write_header, size_t audio_idx);
 extern void flv_packet_mux(struct encoder_packet *packet,
 		uint8_t **output, size_t *size, bool is_header);
+
+#define FLV_TAG_HEADER_SIZE 11
+#define FLV_BODY_PREFIX_MAX 5
+
+/* writes the bytes that come before the packet data in the body of its flv
+ * tag, for sending the packet data in place rather than muxing a copy of it.
+ * returns the number of bytes written */
+extern size_t flv_packet_body_prefix(struct encoder_packet *packet,
+		uint8_t prefix[FLV_BODY_PREFIX_MAX], bool is_header);
@@ -1486,6 +1486,55 @@ WriteN(RTMP *r, const char *buffer, int n)
     return n == 0;
 }
 
+/* sends a list of buffers with a single call where possible.  the buffers
+ * are advanced past whatever was sent by partial writes */
+static int
+WriteNV(RTMP *r, RTMPBuf *bufs, int count)
+{
+    while (count > 0)
+    {
+        int nBytes;
+
+        if (r->m_bCustomSend && r->m_customSendVFunc)
+            nBytes = r->m_customSendVFunc(&r->m_sb, bufs, count, r->m_customSendParam);
+        else
+            nBytes = RTMPSockBuf_SendV(&r->m_sb, bufs, count);
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d (%d buffers)", __FUNCTION__,
+                     sockerr, count);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            r->last_error_code = sockerr;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        while (count > 0 && nBytes >= bufs->size)
+        {
+            nBytes -= bufs->size;
+            bufs++;
+            count--;
+        }
+
+        if (count > 0)
+        {
+            bufs->data += nBytes;
+            bufs->size -= nBytes;
+        }
+    }
+
+    return TRUE;
+}
+
 #define SAVC(x)	static const AVal av_##x = AVC(#x)
 
 SAVC(app);
@@ -3962,18 +4011,18 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
-int
-RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+/* picks the header type of an outgoing packet from the previous packet on
+ * its channel and encodes its header into hbuf.  returns the header size, or
+ * -1 on failure */
+static int
+EncodePacketHeader(RTMP *r, RTMPPacket *packet, char *hbuf, int *pcSize)
 {
     const RTMPPacket *prevPacket;
     uint32_t last = 0;
     int nSize;
     int hSize, cSize;
-    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *hptr, *hend = hbuf + RTMP_MAX_HEADER_SIZE, c;
     uint32_t t;
-    char *buffer, *tbuf = NULL, *toff = NULL;
-    int nChunkSize;
-    int tlen;
 
     if (packet->m_nChannel >= r->m_channelsAllocatedOut)
     {
@@ -3984,7 +4033,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
             free(r->m_vecChannelsOut);
             r->m_vecChannelsOut = NULL;
             r->m_channelsAllocatedOut = 0;
-            return FALSE;
+            return -1;
         }
         r->m_vecChannelsOut = packets;
         memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (n - r->m_channelsAllocatedOut));
@@ -4010,7 +4059,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     {
         RTMP_Log(RTMP_LOGERROR, "sanity failed!! trying to send header of type: 0x%02x.",
                  (unsigned char)packet->m_headerType);
-        return FALSE;
+        return -1;
     }
 
     nSize = packetSize[packet->m_headerType];
@@ -4018,34 +4067,16 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     cSize = 0;
     t = packet->m_nTimeStamp - last;
 
-    if (packet->m_body)
-    {
-        header = packet->m_body - nSize;
-        hend = packet->m_body;
-    }
-    else
-    {
-        header = hbuf + 6;
-        hend = hbuf + sizeof(hbuf);
-    }
-
     if (packet->m_nChannel > 319)
         cSize = 2;
     else if (packet->m_nChannel > 63)
         cSize = 1;
-    if (cSize)
-    {
-        header -= cSize;
-        hSize += cSize;
-    }
+    hSize += cSize;
 
     if (nSize > 1 && t >= 0xffffff)
-    {
-        header -= 4;
         hSize += 4;
-    }
 
-    hptr = header;
+    hptr = hbuf;
     c = packet->m_headerType << 6;
     switch (cSize)
     {
@@ -4084,6 +4115,50 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     if (nSize > 1 && t >= 0xffffff)
         hptr = AMF_EncodeInt32(hptr, hend, t);
 
+    *pcSize = cSize;
+    return hSize;
+}
+
+/* remembers the last packet sent on its channel, for compressing the headers
+ * of the next one */
+static int
+SaveChannelOut(RTMP *r, const RTMPPacket *packet)
+{
+    if (!r->m_vecChannelsOut[packet->m_nChannel])
+        r->m_vecChannelsOut[packet->m_nChannel] = malloc(sizeof(RTMPPacket));
+    if (!r->m_vecChannelsOut[packet->m_nChannel])
+        return FALSE;
+    memcpy(r->m_vecChannelsOut[packet->m_nChannel], packet, sizeof(RTMPPacket));
+    return TRUE;
+}
+
+int
+RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    int nSize;
+    int hSize, cSize;
+    char *header, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *buffer, *tbuf = NULL, *toff = NULL;
+    int nChunkSize;
+    int tlen;
+
+    hSize = EncodePacketHeader(r, packet, hbuf, &cSize);
+    if (hSize < 0)
+        return FALSE;
+    c = hbuf[0];
+
+    /* the header goes right in front of the body so that the first chunk
+     * is sent with a single write */
+    if (packet->m_body)
+    {
+        header = packet->m_body - hSize;
+        memcpy(header, hbuf, hSize);
+    }
+    else
+    {
+        header = hbuf;
+    }
+
     nSize = packet->m_nBodySize;
     buffer = packet->m_body;
     nChunkSize = r->m_outChunkSize;
@@ -4173,10 +4248,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
         }
     }
 
-    if (!r->m_vecChannelsOut[packet->m_nChannel])
-        r->m_vecChannelsOut[packet->m_nChannel] = malloc(sizeof(RTMPPacket));
-    memcpy(r->m_vecChannelsOut[packet->m_nChannel], packet, sizeof(RTMPPacket));
-    return TRUE;
+    return SaveChannelOut(r, packet);
 }
 
 int
@@ -4414,6 +4486,46 @@ RTMPSockBuf_Send(RTMPSockBuf *sb, const char *buf, int len)
     return rc;
 }
 
+int
+RTMPSockBuf_SendV(RTMPSockBuf *sb, const RTMPBuf *bufs, int count)
+{
+#ifdef _WIN32
+    WSABUF wsabufs[RTMP_MAX_SEND_BUFS];
+    DWORD sent = 0;
+#else
+    struct iovec iov[RTMP_MAX_SEND_BUFS];
+#endif
+    int i;
+
+    if (count > RTMP_MAX_SEND_BUFS)
+        count = RTMP_MAX_SEND_BUFS;
+
+#if defined(RTMP_NETSTACK_DUMP)
+    for (i = 0; i < count; i++)
+        fwrite(bufs[i].data, 1, bufs[i].size, netstackdump);
+#endif
+
+#ifdef _WIN32
+    for (i = 0; i < count; i++)
+    {
+        wsabufs[i].buf = (char *)bufs[i].data;
+        wsabufs[i].len = bufs[i].size;
+    }
+
+    if (WSASend(sb->sb_socket, wsabufs, count, &sent, 0, NULL, NULL) != 0)
+        return -1;
+    return (int)sent;
+#else
+    for (i = 0; i < count; i++)
+    {
+        iov[i].iov_base = (void *)bufs[i].data;
+        iov[i].iov_len = bufs[i].size;
+    }
+
+    return (int)writev(sb->sb_socket, iov, count);
+#endif
+}
+
 int
 RTMPSockBuf_Close(RTMPSockBuf *sb)
 {
@@ -5284,3 +5396,127 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
     }
     return size+s2;
 }
+
+/* vectored sends write straight to the socket, so they can't be used when
+ * the data has to be encrypted or wrapped in http requests */
+static int
+CanSendVectored(RTMP *r)
+{
+    if (r->Link.protocol & RTMP_FEATURE_HTTP)
+        return FALSE;
+    if (r->m_bCustomSend)
+        return r->m_customSendVFunc != NULL;
+#ifdef CRYPTO
+    if (r->Link.rc4keyOut || r->m_sb.sb_ssl)
+        return FALSE;
+#endif
+    return TRUE;
+}
+
+static int
+SendPacketCopy(RTMP *r, RTMPPacket *packet, const RTMPBuf *body, int count)
+{
+    char *enc;
+    int ret, i;
+
+    if (!RTMPPacket_Alloc(packet, packet->m_nBodySize))
+    {
+        RTMP_Log(RTMP_LOGDEBUG, "%s, failed to allocate packet", __FUNCTION__);
+        return FALSE;
+    }
+
+    enc = packet->m_body;
+    for (i = 0; i < count; i++)
+    {
+        memcpy(enc, body[i].data, body[i].size);
+        enc += body[i].size;
+    }
+
+    ret = RTMP_SendPacket(r, packet, FALSE);
+    RTMPPacket_Free(packet);
+    return ret;
+}
+
+int
+RTMP_WriteV(RTMP *r, uint8_t packetType, uint32_t timestamp,
+            const RTMPBuf *body, int count, int streamIdx)
+{
+    RTMPPacket packet = {0};
+    RTMPBuf bufs[RTMP_MAX_SEND_BUFS];
+    char hbuf[RTMP_MAX_HEADER_SIZE], cbuf[3];
+    int hSize, cSize, nBufs;
+    int nSize = 0, chunkLeft, offset = 0, i;
+
+    for (i = 0; i < count; i++)
+        nSize += body[i].size;
+
+    packet.m_nChannel = 0x04;	/* source channel */
+    packet.m_nInfoField2 = r->Link.streams[streamIdx].id;
+    packet.m_packetType = packetType;
+    packet.m_nTimeStamp = timestamp;
+    packet.m_nBodySize = nSize;
+    packet.m_headerType = timestamp ?
+            RTMP_PACKET_SIZE_MEDIUM : RTMP_PACKET_SIZE_LARGE;
+
+    if (!CanSendVectored(r))
+        return SendPacketCopy(r, &packet, body, count);
+
+    hSize = EncodePacketHeader(r, &packet, hbuf, &cSize);
+    if (hSize < 0)
+        return FALSE;
+
+    /* every chunk after the first starts with the same small header */
+    memcpy(cbuf, hbuf, cSize + 1);
+    cbuf[0] |= 0xc0;
+
+    bufs[0].data = hbuf;
+    bufs[0].size = hSize;
+    nBufs = 1;
+    chunkLeft = r->m_outChunkSize;
+    i = 0;
+
+    while (i < count)
+    {
+        int size = body[i].size - offset;
+
+        if (size > chunkLeft)
+            size = chunkLeft;
+
+        if (size > 0)
+        {
+            bufs[nBufs].data = body[i].data + offset;
+            bufs[nBufs].size = size;
+            nBufs++;
+
+            offset += size;
+            chunkLeft -= size;
+            nSize -= size;
+        }
+
+        if (offset == body[i].size)
+        {
+            offset = 0;
+            i++;
+        }
+
+        if (!chunkLeft && nSize > 0)
+        {
+            bufs[nBufs].data = cbuf;
+            bufs[nBufs].size = cSize + 1;
+            nBufs++;
+            chunkLeft = r->m_outChunkSize;
+        }
+
+        if (nBufs > RTMP_MAX_SEND_BUFS - 2)
+        {
+            if (!WriteNV(r, bufs, nBufs))
+                return FALSE;
+            nBufs = 0;
+        }
+    }
+
+    if (nBufs && !WriteNV(r, bufs, nBufs))
+        return FALSE;
+
+    return SaveChannelOut(r, &packet);
+}
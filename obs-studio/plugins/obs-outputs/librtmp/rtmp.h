@@ -111,6 +111,9 @@ extern "C"
 
 #define RTMP_MAX_HEADER_SIZE 18
 
+    /* maximum number of buffers passed to a single vectored send */
+#define RTMP_MAX_SEND_BUFS 64
+
 #define RTMP_PACKET_SIZE_LARGE    0
 #define RTMP_PACKET_SIZE_MEDIUM   1
 #define RTMP_PACKET_SIZE_SMALL    2
@@ -267,7 +270,14 @@ extern "C"
         int addrLen;
     } RTMP_BINDINFO;
 
+    typedef struct RTMPBuf
+    {
+        const char *data;
+        int size;
+    } RTMPBuf;
+
     typedef int (*CUSTOMSEND)(RTMPSockBuf*, const char *, int, void*);
+    typedef int (*CUSTOMSENDV)(RTMPSockBuf*, const RTMPBuf *, int, void*);
 
     typedef struct RTMP
     {
@@ -293,6 +303,7 @@ extern "C"
         uint8_t m_bCustomSend;
         void*   m_customSendParam;
         CUSTOMSEND m_customSendFunc;
+        CUSTOMSENDV m_customSendVFunc;
 
         RTMP_BINDINFO m_bindIP;
 
@@ -404,6 +415,7 @@ extern "C"
 
     int RTMPSockBuf_Fill(RTMPSockBuf *sb);
     int RTMPSockBuf_Send(RTMPSockBuf *sb, const char *buf, int len);
+    int RTMPSockBuf_SendV(RTMPSockBuf *sb, const RTMPBuf *bufs, int count);
     int RTMPSockBuf_Close(RTMPSockBuf *sb);
 
     int RTMP_SendCreateStream(RTMP *r);
@@ -414,6 +426,11 @@ extern "C"
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
 
+    /* sends an audio or video message whose body is given in pieces,
+     * without copying them into a packet first */
+    int RTMP_WriteV(RTMP *r, uint8_t packetType, uint32_t timestamp,
+                    const RTMPBuf *body, int count, int streamIdx);
+
     /* hashswf.c */
     int RTMP_HashSWF(const char *url, unsigned int *size, unsigned char *hash,
                      int age);
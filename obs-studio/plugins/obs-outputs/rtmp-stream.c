@@ -323,13 +323,61 @@ retry_send:
 	return len;
 }
 
+/* queues the chunks of a message with a single lock.  a batch that doesn't
+ * fit in the buffer at all is queued one chunk at a time */
+static int socket_queue_datav(RTMPSockBuf *sb, const RTMPBuf *bufs, int count,
+		void *arg)
+{
+	struct rtmp_stream *stream = arg;
+	size_t len = 0;
+
+	for (int i = 0; i < count; i++)
+		len += bufs[i].size;
+
+	if (len > stream->write_buf_size)
+		return socket_queue_data(sb, bufs[0].data, bufs[0].size, arg);
+
+retry_send:
+
+	if (!RTMP_IsConnected(&stream->rtmp))
+		return 0;
+
+	pthread_mutex_lock(&stream->write_buf_mutex);
+
+	if (stream->write_buf_len + len > stream->write_buf_size) {
+
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+
+		if (os_event_wait(stream->buffer_space_available_event)) {
+			return 0;
+		}
+
+		goto retry_send;
+	}
+
+	for (int i = 0; i < count; i++) {
+		memcpy(stream->write_buf + stream->write_buf_len,
+				bufs[i].data, bufs[i].size);
+		stream->write_buf_len += bufs[i].size;
+	}
+
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	os_event_signal (stream->buffer_has_data_event);
+
+	return (int)len;
+}
+
 static int send_packet(struct rtmp_stream *stream,
 		struct encoder_packet *packet, bool is_header, size_t idx)
 {
-	uint8_t *data;
-	size_t  size;
-	int     recv_size = 0;
-	int     ret = 0;
+	uint8_t  prefix[FLV_BODY_PREFIX_MAX];
+	size_t   prefix_size;
+	RTMPBuf  body[2];
+	size_t   size;
+	int      recv_size = 0;
+	int      ret = 0;
+	uint64_t send_start_ns;
 
 	if (!stream->new_socket_loop) {
 #ifdef _WIN32
@@ -345,15 +393,36 @@ static int send_packet(struct rtmp_stream *stream,
 		}
 	}
 
-	flv_packet_mux(packet, &data, &size, is_header);
+	if (!packet->data || !packet->size) {
+		ret = 0;
+		size = 0;
+		goto free_packet;
+	}
+
+	/* the flv tag header and the rtmp chunk headers are built on the
+	 * stack, and the packet data is sent from where the encoder put it */
+	prefix_size = flv_packet_body_prefix(packet, prefix, is_header);
+	body[0].data = (const char*)prefix;
+	body[0].size = (int)prefix_size;
+	body[1].data = (const char*)packet->data;
+	body[1].size = (int)packet->size;
+
+	/* count the size of the flv tag, as with the muxed tags before */
+	size = FLV_TAG_HEADER_SIZE + prefix_size + packet->size + 4;
 
 #ifdef TEST_FRAMEDROPS
 	droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char*)data, (int)size, (int)idx);
-	bfree(data);
+	send_start_ns = os_gettime_ns();
+	ret = RTMP_WriteV(&stream->rtmp,
+			packet->type == OBS_ENCODER_VIDEO ?
+				RTMP_PACKET_TYPE_VIDEO : RTMP_PACKET_TYPE_AUDIO,
+			get_ms_time(packet, packet->dts) & 0x7FFFFFFF,
+			body, 2, (int)idx) ? (int)size : -1;
+	stream->bw_window_send_ns += os_gettime_ns() - send_start_ns;
 
+free_packet:
 	if (is_header)
 		bfree(packet->data);
 	else
@@ -436,6 +505,195 @@ static void set_output_error(struct rtmp_stream *stream)
 	obs_output_set_last_error(stream->output, msg);
 }
 
+/* ------------------------------------------------------------------------- */
+/* bandwidth estimation and adaptive bitrate                                 */
+
+#define BW_WINDOW_NS            1000000000ULL
+#define BW_SATURATED_PERCENT    80
+#define ABR_CLEAR_USEC          100000
+#define ABR_INCREASE_WINDOWS    5
+
+static int64_t get_buffer_duration_usec(struct rtmp_stream *stream)
+{
+	int64_t duration = 0;
+	size_t  count;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+
+	count = stream->packets.size / sizeof(struct encoder_packet);
+	for (size_t i = 0; i < count; i++) {
+		struct encoder_packet *cur = circlebuf_data(&stream->packets,
+				i * sizeof(*cur));
+		if (cur->type == OBS_ENCODER_VIDEO) {
+			duration = stream->last_dts_usec - cur->dts_usec;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&stream->packets_mutex);
+	return duration;
+}
+
+static void update_bandwidth_estimate(struct rtmp_stream *stream,
+		uint64_t window_ns, int64_t buffer_usec)
+{
+	uint64_t bytes = stream->total_bytes_sent -
+		stream->bw_window_start_bytes;
+	long window_kbps = (long)(bytes * 8000000ULL / window_ns);
+	long estimate = os_atomic_load_long(&stream->bw_estimate_kbps);
+	bool saturated;
+
+	/* the connection is saturated if writing to the socket blocked for
+	 * most of the window, or if the send buffer keeps growing */
+	saturated = stream->bw_window_send_ns * 100 >=
+			window_ns * BW_SATURATED_PERCENT ||
+		(buffer_usec > ABR_CLEAR_USEC &&
+		 buffer_usec > stream->bw_last_buffer_usec);
+
+	/* while the connection keeps up, the rate data is sent at is only a
+	 * lower bound of the bandwidth; once it can't, it's the bandwidth */
+	if (saturated)
+		estimate = estimate ? (estimate + window_kbps) / 2 :
+			window_kbps;
+	else if (window_kbps > estimate)
+		estimate = window_kbps;
+
+	os_atomic_set_long(&stream->bw_estimate_kbps, estimate);
+}
+
+static void set_video_bitrate(struct rtmp_stream *stream, int kbps)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t    *settings;
+
+	if (!vencoder || kbps == stream->abr_cur_kbps)
+		return;
+
+	settings = obs_data_create();
+	obs_data_set_int(settings, "bitrate", kbps);
+	obs_encoder_update(vencoder, settings);
+	obs_data_release(settings);
+
+	stream->abr_cur_kbps = kbps;
+}
+
+static void adjust_bitrate(struct rtmp_stream *stream, int64_t buffer_usec)
+{
+	int estimate = (int)os_atomic_load_long(&stream->bw_estimate_kbps);
+	int target   = stream->abr_cur_kbps;
+	bool congested = buffer_usec > stream->drop_threshold_usec / 4 &&
+		buffer_usec > stream->bw_last_buffer_usec;
+
+	if (congested) {
+		/* leave some headroom so that the buffer can drain before
+		 * frames have to be dropped */
+		target = estimate * 85 / 100 - stream->abr_audio_kbps;
+		if (target > stream->abr_cur_kbps * 9 / 10)
+			target = stream->abr_cur_kbps * 9 / 10;
+		stream->abr_clear_windows = 0;
+
+	} else if (buffer_usec < ABR_CLEAR_USEC) {
+		/* probe back up slowly while the connection keeps up */
+		if (++stream->abr_clear_windows >= ABR_INCREASE_WINDOWS) {
+			target += stream->abr_max_kbps / 10;
+			stream->abr_clear_windows = 0;
+		}
+	} else {
+		stream->abr_clear_windows = 0;
+	}
+
+	if (target < stream->abr_min_kbps)
+		target = stream->abr_min_kbps;
+	else if (target > stream->abr_max_kbps)
+		target = stream->abr_max_kbps;
+
+	if (target != stream->abr_cur_kbps) {
+		info("Adaptive bitrate: %d -> %d kbps (estimated bandwidth: "
+		     "%d kbps, buffered: %" PRId64 " ms)",
+		     stream->abr_cur_kbps, target, estimate,
+		     buffer_usec / 1000);
+		set_video_bitrate(stream, target);
+	}
+}
+
+static void check_bandwidth(struct rtmp_stream *stream)
+{
+	uint64_t now       = os_gettime_ns();
+	uint64_t window_ns = now - stream->bw_window_start_ns;
+	int64_t  buffer_usec;
+
+	if (window_ns < BW_WINDOW_NS)
+		return;
+
+	buffer_usec = get_buffer_duration_usec(stream);
+	update_bandwidth_estimate(stream, window_ns, buffer_usec);
+
+	if (stream->abr_enabled)
+		adjust_bitrate(stream, buffer_usec);
+
+	stream->bw_last_buffer_usec   = buffer_usec;
+	stream->bw_window_start_ns    = now;
+	stream->bw_window_start_bytes = stream->total_bytes_sent;
+	stream->bw_window_send_ns     = 0;
+}
+
+static void init_adaptive_bitrate(struct rtmp_stream *stream)
+{
+	obs_output_t  *context  = stream->output;
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(context);
+	obs_encoder_t *aencoder = obs_output_get_audio_encoder(context, 0);
+	obs_data_t    *params;
+	const char    *rate_control;
+
+	stream->bw_window_start_ns    = os_gettime_ns();
+	stream->bw_window_start_bytes = stream->total_bytes_sent;
+	stream->bw_window_send_ns     = 0;
+	stream->bw_last_buffer_usec   = 0;
+	stream->abr_clear_windows     = 0;
+	os_atomic_set_long(&stream->bw_estimate_kbps, 0);
+
+	if (!stream->abr_enabled)
+		return;
+
+	if (!vencoder) {
+		stream->abr_enabled = false;
+		return;
+	}
+
+	params = obs_encoder_get_settings(vencoder);
+	stream->abr_max_kbps = (int)obs_data_get_int(params, "bitrate");
+	rate_control = obs_data_get_string(params, "rate_control");
+
+	/* with constant quality rate control the bitrate isn't used */
+	if (stream->abr_max_kbps <= 0 ||
+	    astrcmpi(rate_control, "CRF") == 0 ||
+	    astrcmpi(rate_control, "CQP") == 0) {
+		warn("Adaptive bitrate disabled, the video encoder does not "
+		     "use a bitrate");
+		stream->abr_enabled = false;
+	}
+
+	obs_data_release(params);
+
+	if (!stream->abr_enabled)
+		return;
+
+	stream->abr_audio_kbps = 0;
+	if (aencoder) {
+		params = obs_encoder_get_settings(aencoder);
+		stream->abr_audio_kbps = (int)obs_data_get_int(params,
+				"bitrate");
+		obs_data_release(params);
+	}
+
+	if (stream->abr_min_kbps > stream->abr_max_kbps)
+		stream->abr_min_kbps = stream->abr_max_kbps;
+	stream->abr_cur_kbps = stream->abr_max_kbps;
+
+	info("Adaptive bitrate enabled: %d - %d kbps",
+	     stream->abr_min_kbps, stream->abr_max_kbps);
+}
+
 static void *send_thread(void *data)
 {
 	struct rtmp_stream *stream = data;
@@ -470,6 +728,8 @@ static void *send_thread(void *data)
 			os_atomic_set_bool(&stream->disconnected, true);
 			break;
 		}
+
+		check_bandwidth(stream);
 	}
 
 	if (disconnected(stream)) {
@@ -486,6 +746,10 @@ static void *send_thread(void *data)
 		stream->rtmp.m_bCustomSend = false;
 	}
 
+	/* the encoder may outlive the stream, so give it back its bitrate */
+	if (stream->abr_enabled)
+		set_video_bitrate(stream, stream->abr_max_kbps);
+
 	set_output_error(stream);
 	RTMP_Close(&stream->rtmp);
 
@@ -618,6 +882,7 @@ static int init_send(struct rtmp_stream *stream)
 #endif
 
 	reset_semaphore(stream);
+	init_adaptive_bitrate(stream);
 
 	ret = pthread_create(&stream->send_thread, NULL, send_thread, stream);
 	if (ret != 0) {
@@ -697,6 +962,7 @@ static int init_send(struct rtmp_stream *stream)
 		stream->socket_thread_active = true;
 		stream->rtmp.m_bCustomSend = true;
 		stream->rtmp.m_customSendFunc = socket_queue_data;
+		stream->rtmp.m_customSendVFunc = socket_queue_datav;
 		stream->rtmp.m_customSendParam = stream;
 	}
 
@@ -890,6 +1156,10 @@ static bool init_connect(struct rtmp_stream *stream)
 			OPT_NEWSOCKETLOOP_ENABLED);
 	stream->low_latency_mode = obs_data_get_bool(settings,
 			OPT_LOWLATENCY_ENABLED);
+	stream->abr_enabled = obs_data_get_bool(settings,
+			OPT_ADAPTIVE_BITRATE_ENABLED);
+	stream->abr_min_kbps = (int)obs_data_get_int(settings,
+			OPT_ADAPTIVE_MIN_BITRATE);
 
 	obs_data_release(settings);
 	return true;
@@ -1107,6 +1377,9 @@ static void rtmp_stream_defaults(obs_data_t *defaults)
 	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
 	obs_data_set_default_bool(defaults, OPT_NEWSOCKETLOOP_ENABLED, false);
 	obs_data_set_default_bool(defaults, OPT_LOWLATENCY_ENABLED, false);
+	obs_data_set_default_bool(defaults, OPT_ADAPTIVE_BITRATE_ENABLED,
+			false);
+	obs_data_set_default_int(defaults, OPT_ADAPTIVE_MIN_BITRATE, 100);
 }
 
 static obs_properties_t *rtmp_stream_properties(void *unused)
@@ -1138,6 +1411,11 @@ static obs_properties_t *rtmp_stream_properties(void *unused)
 			obs_module_text("RTMPStream.NewSocketLoop"));
 	obs_properties_add_bool(props, OPT_LOWLATENCY_ENABLED,
 			obs_module_text("RTMPStream.LowLatencyMode"));
+	obs_properties_add_bool(props, OPT_ADAPTIVE_BITRATE_ENABLED,
+			obs_module_text("RTMPStream.AdaptiveBitrate"));
+	obs_properties_add_int(props, OPT_ADAPTIVE_MIN_BITRATE,
+			obs_module_text("RTMPStream.AdaptiveMinBitrate"),
+			50, 100000, 50);
 
 	return props;
 }
@@ -1171,6 +1449,12 @@ static int rtmp_stream_connect_time(void *data)
 	return stream->rtmp.connect_time_ms;
 }
 
+static int rtmp_stream_bandwidth_estimate(void *data)
+{
+	struct rtmp_stream *stream = data;
+	return (int)os_atomic_load_long(&stream->bw_estimate_kbps);
+}
+
 struct obs_output_info rtmp_output_info = {
 	.id                 = "rtmp_output",
 	.flags              = OBS_OUTPUT_AV |
@@ -1188,5 +1472,6 @@ struct obs_output_info rtmp_output_info = {
 	.get_total_bytes    = rtmp_stream_total_bytes_sent,
 	.get_congestion     = rtmp_stream_congestion,
 	.get_connect_time_ms= rtmp_stream_connect_time,
-	.get_dropped_frames = rtmp_stream_dropped_frames
+	.get_dropped_frames = rtmp_stream_dropped_frames,
+	.get_bandwidth_estimate = rtmp_stream_bandwidth_estimate
 };
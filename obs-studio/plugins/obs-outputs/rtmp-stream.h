@@ -30,6 +30,8 @@
 #define OPT_BIND_IP "bind_ip"
 #define OPT_NEWSOCKETLOOP_ENABLED "new_socket_loop_enabled"
 #define OPT_LOWLATENCY_ENABLED "low_latency_mode_enabled"
+#define OPT_ADAPTIVE_BITRATE_ENABLED "adaptive_bitrate_enabled"
+#define OPT_ADAPTIVE_MIN_BITRATE "adaptive_min_bitrate"
 
 //#define TEST_FRAMEDROPS
 
@@ -81,6 +83,21 @@ struct rtmp_stream {
 	uint64_t         total_bytes_sent;
 	int              dropped_frames;
 
+	/* bandwidth estimation variables */
+	uint64_t         bw_window_start_ns;
+	uint64_t         bw_window_start_bytes;
+	uint64_t         bw_window_send_ns;
+	int64_t          bw_last_buffer_usec;
+	volatile long    bw_estimate_kbps;
+
+	/* adaptive bitrate variables */
+	bool             abr_enabled;
+	int              abr_min_kbps;
+	int              abr_max_kbps;
+	int              abr_cur_kbps;
+	int              abr_audio_kbps;
+	int              abr_clear_windows;
+
 #ifdef TEST_FRAMEDROPS
 	struct circlebuf droptest_info;
 	size_t           droptest_size;
@@ -51,6 +51,12 @@ struct obs_x264 {
 	size_t                 extra_data_size;
 	size_t                 sei_size;
 
+	/* keyframe interval in pts units, only used with the
+	 * "skip_duplicate_frames" setting: duplicate frames that were not
+	 * encoded leave gaps so the interval can't be counted in frames */
+	int64_t                keyint_pts;
+	int64_t                last_keyframe_pts;
+
 	os_performance_token_t *performance_token;
 };
 
@@ -97,6 +103,7 @@ static void obs_x264_defaults(obs_data_t *settings)
 	obs_data_set_default_int   (settings, "keyint_sec",  0);
 	obs_data_set_default_int   (settings, "crf",         23);
 	obs_data_set_default_bool  (settings, "vfr",         false);
+	obs_data_set_default_bool  (settings, "skip_duplicate_frames", false);
 	obs_data_set_default_string(settings, "rate_control","CBR");
 
 	obs_data_set_default_string(settings, "preset",      "veryfast");
@@ -409,6 +416,7 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t *settings,
 	int height       = (int)obs_encoder_get_height(obsx264->encoder);
 	bool use_bufsize = obs_data_get_bool(settings, "use_bufsize");
 	bool vfr         = obs_data_get_bool(settings, "vfr");
+	bool skip_dups   = obs_data_get_bool(settings, "skip_duplicate_frames");
 	bool cbr_override= obs_data_get_bool(settings, "cbr");
 	enum rate_control rc;
 
@@ -446,7 +454,22 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t *settings,
 	if (!use_bufsize)
 		buffer_size = bitrate;
 
+	/* set this when the encoder skips duplicate frames
+	 * (obs_encoder_set_skip_duplicate_frames): the pts then have gaps, so
+	 * rate control has to follow the timestamps and keyframes are forced
+	 * by time */
+	obsx264->keyint_pts = 0;
+	if (skip_dups) {
+		vfr = true;
+		if (obsx264->params.i_keyint_max < X264_KEYINT_MAX_INFINITE)
+			obsx264->keyint_pts =
+				(int64_t)obsx264->params.i_keyint_max *
+				voi->fps_den;
+	}
+
 	obsx264->params.b_vfr_input          = vfr;
+	obsx264->params.i_timebase_num       = 1;
+	obsx264->params.i_timebase_den       = voi->fps_num;
 	obsx264->params.rc.i_vbv_max_bitrate = bitrate;
 	obsx264->params.rc.i_vbv_buffer_size = buffer_size;
 	obsx264->params.rc.i_bitrate         = bitrate;
@@ -507,7 +530,8 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t *settings,
 	     "\twidth:        %d\n"
 	     "\theight:       %d\n"
 	     "\tkeyint:       %d\n"
-	     "\tvfr:          %s\n",
+	     "\tvfr:          %s\n"
+	     "\tskip dups:    %s\n",
 	     rate_control,
 	     obsx264->params.rc.i_vbv_max_bitrate,
 	     obsx264->params.rc.i_vbv_buffer_size,
@@ -515,7 +539,8 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t *settings,
 	     voi->fps_num, voi->fps_den,
 	     width, height,
 	     obsx264->params.i_keyint_max,
-	     vfr ? "on" : "off");
+	     vfr ? "on" : "off",
+	     skip_dups ? "on" : "off");
 }
 
 static bool update_settings(struct obs_x264 *obsx264, obs_data_t *settings)
@@ -691,6 +716,12 @@ static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 	if (frame)
 		init_pic_data(obsx264, &pic, frame);
 
+	if (obsx264->keyint_pts &&
+	    pic.i_pts - obsx264->last_keyframe_pts >= obsx264->keyint_pts) {
+		pic.i_type = X264_TYPE_KEYFRAME;
+		obsx264->last_keyframe_pts = pic.i_pts;
+	}
+
 	ret = x264_encoder_encode(obsx264->context, &nals, &nal_count,
 			(frame ? &pic : NULL), &pic_out);
 	if (ret < 0) {
@@ -698,6 +729,10 @@ static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 		return false;
 	}
 
+	if (nal_count && pic_out.b_keyframe &&
+	    pic_out.i_pts > obsx264->last_keyframe_pts)
+		obsx264->last_keyframe_pts = pic_out.i_pts;
+
 	*received_packet = (nal_count != 0);
 	parse_packet(obsx264, packet, nals, nal_count, &pic_out);
 
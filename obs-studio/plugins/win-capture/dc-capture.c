@@ -26,7 +26,7 @@ static inline void init_textures(struct dc_capture *capture)
 
 void dc_capture_init(struct dc_capture *capture, int x, int y,
 		uint32_t width, uint32_t height, bool cursor,
-		bool compatibility)
+		bool compatibility, bool change_detection)
 {
 	memset(capture, 0, sizeof(struct dc_capture));
 
@@ -35,10 +35,11 @@ void dc_capture_init(struct dc_capture *capture, int x, int y,
 	capture->width          = width;
 	capture->height         = height;
 	capture->capture_cursor = cursor;
+	capture->change_detection = change_detection;
 
 	obs_enter_graphics();
 
-	if (!gs_gdi_texture_available())
+	if (!gs_gdi_texture_available() || change_detection)
 		compatibility = true;
 
 	capture->compatibility = compatibility;
@@ -76,6 +77,8 @@ void dc_capture_free(struct dc_capture *capture)
 		DeleteObject(capture->bmp);
 	}
 
+	tile_hash_free(&capture->tiles);
+
 	obs_enter_graphics();
 
 	for (int i = 0; i < capture->num_textures; i++)
@@ -129,9 +132,26 @@ static inline HDC dc_capture_get_dc(struct dc_capture *capture)
 		return gs_texture_get_dc(capture->textures[capture->cur_tex]);
 }
 
+static inline bool dc_capture_bits_changed(struct dc_capture *capture)
+{
+	size_t changed;
+
+	if (!capture->change_detection || !capture->bits)
+		return true;
+
+	GdiFlush();
+
+	changed = tile_hash_update(&capture->tiles, capture->bits,
+			capture->width * 4, capture->width, capture->height);
+	return changed != 0;
+}
+
 static inline void dc_capture_release_dc(struct dc_capture *capture)
 {
 	if (capture->compatibility) {
+		if (capture->unchanged)
+			return;
+
 		gs_texture_set_image(capture->textures[capture->cur_tex],
 				capture->bits, capture->width*4, false);
 	} else {
@@ -139,10 +159,9 @@ static inline void dc_capture_release_dc(struct dc_capture *capture)
 	}
 }
 
-void dc_capture_capture(struct dc_capture *capture, HWND window)
+static inline void dc_capture_begin(struct dc_capture *capture)
 {
-	HDC hdc_target;
-	HDC hdc;
+	capture->unchanged = false;
 
 	if (capture->capture_cursor) {
 		memset(&capture->ci, 0, sizeof(CURSORINFO));
@@ -152,15 +171,11 @@ void dc_capture_capture(struct dc_capture *capture, HWND window)
 
 	if (++capture->cur_tex == capture->num_textures)
 		capture->cur_tex = 0;
+}
 
-	hdc = dc_capture_get_dc(capture);
-	if (!hdc) {
-		blog(LOG_WARNING, "[capture_screen] Failed to get "
-		                  "texture DC");
-		return;
-	}
-
-	hdc_target = GetDC(window);
+static void dc_capture_blit(struct dc_capture *capture, HDC hdc, HWND window)
+{
+	HDC hdc_target = GetDC(window);
 
 	BitBlt(hdc, 0, 0, capture->width, capture->height,
 			hdc_target, capture->x, capture->y, SRCCOPY);
@@ -170,6 +185,40 @@ void dc_capture_capture(struct dc_capture *capture, HWND window)
 	if (capture->cursor_captured && !capture->cursor_hidden)
 		draw_cursor(capture, hdc, window);
 
+	if (capture->compatibility)
+		capture->unchanged = !dc_capture_bits_changed(capture);
+}
+
+bool dc_capture_grab(struct dc_capture *capture, HWND window)
+{
+	if (!capture->valid || !capture->compatibility)
+		return false;
+
+	dc_capture_begin(capture);
+	dc_capture_blit(capture, capture->hdc, window);
+
+	capture->grabbed = true;
+	return true;
+}
+
+void dc_capture_capture(struct dc_capture *capture, HWND window)
+{
+	HDC hdc;
+
+	if (!capture->grabbed) {
+		dc_capture_begin(capture);
+
+		hdc = dc_capture_get_dc(capture);
+		if (!hdc) {
+			blog(LOG_WARNING, "[capture_screen] Failed to get "
+			                  "texture DC");
+			return;
+		}
+
+		dc_capture_blit(capture, hdc, window);
+	}
+
+	capture->grabbed = false;
 	dc_capture_release_dc(capture);
 
 	capture->textures_written[capture->cur_tex] = true;
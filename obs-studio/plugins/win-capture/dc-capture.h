@@ -4,6 +4,7 @@
 #include <windows.h>
 
 #include <obs-module.h>
+#include <util/tile-hash.h>
 
 #define NUM_TEXTURES 2
 
@@ -26,13 +27,26 @@ struct dc_capture {
 	bool         cursor_hidden;
 	CURSORINFO   ci;
 
+	/* hashes the captured bits and skips the texture upload when none of
+	 * the tiles changed, requires the compatibility (DIB) path */
+	bool         change_detection;
+	bool         unchanged;
+	struct tile_hash tiles;
+
+	/* the window was already copied by dc_capture_grab */
+	bool         grabbed;
+
 	bool         valid;
 };
 
 extern void dc_capture_init(struct dc_capture *capture, int x, int y,
 		uint32_t width, uint32_t height, bool cursor,
-		bool compatibility);
+		bool compatibility, bool change_detection);
 extern void dc_capture_free(struct dc_capture *capture);
 
+/* copies the window into the DIB without the graphics context, so that
+ * dc_capture_capture only has to upload it.  compatibility captures only,
+ * returns false for the others */
+extern bool dc_capture_grab(struct dc_capture *capture, HWND window);
 extern void dc_capture_capture(struct dc_capture *capture, HWND window);
 extern void dc_capture_render(struct dc_capture *capture, gs_effect_t *effect);
@@ -4,6 +4,7 @@
 #define TEXT_MONITOR_CAPTURE obs_module_text("MonitorCapture")
 #define TEXT_CAPTURE_CURSOR  obs_module_text("CaptureCursor")
 #define TEXT_COMPATIBILITY   obs_module_text("Compatibility")
+#define TEXT_CHANGE_DETECT   obs_module_text("ChangeDetection")
 #define TEXT_MONITOR         obs_module_text("Monitor")
 #define TEXT_PRIMARY_MONITOR obs_module_text("PrimaryMonitor")
 
@@ -13,6 +14,7 @@ struct monitor_capture {
 	int               monitor;
 	bool              capture_cursor;
 	bool              compatibility;
+	bool              change_detection;
 
 	struct dc_capture data;
 };
@@ -72,7 +74,7 @@ static void update_monitor(struct monitor_capture *capture,
 
 	dc_capture_init(&capture->data, monitor.rect.left, monitor.rect.top,
 			width, height, capture->capture_cursor,
-			capture->compatibility);
+			capture->compatibility, capture->change_detection);
 }
 
 static inline void update_settings(struct monitor_capture *capture,
@@ -81,6 +83,8 @@ static inline void update_settings(struct monitor_capture *capture,
 	capture->monitor        = (int)obs_data_get_int(settings, "monitor");
 	capture->capture_cursor = obs_data_get_bool(settings, "capture_cursor");
 	capture->compatibility  = obs_data_get_bool(settings, "compatibility");
+	capture->change_detection =
+		obs_data_get_bool(settings, "change_detection");
 
 	dc_capture_free(&capture->data);
 	update_monitor(capture, settings);
@@ -110,6 +114,7 @@ static void monitor_capture_defaults(obs_data_t *settings)
 	obs_data_set_default_int(settings, "monitor", 0);
 	obs_data_set_default_bool(settings, "capture_cursor", true);
 	obs_data_set_default_bool(settings, "compatibility", false);
+	obs_data_set_default_bool(settings, "change_detection", false);
 }
 
 static void monitor_capture_update(void *data, obs_data_t *settings)
@@ -141,6 +146,9 @@ static void monitor_capture_tick(void *data, float seconds)
 	dc_capture_capture(&capture->data, NULL);
 	obs_leave_graphics();
 
+	obs_source_set_video_unchanged(capture->source,
+			capture->data.unchanged);
+
 	UNUSED_PARAMETER(seconds);
 }
 
@@ -222,6 +230,7 @@ static obs_properties_t *monitor_capture_properties(void *unused)
 		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
 
 	obs_properties_add_bool(props, "compatibility", TEXT_COMPATIBILITY);
+	obs_properties_add_bool(props, "change_detection", TEXT_CHANGE_DETECT);
 	obs_properties_add_bool(props, "capture_cursor", TEXT_CAPTURE_CURSOR);
 
 	EnumDisplayMonitors(NULL, NULL, enum_monitor_props, (LPARAM)monitors);
@@ -11,6 +11,14 @@
 #define TEXT_MATCH_EXE      obs_module_text("WindowCapture.Priority.Exe")
 #define TEXT_CAPTURE_CURSOR obs_module_text("CaptureCursor")
 #define TEXT_COMPATIBILITY  obs_module_text("Compatibility")
+#define TEXT_CHANGE_DETECT  obs_module_text("ChangeDetection")
+
+enum wc_state {
+	WC_IDLE,
+	WC_LOST,
+	WC_MINIMIZED,
+	WC_CAPTURE
+};
 
 struct window_capture {
 	obs_source_t         *source;
@@ -21,6 +29,7 @@ struct window_capture {
 	enum window_priority priority;
 	bool                 cursor;
 	bool                 compatibility;
+	bool                 change_detection;
 	bool                 use_wildcards; /* TODO */
 
 	struct dc_capture    capture;
@@ -30,6 +39,11 @@ struct window_capture {
 
 	HWND                 window;
 	RECT                 last_rect;
+
+	/* found by wc_prepare for the following wc_tick */
+	enum wc_state        state;
+	bool                 reset_capture;
+	RECT                 rect;
 };
 
 static void update_settings(struct window_capture *wc, obs_data_t *s)
@@ -47,6 +61,7 @@ static void update_settings(struct window_capture *wc, obs_data_t *s)
 	wc->cursor        = obs_data_get_bool(s, "cursor");
 	wc->use_wildcards = obs_data_get_bool(s, "use_wildcards");
 	wc->compatibility = obs_data_get_bool(s, "compatibility");
+	wc->change_detection = obs_data_get_bool(s, "change_detection");
 }
 
 /* ------------------------------------------------------------------------- */
@@ -88,8 +103,11 @@ static void wc_update(void *data, obs_data_t *settings)
 	struct window_capture *wc = data;
 	update_settings(wc, settings);
 
-	/* forces a reset */
+	/* forces a reset.  deferred updates are applied between wc_prepare and
+	 * wc_tick, so whatever wc_prepare found or grabbed is dropped too */
 	wc->window = NULL;
+	wc->state = WC_IDLE;
+	wc->capture.grabbed = false;
 }
 
 static uint32_t wc_width(void *data)
@@ -108,6 +126,7 @@ static void wc_defaults(obs_data_t *defaults)
 {
 	obs_data_set_default_bool(defaults, "cursor", true);
 	obs_data_set_default_bool(defaults, "compatibility", false);
+	obs_data_set_default_bool(defaults, "change_detection", false);
 }
 
 static obs_properties_t *wc_properties(void *unused)
@@ -131,17 +150,22 @@ static obs_properties_t *wc_properties(void *unused)
 
 	obs_properties_add_bool(ppts, "compatibility", TEXT_COMPATIBILITY);
 
+	obs_properties_add_bool(ppts, "change_detection", TEXT_CHANGE_DETECT);
+
 	return ppts;
 }
 
 #define RESIZE_CHECK_TIME 0.2f
 #define CURSOR_CHECK_TIME 0.2f
 
-static void wc_tick(void *data, float seconds)
+/* finds the window and, for compatibility captures, copies it.  none of it
+ * needs the graphics context, which leaves wc_tick with the textures */
+static void wc_prepare(void *data, float seconds)
 {
 	struct window_capture *wc = data;
-	RECT rect;
-	bool reset_capture = false;
+
+	wc->state = WC_IDLE;
+	wc->reset_capture = false;
 
 	if (!obs_source_showing(wc->source))
 		return;
@@ -153,14 +177,14 @@ static void wc_tick(void *data, float seconds)
 		wc->window = find_window(EXCLUDE_MINIMIZED, wc->priority,
 				wc->class, wc->title, wc->executable);
 		if (!wc->window) {
-			if (wc->capture.valid)
-				dc_capture_free(&wc->capture);
+			wc->state = WC_LOST;
 			return;
 		}
 
-		reset_capture = true;
+		wc->reset_capture = true;
 
 	} else if (IsIconic(wc->window)) {
+		wc->state = WC_MINIMIZED;
 		return;
 	}
 
@@ -183,32 +207,73 @@ static void wc_tick(void *data, float seconds)
 		wc->cursor_check_time = 0.0f;
 	}
 
-	obs_enter_graphics();
-
-	GetClientRect(wc->window, &rect);
+	GetClientRect(wc->window, &wc->rect);
 
-	if (!reset_capture) {
+	if (!wc->reset_capture) {
 		wc->resize_timer += seconds;
 
 		if (wc->resize_timer >= RESIZE_CHECK_TIME) {
-			if (rect.bottom != wc->last_rect.bottom ||
-			    rect.right  != wc->last_rect.right)
-				reset_capture = true;
+			if (wc->rect.bottom != wc->last_rect.bottom ||
+			    wc->rect.right  != wc->last_rect.right)
+				wc->reset_capture = true;
 
 			wc->resize_timer = 0.0f;
 		}
 	}
 
-	if (reset_capture) {
+	/* a capture that is about to be recreated is copied in wc_tick */
+	if (!wc->reset_capture)
+		dc_capture_grab(&wc->capture, wc->window);
+
+	wc->state = WC_CAPTURE;
+}
+
+static void wc_tick(void *data, float seconds)
+{
+	struct window_capture *wc = data;
+
+	switch (wc->state) {
+	case WC_IDLE:
+		return;
+
+	case WC_LOST:
+		if (wc->capture.valid)
+			dc_capture_free(&wc->capture);
+		return;
+
+	case WC_MINIMIZED:
+		/* nothing is captured, so the last texture stays as it is */
+		obs_source_set_video_unchanged(wc->source,
+				wc->change_detection && wc->capture.valid);
+		return;
+
+	case WC_CAPTURE:
+		break;
+	}
+
+	/* a NULL window would make dc_capture copy the whole desktop */
+	if (!wc->window || !IsWindow(wc->window)) {
+		wc->capture.grabbed = false;
+		return;
+	}
+
+	obs_enter_graphics();
+
+	if (wc->reset_capture) {
 		wc->resize_timer = 0.0f;
-		wc->last_rect = rect;
+		wc->last_rect = wc->rect;
 		dc_capture_free(&wc->capture);
-		dc_capture_init(&wc->capture, 0, 0, rect.right, rect.bottom,
-				wc->cursor, wc->compatibility);
+		dc_capture_init(&wc->capture, 0, 0, wc->rect.right,
+				wc->rect.bottom, wc->cursor, wc->compatibility,
+				wc->change_detection);
 	}
 
 	dc_capture_capture(&wc->capture, wc->window);
 	obs_leave_graphics();
+
+	obs_source_set_video_unchanged(wc->source, wc->capture.unchanged);
+
+	UNUSED_PARAMETER(seconds);
 }
 
 static void wc_render(void *data, gs_effect_t *effect)
@@ -229,6 +294,7 @@ struct obs_source_info window_capture_info = {
 	.update         = wc_update,
 	.video_render   = wc_render,
 	.video_tick     = wc_tick,
+	.video_prepare  = wc_prepare,
 	.get_width      = wc_width,
 	.get_height     = wc_height,
 	.get_defaults   = wc_defaults,
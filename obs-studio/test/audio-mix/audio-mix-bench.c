@@ -0,0 +1,205 @@
+/*
+ * Measures the cost of an audio thread tick as a function of the number of
+ * audio sources and the number of mixes that have outputs connected.  The
+ * sources are fed planar float audio from one thread; the time comes from
+ * the profiler's audio thread entries, divided by the number of ticks that
+ * were output.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <util/bmem.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include <util/profiler.h>
+#include <obs.h>
+
+#define RUN_SECONDS     3
+#define FEED_FRAMES     480
+#define FEED_INTERVAL   10000000ULL
+
+static const size_t source_counts[] = {1, 8, 32, 64};
+static const size_t mix_counts[]    = {1, 2, MAX_AUDIO_MIXES};
+
+static obs_source_t  *sources[MAX_CHANNELS];
+static volatile long num_sources;
+static os_event_t    *stop_feed;
+static volatile long ticks;
+
+/* ------------------------------------------------------------------------- */
+
+static const char *bench_audio_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Audio Mix Bench Source";
+}
+
+static void *bench_audio_create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	return source;
+}
+
+static void bench_audio_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static struct obs_source_info bench_audio = {
+	.id           = "audio_mix_bench_source",
+	.type         = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_AUDIO,
+	.get_name     = bench_audio_getname,
+	.create       = bench_audio_create,
+	.destroy      = bench_audio_destroy,
+};
+
+static void *feed_thread(void *unused)
+{
+	float    left[FEED_FRAMES];
+	float    right[FEED_FRAMES];
+	uint64_t next_time = os_gettime_ns();
+
+	for (size_t i = 0; i < FEED_FRAMES; i++) {
+		left[i]  = (float)sin((double)i * 0.05) * 0.5f;
+		right[i] = -left[i];
+	}
+
+	while (os_event_try(stop_feed) == EAGAIN) {
+		struct obs_source_audio data = {
+			.data            = {(uint8_t*)left, (uint8_t*)right},
+			.frames          = FEED_FRAMES,
+			.speakers        = SPEAKERS_STEREO,
+			.samples_per_sec = 48000,
+			.format          = AUDIO_FORMAT_FLOAT_PLANAR,
+			.timestamp       = next_time
+		};
+		long count = os_atomic_load_long(&num_sources);
+
+		for (long i = 0; i < count; i++)
+			obs_source_output_audio(sources[i], &data);
+
+		if (!os_sleepto_ns(next_time += FEED_INTERVAL))
+			next_time = os_gettime_ns();
+	}
+
+	UNUSED_PARAMETER(unused);
+	return NULL;
+}
+
+static void count_tick(void *param, size_t mix_idx, struct audio_data *data)
+{
+	if (mix_idx == 0)
+		os_atomic_inc_long(&ticks);
+
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(data);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool sum_audio_thread(void *context, profiler_snapshot_entry_t *entry)
+{
+	uint64_t *usec = context;
+	profiler_time_entries_t *times;
+
+	if (strncmp(profiler_snapshot_entry_name(entry), "audio_thread(",
+				13) != 0)
+		return true;
+
+	times = profiler_snapshot_entry_times(entry);
+	for (size_t i = 0; i < times->num; i++)
+		*usec += times->array[i].time_delta *
+			times->array[i].count;
+
+	return false;
+}
+
+static uint64_t audio_thread_usec(void)
+{
+	profiler_snapshot_t *snap = profile_snapshot_create();
+	uint64_t usec = 0;
+
+	profiler_snapshot_enumerate_roots(snap, sum_audio_thread, &usec);
+	profile_snapshot_free(snap);
+	return usec;
+}
+
+static void run(size_t source_count, size_t mix_count)
+{
+	audio_t  *audio = obs_get_audio();
+	uint64_t start_usec;
+	long     start_ticks;
+	long     tick_count;
+
+	for (size_t i = 0; i < mix_count; i++)
+		audio_output_connect(audio, i, NULL, count_tick, NULL);
+	for (size_t i = 0; i < source_count; i++)
+		obs_set_output_source((uint32_t)i, sources[i]);
+	os_atomic_set_long(&num_sources, (long)source_count);
+
+	/* let the audio buffering settle first */
+	os_sleep_ms(1000);
+
+	start_usec  = audio_thread_usec();
+	start_ticks = os_atomic_load_long(&ticks);
+	os_sleep_ms(RUN_SECONDS * 1000);
+	tick_count  = os_atomic_load_long(&ticks) - start_ticks;
+
+	if (tick_count > 0)
+		printf("  sources: %2d  mixes: %d  %8.2f us/tick\n",
+				(int)source_count, (int)mix_count,
+				(double)(audio_thread_usec() - start_usec) /
+				(double)tick_count);
+
+	os_atomic_set_long(&num_sources, 0);
+	for (size_t i = 0; i < source_count; i++)
+		obs_set_output_source((uint32_t)i, NULL);
+	for (size_t i = 0; i < mix_count; i++)
+		audio_output_disconnect(audio, i, count_tick, NULL);
+}
+
+int main(void)
+{
+	struct obs_audio_info oai = {
+		.samples_per_sec = 48000,
+		.speakers        = SPEAKERS_STEREO
+	};
+	pthread_t thread;
+
+	profiler_start();
+
+	if (!obs_startup("en-US", NULL, NULL) || !obs_reset_audio(&oai)) {
+		printf("failed to initialize libobs\n");
+		return 1;
+	}
+
+	obs_register_source(&bench_audio);
+
+	for (size_t i = 0; i < MAX_CHANNELS; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "audio %d", (int)i);
+		sources[i] = obs_source_create(bench_audio.id, name, NULL,
+				NULL);
+	}
+
+	os_event_init(&stop_feed, OS_EVENT_TYPE_MANUAL);
+	pthread_create(&thread, NULL, feed_thread, NULL);
+
+	for (size_t s = 0; s < sizeof(source_counts) / sizeof(size_t); s++)
+		for (size_t m = 0; m < sizeof(mix_counts) / sizeof(size_t); m++)
+			run(source_counts[s], mix_counts[m]);
+
+	os_event_signal(stop_feed);
+	pthread_join(thread, NULL);
+	os_event_destroy(stop_feed);
+
+	for (size_t i = 0; i < MAX_CHANNELS; i++)
+		obs_source_release(sources[i]);
+
+	obs_shutdown();
+	profiler_stop();
+	profiler_free();
+	return 0;
+}
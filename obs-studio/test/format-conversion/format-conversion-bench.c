@@ -0,0 +1,246 @@
+/*
+ * Checks that every set of format conversion kernels the CPU supports gives
+ * exactly the same output as the reference kernels, and reports the
+ * throughput of each at 720p and 1080p.  Returns non-zero on a mismatch.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/format-conversion.h>
+
+#define ITERATIONS 100
+#define PADDING    64
+
+static const char *simd_names[] = {"reference", "SSE4.1", "AVX2"};
+
+struct buffers {
+	uint32_t width;
+	uint32_t height;
+
+	uint8_t  *packed;        /* uyvx / 422 input */
+	uint8_t  *planes[3];     /* planar input */
+	uint8_t  *out_packed;
+	uint8_t  *out_planes[3];
+	uint8_t  *ref_packed;
+	uint8_t  *ref_planes[3];
+	size_t   packed_size;
+	size_t   plane_size;
+};
+
+static uint32_t rand_state = 0x12345678;
+
+static void fill_random(uint8_t *data, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		rand_state = rand_state * 1664525 + 1013904223;
+		data[i] = (uint8_t)(rand_state >> 24);
+	}
+}
+
+static uint8_t *alloc_buffer(size_t size, bool random)
+{
+	uint8_t *data = bzalloc(size + PADDING);
+	if (random)
+		fill_random(data, size);
+	return data;
+}
+
+static void buffers_init(struct buffers *b, uint32_t width, uint32_t height)
+{
+	b->width       = width;
+	b->height      = height;
+	b->packed_size = width * height * 4;
+	b->plane_size  = width * height;
+
+	b->packed     = alloc_buffer(b->packed_size, true);
+	b->out_packed = alloc_buffer(b->packed_size, false);
+	b->ref_packed = alloc_buffer(b->packed_size, false);
+
+	for (size_t i = 0; i < 3; i++) {
+		b->planes[i]     = alloc_buffer(b->plane_size, true);
+		b->out_planes[i] = alloc_buffer(b->plane_size, false);
+		b->ref_planes[i] = alloc_buffer(b->plane_size, false);
+	}
+}
+
+static void buffers_free(struct buffers *b)
+{
+	bfree(b->packed);
+	bfree(b->out_packed);
+	bfree(b->ref_packed);
+
+	for (size_t i = 0; i < 3; i++) {
+		bfree(b->planes[i]);
+		bfree(b->out_planes[i]);
+		bfree(b->ref_planes[i]);
+	}
+}
+
+enum conversion {
+	CONV_UYVX_TO_I420,
+	CONV_UYVX_TO_NV12,
+	CONV_UYVX_TO_I444,
+	CONV_DECOMPRESS_420,
+	CONV_DECOMPRESS_NV12,
+	CONV_DECOMPRESS_422_Y,
+	CONV_DECOMPRESS_422_U,
+	CONV_COUNT
+};
+
+static const char *conversion_names[] = {
+	"uyvx -> i420",
+	"uyvx -> nv12",
+	"uyvx -> i444",
+	"i420 -> yuvx",
+	"nv12 -> yuvx",
+	"yuy2 -> yuvx",
+	"uyvy -> yuvx",
+};
+
+static bool conversion_is_compress(enum conversion conv)
+{
+	return conv <= CONV_UYVX_TO_I444;
+}
+
+/* returns the size of the input data, for the throughput */
+static size_t run_conversion(struct buffers *b, enum conversion conv,
+		uint8_t *out_packed, uint8_t *out_planes[3])
+{
+	uint32_t w = b->width;
+	uint32_t h = b->height;
+	const uint8_t *planes[3] = {b->planes[0], b->planes[1], b->planes[2]};
+	uint32_t linesize_420[3]  = {w, w/2, w/2};
+	uint32_t linesize_nv12[3] = {w, w, 0};
+	uint32_t linesize_444[3]  = {w, w, w};
+
+	switch (conv) {
+	case CONV_UYVX_TO_I420:
+		compress_uyvx_to_i420(b->packed, w*4, 0, h,
+				out_planes, linesize_420);
+		return w * h * 4;
+	case CONV_UYVX_TO_NV12:
+		compress_uyvx_to_nv12(b->packed, w*4, 0, h,
+				out_planes, linesize_nv12);
+		return w * h * 4;
+	case CONV_UYVX_TO_I444:
+		convert_uyvx_to_i444(b->packed, w*4, 0, h,
+				out_planes, linesize_444);
+		return w * h * 4;
+	case CONV_DECOMPRESS_420:
+		decompress_420(planes, linesize_420, 0, h, out_packed, w*4);
+		return w * h * 3 / 2;
+	case CONV_DECOMPRESS_NV12:
+		decompress_nv12(planes, linesize_nv12, 0, h, out_packed, w*4);
+		return w * h * 3 / 2;
+	case CONV_DECOMPRESS_422_Y:
+		decompress_422(b->packed, w*2, 0, h, out_packed, w*4, true);
+		return w * h * 2;
+	case CONV_DECOMPRESS_422_U:
+		decompress_422(b->packed, w*2, 0, h, out_packed, w*4, false);
+		return w * h * 2;
+	case CONV_COUNT:
+		break;
+	}
+
+	return 0;
+}
+
+static void clear_outputs(struct buffers *b, uint8_t *packed,
+		uint8_t *planes[3])
+{
+	memset(packed, 0, b->packed_size + PADDING);
+	for (size_t i = 0; i < 3; i++)
+		memset(planes[i], 0, b->plane_size + PADDING);
+}
+
+static bool outputs_match(struct buffers *b, enum conversion conv)
+{
+	if (!conversion_is_compress(conv))
+		return memcmp(b->ref_packed, b->out_packed,
+				b->packed_size + PADDING) == 0;
+
+	for (size_t i = 0; i < 3; i++) {
+		if (memcmp(b->ref_planes[i], b->out_planes[i],
+					b->plane_size + PADDING) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+static double benchmark(struct buffers *b, enum conversion conv)
+{
+	uint64_t start = os_gettime_ns();
+	size_t   bytes = 0;
+	double   seconds;
+
+	for (int i = 0; i < ITERATIONS; i++)
+		bytes += run_conversion(b, conv, b->out_packed, b->out_planes);
+
+	seconds = (double)(os_gettime_ns() - start) / 1000000000.0;
+	return (double)bytes / 1000000.0 / seconds;
+}
+
+static bool test_resolution(uint32_t width, uint32_t height, bool bench)
+{
+	enum format_conversion_simd max = format_conversion_get_max_simd();
+	struct buffers b;
+	bool success = true;
+
+	buffers_init(&b, width, height);
+	printf("%ux%u\n", width, height);
+
+	for (int conv = 0; conv < CONV_COUNT; conv++) {
+		format_conversion_set_simd(FORMAT_CONVERSION_REFERENCE);
+		clear_outputs(&b, b.ref_packed, b.ref_planes);
+		run_conversion(&b, conv, b.ref_packed, b.ref_planes);
+
+		printf("  %-14s", conversion_names[conv]);
+
+		for (int level = 0; level <= (int)max; level++) {
+			bool match;
+
+			format_conversion_set_simd(level);
+			clear_outputs(&b, b.out_packed, b.out_planes);
+			run_conversion(&b, conv, b.out_packed, b.out_planes);
+
+			match = outputs_match(&b, conv);
+			if (!match)
+				success = false;
+
+			if (bench)
+				printf("  %s: %8.1f MB/s%s", simd_names[level],
+						benchmark(&b, conv),
+						match ? "" : " (MISMATCH)");
+			else
+				printf("  %s: %s", simd_names[level],
+						match ? "ok" : "MISMATCH");
+		}
+
+		printf("\n");
+	}
+
+	buffers_free(&b);
+	return success;
+}
+
+int main(void)
+{
+	enum format_conversion_simd max = format_conversion_get_max_simd();
+	bool success = true;
+
+	printf("fastest supported kernels: %s\n", simd_names[max]);
+
+	/* odd sizes that don't fill whole vectors check the line tails */
+	success &= test_resolution(1292, 722, false);
+	success &= test_resolution(1280, 720, true);
+	success &= test_resolution(1920, 1080, true);
+
+	format_conversion_set_simd(max);
+
+	printf(success ? "all kernels match the reference\n" :
+			"MISMATCH against the reference kernels\n");
+	return success ? 0 : 1;
+}
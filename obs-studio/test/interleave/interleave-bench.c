@@ -0,0 +1,300 @@
+/*
+ * Measures the cost of interleaving encoder packets, per packet inserted and
+ * sent, as a function of the number of tracks and the number of packets
+ * waiting in the interleave buffer.  Three strategies are compared:
+ *
+ *   sorted    one array sorted by dts_usec, with a linear scan and insert for
+ *             each packet and an erase of the head for each send (what
+ *             obs_output did before the per-track fifos)
+ *   fifo      one fifo per track, sending the lowest of the track heads found
+ *             with a linear scan (what obs_output does now)
+ *   heap      one fifo per track, with the track heads kept in a binary heap
+ *
+ * The packets are 30 fps video plus 48 kHz AAC audio tracks (1024 frames per
+ * packet), arriving in dts order per track, with audio a few packets ahead of
+ * video as it is with real encoders.
+ */
+
+#include <stdio.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/circlebuf.h>
+#include <util/platform.h>
+#include <obs.h>
+
+#define TOTAL_PACKETS  2000000
+#define MAX_TRACKS     (1 + MAX_AUDIO_MIXES)
+
+static const size_t track_counts[] = {2, 4, MAX_TRACKS};
+static const size_t buffer_depths[] = {16, 64, 512};
+
+/* ------------------------------------------------------------------------- */
+/* packet source */
+
+struct packet_gen {
+	size_t   num_tracks;
+	int64_t  next_dts[MAX_TRACKS];
+	int64_t  interval[MAX_TRACKS];
+};
+
+static void packet_gen_init(struct packet_gen *gen, size_t num_tracks)
+{
+	gen->num_tracks = num_tracks;
+	gen->interval[0] = 1000000 / 30;
+	gen->next_dts[0] = 0;
+
+	for (size_t i = 1; i < num_tracks; i++) {
+		gen->interval[i] = 1024 * 1000000 / 48000;
+		gen->next_dts[i] = -(int64_t)i * 1000;
+	}
+}
+
+/* the track furthest behind produces next, with audio running ahead */
+static void packet_gen_next(struct packet_gen *gen,
+		struct encoder_packet *packet)
+{
+	size_t track = 0;
+	int64_t lowest = gen->next_dts[0] - 10000;
+
+	for (size_t i = 1; i < gen->num_tracks; i++) {
+		if (gen->next_dts[i] < lowest) {
+			lowest = gen->next_dts[i];
+			track = i;
+		}
+	}
+
+	memset(packet, 0, sizeof(*packet));
+	packet->type      = track ? OBS_ENCODER_AUDIO : OBS_ENCODER_VIDEO;
+	packet->track_idx = track ? track - 1 : 0;
+	packet->dts_usec  = gen->next_dts[track];
+
+	gen->next_dts[track] += gen->interval[track];
+}
+
+static inline size_t packet_track(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO ? 0 : 1 + packet->track_idx;
+}
+
+/* ------------------------------------------------------------------------- */
+/* sorted array */
+
+static DARRAY(struct encoder_packet) sorted;
+
+static void sorted_insert(const struct encoder_packet *packet)
+{
+	size_t idx;
+
+	for (idx = 0; idx < sorted.num; idx++)
+		if (packet->dts_usec < sorted.array[idx].dts_usec)
+			break;
+
+	da_insert(sorted, idx, packet);
+}
+
+static bool sorted_send(struct encoder_packet *packet)
+{
+	if (!sorted.num)
+		return false;
+
+	*packet = sorted.array[0];
+	da_erase(sorted, 0);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* fifo per track */
+
+static struct circlebuf tracks[MAX_TRACKS];
+
+static inline struct encoder_packet *track_head(size_t track)
+{
+	if (!tracks[track].size)
+		return NULL;
+	return circlebuf_data(&tracks[track], 0);
+}
+
+static void fifo_insert(const struct encoder_packet *packet)
+{
+	circlebuf_push_back(&tracks[packet_track(packet)], packet,
+			sizeof(*packet));
+}
+
+static bool fifo_send(struct encoder_packet *packet)
+{
+	struct encoder_packet *first = NULL;
+	size_t track = 0;
+
+	for (size_t i = 0; i < MAX_TRACKS; i++) {
+		struct encoder_packet *head = track_head(i);
+
+		if (head && (!first || head->dts_usec < first->dts_usec)) {
+			first = head;
+			track = i;
+		}
+	}
+
+	if (!first)
+		return false;
+
+	circlebuf_pop_front(&tracks[track], packet, sizeof(*packet));
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* fifo per track, heads in a binary heap */
+
+static size_t heap[MAX_TRACKS];
+static size_t heap_size;
+
+static inline bool heap_less(size_t a, size_t b)
+{
+	return track_head(heap[a])->dts_usec < track_head(heap[b])->dts_usec;
+}
+
+static inline void heap_swap(size_t a, size_t b)
+{
+	size_t tmp = heap[a];
+	heap[a] = heap[b];
+	heap[b] = tmp;
+}
+
+static void heap_up(size_t i)
+{
+	while (i && heap_less(i, (i - 1) / 2)) {
+		heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void heap_down(size_t i)
+{
+	for (;;) {
+		size_t left  = i * 2 + 1;
+		size_t right = left + 1;
+		size_t min   = i;
+
+		if (left < heap_size && heap_less(left, min))
+			min = left;
+		if (right < heap_size && heap_less(right, min))
+			min = right;
+		if (min == i)
+			break;
+
+		heap_swap(i, min);
+		i = min;
+	}
+}
+
+static void heap_insert(const struct encoder_packet *packet)
+{
+	size_t track = packet_track(packet);
+	bool was_empty = !tracks[track].size;
+
+	fifo_insert(packet);
+
+	/* a track is in the heap while it has packets, and its head only
+	 * changes when it is popped */
+	if (was_empty) {
+		heap[heap_size++] = track;
+		heap_up(heap_size - 1);
+	}
+}
+
+static bool heap_send(struct encoder_packet *packet)
+{
+	size_t track;
+
+	if (!heap_size)
+		return false;
+
+	track = heap[0];
+	circlebuf_pop_front(&tracks[track], packet, sizeof(*packet));
+
+	if (!tracks[track].size)
+		heap[0] = heap[--heap_size];
+	heap_down(0);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct strategy {
+	const char *name;
+	void (*insert)(const struct encoder_packet *packet);
+	bool (*send)(struct encoder_packet *packet);
+};
+
+static const struct strategy strategies[] = {
+	{"sorted", sorted_insert, sorted_send},
+	{"fifo",   fifo_insert,   fifo_send},
+	{"heap",   heap_insert,   heap_send},
+};
+
+#define NUM_STRATEGIES (sizeof(strategies) / sizeof(strategies[0]))
+
+/* keeps depth packets buffered, inserting one and sending one per step, and
+ * returns the time per packet in ns */
+static double run(const struct strategy *s, size_t num_tracks, size_t depth)
+{
+	struct packet_gen gen;
+	struct encoder_packet packet;
+	int64_t last_dts = INT64_MIN;
+	uint64_t start, end;
+
+	packet_gen_init(&gen, num_tracks);
+
+	for (size_t i = 0; i < depth; i++) {
+		packet_gen_next(&gen, &packet);
+		s->insert(&packet);
+	}
+
+	start = os_gettime_ns();
+
+	for (size_t i = 0; i < TOTAL_PACKETS; i++) {
+		packet_gen_next(&gen, &packet);
+		s->insert(&packet);
+		s->send(&packet);
+
+		if (packet.dts_usec < last_dts) {
+			printf("%s: packets out of order\n", s->name);
+			break;
+		}
+		last_dts = packet.dts_usec;
+	}
+
+	end = os_gettime_ns();
+
+	while (s->send(&packet));
+	return (double)(end - start) / (double)TOTAL_PACKETS;
+}
+
+int main(void)
+{
+	printf("interleave, %d packets, ns/packet\n", TOTAL_PACKETS);
+	printf("  tracks  buffered");
+	for (size_t i = 0; i < NUM_STRATEGIES; i++)
+		printf("  %8s", strategies[i].name);
+	printf("\n");
+
+	for (size_t t = 0; t < sizeof(track_counts) / sizeof(size_t); t++) {
+		for (size_t d = 0; d < sizeof(buffer_depths) / sizeof(size_t);
+				d++) {
+			printf("  %6d  %8d", (int)track_counts[t],
+					(int)buffer_depths[d]);
+
+			for (size_t i = 0; i < NUM_STRATEGIES; i++)
+				printf("  %8.1f", run(&strategies[i],
+						track_counts[t],
+						buffer_depths[d]));
+			printf("\n");
+		}
+	}
+
+	da_free(sorted);
+	for (size_t i = 0; i < MAX_TRACKS; i++)
+		circlebuf_free(&tracks[i]);
+
+	printf("Number of memory leaks: %ld\n", bnum_allocs());
+	return 0;
+}
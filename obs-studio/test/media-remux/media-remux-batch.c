@@ -0,0 +1,184 @@
+/*
+ * Remuxes a batch of files headless with media_remux_batch, and reports the
+ * throughput in files/hour and MB/s.  Each output is written next to its
+ * input with the extension replaced (mp4 by default).
+ *
+ *   media-remux-batch [-j workers] [-e extension] [-t timeout_sec] files...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/bmem.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <media-io/media-remux.h>
+
+struct batch_file {
+	const char *in_filename;
+	char       *out_filename;
+	int64_t    size;
+	uint64_t   start_ns;
+	bool       success;
+};
+
+struct batch_info {
+	struct batch_file *files;
+	size_t            num_files;
+	volatile long     num_done;
+	uint64_t          timeout_ns;
+};
+
+/* ------------------------------------------------------------------------- */
+
+static bool remux_progress(void *data, size_t job, float percent)
+{
+	struct batch_info *info = data;
+	struct batch_file *file = &info->files[job];
+	uint64_t ts = os_gettime_ns();
+
+	if (!file->start_ns)
+		file->start_ns = ts;
+
+	/* cancel files that take too long, instead of stalling the batch */
+	if (info->timeout_ns && ts - file->start_ns > info->timeout_ns) {
+		fprintf(stderr, "timed out at %.1f%%: %s\n", percent,
+				file->in_filename);
+		return false;
+	}
+
+	return true;
+}
+
+static void remux_done(void *data, size_t job, bool success)
+{
+	struct batch_info *info = data;
+	struct batch_file *file = &info->files[job];
+	long done = os_atomic_inc_long(&info->num_done);
+
+	file->success = success;
+	printf("[%ld/%d] %s %s\n", done, (int)info->num_files,
+			success ? "ok    " : "FAILED", file->in_filename);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static char *get_out_filename(const char *in_filename, const char *ext)
+{
+	const char *slash = strrchr(in_filename, '/');
+	const char *dot   = strrchr(in_filename, '.');
+	struct dstr out   = {0};
+
+	if (dot && (!slash || dot > slash))
+		dstr_ncopy(&out, in_filename, dot - in_filename);
+	else
+		dstr_copy(&out, in_filename);
+
+	dstr_catf(&out, ".%s", ext);
+	return out.array;
+}
+
+static int64_t get_file_size(const char *filename)
+{
+	FILE *file = os_fopen(filename, "rb");
+	int64_t size;
+
+	if (!file)
+		return 0;
+
+	os_fseeki64(file, 0, SEEK_END);
+	size = os_ftelli64(file);
+	fclose(file);
+	return size;
+}
+
+static void usage(void)
+{
+	printf("usage: media-remux-batch [-j workers] [-e extension] "
+	       "[-t timeout_sec] files...\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct batch_info info = {0};
+	media_remux_batch_t batch;
+	const char *ext = "mp4";
+	size_t num_workers = 0;
+	size_t num_failed = 0;
+	int64_t total_size = 0;
+	uint64_t start_ns, elapsed_ns;
+	double hours, mb;
+	int i;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (i + 1 >= argc) {
+			usage();
+			return 1;
+		}
+
+		if (strcmp(argv[i], "-j") == 0)
+			num_workers = (size_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "-e") == 0)
+			ext = argv[++i];
+		else if (strcmp(argv[i], "-t") == 0)
+			info.timeout_ns = (uint64_t)atoi(argv[++i]) *
+				1000000000ULL;
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if (i == argc) {
+		usage();
+		return 1;
+	}
+
+	info.num_files = (size_t)(argc - i);
+	info.files = bzalloc(sizeof(struct batch_file) * info.num_files);
+
+	for (size_t f = 0; f < info.num_files; f++) {
+		struct batch_file *file = &info.files[f];
+		file->in_filename  = argv[i + f];
+		file->out_filename = get_out_filename(file->in_filename, ext);
+		file->size         = get_file_size(file->in_filename);
+		total_size += file->size;
+	}
+
+	batch = media_remux_batch_create(num_workers, remux_progress,
+			remux_done, &info);
+	if (!batch) {
+		printf("failed to create the remux workers\n");
+		return 1;
+	}
+
+	start_ns = os_gettime_ns();
+
+	for (size_t f = 0; f < info.num_files; f++)
+		media_remux_batch_add(batch, info.files[f].in_filename,
+				info.files[f].out_filename);
+
+	media_remux_batch_wait(batch);
+	elapsed_ns = os_gettime_ns() - start_ns;
+	media_remux_batch_destroy(batch);
+
+	for (size_t f = 0; f < info.num_files; f++) {
+		if (!info.files[f].success)
+			num_failed++;
+		bfree(info.files[f].out_filename);
+	}
+	bfree(info.files);
+
+	hours = (double)elapsed_ns / 3600000000000.0;
+	mb    = (double)total_size / (1024.0 * 1024.0);
+
+	printf("remuxed %d files (%d failed), %.1f MB in %.2f s:\n",
+			(int)info.num_files, (int)num_failed, mb,
+			(double)elapsed_ns / 1000000000.0);
+	printf("  %.0f files/hour  %.1f MB/s\n",
+			(double)info.num_files / hours,
+			mb / ((double)elapsed_ns / 1000000000.0));
+
+	return num_failed ? 1 : 0;
+}
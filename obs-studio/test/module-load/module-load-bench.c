@@ -0,0 +1,187 @@
+/*
+ * Measures startup module loading.  Without -l, every module in the given
+ * paths is loaded like obs_load_all_modules does, and the cost of opening and
+ * initializing each one is reported, most expensive first.  With -l, the
+ * modules are loaded with obs_load_all_modules_lazy using the given cache
+ * file (run it twice: the first run builds the cache), and then the time to
+ * resolve each of the given source/output/encoder/service ids is reported,
+ * which includes loading the module that provides it.  -a restricts the
+ * lazy loading to the given modules.
+ *
+ *   module-load-bench [-l cache.json] [-a module]... bin_path data_path [ids...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <obs.h>
+
+struct module_cost {
+	const char *file;
+	char       *bin_path;
+	uint64_t   open_ns;
+	uint64_t   init_ns;
+	bool       success;
+};
+
+static DARRAY(struct module_cost) costs;
+
+static inline double ms(uint64_t ns)
+{
+	return (double)ns / 1000000.0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void load_callback(void *param, const struct obs_module_info *info)
+{
+	struct module_cost cost = {0};
+	obs_module_t *module;
+	uint64_t start_ns;
+
+	cost.bin_path = bstrdup(info->bin_path);
+	cost.file = strrchr(cost.bin_path, '/');
+	cost.file = cost.file ? cost.file + 1 : cost.bin_path;
+
+	start_ns = os_gettime_ns();
+	cost.success = obs_open_module(&module, info->bin_path,
+			info->data_path) == MODULE_SUCCESS;
+	cost.open_ns = os_gettime_ns() - start_ns;
+
+	if (cost.success) {
+		start_ns = os_gettime_ns();
+		cost.success = obs_init_module(module);
+		cost.init_ns = os_gettime_ns() - start_ns;
+	}
+
+	da_push_back(costs, &cost);
+
+	UNUSED_PARAMETER(param);
+}
+
+static int compare_cost(const void *a, const void *b)
+{
+	const struct module_cost *ca = a;
+	const struct module_cost *cb = b;
+	uint64_t total_a = ca->open_ns + ca->init_ns;
+	uint64_t total_b = cb->open_ns + cb->init_ns;
+
+	return total_a < total_b ? 1 : (total_a > total_b ? -1 : 0);
+}
+
+static void bench_all_modules(void)
+{
+	uint64_t total_ns = 0;
+
+	obs_find_modules(load_callback, NULL);
+
+	qsort(costs.array, costs.num, sizeof(struct module_cost),
+			compare_cost);
+
+	printf("%-32s %10s %10s %10s\n", "module", "open ms", "init ms",
+			"total ms");
+
+	for (size_t i = 0; i < costs.num; i++) {
+		struct module_cost *cost = costs.array + i;
+
+		printf("%-32s %10.2f %10.2f %10.2f%s\n", cost->file,
+				ms(cost->open_ns), ms(cost->init_ns),
+				ms(cost->open_ns + cost->init_ns),
+				cost->success ? "" : "  (failed)");
+
+		total_ns += cost->open_ns + cost->init_ns;
+		bfree(cost->bin_path);
+	}
+
+	printf("%d modules in %.2f ms\n", (int)costs.num, ms(total_ns));
+	da_free(costs);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void bench_lazy(const char *cache_file, char **ids, int num_ids)
+{
+	uint64_t start_ns = os_gettime_ns();
+
+	obs_load_all_modules_lazy(cache_file);
+	printf("obs_load_all_modules_lazy: %.2f ms\n",
+			ms(os_gettime_ns() - start_ns));
+
+	obs_log_loaded_modules();
+
+	for (int i = 0; i < num_ids; i++) {
+		const char *id = ids[i];
+		const char *kind = "unknown";
+
+		start_ns = os_gettime_ns();
+
+		if (obs_source_get_display_name(id))
+			kind = "source";
+		else if (obs_output_get_display_name(id))
+			kind = "output";
+		else if (obs_encoder_get_display_name(id))
+			kind = "encoder";
+		else if (obs_service_get_display_name(id))
+			kind = "service";
+
+		printf("  %-30s %-8s %10.2f ms\n", id, kind,
+				ms(os_gettime_ns() - start_ns));
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void usage(void)
+{
+	printf("usage: module-load-bench [-l cache.json] [-a module]... "
+	       "bin_path data_path [ids...]\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *cache_file = NULL;
+	int i;
+
+	if (!obs_startup("en-US", NULL, NULL)) {
+		printf("obs_startup failed\n");
+		return 1;
+	}
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (i + 1 >= argc) {
+			usage();
+			obs_shutdown();
+			return 1;
+		}
+
+		if (strcmp(argv[i], "-l") == 0) {
+			cache_file = argv[++i];
+		} else if (strcmp(argv[i], "-a") == 0) {
+			obs_add_allowed_module(argv[++i]);
+		} else {
+			usage();
+			obs_shutdown();
+			return 1;
+		}
+	}
+
+	if (argc - i < 2) {
+		usage();
+		obs_shutdown();
+		return 1;
+	}
+
+	obs_add_module_path(argv[i], argv[i + 1]);
+
+	if (cache_file)
+		bench_lazy(cache_file, argv + i + 2, argc - i - 2);
+	else
+		bench_all_modules();
+
+	obs_shutdown();
+	blog(LOG_INFO, "Number of memory leaks: %ld", bnum_allocs());
+	return 0;
+}
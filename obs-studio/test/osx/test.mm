@@ -44,7 +44,7 @@ static void CreateOBS()
 	if (!obs_startup("en", nullptr))
 		throw "Couldn't create OBS";
 
-	struct obs_video_info ovi;
+	struct obs_video_info ovi = {};
 	ovi.adapter         = 0;
 	ovi.fps_num         = 30000;
 	ovi.fps_den         = 1001;
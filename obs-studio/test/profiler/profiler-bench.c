@@ -0,0 +1,112 @@
+/*
+ * Measures the cost of profile_start/profile_end pairs as a function of the
+ * sampling interval, with several threads profiling at once.  Each thread
+ * runs a root with a few nested children, like the graphics and audio
+ * threads do.  The timeline of the last run is written to the file given on
+ * the command line, if any.
+ *
+ *   profiler-bench [trace.json]
+ */
+
+#include <stdio.h>
+#include <util/bmem.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include <util/profiler.h>
+
+#define NUM_THREADS  4
+#define ROOT_CALLS   200000
+#define CHILD_CALLS  4
+
+static const uint32_t sample_intervals[] = {1, 10, 100};
+
+static const char *root_names[NUM_THREADS] = {
+	"bench_thread(0)", "bench_thread(1)",
+	"bench_thread(2)", "bench_thread(3)"
+};
+static const char *child_name = "child";
+static const char *leaf_name  = "leaf";
+
+/* ------------------------------------------------------------------------- */
+
+static void *bench_thread(void *data)
+{
+	const char *root_name = data;
+
+	for (int i = 0; i < ROOT_CALLS; i++) {
+		profile_start(root_name);
+
+		for (int j = 0; j < CHILD_CALLS; j++) {
+			profile_start(child_name);
+			profile_start(leaf_name);
+			profile_end(leaf_name);
+			profile_end(child_name);
+		}
+
+		profile_end(root_name);
+		profile_reenable_thread();
+	}
+
+	return NULL;
+}
+
+static double run(bool enable, uint32_t interval)
+{
+	pthread_t threads[NUM_THREADS];
+	uint64_t start_ns, elapsed_ns;
+	double pairs;
+
+	if (enable)
+		profiler_start();
+	else
+		profiler_stop();
+
+	profiler_set_sample_interval(interval);
+
+	start_ns = os_gettime_ns();
+
+	for (size_t i = 0; i < NUM_THREADS; i++)
+		pthread_create(&threads[i], NULL, bench_thread,
+				(void*)root_names[i]);
+	for (size_t i = 0; i < NUM_THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	elapsed_ns = os_gettime_ns() - start_ns;
+
+	/* wall time over all threads, so contention between the threads
+	 * shows up in the result */
+	pairs = (double)NUM_THREADS * ROOT_CALLS * (1 + CHILD_CALLS * 2);
+	return (double)elapsed_ns / pairs;
+}
+
+int main(int argc, char *argv[])
+{
+	profiler_snapshot_t *snap;
+
+	for (size_t i = 0; i < NUM_THREADS; i++)
+		profile_register_root(root_names[i], 0);
+
+	printf("profiler, %d threads, %d root calls with %d nested pairs "
+			"each:\n", NUM_THREADS, ROOT_CALLS, CHILD_CALLS * 2);
+	printf("  disabled        %6.1f ns/pair\n", run(false, 1));
+
+	for (size_t i = 0; i < sizeof(sample_intervals) / sizeof(uint32_t);
+			i++)
+		printf("  1 in %-4u      %6.1f ns/pair\n",
+				sample_intervals[i],
+				run(true, sample_intervals[i]));
+
+	snap = profile_snapshot_create();
+
+	if (argc > 1) {
+		if (profiler_snapshot_dump_trace_json(snap, argv[1]))
+			printf("timeline written to %s\n", argv[1]);
+		else
+			printf("failed to write %s\n", argv[1]);
+	}
+
+	profile_snapshot_free(snap);
+	profiler_stop();
+	profiler_free();
+	return 0;
+}
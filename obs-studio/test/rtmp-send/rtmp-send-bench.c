@@ -0,0 +1,268 @@
+/*
+ * Measures the cost of sending encoded packets over RTMP.  Packets are sent
+ * over loopback TCP to a stand-in sink thread that reads and discards the
+ * stream, once with the flv mux + RTMP_Write path (the packet is copied into
+ * an flv tag, then into an RTMP packet) and once with the vectored
+ * RTMP_WriteV path (the packet data is sent in place).  Both paths first send
+ * a short run with the sink hashing what it receives, to check that they put
+ * exactly the same bytes on the wire.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <util/bmem.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include <obs.h>
+#include "librtmp/rtmp.h"
+#include "librtmp/rtmp_sys.h"
+#include "flv-mux.h"
+
+#define VERIFY_FRAMES   200
+#define RUN_FRAMES      6000
+#define KEYFRAME_SIZE   (160 * 1024)
+#define FRAME_SIZE      (16 * 1024)
+#define KEYINT          120
+#define AUDIO_SIZE      372
+#define CHUNK_SIZE      4096
+
+struct sink {
+	int       fd;
+	bool      hash;
+	uint64_t  bytes;
+	uint64_t  fnv;
+	pthread_t thread;
+};
+
+static uint8_t keyframe_data[KEYFRAME_SIZE];
+static uint8_t frame_data[FRAME_SIZE];
+static uint8_t audio_data[AUDIO_SIZE];
+
+/* ------------------------------------------------------------------------- */
+
+static void *sink_thread(void *data)
+{
+	struct sink *sink = data;
+	static uint8_t buf[256 * 1024];
+
+	sink->fnv = 14695981039346656037ULL;
+
+	for (;;) {
+		ssize_t ret = recv(sink->fd, buf, sizeof(buf), 0);
+		if (ret <= 0)
+			break;
+
+		if (sink->hash) {
+			for (ssize_t i = 0; i < ret; i++) {
+				sink->fnv ^= buf[i];
+				sink->fnv *= 1099511628211ULL;
+			}
+		}
+
+		sink->bytes += (uint64_t)ret;
+	}
+
+	close(sink->fd);
+	return NULL;
+}
+
+/* connects an RTMP object to a fresh sink over loopback.  no handshake is
+ * done; the sink only consumes the chunk stream */
+static bool connect_sink(RTMP *rtmp, struct sink *sink, bool hash)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t len = sizeof(addr);
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	int fd;
+
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(listener, (struct sockaddr*)&addr, len) != 0 ||
+	    listen(listener, 1) != 0 ||
+	    getsockname(listener, (struct sockaddr*)&addr, &len) != 0) {
+		close(listener);
+		return false;
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (connect(fd, (struct sockaddr*)&addr, len) != 0) {
+		close(fd);
+		close(listener);
+		return false;
+	}
+
+	memset(sink, 0, sizeof(*sink));
+	sink->fd   = accept(listener, NULL, NULL);
+	sink->hash = hash;
+	close(listener);
+
+	pthread_create(&sink->thread, NULL, sink_thread, sink);
+
+	RTMP_Init(rtmp);
+	RTMP_AddStream(rtmp, "bench");
+	rtmp->Link.streams[0].id = 1;
+	rtmp->m_sb.sb_socket     = fd;
+	rtmp->m_outChunkSize     = CHUNK_SIZE;
+	return true;
+}
+
+static void disconnect_sink(RTMP *rtmp, struct sink *sink)
+{
+	shutdown(rtmp->m_sb.sb_socket, SHUT_WR);
+	pthread_join(sink->thread, NULL);
+	close(rtmp->m_sb.sb_socket);
+	rtmp->m_sb.sb_socket = -1;
+	RTMPPacket_Free(&rtmp->m_write);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool send_copy(RTMP *rtmp, struct encoder_packet *packet)
+{
+	uint8_t *data;
+	size_t  size;
+	int     ret;
+
+	flv_packet_mux(packet, &data, &size, false);
+	ret = RTMP_Write(rtmp, (char*)data, (int)size, 0);
+	bfree(data);
+	return ret >= 0;
+}
+
+static bool send_vectored(RTMP *rtmp, struct encoder_packet *packet)
+{
+	uint8_t prefix[FLV_BODY_PREFIX_MAX];
+	RTMPBuf body[2];
+
+	body[0].data = (const char*)prefix;
+	body[0].size = (int)flv_packet_body_prefix(packet, prefix, false);
+	body[1].data = (const char*)packet->data;
+	body[1].size = (int)packet->size;
+
+	return !!RTMP_WriteV(rtmp,
+			packet->type == OBS_ENCODER_VIDEO ?
+				RTMP_PACKET_TYPE_VIDEO : RTMP_PACKET_TYPE_AUDIO,
+			get_ms_time(packet, packet->dts) & 0x7FFFFFFF,
+			body, 2, 0);
+}
+
+typedef bool (*send_func_t)(RTMP *rtmp, struct encoder_packet *packet);
+
+static bool send_stream(RTMP *rtmp, send_func_t send, int frames)
+{
+	for (int i = 0; i < frames; i++) {
+		struct encoder_packet video = {
+			.type         = OBS_ENCODER_VIDEO,
+			.timebase_num = 1,
+			.timebase_den = 60,
+			.dts          = i + 1,
+			.pts          = i + 2,
+			.keyframe     = (i % KEYINT) == 0
+		};
+		struct encoder_packet audio = {
+			.type         = OBS_ENCODER_AUDIO,
+			.timebase_num = 1,
+			.timebase_den = 48000,
+			.dts          = (i + 1) * 800,
+			.pts          = (i + 1) * 800,
+			.data         = audio_data,
+			.size         = AUDIO_SIZE
+		};
+
+		video.data = video.keyframe ? keyframe_data : frame_data;
+		video.size = video.keyframe ? KEYFRAME_SIZE : FRAME_SIZE;
+
+		if (!send(rtmp, &video) || !send(rtmp, &audio))
+			return false;
+	}
+
+	return true;
+}
+
+static uint64_t thread_cpu_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static bool verify(send_func_t send, uint64_t *fnv)
+{
+	struct sink sink;
+	RTMP rtmp;
+	bool success;
+
+	if (!connect_sink(&rtmp, &sink, true))
+		return false;
+
+	success = send_stream(&rtmp, send, VERIFY_FRAMES);
+	disconnect_sink(&rtmp, &sink);
+
+	*fnv = sink.fnv;
+	return success;
+}
+
+static bool run(const char *name, send_func_t send)
+{
+	struct sink sink;
+	RTMP     rtmp;
+	uint64_t start_ns, start_cpu_ns, wall_ns, cpu_ns;
+	double   mb;
+	bool     success;
+
+	if (!connect_sink(&rtmp, &sink, false))
+		return false;
+
+	start_ns     = os_gettime_ns();
+	start_cpu_ns = thread_cpu_ns();
+	success      = send_stream(&rtmp, send, RUN_FRAMES);
+	cpu_ns       = thread_cpu_ns() - start_cpu_ns;
+	disconnect_sink(&rtmp, &sink);
+	wall_ns      = os_gettime_ns() - start_ns;
+
+	if (!success)
+		return false;
+
+	mb = (double)sink.bytes / (1024.0 * 1024.0);
+	printf("  %-9s %8.1f MB  %8.1f MB/s  %6.3f ms CPU/MB\n", name, mb,
+			mb / ((double)wall_ns / 1000000000.0),
+			(double)cpu_ns / 1000000.0 / mb);
+	return true;
+}
+
+int main(void)
+{
+	uint64_t fnv_copy, fnv_vectored;
+	uint32_t seed = 1;
+
+	for (size_t i = 0; i < KEYFRAME_SIZE; i++) {
+		seed = seed * 1103515245 + 12345;
+		keyframe_data[i] = (uint8_t)(seed >> 16);
+	}
+	memcpy(frame_data, keyframe_data + 1, FRAME_SIZE);
+	memcpy(audio_data, keyframe_data + 2, AUDIO_SIZE);
+
+	if (!verify(send_copy, &fnv_copy) ||
+	    !verify(send_vectored, &fnv_vectored)) {
+		printf("failed to send to the loopback sink\n");
+		return 1;
+	}
+
+	if (fnv_copy != fnv_vectored) {
+		printf("vectored send does not match the muxed stream\n");
+		return 1;
+	}
+
+	printf("rtmp send, %d frames, %d byte chunks:\n", RUN_FRAMES,
+			CHUNK_SIZE);
+
+	if (!run("muxed", send_copy) || !run("vectored", send_vectored)) {
+		printf("failed to send to the loopback sink\n");
+		return 1;
+	}
+
+	printf("  (bytes on the wire are identical)\n");
+	return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * Measures the software renderer on its own: starts libobs headless with
+ * graphics_module "libobs-software", times the draws the output pipeline
+ * makes each frame (a 1:1 copy and the bicubic, lanczos and bilinear scale
+ * passes) and then lets the video thread run for a few seconds and prints
+ * its frame metrics.  Needs no GPU and no display.
+ *
+ *   software-render-bench [base_width base_height [output_width output_height]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/metrics.h>
+#include <graphics/vec2.h>
+#include <obs.h>
+
+#define ITERATIONS 20
+#define RUN_SECONDS 3
+
+#ifdef _WIN32
+#define SOFTWARE_MODULE "libobs-software.dll"
+#else
+#define SOFTWARE_MODULE "libobs-software"
+#endif
+
+struct scale_pass {
+	const char          *name;
+	enum obs_base_effect effect;
+	bool                 scaled;
+};
+
+static const struct scale_pass passes[] = {
+	{"copy",     OBS_EFFECT_DEFAULT,         false},
+	{"bicubic",  OBS_EFFECT_BICUBIC,         true},
+	{"lanczos",  OBS_EFFECT_LANCZOS,         true},
+	{"bilinear", OBS_EFFECT_BILINEAR_LOWRES, true},
+};
+
+static gs_texture_t *create_source_texture(uint32_t cx, uint32_t cy)
+{
+	uint32_t state = 0x12345678;
+	size_t size = (size_t)cx * cy * 4;
+	uint8_t *data = bmalloc(size);
+	const uint8_t *levels[1] = {data};
+	gs_texture_t *tex;
+
+	for (size_t i = 0; i < size; i++) {
+		state = state * 1664525 + 1013904223;
+		data[i] = (uint8_t)(state >> 24);
+	}
+
+	tex = gs_texture_create(cx, cy, GS_BGRA, 1, levels, 0);
+	bfree(data);
+	return tex;
+}
+
+static double draw_ms(const struct scale_pass *pass, gs_texture_t *tex,
+		gs_texrender_t *texrender, uint32_t cx, uint32_t cy)
+{
+	gs_effect_t *effect = obs_get_base_effect(pass->effect);
+	gs_eparam_t *image = gs_effect_get_param_by_name(effect, "image");
+	gs_eparam_t *dim = gs_effect_get_param_by_name(effect,
+			"base_dimension_i");
+	uint32_t tex_cx = gs_texture_get_width(tex);
+	uint32_t tex_cy = gs_texture_get_height(tex);
+	uint64_t start;
+	struct vec2 dim_i;
+
+	vec2_set(&dim_i, 1.0f / (float)tex_cx, 1.0f / (float)tex_cy);
+
+	start = os_gettime_ns();
+
+	for (int i = 0; i < ITERATIONS; i++) {
+		gs_texrender_reset(texrender);
+		if (!gs_texrender_begin(texrender, cx, cy))
+			return 0.0;
+
+		gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+		gs_set_viewport(0, 0, cx, cy);
+
+		gs_effect_set_texture(image, tex);
+		if (dim)
+			gs_effect_set_vec2(dim, &dim_i);
+
+		while (gs_effect_loop(effect, "Draw"))
+			gs_draw_sprite(tex, 0, cx, cy);
+
+		gs_texrender_end(texrender);
+	}
+
+	return (double)(os_gettime_ns() - start) / 1000000.0 / ITERATIONS;
+}
+
+static void bench_draws(uint32_t base_cx, uint32_t base_cy,
+		uint32_t out_cx, uint32_t out_cy)
+{
+	gs_texrender_t *texrender;
+	gs_texture_t *tex;
+
+	obs_enter_graphics();
+
+	tex = create_source_texture(base_cx, base_cy);
+	texrender = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+
+	for (size_t i = 0; i < sizeof(passes) / sizeof(passes[0]); i++) {
+		const struct scale_pass *pass = passes + i;
+		uint32_t cx = pass->scaled ? out_cx : base_cx;
+		uint32_t cy = pass->scaled ? out_cy : base_cy;
+
+		printf("  %-8s %ux%u -> %ux%u: %7.2f ms\n", pass->name,
+				base_cx, base_cy, cx, cy,
+				draw_ms(pass, tex, texrender, cx, cy));
+	}
+
+	gs_texrender_destroy(texrender);
+	gs_texture_destroy(tex);
+
+	obs_leave_graphics();
+}
+
+static void print_histogram(const char *name)
+{
+	struct metrics_histogram_data data;
+
+	metrics_histogram_get_data(metrics_histogram_get(name), &data);
+	printf("  %-14s count %6llu  p50 %7.2f ms  p99 %7.2f ms\n", name,
+			(unsigned long long)data.count,
+			(double)metrics_histogram_percentile_ns(&data, 0.5) /
+				1000000.0,
+			(double)metrics_histogram_percentile_ns(&data, 0.99) /
+				1000000.0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct obs_video_info ovi = {0};
+	int ret = 1;
+
+	ovi.graphics_module = SOFTWARE_MODULE;
+	ovi.fps_num         = 30;
+	ovi.fps_den         = 1;
+	ovi.base_width      = argc > 2 ? (uint32_t)atoi(argv[1]) : 1920;
+	ovi.base_height     = argc > 2 ? (uint32_t)atoi(argv[2]) : 1080;
+	ovi.output_width    = argc > 4 ? (uint32_t)atoi(argv[3]) : 1280;
+	ovi.output_height   = argc > 4 ? (uint32_t)atoi(argv[4]) : 720;
+	ovi.output_format   = VIDEO_FORMAT_NV12;
+	ovi.colorspace      = VIDEO_CS_601;
+	ovi.range           = VIDEO_RANGE_PARTIAL;
+	ovi.gpu_conversion  = true;
+	ovi.scale_type      = OBS_SCALE_BICUBIC;
+
+	if (!obs_startup("en-US", NULL, NULL)) {
+		printf("obs_startup failed\n");
+		return 1;
+	}
+
+	if (obs_reset_video(&ovi) != OBS_VIDEO_SUCCESS) {
+		printf("could not start video with %s\n", SOFTWARE_MODULE);
+		goto exit;
+	}
+
+	printf("draws (%d iterations):\n", ITERATIONS);
+	bench_draws(ovi.base_width, ovi.base_height, ovi.output_width,
+			ovi.output_height);
+
+	printf("video thread over %d seconds:\n", RUN_SECONDS);
+	os_sleep_ms(RUN_SECONDS * 1000);
+	print_histogram("video.frame");
+	print_histogram("video.render");
+	print_histogram("video.download");
+	print_histogram("video.convert");
+	printf("  lagged frames: %lld\n", (long long)metrics_counter_value(
+				metrics_counter_get("video.lagged_frames")));
+	ret = 0;
+
+exit:
+	obs_shutdown();
+	blog(LOG_INFO, "Number of memory leaks: %ld", bnum_allocs());
+	return ret;
+}
@@ -0,0 +1,195 @@
+/*
+ * Measures the CPU conversion of a staged frame to I420/NV12 as done when GPU
+ * conversion is off, as a function of the number of slice threads.  The 1
+ * thread time is what the graphics thread used to spend per frame; it now
+ * runs on the conversion thread.  Returns non-zero if the sliced output
+ * differs from converting the whole frame on one thread.
+ *
+ *   video-convert-bench [max_threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/format-conversion.h>
+#include <media-io/video-slice-pool.h>
+
+#define ITERATIONS 60
+
+struct frame {
+	uint32_t width;
+	uint32_t height;
+	uint8_t  *packed;
+	uint8_t  *planes[3];
+	uint8_t  *ref_planes[3];
+	uint32_t linesize[3];
+	bool     nv12;
+};
+
+static const uint32_t resolutions[][2] = {
+	{1280, 720},
+	{1920, 1080},
+	{2560, 1440},
+	{3840, 2160},
+};
+
+static void frame_init(struct frame *f, uint32_t width, uint32_t height)
+{
+	uint32_t state = 0x12345678;
+	size_t size = (size_t)width * height * 4;
+
+	memset(f, 0, sizeof(*f));
+	f->width  = width;
+	f->height = height;
+	f->packed = bmalloc(size);
+
+	for (size_t i = 0; i < size; i++) {
+		state = state * 1664525 + 1013904223;
+		f->packed[i] = (uint8_t)(state >> 24);
+	}
+
+	for (size_t i = 0; i < 3; i++) {
+		f->planes[i]     = bzalloc((size_t)width * height);
+		f->ref_planes[i] = bzalloc((size_t)width * height);
+	}
+}
+
+static void frame_free(struct frame *f)
+{
+	bfree(f->packed);
+
+	for (size_t i = 0; i < 3; i++) {
+		bfree(f->planes[i]);
+		bfree(f->ref_planes[i]);
+	}
+}
+
+static void convert_slice(void *param, uint32_t start_y, uint32_t end_y)
+{
+	struct frame *f = param;
+
+	if (f->nv12)
+		compress_uyvx_to_nv12(f->packed, f->width * 4, start_y, end_y,
+				f->planes, f->linesize);
+	else
+		compress_uyvx_to_i420(f->packed, f->width * 4, start_y, end_y,
+				f->planes, f->linesize);
+}
+
+static void set_format(struct frame *f, bool nv12)
+{
+	f->nv12        = nv12;
+	f->linesize[0] = f->width;
+	f->linesize[1] = nv12 ? f->width : f->width / 2;
+	f->linesize[2] = nv12 ? 0 : f->width / 2;
+}
+
+static bool outputs_match(struct frame *f)
+{
+	size_t size = (size_t)f->width * f->height;
+
+	for (size_t i = 0; i < 3; i++) {
+		if (memcmp(f->planes[i], f->ref_planes[i], size) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void clear_planes(struct frame *f)
+{
+	for (size_t i = 0; i < 3; i++)
+		memset(f->planes[i], 0, (size_t)f->width * f->height);
+}
+
+static double convert_ms(struct frame *f, video_slice_pool_t *pool)
+{
+	uint64_t start = os_gettime_ns();
+
+	for (int i = 0; i < ITERATIONS; i++)
+		video_slice_pool_run(pool, convert_slice, f, f->height, 2);
+
+	return (double)(os_gettime_ns() - start) / 1000000.0 / ITERATIONS;
+}
+
+static bool bench_resolution(uint32_t width, uint32_t height,
+		video_slice_pool_t **pools, size_t num_pools)
+{
+	struct frame f;
+	bool success = true;
+
+	frame_init(&f, width, height);
+	printf("%ux%u\n", width, height);
+
+	for (int nv12 = 0; nv12 <= 1; nv12++) {
+		double single_ms = 0.0;
+
+		set_format(&f, !!nv12);
+		clear_planes(&f);
+		convert_slice(&f, 0, height);
+		for (size_t i = 0; i < 3; i++)
+			memcpy(f.ref_planes[i], f.planes[i],
+					(size_t)width * height);
+
+		printf("  %s", nv12 ? "nv12" : "i420");
+
+		for (size_t p = 0; p < num_pools; p++) {
+			double ms;
+			bool match;
+
+			clear_planes(&f);
+			ms = convert_ms(&f, pools[p]);
+			match = outputs_match(&f);
+			if (!match)
+				success = false;
+			if (p == 0)
+				single_ms = ms;
+
+			printf("  %dT: %6.2f ms (%.1fx)%s",
+					(int)video_slice_pool_num_threads(
+						pools[p]),
+					ms, single_ms / ms,
+					match ? "" : " MISMATCH");
+		}
+
+		printf("\n");
+	}
+
+	frame_free(&f);
+	return success;
+}
+
+int main(int argc, char *argv[])
+{
+	video_slice_pool_t *pools[9];
+	size_t num_pools = 0;
+	int max_threads = argc > 1 ? atoi(argv[1]) : os_get_logical_cores();
+	bool success = true;
+
+	if (max_threads < 1)
+		max_threads = 1;
+
+	for (int threads = 1; threads <= max_threads && num_pools < 8;
+			threads = threads < 4 ? threads + 1 : threads * 2)
+		pools[num_pools++] = video_slice_pool_create((size_t)threads);
+
+	pools[num_pools] = video_slice_pool_create(0);
+	printf("default pool size: %d threads\n", (int)
+			video_slice_pool_num_threads(pools[num_pools]));
+	video_slice_pool_destroy(pools[num_pools]);
+
+	for (size_t i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++)
+		success &= bench_resolution(resolutions[i][0],
+				resolutions[i][1], pools, num_pools);
+
+	for (size_t i = 0; i < num_pools; i++)
+		video_slice_pool_destroy(pools[i]);
+
+	printf(success ? "sliced output matches\n" :
+			"MISMATCH between sliced and whole-frame output\n");
+	return success ? 0 : 1;
+}
@@ -1,54 +1,66 @@
 ﻿#include "zdlogger.h"
 
-#include <QDateTime>
-#include <QMutexLocker>
-#include <QTextStream>
+#include <QThread>
+#include <QTime>
 
-ZDLogger::ZDLogger()
-{
-}
+#include <cstdio>
+#include <cstring>
 
-void ZDLogger::open(QFile *file, const QString &path)
-{
-    if (file->isOpen())
-        file->close();
+#define ZDLOG_MC_RING_SLOTS  1024
 
-    file->setFileName(path);
-    file->open(QIODevice::WriteOnly | QIODevice::Append);
+ZDLogger::ZDLogger() :
+    m_mcSink(ZDLOG_MC_RING_SLOTS)
+{
 }
 
 void ZDLogger::openLogFile(const QString &path)
 {
-    QMutexLocker locker(&m_mutex);
-
-    open(&m_file, path);
+    m_sink.open(path);
 }
 
 void ZDLogger::openMCLogFile(const QString &path)
 {
-    QMutexLocker locker(&m_mcmutex);
-
-    open(&m_mcfile, path);
+    m_mcSink.open(path);
 }
 
 void ZDLogger::writeLog(const QString &text)
 {
-    QMutexLocker locker(&m_mutex);
-
-    if (m_file.isOpen()) {
-        QTextStream ts(&m_file);
-        ts.setCodec("UTF-8");
-        ts << text << "\n";
-    }
+    QByteArray line = text.toUtf8();
+    m_sink.write(line.constData(), line.size());
 }
 
 void ZDLogger::writeMCLog(const QString &text)
 {
-    QMutexLocker locker(&m_mcmutex);
+    QByteArray line = text.toUtf8();
+    m_mcSink.write(line.constData(), line.size());
+}
+
+void ZDLogger::writeLog(const char *label, const char *text, bool urgent)
+{
+    char line[ZDLOG_SLOT_SIZE];
+    QTime time = QTime::currentTime();
+
+    int prefix = snprintf(line, sizeof(line), "[%02d:%02d:%02d.%03d][%llu:%s] ",
+                          time.hour(), time.minute(), time.second(),
+                          time.msec(),
+                          (unsigned long long)quintptr(QThread::currentThreadId()),
+                          label);
+    if (prefix < 0 || prefix >= (int)sizeof(line))
+        return;
 
-    if (m_mcfile.isOpen()) {
-        QTextStream ts(&m_mcfile);
-        ts.setCodec("UTF-8");
-        ts << text << "\n";
+    int len = (int)strlen(text);
+    if (prefix + len <= (int)sizeof(line)) {
+        memcpy(line + prefix, text, len);
+        m_sink.write(line, prefix + len, urgent);
+    } else {
+        QByteArray longLine(line, prefix);
+        longLine.append(text, len);
+        m_sink.write(longLine.constData(), longLine.size(), urgent);
     }
 }
+
+void ZDLogger::flush(int timeoutMs)
+{
+    m_sink.flush(timeoutMs);
+    m_mcSink.flush(timeoutMs);
+}
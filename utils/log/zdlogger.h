@@ -2,7 +2,7 @@
 #define ZDLOGGER_H
 
 #include "utils/singlebase/singlebase.h"
-#include <QFile>
+#include "zdlogsink.h"
 
 class ZDLogger : public Singleton<ZDLogger>
 {
@@ -13,23 +13,25 @@ public:
     void writeLog(const QString &);
     void writeMCLog(const QString &);
 
-    QString logPath() { return m_file.fileName(); }
-    QString mcLogPath() { return m_mcfile.fileName(); }
+    // 加上时间、线程前缀后写入，例如 [12:00:00.000][1234:INFO] text
+    void writeLog(const char *label, const char *text, bool urgent = false);
+
+    QString logPath() { return m_sink.fileName(); }
+    QString mcLogPath() { return m_mcSink.fileName(); }
 
     void openLogFile(const QString &);
     void openMCLogFile(const QString &);
 
-private:
-    void open(QFile *, const QString &);
+    // 等待日志写入磁盘，用于崩溃及退出前
+    void flush(int timeoutMs = 1000);
+
+    quint64 droppedLogCount() const { return m_sink.droppedCount(); }
 
 private:
     ZDLogger();
 
-    QFile m_file;
-    QMutex m_mutex;
-
-    QFile m_mcfile;
-    QMutex m_mcmutex;
+    ZDLogSink m_sink;
+    ZDLogSink m_mcSink;
 };
 
 #endif // ZDLOGGER_H
@@ -0,0 +1,245 @@
+﻿#include "zdlogsink.h"
+
+#include <QTime>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define BATCH_RESERVE_SIZE  (64 * 1024)
+
+ZDLogSink::ZDLogSink(size_t slots) :
+    m_enqueuePos(0),
+    m_dequeuePos(0),
+    m_writtenPos(0),
+    m_dropped(0),
+    m_droppedReported(0),
+    m_wake(false),
+    m_stop(false),
+    m_maxBytes(ZDLOG_MAX_FILE_SIZE),
+    m_maxFiles(ZDLOG_MAX_FILES)
+{
+    m_slots = new Slot[slots];
+    m_mask  = slots - 1;
+    for (size_t i = 0; i < slots; ++i) {
+        m_slots[i].seq.store(i, std::memory_order_relaxed);
+        m_slots[i].len  = 0;
+        m_slots[i].heap = nullptr;
+    }
+}
+
+ZDLogSink::~ZDLogSink()
+{
+    close();
+
+    for (size_t i = 0; i <= m_mask; ++i)
+        free(m_slots[i].heap);
+    delete[] m_slots;
+}
+
+bool ZDLogSink::open(const QString &path)
+{
+    close();
+
+    m_path = path;
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+
+    m_stop = false;
+    m_thread = std::thread(&ZDLogSink::run, this);
+    return true;
+}
+
+void ZDLogSink::close()
+{
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            m_stop = true;
+        }
+        m_wakeCond.notify_one();
+        m_thread.join();
+    }
+
+    if (m_file.isOpen())
+        m_file.close();
+}
+
+void ZDLogSink::setRotation(qint64 maxBytes, int maxFiles)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_maxBytes = maxBytes;
+    m_maxFiles = maxFiles;
+}
+
+void ZDLogSink::wake()
+{
+    m_wake.store(true);
+    m_wakeCond.notify_one();
+}
+
+// 多生产者有界队列，每个槽位的序号表示它可写（== pos）还是可读（== pos + 1）
+bool ZDLogSink::write(const char *line, int len, bool urgent)
+{
+    size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    Slot *slot;
+
+    for (;;) {
+        slot = &m_slots[pos & m_mask];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                                   std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->len = len;
+    if (len <= ZDLOG_SLOT_SIZE) {
+        memcpy(slot->data, line, len);
+    } else {
+        slot->heap = (char *)malloc(len);
+        if (slot->heap)
+            memcpy(slot->heap, line, len);
+        else
+            slot->len = 0;
+    }
+    slot->seq.store(pos + 1, std::memory_order_release);
+
+    // 队列过半时提前唤醒，避免等到定时写入时已经溢出
+    if (urgent || pos - m_writtenPos.load(std::memory_order_relaxed) >
+            (m_mask + 1) / 2)
+        wake();
+
+    return true;
+}
+
+bool ZDLogSink::pop(QByteArray &batch)
+{
+    Slot *slot = &m_slots[m_dequeuePos & m_mask];
+    if (slot->seq.load(std::memory_order_acquire) != m_dequeuePos + 1)
+        return false;
+
+    if (slot->heap) {
+        batch.append(slot->heap, slot->len);
+        free(slot->heap);
+        slot->heap = nullptr;
+    } else {
+        batch.append(slot->data, slot->len);
+    }
+    batch.append('\n');
+
+    slot->seq.store(m_dequeuePos + m_mask + 1, std::memory_order_release);
+    m_dequeuePos++;
+    return true;
+}
+
+void ZDLogSink::reportDropped(QByteArray &batch)
+{
+    quint64 dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped == m_droppedReported)
+        return;
+
+    char line[128];
+    QTime time = QTime::currentTime();
+    int len = snprintf(line, sizeof(line),
+                       "[%02d:%02d:%02d.%03d][log:WARNING] "
+                       "%llu log lines dropped, queue full.\n",
+                       time.hour(), time.minute(), time.second(), time.msec(),
+                       (unsigned long long)(dropped - m_droppedReported));
+    batch.append(line, qMin(len, (int)sizeof(line) - 1));
+    m_droppedReported = dropped;
+}
+
+void ZDLogSink::writeBatch(const QByteArray &batch)
+{
+    if (!m_file.isOpen())
+        return;
+
+    m_file.write(batch);
+    m_file.flush();
+
+    if (m_maxBytes > 0 && m_file.size() >= m_maxBytes)
+        rotate();
+}
+
+// log -> log.1 -> log.2 ... 超过 m_maxFiles 的被删除
+void ZDLogSink::rotate()
+{
+    m_file.close();
+
+    if (m_maxFiles > 0) {
+        QFile::remove(QString("%1.%2").arg(m_path).arg(m_maxFiles));
+        for (int i = m_maxFiles - 1; i > 0; --i)
+            QFile::rename(QString("%1.%2").arg(m_path).arg(i),
+                          QString("%1.%2").arg(m_path).arg(i + 1));
+        QFile::rename(m_path, m_path + ".1");
+    } else {
+        QFile::remove(m_path);
+    }
+
+    m_file.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+void ZDLogSink::run()
+{
+    QByteArray batch;
+    batch.reserve(BATCH_RESERVE_SIZE);
+
+    for (;;) {
+        bool stop;
+        {
+            std::unique_lock<std::mutex> locker(m_mutex);
+            m_wakeCond.wait_for(locker,
+                    std::chrono::milliseconds(ZDLOG_FLUSH_INTERVAL_MS),
+                    [this] { return m_stop || m_wake.load(); });
+            m_wake.store(false);
+            stop = m_stop;
+        }
+
+        // 每次写入前只取到当前位置，避免持续写日志时一直不落盘
+        size_t end = m_enqueuePos.load(std::memory_order_acquire);
+        while (m_dequeuePos != end && pop(batch))
+            if (batch.size() >= BATCH_RESERVE_SIZE) {
+                writeBatch(batch);
+                batch.resize(0);
+            }
+
+        reportDropped(batch);
+        if (!batch.isEmpty()) {
+            writeBatch(batch);
+            batch.resize(0);
+        }
+
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            m_writtenPos.store(m_dequeuePos);
+        }
+        m_writtenCond.notify_all();
+
+        if (stop)
+            break;
+    }
+}
+
+bool ZDLogSink::flush(int timeoutMs)
+{
+    if (!m_thread.joinable())
+        return true;
+
+    size_t target = m_enqueuePos.load();
+    wake();
+
+    std::unique_lock<std::mutex> locker(m_mutex);
+    return m_writtenCond.wait_for(locker, std::chrono::milliseconds(timeoutMs),
+            [this, target] { return m_writtenPos.load() >= target; });
+}
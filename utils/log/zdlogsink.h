@@ -0,0 +1,80 @@
+﻿#ifndef ZDLOGSINK_H
+#define ZDLOGSINK_H
+
+#include <QFile>
+#include <QString>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define ZDLOG_SLOT_SIZE          480     // 超过的行在写日志的线程上另行分配
+#define ZDLOG_RING_SLOTS         4096    // 必须是 2 的幂
+#define ZDLOG_FLUSH_INTERVAL_MS  200
+#define ZDLOG_MAX_FILE_SIZE      (20 * 1024 * 1024)
+#define ZDLOG_MAX_FILES          3
+
+/*
+ * 异步日志文件：任意线程调用 write() 只把一行日志放入无锁队列，
+ * 由后台线程批量写入文件，写日志的线程不会等待磁盘 I/O。
+ * 队列满时丢弃日志并计数，后台线程会在文件中记录丢弃的行数。
+ * 文件超过大小后轮转为 <文件名>.1 ~ <文件名>.N。
+ */
+class ZDLogSink
+{
+public:
+    explicit ZDLogSink(size_t slots = ZDLOG_RING_SLOTS);
+    ~ZDLogSink();
+
+    bool open(const QString &path);
+    void close();   // 写完队列中的日志后关闭
+
+    void setRotation(qint64 maxBytes, int maxFiles);
+
+    // 不阻塞，队列满时返回 false；urgent 为 true 时立即唤醒后台线程
+    bool write(const char *line, int len, bool urgent = false);
+
+    // 等待调用前写入的日志落盘，最多等待 timeoutMs
+    bool flush(int timeoutMs);
+
+    quint64 droppedCount() const { return m_dropped.load(); }
+    QString fileName() const { return m_path; }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        int                 len;
+        char                *heap;
+        char                data[ZDLOG_SLOT_SIZE];
+    };
+
+    void run();
+    bool pop(QByteArray &batch);
+    void writeBatch(const QByteArray &batch);
+    void reportDropped(QByteArray &batch);
+    void rotate();
+    void wake();
+
+    Slot                *m_slots;
+    size_t              m_mask;
+    std::atomic<size_t> m_enqueuePos;
+    size_t              m_dequeuePos;       // 只由后台线程访问
+    std::atomic<size_t> m_writtenPos;
+    std::atomic<quint64> m_dropped;
+    quint64             m_droppedReported;
+
+    std::thread             m_thread;
+    std::mutex              m_mutex;
+    std::condition_variable m_wakeCond;
+    std::condition_variable m_writtenCond;
+    std::atomic<bool>       m_wake;
+    bool                    m_stop;
+
+    QString m_path;
+    QFile   m_file;
+    qint64  m_maxBytes;
+    int     m_maxFiles;
+};
+
+#endif // ZDLOGSINK_H